@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Counts the heap allocations of the process, for the benchmarks.
+ *
+ * On glibc malloc, calloc and realloc are interposed, so that allocations
+ * made by Qt containers (which call malloc directly) are counted along with
+ * operator new. Elsewhere only operator new is counted.
+ */
+namespace AllocationCounter
+{
+    std::uint64_t count();
+
+    // Whether allocations made with malloc are counted
+    bool countsMalloc();
+}
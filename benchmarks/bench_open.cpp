@@ -0,0 +1,168 @@
+/*
+ * Time and peak memory of opening a large file in the editor.
+ *
+ * Usage: bench_open [--sizes MB,MB,...] [--directory DIR] [--eol lf|crlf] [--latin1]
+ *
+ * A log-like file of each size (10 MB, 100 MB and 1 GB by default) is
+ * generated, then opened in a QPlainTextEdit by a child process, once with
+ * the former path (QTextStream::readAll() then setPlainText()) and once with
+ * DocumentLoader. Each open runs in its own process so that the peak
+ * resident set size of one does not hide the other.
+ *
+ * --eol crlf writes "\r\n" line endings, and --latin1 adds a Latin-1 byte
+ * to every line, to time the paths taken by such files.
+ */
+#include "DocumentLoader.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QPlainTextEdit>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    // Peak resident set size of the process so far, in MB
+    double peakMemory()
+    {
+#ifdef Q_OS_UNIX
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef Q_OS_MACOS
+        return usage.ru_maxrss / (1024.0 * 1024.0); // Bytes
+#else
+        return usage.ru_maxrss / 1024.0; // Kilobytes
+#endif
+#else
+        return 0.0;
+#endif
+    }
+
+    bool generateFile(const QString &path, qint64 megabytes, bool crlf, bool latin1)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            return false;
+        }
+
+        const qint64 size = megabytes * 1024 * 1024;
+        qint64 written    = 0;
+        QByteArray buffer;
+        for (qint64 line = 0; written + buffer.size() < size; ++line)
+        {
+            buffer += "2024-01-01T00:00:00.000Z INFO [worker-" + QByteArray::number(line % 16)
+                      + "] Request " + QByteArray::number(line) + " handled in 42 ms, status=200";
+            buffer += latin1 ? " \xB5s" : "";
+            buffer += crlf ? "\r\n" : "\n";
+            if (buffer.size() > 1024 * 1024)
+            {
+                written += file.write(buffer);
+                buffer.clear();
+            }
+        }
+        return file.write(buffer) >= 0;
+    }
+
+    // Runs in the child process: opens the file and prints "milliseconds startupMB peakMB"
+    int openFile(const QString &path, const QString &mode)
+    {
+        QPlainTextEdit editor;
+        const double startup = peakMemory();
+
+        QElapsedTimer timer;
+        timer.start();
+        if (mode == "legacy")
+        {
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            {
+                return 1;
+            }
+            QTextStream in(&file);
+            editor.setPlainText(in.readAll());
+        }
+        else if (!DocumentLoader::load(path, editor.document()).success)
+        {
+            return 1;
+        }
+        const qint64 elapsed = timer.elapsed();
+
+        QTextStream(stdout) << elapsed << " " << startup << " " << peakMemory() << "\n";
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Time and peak memory of opening a large file");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "File sizes, in MB.", "MB,MB,...", "10,100,1024");
+    QCommandLineOption directoryOption("directory", "Where to generate the files.", "DIR");
+    QCommandLineOption childOption("open", "Open a single file (internal).", "FILE");
+    QCommandLineOption modeOption("mode", "legacy or mapped (internal).", "MODE", "mapped");
+    QCommandLineOption eolOption("eol", "Line endings of the files: lf or crlf.", "EOL", "lf");
+    QCommandLineOption latin1Option("latin1", "Make the files Latin-1 rather than ASCII.");
+    parser.addOptions({sizesOption, directoryOption, childOption, modeOption, eolOption, latin1Option});
+    parser.process(app);
+
+    if (parser.isSet(childOption))
+    {
+        return openFile(parser.value(childOption), parser.value(modeOption));
+    }
+
+    QTemporaryDir temporary;
+    const QString directory = parser.isSet(directoryOption) ? parser.value(directoryOption) : temporary.path();
+
+    QTextStream out(stdout);
+    out << "size     mode    open (ms)   MB/s  peak (MB)  over startup (MB)\n";
+    for (const QString &size : parser.value(sizesOption).split(',', Qt::SkipEmptyParts))
+    {
+        const QString path = directory + "/bench_open_" + size + "MB.log";
+        if (!generateFile(path, size.toLongLong(), parser.value(eolOption) == "crlf", parser.isSet(latin1Option)))
+        {
+            QTextStream(stderr) << "[bench_open] Failed to write " << path << "\n";
+            return 2;
+        }
+
+        for (const QString &mode : {QStringLiteral("legacy"), QStringLiteral("mapped")})
+        {
+            QProcess child;
+            child.start(app.applicationFilePath(), {"--open", path, "--mode", mode});
+            child.waitForFinished(-1);
+
+            const QStringList values = QString::fromUtf8(child.readAllStandardOutput()).simplified().split(' ');
+            if (child.exitCode() != 0 || values.size() != 3)
+            {
+                out << size.rightJustified(5) << " MB  " << mode.leftJustified(7) << " failed\n";
+                continue;
+            }
+
+            const double peak       = values[2].toDouble();
+            const double throughput = size.toDouble() * 1000.0 / std::max(1.0, values[0].toDouble());
+            out << size.rightJustified(5) << " MB  " << mode.leftJustified(7) << " "
+                << values[0].rightJustified(9) << "  " << QString::number(throughput, 'f', 0).rightJustified(5) << "  "
+                << QString::number(peak, 'f', 0).rightJustified(9) << "  "
+                << QString::number(peak - values[1].toDouble(), 'f', 0).rightJustified(17) << "\n";
+        }
+        QFile::remove(path);
+    }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Measures how many rule runs the literal-character prefilter saves.
+ *
+ * Usage: bench_prefilter [file...]
+ *
+ * Every line of the files is tokenized with the rules of its language, run
+ * one by one, with and without the prefilter. Without arguments the C++
+ * sources of the project are used. Prints, per language, the share of rule
+ * runs skipped and the tokenize time of both passes.
+ */
+#include "Syntax.h"
+#include "SyntaxPrefilter.h"
+#include "SyntaxRegistry.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QTextStream>
+
+namespace
+{
+    struct LanguageStats
+    {
+        qint64 lines        = 0;
+        qint64 ruleRuns     = 0;
+        qint64 skippedRuns  = 0;
+        int rules           = 0;
+        int filteredRules   = 0;
+        qint64 filteredNs   = 0;
+        qint64 unfilteredNs = 0;
+    };
+
+    QStringList defaultCorpus()
+    {
+        QStringList files;
+        for (const QString &directory : {QStringLiteral("src"), QStringLiteral("include")})
+        {
+            QDirIterator it(QDir(CODEASTRA_SOURCE_DIR).filePath(directory), {"*.cpp", "*.h"},
+                            QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+            {
+                files << it.next();
+            }
+        }
+        return files;
+    }
+
+    // Tokenizes every line, carrying the region state, and returns the elapsed time
+    qint64 tokenizeLines(const Syntax::RuleSet &ruleSet, const QStringList &lines)
+    {
+        QVector<SyntaxToken> tokens;
+        QElapsedTimer timer;
+        timer.start();
+
+        int state = 0;
+        for (const QString &line : lines)
+        {
+            state = Syntax::tokenize(ruleSet, line, state, tokens);
+        }
+        return timer.nsecsElapsed();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList files = app.arguments().mid(1);
+    if (files.isEmpty())
+    {
+        files = defaultCorpus();
+    }
+
+    QMap<QString, LanguageStats> stats;
+    for (const QString &path : files)
+    {
+        auto definition = SyntaxRegistry::getInstance().definitionForExtension(QFileInfo(path).suffix());
+        QFile file(path);
+        if (!definition || !file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            QTextStream(stderr) << "Skipping " << path << "\n";
+            continue;
+        }
+
+        const QStringList lines = QString::fromUtf8(file.readAll()).split('\n');
+
+        Syntax::RuleSet filtered{definition->rules, definition->regions, definition->name, nullptr,
+                                 definition->prefilter};
+        Syntax::RuleSet unfiltered = filtered;
+        unfiltered.prefilter       = nullptr;
+
+        LanguageStats &language = stats[definition->name];
+        language.rules          = static_cast<int>(definition->rules.size());
+        language.filteredRules  = definition->prefilter->filteredRules();
+        language.lines += lines.size();
+        for (const QString &line : lines)
+        {
+            const quint32 present = definition->prefilter->scan(line);
+            for (int rule = 0; rule < language.rules; ++rule)
+            {
+                ++language.ruleRuns;
+                language.skippedRuns += definition->prefilter->canMatch(rule, present) ? 0 : 1;
+            }
+        }
+
+        // Warm up, then time both passes
+        tokenizeLines(unfiltered, lines);
+        language.unfilteredNs += tokenizeLines(unfiltered, lines);
+        language.filteredNs += tokenizeLines(filtered, lines);
+    }
+
+    QTextStream out(stdout);
+    for (auto it = stats.cbegin(); it != stats.cend(); ++it)
+    {
+        const LanguageStats &language = it.value();
+        const double skipped = language.ruleRuns ? 100.0 * language.skippedRuns / language.ruleRuns : 0.0;
+        const double speedup = language.filteredNs ? double(language.unfilteredNs) / language.filteredNs : 0.0;
+
+        out << it.key() << ": " << language.lines << " lines, " << language.filteredRules << "/" << language.rules
+            << " rules filtered, " << QString::number(skipped, 'f', 1) << "% of rule runs skipped\n"
+            << "    without prefilter " << QString::number(language.unfilteredNs / 1e6, 'f', 2) << " ms, with "
+            << QString::number(language.filteredNs / 1e6, 'f', 2) << " ms (x" << QString::number(speedup, 'f', 2)
+            << ")\n";
+    }
+
+    return 0;
+}
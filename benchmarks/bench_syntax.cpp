@@ -0,0 +1,417 @@
+/*
+ * Highlighting throughput of the bundled languages.
+ *
+ * Usage: bench_syntax [--size MB] [--iterations N] [--corpus DIR]
+ *                     [--json] [--output FILE] [--baseline FILE] [--threshold PERCENT]
+ *
+ * For every bundled language a corpus is generated (or, with --corpus, read
+ * from the files of DIR with the extensions of the language), loaded into a
+ * QTextDocument and highlighted by Syntax, headless. The median of the
+ * iterations is reported as MB/s, ns per block and heap allocations per
+ * block. --json prints the results as JSON, --output saves them; a saved
+ * file can be given back with --baseline, which compares against it and
+ * exits with 1 when a language got slower, or allocates more, by more than
+ * the threshold.
+ */
+#include "AllocationCounter.h"
+#include "BundledSyntax.h"
+#include "Syntax.h"
+#include "SyntaxRegistry.h"
+
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextDocument>
+#include <QTextStream>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    struct Result
+    {
+        QString language;
+        qint64 bytes          = 0;
+        int blocks            = 0;
+        double mbPerSecond    = 0.0;
+        double nsPerBlock     = 0.0;
+        double allocsPerBlock = 0.0;
+    };
+
+    /*
+     * A page of typical code per language, keyed by its first extension.
+     * %1 is replaced by a counter so that the generated lines differ.
+     */
+    QString samplePage(const QString &extension)
+    {
+        if (extension == "cpp")
+        {
+            return R"SAMPLE(#include <vector>
+#include "Widget%1.h"
+
+/* Block comment %1
+ * spanning several lines
+ */
+namespace app%1
+{
+    // Computes the sum of the first values
+    static int sum%1(const std::vector<int> &values, unsigned long limit)
+    {
+        int total = 0x%1;
+        for (unsigned long i = 0; i < limit && i < values.size(); ++i)
+        {
+            if (values[i] > 42)
+            {
+                total += values[i] * 3.14;
+            }
+        }
+        const char *message = "total = \"%1\"\n";
+        std::printf(message, total);
+        return total;
+    }
+
+    const char *raw%1 = R"(raw string %1
+with two lines)";
+}
+)SAMPLE";
+        }
+        if (extension == "go")
+        {
+            return R"SAMPLE(package main%1
+
+import "fmt"
+
+/* Block comment %1
+   spanning several lines */
+func sum%1(values []int, limit int) int {
+	total := 0x%1
+	for i := 0; i < limit && i < len(values); i++ {
+		if values[i] > 42 {
+			total += values[i] * 3
+		}
+	}
+	// Print the result
+	fmt.Printf("total = %d\n", total)
+	query := `SELECT id
+FROM table%1`
+	return total + len(query)
+}
+)SAMPLE";
+        }
+        if (extension == "py")
+        {
+            return R"SAMPLE(import os
+
+
+class Widget%1:
+    """Docstring of the widget %1
+    spanning several lines.
+    """
+
+    def sum(self, values, limit=%1):
+        # Sum of the first values
+        total = 0x%1
+        for index, value in enumerate(values):
+            if index >= limit:
+                break
+            total += value * 3.14
+        print("total = \"%1\"", total)
+        return total
+)SAMPLE";
+        }
+        if (extension == "tsx")
+        {
+            return R"SAMPLE(import { useState } from 'react';
+
+/* Block comment %1
+ * spanning several lines */
+interface Props%1 {
+  title: string;
+  count: number;
+}
+
+export function Widget%1({ title, count }: Props%1): JSX.Element {
+  // Local state
+  const [value, setValue] = useState<number>(0x%1);
+  const label = `Count ${count}
+and value ${value}`;
+  if (value >= 42 && title !== "widget") {
+    setValue(value + 1);
+  }
+  return <div className='widget'>{label}</div>;
+}
+)SAMPLE";
+        }
+        if (extension == "yaml")
+        {
+            return R"SAMPLE(# Service %1
+service%1:
+  name: "service-%1"
+  enabled: true
+  replicas: %1
+  ratio: 0.75
+  tags: [web, api, v%1]
+  parent: null
+  command:
+    - run
+    - --port=8080
+)SAMPLE";
+        }
+        if (extension == "md")
+        {
+            return R"SAMPLE(# Section %1
+
+Some **bold** text, some *italic* text and `inline code` with a [link](https://example.com/%1).
+
+## Tasks
+
+- [ ] Open task %1
+- [x] Done task
+1. First item
+2. Second item
+
+> Quoted line %1
+)SAMPLE";
+        }
+        return QString();
+    }
+
+    QString generateCorpus(const QString &page, qint64 bytes)
+    {
+        QString corpus;
+        corpus.reserve(bytes + page.size() * 2);
+        for (int i = 1; corpus.size() < bytes; ++i)
+        {
+            corpus += page.arg(i);
+        }
+        return corpus;
+    }
+
+    QString readCorpus(const QString &directory, const QStringList &extensions, qint64 bytes)
+    {
+        QStringList filters;
+        for (const QString &extension : extensions)
+        {
+            filters << "*." + extension;
+        }
+
+        QString corpus;
+        QDirIterator it(directory, filters, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext() && corpus.size() < bytes)
+        {
+            QFile file(it.next());
+            if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+            {
+                corpus += QString::fromUtf8(file.readAll()) + '\n';
+            }
+        }
+        return corpus;
+    }
+
+    Result measure(const QString &language, const std::shared_ptr<const SyntaxDefinition> &definition,
+                   const QString &corpus, int iterations)
+    {
+        QTextDocument document;
+        document.setPlainText(corpus);
+        Syntax syntax(&document, definition);
+        syntax.rehighlight(); // Warm up
+
+        std::vector<qint64> times;
+        std::vector<std::uint64_t> allocations;
+        for (int i = 0; i < iterations; ++i)
+        {
+            const std::uint64_t before = AllocationCounter::count();
+            QElapsedTimer timer;
+            timer.start();
+            syntax.rehighlight();
+            times.push_back(timer.nsecsElapsed());
+            allocations.push_back(AllocationCounter::count() - before);
+        }
+
+        std::sort(times.begin(), times.end());
+        std::sort(allocations.begin(), allocations.end());
+        const double ns = static_cast<double>(times[times.size() / 2]);
+
+        Result result;
+        result.language       = language;
+        result.bytes          = corpus.toUtf8().size();
+        result.blocks         = document.blockCount();
+        result.mbPerSecond    = ns > 0 ? result.bytes / (ns / 1e9) / (1024.0 * 1024.0) : 0.0;
+        result.nsPerBlock     = ns / result.blocks;
+        result.allocsPerBlock = static_cast<double>(allocations[allocations.size() / 2]) / result.blocks;
+        return result;
+    }
+
+    QJsonObject toJson(const std::vector<Result> &results)
+    {
+        QJsonObject languages;
+        for (const Result &result : results)
+        {
+            languages.insert(result.language, QJsonObject{
+                {"bytes", result.bytes},
+                {"blocks", result.blocks},
+                {"mb_per_s", result.mbPerSecond},
+                {"ns_per_block", result.nsPerBlock},
+                {"allocs_per_block", result.allocsPerBlock},
+            });
+        }
+        return QJsonObject{{"version", 1}, {"languages", languages}};
+    }
+
+    // Relative change in percent, positive when the value grew
+    double change(double baseline, double current)
+    {
+        return baseline > 0 ? (current - baseline) / baseline * 100.0 : 0.0;
+    }
+
+    bool compare(const std::vector<Result> &results, const QJsonObject &baseline, double threshold,
+                 QTextStream &out)
+    {
+        const QJsonObject languages = baseline.value("languages").toObject();
+        bool regressed              = false;
+
+        out << "\nComparison with baseline (threshold " << threshold << "%):\n";
+        for (const Result &result : results)
+        {
+            if (!languages.contains(result.language))
+            {
+                out << "  " << result.language << ": not in baseline\n";
+                continue;
+            }
+
+            const QJsonObject saved = languages.value(result.language).toObject();
+            const double time       = change(saved.value("ns_per_block").toDouble(), result.nsPerBlock);
+            const double allocs     = change(saved.value("allocs_per_block").toDouble(), result.allocsPerBlock);
+            const bool worse        = time > threshold || allocs > threshold;
+            regressed               = regressed || worse;
+
+            out << "  " << result.language << ": ns/block " << (time >= 0 ? "+" : "") << QString::number(time, 'f', 1)
+                << "%, allocs/block " << (allocs >= 0 ? "+" : "") << QString::number(allocs, 'f', 1) << "%"
+                << (worse ? "  REGRESSION" : "") << "\n";
+        }
+        return !regressed;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Headless unless a platform is forced
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    // Only the bundled definitions are measured, whatever the user config holds
+    QTemporaryDir emptyConfig;
+    qputenv("CONFIG_DIR", emptyConfig.path().toUtf8());
+
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Highlighting throughput of the bundled languages");
+    parser.addHelpOption();
+    QCommandLineOption sizeOption("size", "Corpus size per language, in MB.", "MB", "2");
+    QCommandLineOption iterationsOption("iterations", "Highlighting passes per language.", "N", "5");
+    QCommandLineOption corpusOption("corpus", "Read the corpora from the files of a directory.", "DIR");
+    QCommandLineOption jsonOption("json", "Print the results as JSON.");
+    QCommandLineOption outputOption("output", "Save the results as JSON, to be used as a baseline.", "FILE");
+    QCommandLineOption baselineOption("baseline", "Compare with results saved by --output.", "FILE");
+    QCommandLineOption thresholdOption("threshold", "Allowed regression, in percent.", "PERCENT", "10");
+    parser.addOptions({sizeOption, iterationsOption, corpusOption, jsonOption, outputOption, baselineOption,
+                       thresholdOption});
+    parser.process(app);
+
+    const qint64 bytes   = static_cast<qint64>(parser.value(sizeOption).toDouble() * 1024 * 1024);
+    const int iterations = std::max(1, parser.value(iterationsOption).toInt());
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    std::vector<Result> results;
+    for (const BundledSyntax &bundled : bundledSyntaxDefinitions())
+    {
+        if (bundled.extensionCount == 0)
+        {
+            continue;
+        }
+
+        const QString language = QString::fromUtf8(bundled.name);
+        QStringList extensions;
+        for (std::size_t i = 0; i < bundled.extensionCount; ++i)
+        {
+            extensions << QString::fromUtf8(bundled.extensions[i]);
+        }
+
+        const QString corpus = parser.isSet(corpusOption)
+                                   ? readCorpus(parser.value(corpusOption), extensions, bytes)
+                                   : generateCorpus(samplePage(extensions.first()), bytes);
+        if (corpus.isEmpty())
+        {
+            err << "[bench_syntax] No corpus for " << language << ": Skipping...\n";
+            continue;
+        }
+
+        auto definition = SyntaxRegistry::getInstance().definitionForExtension(extensions.first());
+        if (!definition)
+        {
+            err << "[bench_syntax] No definition for " << language << ": Skipping...\n";
+            continue;
+        }
+
+        results.push_back(measure(language, definition, corpus, iterations));
+    }
+
+    const QJsonObject json = toJson(results);
+    if (parser.isSet(jsonOption))
+    {
+        out << QJsonDocument(json).toJson();
+    }
+    else
+    {
+        out << "Allocations counted: " << (AllocationCounter::countsMalloc() ? "malloc and new" : "new only") << "\n";
+        for (const Result &result : results)
+        {
+            out << result.language << ": " << result.blocks << " blocks, "
+                << QString::number(result.mbPerSecond, 'f', 2) << " MB/s, "
+                << QString::number(result.nsPerBlock, 'f', 0) << " ns/block, "
+                << QString::number(result.allocsPerBlock, 'f', 2) << " allocs/block\n";
+        }
+    }
+
+    if (parser.isSet(outputOption))
+    {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            err << "[bench_syntax] Failed to write " << file.fileName() << "\n";
+            return 2;
+        }
+        file.write(QJsonDocument(json).toJson());
+    }
+
+    if (parser.isSet(baselineOption))
+    {
+        QFile file(parser.value(baselineOption));
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            err << "[bench_syntax] Failed to open baseline " << file.fileName() << "\n";
+            return 2;
+        }
+
+        // The comparison goes to stderr when stdout carries the JSON
+        QTextStream &report = parser.isSet(jsonOption) ? err : out;
+        const double threshold = parser.value(thresholdOption).toDouble();
+        if (!compare(results, QJsonDocument::fromJson(file.readAll()).object(), threshold, report))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "FileManager.h"
+
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+
+/**
+ * @class BatchJob
+ * @brief Deletes, duplicates or moves several paths on a worker thread.
+ *
+ * Paths inside another path of the batch are dropped, since the operation
+ * on their ancestor covers them: selecting a folder and its whole content
+ * deletes the folder with a single move to the trash. Moves within a
+ * filesystem are single renames; across filesystems the path is copied
+ * then removed.
+ *
+ * A failed item does not stop the batch: the result lists the failures
+ * after the count of paths done. cancel() stops before the next item.
+ */
+class BatchJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Operation
+    {
+        Delete,
+        Duplicate,
+        Move
+    };
+
+    // destination is the directory paths are moved to
+    BatchJob(Operation operation, const QStringList &paths, const QString &destination = QString(),
+             QObject *parent = nullptr);
+
+    // Cancels the batch and waits for the current item
+    ~BatchJob();
+
+    // Runs on a worker thread; finished() is emitted when done
+    void start();
+
+    // Runs on the calling thread and returns when done
+    OperationResult run();
+
+    void cancel();
+    bool isCancelled() const;
+    bool isRunning() const;
+
+    Operation operation() const;
+
+    // The paths operated on, without those inside another one
+    QStringList paths() const;
+
+    static QStringList topLevelPaths(const QStringList &paths);
+
+    // Failures listed in the result, the others are only counted
+    static constexpr int MaxReportedFailures = 10;
+
+    static constexpr int ProgressInterval = 100; // ms
+
+signals:
+    void progress(int donePaths, int totalPaths);
+    void finished(bool success, const QString &message);
+
+private:
+    OperationResult execute();
+    OperationResult apply(const QString &path) const;
+    OperationResult move(const QString &path) const;
+
+    const Operation m_operation;
+    const QStringList m_paths;
+    const QString m_destination;
+
+    QThreadPool m_pool;
+    QTimer m_progressTimer;
+    bool m_running = false;
+
+    std::atomic_bool m_cancelled{false};
+    std::atomic_int m_done{0};
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+/*
+ * Static tables of the syntax definitions bundled in resources/syntax.
+ *
+ * The tables are generated at build time by SyntaxTableGen (see
+ * src/tools) and linked into the application, so the built-in languages
+ * need no YAML parsing at runtime. This header is shared with the
+ * generator and must stay free of Qt.
+ */
+
+struct BundledRule
+{
+    const char *category;
+    const char *regex;
+    const char *color;
+    bool bold;
+    bool italic;
+    int priority;
+};
+
+struct BundledRegion
+{
+    const char *category;
+    const char *begin;
+    const char *end;
+    const char *color;
+    bool bold;
+    bool italic;
+};
+
+struct BundledSyntax
+{
+    const char *name;   // File name in resources/syntax
+    std::uint64_t hash; // bundledSyntaxHash() of the file, see below
+    const char *const *extensions;
+    std::size_t extensionCount;
+    const BundledRule *rules;
+    std::size_t ruleCount;
+    const BundledRegion *regions;
+    std::size_t regionCount;
+    bool lexer; // "engine: lexer", see SyntaxLexer
+};
+
+// Every bundled definition, ordered by file name
+std::span<const BundledSyntax> bundledSyntaxDefinitions();
+
+/**
+ * @brief FNV-1a hash of a syntax file.
+ *
+ * Used to recognize unmodified copies of the bundled files in the user
+ * syntax directory, which are then served from the tables.
+ */
+inline std::uint64_t bundledSyntaxHash(const char *data, std::size_t size)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Files shipped by earlier releases, by name and bundledSyntaxHash().
+ *
+ * The first run copies the bundled files to the user syntax directory.
+ * Copies of an earlier version left as they were are not user edits: they
+ * are refreshed from the current files, and served from the tables until
+ * then. Add the hash of a file here whenever a release changes it.
+ */
+struct PreviousBundledSyntax
+{
+    const char *name;
+    std::uint64_t hash;
+};
+
+inline constexpr PreviousBundledSyntax previousBundledSyntax[] = {
+    {"cxx.syntax.yaml", 9883895149709383414ull},
+    {"go.syntax.yaml", 757850054803894056ull},
+    {"python.syntax.yaml", 18021209333948276260ull},
+    {"tsx.syntax.yaml", 5092985970288950365ull},
+};
+
+inline bool isPreviousBundledSyntax(std::string_view name, std::uint64_t hash)
+{
+    for (const PreviousBundledSyntax &previous : previousBundledSyntax)
+    {
+        if (previous.hash == hash && name == previous.name)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -30,8 +30,12 @@ public:
     int lineNumberAreaWidth();
     void autoIndentation();
 
+    // First and last block numbers currently shown in the viewport
+    QPair<int, int> visibleBlockRange();
+
 signals:
     void statusMessageChanged(const QString &message);
+    void visibleBlocksChanged(int firstBlock, int lastBlock);
 
 protected:
     void keyPressEvent(QKeyEvent *event) override;
@@ -45,6 +49,7 @@ private slots:
 private:
     QWidget *m_lineNumberArea;
     FileManager *m_fileManager;
+    QPair<int, int> m_visibleBlocks{0, -1};
 
     void addLanguageSymbol(QTextCursor &cursor, const QString &commentSymbol);
     void commentSelection(QTextCursor &cursor, const QString &commentSymbol);
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "FileManager.h"
+
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <utility>
+
+/**
+ * @class CopyJob
+ * @brief Copies a file or a directory tree on worker threads.
+ *
+ * Directories are walked by several workers sharing a queue: each one lists
+ * a directory, creates its subdirectories and queues them, and copies its
+ * files. On Linux the file contents are cloned (FICLONE) where the
+ * filesystem shares extents, and otherwise copied by the kernel with
+ * copy_file_range(), falling back to reads and writes across filesystems
+ * that support neither.
+ *
+ * The target must not exist. When the copy fails or is cancelled, whatever
+ * was already written to the target is removed. A job runs only once.
+ */
+class CopyJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    CopyJob(const QString &source, const QString &target, QObject *parent = nullptr);
+
+    // Cancels the copy and waits for the partial target to be removed
+    ~CopyJob();
+
+    // Copies on worker threads; finished() is emitted when done
+    void start();
+
+    // Copies on the calling thread and the workers, and returns when done
+    OperationResult run();
+
+    void cancel();
+    bool isCancelled() const;
+    bool isRunning() const;
+
+    QString source() const;
+    QString target() const;
+
+    qint64 copiedBytes() const;
+
+    // Grows while the walk discovers files
+    qint64 totalBytes() const;
+
+    static constexpr int MaxWorkers       = 8;
+    static constexpr int ProgressInterval = 100; // ms
+
+    // Bytes copied between two checks of cancel()
+    static constexpr qint64 CopyStep = 8 * 1024 * 1024;
+
+signals:
+    void progress(qint64 copiedBytes, qint64 totalBytes);
+    void finished(bool success, const QString &message);
+
+private:
+    OperationResult execute();
+    void walk();
+    void copyDirectory(const std::filesystem::path &source, const std::filesystem::path &target);
+    bool copyFile(const std::filesystem::path &source, const std::filesystem::path &target);
+    bool copyContents(int in, int out, qint64 size);
+    void fail(const QString &message);
+    bool isStopped() const;
+
+    const std::filesystem::path m_source;
+    const std::filesystem::path m_target;
+
+    QThreadPool m_runner;  // Runs execute() for start()
+    QThreadPool m_workers; // Walks the tree
+    QTimer m_progressTimer;
+    bool m_running = false;
+
+    std::atomic_bool m_cancelled{false};
+    std::atomic_bool m_failed{false};
+    std::atomic<qint64> m_copiedBytes{0};
+    std::atomic<qint64> m_totalBytes{0};
+
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    std::deque<std::pair<std::filesystem::path, std::filesystem::path>> m_directories; // Created, not yet listed
+    int m_busy = 0; // Workers listing a directory
+    QString m_error;
+};
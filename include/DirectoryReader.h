@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QString>
+#include <vector>
+
+/**
+ * @class DirectoryReader
+ * @brief Lists directories without a stat() per entry.
+ *
+ * On Linux, entries are read with getdents64() into a 64 KB buffer, so a
+ * directory of thousands of entries costs a handful of system calls; the
+ * type of each entry comes with its name. Only symbolic links, and the
+ * entries of filesystems that do not report types, are stat()ed.
+ * Elsewhere, QDirIterator is used.
+ */
+class DirectoryReader
+{
+public:
+    struct Entry
+    {
+        QString name;
+        bool isDirectory = false; // Directories and links to directories
+        bool isSymLink   = false;
+        bool isIgnored   = false; // Left to the caller's ignore rules
+    };
+
+    static constexpr int BufferSize = 64 * 1024;
+
+    // The entries of path but "." and "..", in no particular order
+    static std::vector<Entry> read(const QString &path, bool *ok = nullptr);
+
+    // The entry at path, if it exists
+    static bool entry(const QString &path, Entry *entry);
+};
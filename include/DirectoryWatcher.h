@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <memory>
+
+class QFileSystemWatcher;
+class QSocketNotifier;
+
+/**
+ * @class DirectoryWatcher
+ * @brief Process-wide watches on directories, shared by the tree and the project indexes.
+ *
+ * The tree, the path index and the trigram index follow the same
+ * directories. Each watch is counted: a directory watched by all of them
+ * takes a single inotify watch, so the watches used, against
+ * max_user_watches, are those of the directories, whoever follows them.
+ *
+ * On Linux, events name the entry that changed, and files written to are
+ * reported as well. Elsewhere QFileSystemWatcher is used: a change only
+ * says that a directory should be read again, and files rewritten in place
+ * are not seen.
+ */
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static DirectoryWatcher &getInstance()
+    {
+        static DirectoryWatcher instance;
+        return instance;
+    }
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+    // Every successful watch() is undone by one unwatch() of the same path
+    bool watch(const QString &path);
+    void unwatch(const QString &path);
+
+    // The paths that could not be watched
+    QStringList watch(const QStringList &paths);
+    void unwatch(const QStringList &paths);
+
+    // Directories watched, each counted once
+    int watchCount() const;
+
+signals:
+    // name was created, removed or renamed in directory; empty when unknown, and the whole directory may have changed
+    void entriesChanged(const QString &directory, const QString &name);
+
+    // The file name of directory was written to
+    void fileWritten(const QString &directory, const QString &name);
+
+    // The directory itself was removed or renamed
+    void directoryRemoved(const QString &directory);
+
+    // Events were lost: any watched directory may have changed
+    void overflowed();
+
+private:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+
+    void onEvents();
+
+    struct Watch
+    {
+        int users      = 0;
+        int descriptor = -1; // Of inotify; -1 once the directory is gone, until it is watched again
+    };
+
+    bool addWatch(const QString &path, Watch &watch);
+
+    QHash<QString, Watch> m_watches;
+    QHash<int, QStringList> m_paths; // A directory reached through links has one descriptor for several paths
+    int m_inotify = -1;
+    std::unique_ptr<QSocketNotifier> m_notifier;
+    std::unique_ptr<QFileSystemWatcher> m_watcher;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "TextFormat.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QSyntaxHighlighter>
+#include <QTextDocument>
+#include <memory>
+#include <vector>
+
+/**
+ * @struct CachedDocument
+ * @brief A document put aside with everything needed to show it again as it was.
+ */
+struct CachedDocument
+{
+    QString filePath;
+    std::unique_ptr<QTextDocument> document;
+
+    // Child of the document; null once definitions changed and it must be rebuilt
+    QPointer<QSyntaxHighlighter> highlighter;
+
+    TextFormat format;
+    int cursorPosition   = 0;
+    int anchorPosition   = 0;
+    int horizontalScroll = 0;
+    int verticalScroll   = 0;
+
+    // The file as last loaded or saved, see FileManager::hasUnsavedChanges()
+    qint64 savedSize    = -1;
+    QDateTime savedModified;
+    QByteArray savedHash;
+    int savedCharacters = 0;
+
+    qint64 memoryCost = 0;
+};
+
+/**
+ * @class DocumentCache
+ * @brief Least recently used documents kept in memory, within a budget.
+ *
+ * Switching back to a cached document swaps it into the editor instead of
+ * reading, decoding and highlighting the file again. Once the estimated
+ * size of the cache exceeds its budget, the least recently used documents
+ * are dropped, except modified ones: their edits would be lost.
+ *
+ * The budget is DefaultMemoryBudget, or DOCUMENT_CACHE_MB megabytes when
+ * that environment variable is set.
+ */
+class DocumentCache
+{
+public:
+    static constexpr qint64 DefaultMemoryBudget = 256 * 1024 * 1024;
+
+    // Estimated per block: the block itself, its layout and its highlighting formats
+    static constexpr qint64 BlockOverhead = 256;
+
+    explicit DocumentCache(qint64 memoryBudget = defaultMemoryBudget());
+
+    static qint64 defaultMemoryBudget();
+    static qint64 estimatedSize(const QTextDocument *document);
+
+    // Becomes the most recently used; returns the paths of the documents evicted to make room
+    QStringList insert(std::unique_ptr<CachedDocument> entry);
+
+    // Removes the document from the cache and hands it over, null if not cached
+    std::unique_ptr<CachedDocument> take(const QString &filePath);
+
+    CachedDocument *find(const QString &filePath) const;
+    bool contains(const QString &filePath) const;
+    void remove(const QString &filePath);
+    void clear();
+
+    // Deletes every highlighter, to be rebuilt with new definitions when shown again
+    void clearHighlighters();
+
+    // Most recently used first
+    QStringList filePaths() const;
+
+    int size() const;
+    qint64 memoryUsage() const;
+    qint64 memoryBudget() const;
+    QStringList setMemoryBudget(qint64 bytes);
+
+private:
+    QStringList evict();
+
+    std::vector<std::unique_ptr<CachedDocument>> m_entries; // Most recently used first
+    qint64 m_memoryBudget;
+    qint64 m_memoryUsage = 0;
+};
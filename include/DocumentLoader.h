@@ -0,0 +1,107 @@
+#pragma once
+
+#include "FileManager.h"
+#include "TextFormat.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTextDocument>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+
+/**
+ * @class DocumentLoader
+ * @brief Loads a text file into a document without intermediate copies.
+ *
+ * The file is memory-mapped and decoded one chunk at a time, each chunk
+ * being appended to the document as soon as it is decoded; the pages
+ * already consumed are released. The peak memory is then close to the
+ * decoded text held by the document, instead of the raw file, a full
+ * QString and the document. The encoding and line endings are detected
+ * first (see TextFormat); line endings are normalized to '\n', and an
+ * initial BOM is skipped.
+ * A file found not to be valid UTF-8 past the detection sample is loaded
+ * again as Latin-1, so that saving it does not replace its invalid bytes.
+ *
+ * Files that cannot be mapped (pipes, some network file systems) are read
+ * chunk by chunk instead.
+ *
+ * load() runs on the calling thread. start() streams large files: chunks
+ * are read and decoded on a worker thread, and appended to the document on
+ * the GUI thread as they arrive, so the beginning of the file is shown
+ * while the rest is loading. A streaming load can be cancelled at any time.
+ */
+class DocumentLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr qsizetype ChunkSize = 4 * 1024 * 1024;
+
+    // Files larger than this are streamed, in chunks of BatchSize bytes
+    static constexpr qint64 StreamingThreshold = 16 * 1024 * 1024;
+    static constexpr qsizetype BatchSize       = 1024 * 1024;
+
+    // Decoded chunks waiting for the GUI thread, bounding the memory in flight
+    static constexpr int MaxPendingBatches = 4;
+
+    explicit DocumentLoader(QObject *parent = nullptr);
+    ~DocumentLoader();
+
+    /**
+     * @brief Replaces the content of a document with the content of a file.
+     *
+     * The encoding is detected from the start of the file, and stored in
+     * format if given. Undo history is dropped. On failure the document is
+     * left empty.
+     */
+    static OperationResult load(const QString &filePath, QTextDocument *document, TextFormat *format = nullptr);
+
+    /**
+     * @brief Hashes the text a load of the file would produce, reading it chunk by chunk.
+     *
+     * Line endings are normalized and the BOM skipped as by a load, so the
+     * result equals hashDocument() of the loaded document. Returns an empty
+     * hash if the file cannot be read.
+     */
+    static QByteArray hashFile(const QString &filePath);
+    static QByteArray hashDocument(const QTextDocument *document);
+    static QByteArray hashText(const QByteArray &text);
+
+    /**
+     * @brief Starts streaming a file into a document, cancelling the current load.
+     *
+     * The document is cleared only once the file is known to be readable;
+     * otherwise the error is returned and the document is left untouched.
+     * Progress and the outcome are reported with the signals below.
+     */
+    OperationResult start(const QString &filePath, QTextDocument *document);
+
+    // Abandons the current load, leaving the document partially loaded
+    void cancel();
+
+    bool isLoading() const;
+    QString filePath() const;
+
+    // Format of the file of the last finished load
+    TextFormat format() const;
+
+signals:
+    void progress(qint64 loadedBytes, qint64 totalBytes);
+    void finished(bool success, const QString &message);
+
+private:
+    void append(int generation, const QString &text, qint64 loadedBytes, qint64 totalBytes);
+    void restart(int generation);
+    void finish(int generation, const OperationResult &result, const TextFormat &format);
+
+    QThreadPool m_pool;
+    std::shared_ptr<std::atomic_int> m_generation;
+    QPointer<QTextDocument> m_document;
+    QString m_filePath;
+    TextFormat m_format;
+    bool m_undoEnabled = true;
+    bool m_loading     = false;
+};
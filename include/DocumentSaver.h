@@ -0,0 +1,67 @@
+#pragma once
+
+#include "FileManager.h"
+#include "TextFormat.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+/**
+ * @class DocumentSaver
+ * @brief Writes snapshots of documents to disk on a worker thread.
+ *
+ * Each save encodes the text in the format the file was loaded with, and
+ * writes it to a temporary file in the target's directory, which is synced
+ * then renamed over the target: a crash or a full disk leaves either the
+ * previous file or the new one, never a truncated mix.
+ *
+ * Saves of the same file coalesce: while one is being written, further
+ * snapshots replace each other and only the latest is written next.
+ * Pending saves are still written when the saver is destroyed.
+ */
+class DocumentSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DocumentSaver(QObject *parent = nullptr);
+    ~DocumentSaver();
+
+    // Queues a snapshot of a document to be written to filePath
+    void save(const QString &filePath, const QString &text, const TextFormat &format = TextFormat());
+
+    bool isSaving() const;
+
+    // Waits for every queued save to be written
+    void waitForDone();
+
+    /**
+     * @brief Writes atomically on the calling thread.
+     *
+     * Text that the encoding of format cannot represent is written as UTF-8
+     * instead. hash receives DocumentLoader::hashText() of the text.
+     */
+    static OperationResult write(const QString &filePath, const QString &text, const TextFormat &format = TextFormat(),
+                                 QByteArray *hash = nullptr);
+
+signals:
+    // hash is that of the written text, empty on failure
+    void finished(const QString &filePath, bool success, const QString &message, const QByteArray &hash);
+
+private:
+    void run();
+
+    QThreadPool m_pool;
+    mutable QMutex m_mutex;
+    struct Snapshot
+    {
+        QString text;
+        TextFormat format;
+    };
+
+    QMap<QString, Snapshot> m_pending; // Latest snapshot of each file waiting to be written
+    bool m_running = false;
+};
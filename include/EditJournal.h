@@ -0,0 +1,113 @@
+#pragma once
+
+#include "FileManager.h"
+
+#include <QByteArray>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTextDocument>
+#include <QThreadPool>
+#include <QTimer>
+#include <functional>
+
+/**
+ * @class EditJournal
+ * @brief Append-only log of the edits of a document, to recover them after a crash.
+ *
+ * Every change of the attached document is recorded as its position, the
+ * number of characters removed and the text inserted. Records are buffered
+ * on the GUI thread and appended to the journal file by a worker thread
+ * every FlushInterval milliseconds, so typing never waits on the disk.
+ *
+ * The journal starts from the file as it was on disk when attached; no
+ * journal file exists until the first edit. Once the edits outweigh the
+ * document, the journal is compacted into a snapshot of the whole text.
+ * Replaying a journal onto the loaded file, or onto its last snapshot,
+ * gives back the unsaved document.
+ *
+ * Journals live in ~/.config/codeastra/journal, one per file, plus one for
+ * the untitled document.
+ */
+class EditJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int FlushInterval = 500; // Milliseconds
+
+    // Edits compacted into a snapshot once larger than this and the document
+    static constexpr qint64 CompactionThreshold = 1024 * 1024;
+
+    explicit EditJournal(const QString &directory = defaultDirectory(), QObject *parent = nullptr);
+    ~EditJournal();
+
+    static QString defaultDirectory();
+
+    /**
+     * @brief Starts recording the edits of a document showing filePath.
+     *
+     * An existing journal of the file is removed, unless resume is set: the
+     * document then already has the journal replayed, and the new edits
+     * follow it. An empty filePath stands for the untitled document.
+     */
+    void attach(QTextDocument *document, const QString &filePath, bool resume = false);
+
+    // Stops recording; the journal file is kept for a later recovery if keep is set
+    void detach(bool keep);
+
+    // The document now matches its file on disk: the journal restarts from it
+    void markSaved();
+
+    // Rewrites the journal as a snapshot of the document
+    void compact();
+
+    // Hands the buffered records to the writer, and waits for them to be written
+    void flush();
+    void waitForDone();
+
+    QString filePath() const;
+    bool isAttached() const;
+
+    QString directory() const;
+
+    // Journal file of filePath
+    QString journalPath(const QString &filePath) const;
+
+    // Files with a journal, most recently edited first; "" is the untitled document
+    QStringList journaledFiles() const;
+
+    /**
+     * @brief Replays the journal of filePath onto a document holding the file as loaded.
+     *
+     * The replay is a single undoable edit. It fails, leaving the document
+     * untouched, if there is no journal or if the file changed on disk since
+     * the journal started and no snapshot was taken.
+     */
+    OperationResult replay(const QString &filePath, QTextDocument *document) const;
+
+    // Removes the journal of filePath
+    void discard(const QString &filePath);
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    QByteArray header() const;
+    void schedule(const std::function<void()> &job);
+
+    QString m_directory;
+    QString m_filePath;
+    QString m_journalPath;
+    QPointer<QTextDocument> m_document;
+    int m_revision = 0;
+
+    QByteArray m_buffer; // Records not handed to the writer yet
+    bool m_headerWritten  = false;
+    qint64 m_editBytes    = 0; // Size of the records since the last snapshot
+    qint64 m_baseSize     = -1; // The file the journal starts from
+    qint64 m_baseModified = 0;
+
+    QTimer m_flushTimer;
+    QThreadPool m_pool; // One writer thread, so jobs run in order
+};
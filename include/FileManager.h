@@ -1,12 +1,21 @@
 #pragma once
 
+#include "TextFormat.h"
+
 #include <QObject>
 #include <memory>
 #include <QSyntaxHighlighter>
 #include <QFileInfo>
+#include <QDateTime>
 
 class CodeEditor;
 class MainWindow;
+class DocumentLoader;
+class DocumentSaver;
+class EditJournal;
+class LargeFileDocument;
+class CopyJob;
+class DocumentCache;
 
 struct OperationResult
 {
@@ -50,6 +59,9 @@ public:
     static OperationResult newFile(const QFileInfo &pathInfo, QString newFilePath);
     static OperationResult newFolder(const QFileInfo &pathInfo, QString newFolderPath);
     static OperationResult duplicatePath(const QFileInfo &pathInfo);
+
+    // Starts duplicating on worker threads, or returns nullptr for an invalid path
+    static CopyJob *duplicatePathAsync(const QFileInfo &pathInfo, QObject *parent = nullptr);
     static OperationResult deletePath(const QFileInfo &pathInfo);
 
     int buildUnsavedChangesMessage() const;
@@ -66,13 +78,107 @@ public slots:
 
     QString getDirectoryPath() const;
 
+    // Whether a large file is still being streamed into the editor
+    bool isLoading() const;
+
+    // The file opened in large file mode, if any
+    LargeFileDocument *largeFile() const;
+
+    // Offers to reopen the document left with unsaved changes by the previous session
+    void recoverUnsavedChanges();
+
+    /**
+     * @brief Shows filePath in the editor, as its tab.
+     *
+     * The document shown is put aside in the document cache, unless it
+     * cannot be (untitled, loading or large file): the user is then asked
+     * about its unsaved changes. Returns false if they cancelled.
+     */
+    bool switchToFile(const QString &filePath);
+
+    // Switches to filePath, then puts the cursor at the start of line (from 1),
+    // once loaded if it streams in
+    bool openFileAtLine(const QString &filePath, int line);
+
+    // Closes the tab of filePath, asking about its unsaved changes if any
+    void closeDocument(const QString &filePath);
+
+    // Files with a tab, in the order they were opened
+    QStringList openDocuments() const;
+    bool isDocumentModified(const QString &filePath) const;
+
+    DocumentCache *documentCache() const;
+
+signals:
+    // A tab was opened, closed, switched to, or its document modified
+    void documentsChanged();
+
+private slots:
+    void refreshHighlighter();
+    void onLoadProgress(qint64 loadedBytes, qint64 totalBytes);
+    void onLoadFinished(bool success, const QString &message);
+
+    // Detaches the editor from a file that failed to load, so that saving cannot write over it
+    void abandonLoad(const QString &filePath, const QString &message);
+    void onSaveFinished(const QString &filePath, bool success, const QString &message, const QByteArray &hash);
+
 private:
     FileManager(CodeEditor *editor, MainWindow *mainWindow);
     ~FileManager();
 
+    void cancelLoading();
+
+    // Marks the document clean, and remembers the file it now matches
+    void recordSavedState(const QByteArray &hash);
+
+    // Replays the journal of filePath, if any, then records the new edits
+    void startJournal(const QString &filePath);
+
+    // Marks a document loaded from a file with mixed line endings modified: saving rewrites them
+    void checkLineEndings();
+
+    OperationResult openLargeFile(const QString &filePath);
+    void closeLargeFile();
+
+    // Whether the document shown can be put aside in the cache as is
+    bool isCacheable() const;
+
+    // Moves the document shown to the cache, leaving an empty document in the editor
+    void stashCurrentDocument();
+
+    // Swaps the cached document of filePath into the editor, if still up to date
+    bool restoreDocument(const QString &filePath);
+
+    // An empty document with the editor's font and tab stops
+    QTextDocument *createDocument() const;
+
+    void showUntitledDocument();
+    void moveToLine(int line);
+    void addOpenDocument(const QString &filePath);
+
     CodeEditor *m_editor;
     MainWindow *m_mainWindow;
     QSyntaxHighlighter *m_currentHighlighter = nullptr;
     QString m_currentFileName;
-    bool m_isDirty = false;
+    DocumentLoader *m_loader;
+    DocumentSaver *m_saver;
+    EditJournal *m_journal;
+    int m_loadPercent = -1;
+    int m_pendingLine = 0; // Line to show once the file streaming in is loaded
+    std::unique_ptr<LargeFileDocument> m_largeFile;
+
+    // Encoding and line endings the current file is saved with
+    TextFormat m_textFormat;
+
+    std::unique_ptr<DocumentCache> m_cache;
+    QStringList m_openFiles;
+
+    // File the editor's document was loaded from or saved to; empty while loading
+    QString m_documentPath;
+
+    // The file as last loaded or saved, to tell undone edits from real ones
+    qint64 m_savedSize     = -1;
+    QDateTime m_savedModified;
+    QByteArray m_savedHash;
+    int m_savedCharacters  = 0;
 };
\ No newline at end of file
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "DirectoryReader.h"
+#include "IgnoreRules.h"
+#include "NamePool.h"
+
+#include <QAbstractItemModel>
+#include <QFileInfo>
+#include <QHash>
+#include <QIcon>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <memory>
+#include <vector>
+
+class QAbstractFileIconProvider;
+
+/**
+ * @class FileTreeModel
+ * @brief Lazily populated model of the file system, for trees of millions of files.
+ *
+ * Nothing is listed until a directory is expanded: fetchMore() reads it on
+ * a pool of worker threads with DirectoryReader, so several directories
+ * are read in parallel and the GUI thread only inserts the sorted rows.
+ * Only the name, type and position of an entry are kept, in an arena of
+ * nodes: names are interned in a NamePool, and parents and children are
+ * 32-bit node indices.
+ *
+ * Listed directories are watched through the DirectoryWatcher shared with
+ * the project indexes. Events are coalesced per directory for CoalesceInterval
+ * milliseconds, the changed names are checked on a worker thread, and only
+ * the rows that changed are inserted or removed. A directory with more
+ * than RescanThreshold changed names is read again as a whole. While a
+ * batch runs, suspendChanges() keeps gathering them without applying any.
+ *
+ * Below the root, entries matched by the .gitignore and .ignore files of
+ * their directories, or by the exclude list, are dropped as each listing
+ * is read: ignored directories are never read nor watched. With
+ * setShowIgnored(true) they are listed, greyed out, and read on demand.
+ *
+ * Directories come first, then names in case-insensitive order.
+ */
+class FileTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles
+    {
+        FilePathRole = Qt::UserRole + 1,
+        FileNameRole
+    };
+
+    static constexpr int CoalesceInterval = 50; // ms
+    static constexpr int RescanThreshold  = 256;
+
+    explicit FileTreeModel(QObject *parent = nullptr);
+    ~FileTreeModel();
+
+    // Shows path, and starts reading it
+    QModelIndex setRootPath(const QString &path);
+    QString rootPath() const;
+
+    // Patterns applied below the root before those of its ignore files
+    void setExcludes(const IgnoreRules &excludes);
+    void setShowIgnored(bool show);
+    bool showIgnored() const;
+
+    void setIconProvider(QAbstractFileIconProvider *provider);
+
+    // Index of an existing path, added to its parent if not listed yet
+    QModelIndex index(const QString &path, int column = 0);
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+
+    QString filePath(const QModelIndex &index) const;
+    QString fileName(const QModelIndex &index) const;
+    QFileInfo fileInfo(const QModelIndex &index) const;
+    bool isDir(const QModelIndex &index) const;
+    bool isIgnored(const QModelIndex &index) const;
+
+    // Whether the directory was listed, and is kept up to date
+    bool isFetched(const QModelIndex &index) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    // Drag and drop moves or copies files between directories
+    Qt::DropActions supportedDropActions() const override;
+    QStringList mimeTypes() const override;
+    QMimeData *mimeData(const QModelIndexList &indexes) const override;
+    bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column,
+                      const QModelIndex &parent) override;
+
+    // Holds the coalesced changes back while a batch of file operations runs,
+    // then applies them at once when the last suspension ends. Calls nest.
+    void suspendChanges();
+    void resumeChanges();
+
+    // Nodes in the arena, and directories watched for changes
+    int nodeCount() const;
+    int watchCount() const;
+    qint64 memoryUsage() const;
+
+signals:
+    // A directory was read by fetchMore(), or again after too many changes
+    void directoryLoaded(const QString &path);
+
+private:
+    static constexpr quint32 NoNode     = 0xFFFFFFFF;
+    static constexpr quint32 NoChildren = 0xFFFFFFFF;
+
+    enum class State : quint8
+    {
+        Unfetched,
+        Fetching,
+        Fetched
+    };
+
+    struct Node
+    {
+        quint32 name     = 0;
+        quint32 parent   = NoNode;
+        quint32 children = NoChildren; // Slot in m_children, for directories only
+        quint32 serial   = 0;          // Bumped when the node is freed, to drop late results
+        bool isDirectory : 1 = false;
+        bool isSymLink   : 1 = false;
+        bool isIgnored   : 1 = false;
+        bool isBusy      : 1 = false; // A read or check of the directory is in flight
+        State state          = State::Unfetched;
+    };
+
+    // Identifies a node across the time a worker reads its directory
+    struct Ticket
+    {
+        quint32 id;
+        quint32 serial;
+        quint32 generation;
+    };
+
+    // Names changed in a directory since the last flush
+    struct PendingChanges
+    {
+        QSet<QString> names;
+        bool rescan = false;
+    };
+
+    quint32 allocateNode(quint32 parent, const DirectoryReader::Entry &entry);
+    void freeSubtree(quint32 id);
+    QModelIndex indexOf(quint32 id) const;
+    int rowOf(quint32 id) const;
+    const std::vector<quint32> &childrenOf(quint32 id) const;
+    quint32 nodeOf(const QModelIndex &index) const;
+    QString pathOf(quint32 id) const;
+    Ticket ticketOf(quint32 id) const;
+    bool isCurrent(const Ticket &ticket) const;
+
+    // Node of an absolute path; with create, missing nodes of existing paths are added
+    quint32 nodeAt(const QString &path, bool create);
+
+    // Rules of the directories from the root down to id, outermost first, and
+    // the path of id relative to the root; false when id is not below the root
+    using RuleChain = std::vector<std::shared_ptr<const IgnoreRules>>;
+    bool ignoreRulesOf(quint32 id, bool withOwn, RuleChain *chain, QString *relativePath) const;
+
+    // Reads the listed directories from id down again, once the rules changed
+    void rescanSubtree(quint32 id);
+
+    // Forgets every node and watch, for a new root
+    void clear();
+
+    // Position of a child in its parent's sorted children, or where it belongs
+    int lowerBound(quint32 parent, QStringView name, bool isDirectory) const;
+    quint32 findChild(quint32 parent, QStringView name) const;
+    quint32 insertChild(quint32 parent, const DirectoryReader::Entry &entry);
+    void removeChild(quint32 parent, QStringView name);
+
+    // Applies a listing, or the state of some names, read on a worker thread
+    void applyListing(const Ticket &ticket, const std::vector<DirectoryReader::Entry> &entries,
+                      const std::shared_ptr<const IgnoreRules> &rules);
+    void applyChanges(const Ticket &ticket, const std::vector<DirectoryReader::Entry> &present, const QStringList &absent);
+    void setIgnored(quint32 id, bool isIgnored);
+
+    void startReading(quint32 id);
+    void startChecking(quint32 id, const QStringList &names);
+    void watch(quint32 id);
+    void unwatch(quint32 id);
+    void onEntriesChanged(const QString &directory, const QString &name);
+    void onDirectoryRemoved(const QString &directory);
+    void onOverflowed();
+    void markChanged(quint32 id, const QString &name);
+    void flushChanges();
+
+    std::vector<Node> m_nodes;
+    std::vector<quint32> m_freeNodes;
+    std::vector<std::vector<quint32>> m_children; // Sorted children of each directory
+    std::vector<quint32> m_freeChildren;
+    NamePool m_names;
+
+    QString m_rootPath;
+    quint32 m_rootNode   = NoNode;
+    quint32 m_generation = 0; // Bumped by clear()
+    QThreadPool m_pool;
+    QIcon m_folderIcon;
+    QIcon m_fileIcon;
+
+    std::shared_ptr<const IgnoreRules> m_excludes;
+    QHash<quint32, std::shared_ptr<const IgnoreRules>> m_ignoreRules; // Of directories with ignore files
+    bool m_showIgnored = false;
+
+    QHash<quint32, PendingChanges> m_pending;
+    QTimer m_coalesceTimer;
+    int m_suspended = 0;
+
+    QHash<quint32, QString> m_watches;     // Node to watched path
+    QHash<QString, quint32> m_watchedNodes; // Watched path to node
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Syntax.h"
+
+#include <QObject>
+#include <QTextBlock>
+#include <QTextBlockUserData>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <limits>
+#include <memory>
+
+/**
+ * @struct HighlightData
+ * @brief Tokens computed for one block, and the block states they depend on.
+ *
+ * The data is only valid while the block revision matches the one the
+ * tokens were computed for, and the previous block still ends in
+ * previousState.
+ */
+struct HighlightData : public QTextBlockUserData
+{
+    int revision      = -1;
+    int previousState = 0;
+    int state         = 0;
+    QVector<SyntaxToken> tokens;
+};
+
+/**
+ * @class HighlightScheduler
+ * @brief Tokenizes the blocks of a document on a worker thread.
+ *
+ * A pass snapshots the blocks whose tokens are missing or out of date and
+ * tokenizes them on a worker thread: visible blocks first, then the whole
+ * snapshot in document order, carrying the block state along. A block whose
+ * cached tokens were computed for the incoming state is skipped, so after an
+ * edit only the blocks up to the point where the state converges again are
+ * re-tokenized. Results are published back to the document in batches; a
+ * pass is cancelled as soon as the document layout it was built on changes.
+ *
+ * The blocks that may need work are tracked as a range of block numbers, so
+ * a pass after an edit walks the document from the edit on, and stops where
+ * the stored states chain up again rather than at its end.
+ */
+class HighlightScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    HighlightScheduler(Syntax *syntax, QTextDocument *document);
+    ~HighlightScheduler();
+
+    void setVisibleBlocks(int firstBlock, int lastBlock);
+    bool isVisible(int blockNumber) const;
+
+    // Tokens of a block, or nullptr if they are out of date for previousState
+    const HighlightData *cachedData(const QTextBlock &block, int previousState) const;
+
+    // Tokens last stored for a block, even out of date: its formats are kept until new ones arrive
+    const HighlightData *previousData(const QTextBlock &block) const;
+
+    // Caches tokens computed on the GUI thread, so the worker can skip the block
+    void store(QTextBlock block, int previousState, int state, const QVector<SyntaxToken> &tokens);
+
+    // Start a pass over firstBlock..lastBlock once the running one is done; calls are coalesced
+    void requestPass(int firstBlock, int lastBlock);
+
+    // Drop every cached token and cancel the running pass
+    void reset();
+
+private slots:
+    void startPass();
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    struct BlockSnapshot
+    {
+        int number;
+        int revision;
+        int previousState;  // Incoming state as currently stored in the document
+        int cachedPrevious; // -1 if the block has no valid cached tokens
+        int cachedState;
+        bool hasText;       // Clean blocks are snapshotted without their text
+        QString text;
+        QVector<SyntaxToken> tokens;
+        int state = 0;
+    };
+
+    const HighlightData *storedData(const QTextBlock &block) const;
+    void markDirty(int firstBlock, int lastBlock);
+    void schedulePass();
+    void publish(int generation, const QVector<BlockSnapshot> &batch);
+    void finishPass();
+    void cancel();
+
+    Syntax *m_syntax;
+    QTextDocument *m_document;
+    QThreadPool m_pool;
+    QTimer m_passTimer;
+    std::shared_ptr<std::atomic_int> m_generation;
+    bool m_passRunning = false;
+    bool m_passPending = false;
+    int m_firstVisible = 0;
+    int m_lastVisible  = -1;
+    int m_blockCount   = 0;
+    int m_dirtyFirst   = std::numeric_limits<int>::max(); // Blocks that may need tokens, empty when first > last
+    int m_dirtyLast    = -1;
+    int m_passFirst    = 0; // Blocks of the running pass, dirty again if it is cancelled
+    int m_passLast     = -1;
+};
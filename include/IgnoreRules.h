@@ -0,0 +1,111 @@
+#pragma once
+
+#include "DirectoryReader.h"
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <memory>
+#include <vector>
+
+/**
+ * @class IgnoreRules
+ * @brief Compiled patterns of a .gitignore or .ignore file, or of the user's exclude list.
+ *
+ * Patterns follow gitignore(5): a pattern without a slash matches a name at
+ * any depth, one with a slash matches from the directory holding the rules,
+ * a trailing slash matches directories only, "**" spans directories and a
+ * leading "!" includes again what an earlier pattern ignored.
+ *
+ * Each pattern is parsed once. Plain names and "*.ext" patterns, which make
+ * up most real ignore files, are compared directly; only the others go
+ * through the glob matcher.
+ */
+class IgnoreRules
+{
+public:
+    enum class Match
+    {
+        None,
+        Ignored,
+        Included
+    };
+
+    // Rules of the directory at base, relative to the project root
+    explicit IgnoreRules(const QString &base = QString());
+
+    // Adds the patterns of text, one per line
+    void addPatterns(const QString &text);
+    bool addFile(const QString &path);
+
+    QString base() const;
+    bool isEmpty() const;
+    int size() const;
+
+    // Same base and patterns, in the same order
+    bool operator==(const IgnoreRules &other) const = default;
+
+    // Whether a directory whose rules went from previous to current must be read again, below too
+    static bool isChanged(const std::shared_ptr<const IgnoreRules> &previous,
+                          const std::shared_ptr<const IgnoreRules> &current);
+
+    // The last pattern matching path, relative to base
+    Match match(QStringView path, bool isDirectory) const;
+
+    // Whether path, relative to the project root, is ignored by rules
+    // listed from the outermost directory to the innermost
+    static bool isIgnored(const std::vector<std::shared_ptr<const IgnoreRules>> &rules, QStringView path,
+                          bool isDirectory);
+
+    // .gitignore and .ignore, whose patterns apply to their directory
+    static const QStringList &fileNames();
+    static bool isIgnoreFile(QStringView name);
+
+    // Rules of the ignore files among the entries of the directory at path, or null
+    static std::shared_ptr<const IgnoreRules> readDirectory(const QString &path, const QString &relativePath,
+                                                            const std::vector<DirectoryReader::Entry> &entries);
+
+    // Flags the entries of the directory at relativePath that rules ignore,
+    // and drops them unless kept
+    static void markIgnored(std::vector<DirectoryReader::Entry> &entries,
+                            const std::vector<std::shared_ptr<const IgnoreRules>> &rules, const QString &relativePath,
+                            bool keepIgnored);
+
+    // The rules applying to the entries of directory, relative to the project root,
+    // but its own: excludes, then those of each directory above it found in rules
+    static std::vector<std::shared_ptr<const IgnoreRules>> rulesAbove(
+        const QString &directory, const std::vector<std::shared_ptr<const IgnoreRules>> &excludes,
+        const QHash<QString, std::shared_ptr<const IgnoreRules>> &rules);
+
+    // ".git/", then the patterns of ~/.config/codeastra/exclude, where "!.git/" shows it again
+    static QString userExcludeFile();
+    static IgnoreRules userExcludes();
+
+    // "*" and "?" stop at "/", "**" between slashes spans directories
+    static bool globMatch(QStringView pattern, QStringView text);
+
+private:
+    enum class Kind
+    {
+        Name,   // No wildcard
+        Suffix, // "*" then no wildcard
+        Glob
+    };
+
+    struct Rule
+    {
+        QString pattern; // Without "!" or the slashes around it; only the suffix of Suffix
+        Kind kind          = Kind::Glob;
+        bool isNegated     = false;
+        bool directoryOnly = false;
+        bool isAnchored    = false; // Matched against the whole path rather than the name
+
+        bool operator==(const Rule &other) const = default;
+    };
+
+    void addPattern(QStringView line);
+
+    QString m_base;
+    std::vector<Rule> m_rules;
+};
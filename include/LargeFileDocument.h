@@ -0,0 +1,103 @@
+#pragma once
+
+#include "FileManager.h"
+#include "PieceTable.h"
+#include "TextFormat.h"
+
+#include <QFile>
+#include <QObject>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+
+/**
+ * @class LargeFileDocument
+ * @brief A file too large for QTextDocument, edited in place as a piece table.
+ *
+ * QTextDocument keeps a block and a layout per line, which makes files of
+ * millions of lines cost gigabytes. This document memory-maps the file and
+ * keeps edits in a PieceTable over the mapping, so its memory is the line
+ * index plus the inserted text. The '\n' of the file are indexed on a
+ * worker thread, in chunks; lines become visible as they are indexed, and
+ * editing is allowed once the whole file is indexed.
+ *
+ * Saving streams the pieces to a temporary file next to the target on a
+ * worker thread, which then replaces it; the mapping keeps the previous
+ * version alive. Edits are ignored until saved() is emitted, so the worker
+ * reads pieces that do not change under it.
+ *
+ * The table holds the bytes of the file as they are: the encoding, BOM and
+ * line endings detected on open are used to decode lines and encode edits.
+ * Only encodings in which '\n' is a single byte, UTF-8 and Latin-1, can be
+ * edited this way.
+ */
+class LargeFileDocument : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Files larger than this are opened as a LargeFileDocument
+    static constexpr qint64 Threshold = 128 * 1024 * 1024;
+
+    // Bytes indexed between two progress reports
+    static constexpr qint64 IndexChunkSize = 16 * 1024 * 1024;
+
+    explicit LargeFileDocument(QObject *parent = nullptr);
+    ~LargeFileDocument();
+
+    // Whether the file is in an encoding this document can edit, from its first bytes
+    static bool canOpen(const QString &filePath);
+
+    OperationResult open(const QString &filePath);
+
+    // Starts writing the text to filePath; saved() reports the result
+    OperationResult save(const QString &filePath);
+
+    const PieceTable &text() const;
+    TextFormat format() const;
+
+    // Offset of the first line, after the BOM if any
+    qint64 textStart() const;
+
+    // Conversions between the bytes of the file and text; false in lossless if a character had no encoding
+    QString decode(QByteArrayView bytes) const;
+    QByteArray encode(const QString &text, bool *lossless = nullptr) const;
+
+    // The bytes Return inserts
+    QByteArray lineEnding() const;
+
+    QString filePath() const;
+    bool isIndexed() const;
+    bool isSaving() const;
+    bool isModified() const;
+
+    // Whether edits are applied: once the file is indexed, and while it is not being saved
+    bool isEditable() const;
+
+    void insert(qint64 offset, const QByteArray &bytes);
+    void remove(qint64 offset, qint64 length);
+
+signals:
+    void indexProgress(qint64 indexedBytes, qint64 totalBytes);
+    void indexed();
+    void contentsChanged(qint64 firstLine);
+    void modificationChanged(bool modified);
+    void saved(bool success, const QString &message);
+
+private:
+    void startIndexing();
+    void close();
+    void setModified(bool modified);
+
+    // Runs on the worker thread
+    static OperationResult write(const QString &filePath, const PieceTable &text);
+
+    QFile m_file;
+    uchar *m_mapped = nullptr;
+    PieceTable m_text;
+    TextFormat m_format;
+    QThreadPool m_pool;
+    std::shared_ptr<std::atomic_int> m_generation;
+    bool m_modified = false;
+    bool m_saving   = false;
+};
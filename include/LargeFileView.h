@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Syntax.h"
+
+#include <QAbstractScrollArea>
+#include <QPointer>
+#include <memory>
+
+class LargeFileDocument;
+struct SyntaxDefinition;
+
+/**
+ * @class LargeFileView
+ * @brief Virtualized editor of a LargeFileDocument.
+ *
+ * Nothing is kept per line: each paint reads, decodes and highlights only
+ * the lines in the viewport. Multi-line regions (block comments...) are
+ * recovered by tokenizing RegionLookBehind lines above the viewport, so a
+ * region opened further up is not highlighted.
+ *
+ * Editing is limited to typing, Backspace, Delete and Return at a single
+ * cursor, without selection nor undo; it is enabled once the document is
+ * fully indexed, and paused while it is saved. Lines are decoded and edits encoded in the format of the
+ * document, and Return inserts its line ending.
+ *
+ * No more than MaxDrawnLength characters of a line are decoded, whether to
+ * draw it or to place the cursor: columns are mapped to byte offsets by
+ * walking the bytes of the line up to the column.
+ */
+class LargeFileView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit LargeFileView(QWidget *parent = nullptr);
+
+    void setDocument(LargeFileDocument *document);
+    void setSyntax(std::shared_ptr<const SyntaxDefinition> definition);
+
+    // Moves the cursor to the start of line (from 0), as far as the lines indexed so far
+    void goToLine(qint64 line);
+
+    static constexpr int RegionLookBehind = 200;
+
+    // Only the start of longer lines is drawn and edited
+    static constexpr int MaxDrawnLength = 10000;
+
+    static constexpr int TabWidth = 4;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private slots:
+    void onContentsChanged();
+
+private:
+    qint64 lineStart(qint64 line) const;
+
+    // The first MaxDrawnLength * 4 bytes of a line, enough for MaxDrawnLength characters
+    QByteArray lineBytes(qint64 line, bool *complete = nullptr) const;
+    // Up to MaxDrawnLength characters of a line; false in complete if the line is longer
+    QString lineText(qint64 line, bool *complete = nullptr) const;
+    qint64 lineCount() const;
+    int lineHeight() const;
+    int gutterWidth() const;
+    void updateScrollBars();
+    void setCursorPosition(qint64 line, int column);
+    void ensureCursorVisible();
+    qint64 offsetAt(qint64 line, int column) const;
+    const QTextCharFormat &tokenFormat(int rule) const;
+
+    // The line with tabs expanded, and the display column of each character
+    QString displayText(const QString &text, QVector<int> &columns) const;
+
+    QPointer<LargeFileDocument> m_document;
+    std::shared_ptr<const SyntaxDefinition> m_definition;
+    Syntax::RuleSet m_ruleSet;
+    qint64 m_cursorLine = 0;
+    int m_cursorColumn  = 0;
+    int m_contentWidth  = 0;
+};
@@ -8,6 +8,12 @@
 #include <memory>
 
 class CodeEditor;
+class LargeFileView;
+class QStackedWidget;
+class QuickOpenDialog;
+class SearchPanel;
+class QDockWidget;
+class QTabBar;
 class Syntax;
 class Tree;
 class FileManager;
@@ -35,8 +41,18 @@ public:
                           const QKeySequence &shortcut, const QString &statusTip,
                           const std::function<void()> &slot);
 
+    // Shows the view of files too large for the code editor in its place
+    LargeFileView *largeFileView() const;
+    void showLargeFileView(bool show);
+
 private slots:
     void showAbout();
+    void showHighlightProfile();
+    void showQuickOpen();
+    void showSearchPanel();
+
+    // Rebuilds the tabs from FileManager::openDocuments()
+    void updateTabs();
 
 private:
     void createMenuBar();
@@ -45,7 +61,13 @@ private:
     void createAppActions(QMenu *appMenu);
 
     std::unique_ptr<CodeEditor> m_editor;
+    std::unique_ptr<LargeFileView> m_largeFileView;
+    QStackedWidget *m_editorStack = nullptr;
+    QTabBar *m_tabBar             = nullptr;
     std::unique_ptr<Tree> m_tree;
+    QuickOpenDialog *m_quickOpen = nullptr; // Created on first use
+    QDockWidget *m_searchDock    = nullptr; // Created on first use
+    SearchPanel *m_searchPanel   = nullptr;
 
     FileManager *m_fileManager;
 };
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QString>
+#include <QStringView>
+#include <vector>
+
+/**
+ * @class NamePool
+ * @brief Interned strings, stored back to back in a single buffer.
+ *
+ * Each distinct string is stored once and named by a 32-bit id, which is
+ * all a tree node keeps: the thousands of "index.js" or "package.json" of
+ * a node_modules tree share one copy. Strings are never removed.
+ */
+class NamePool
+{
+public:
+    NamePool();
+
+    // The id of name, added if new
+    quint32 intern(QStringView name);
+
+    QStringView name(quint32 id) const;
+
+    int size() const;
+    qint64 memoryUsage() const;
+
+private:
+    void grow();
+
+    std::vector<char16_t> m_characters; // Every string, back to back
+    std::vector<quint32> m_offsets;     // Start of each string, plus the end of the last one
+    std::vector<quint32> m_slots;       // Open addressing table of id + 1, 0 when empty
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "IgnoreRules.h"
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/**
+ * @class PathIndex
+ * @brief Flat index of the files of a project, for fuzzy "go to file" searches.
+ *
+ * Paths relative to the root are stored as UTF-8, back to back in one
+ * buffer, and named by their position: a search streams through memory
+ * instead of chasing a node per file. The index is built by workers
+ * walking directories in parallel, honouring the same ignore rules as the
+ * tree, then follows changes through the DirectoryWatcher the tree uses.
+ *
+ * A search scores every path on several threads, each keeping its own
+ * best results; a bit mask of the characters of each path skips most of
+ * them unread. The paths that matched are kept, so that typing one more
+ * character only scores those again.
+ */
+class PathIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Match
+    {
+        quint32 id;
+        int score;
+    };
+
+    static constexpr int MaxWorkers     = 8;
+    static constexpr int DefaultLimit   = 50;
+    static constexpr int MinChunk       = 16384; // Paths scored by one thread at least
+    static constexpr int UpdateInterval = 100;   // ms
+
+    explicit PathIndex(QObject *parent = nullptr);
+    ~PathIndex();
+
+    // Indexes the files below path in the background; indexed() once done
+    void setRootPath(const QString &path);
+    QString rootPath() const;
+
+    // Patterns applied before those of the ignore files, from the next setRootPath()
+    void setExcludes(const IgnoreRules &excludes);
+
+    bool isIndexing() const;
+    int size() const;
+    qint64 memoryUsage() const;
+
+    // The path of a match, relative to the root or not
+    QString path(quint32 id) const;
+    QString absolutePath(quint32 id) const;
+
+    // The best matches of query, best first
+    std::vector<Match> search(const QString &query, int limit = DefaultLimit);
+
+    // Paths matching the last query, of which search() returned the best
+    int matchCount() const;
+
+    // Score of query, already folded to lower case, against path: -1 when
+    // the characters of query are not all in path in order. Matches at the
+    // start of a name or word and in a row score higher, gaps lower.
+    static int score(const char *query, int queryLength, const char *path, int pathLength);
+
+    // Positions in path of the characters of query, as score() picks them
+    static QList<int> matchPositions(const QString &query, const QString &path);
+
+signals:
+    void indexed();
+
+    // Paths were added or removed after indexed()
+    void changed();
+
+private:
+    using RuleChain = std::vector<std::shared_ptr<const IgnoreRules>>;
+
+    // A directory read by a worker, its entries filtered
+    struct Listing
+    {
+        QString directory; // Relative to the root, "" for the root
+        QStringList files;
+        QStringList subdirectories;
+        std::shared_ptr<const IgnoreRules> rules;
+    };
+
+    struct Directory
+    {
+        std::vector<quint32> files;
+        QStringList subdirectories;
+    };
+
+    struct Contents
+    {
+        std::vector<char> characters;   // Every path, back to back
+        std::vector<quint32> offsets{0}; // Start of each path, plus the end of the last one
+        std::vector<quint64> masks;      // Characters of each path, one bit per class of them
+        std::vector<quint8> removed;     // Paths are removed in place, and compacted later
+        int removedCount = 0;
+
+        QHash<QString, Directory> directories;
+        QHash<QString, std::shared_ptr<const IgnoreRules>> rules; // Of directories with ignore files
+
+        quint32 add(const QString &path);
+        QString fileName(quint32 id) const;
+
+        // Adds the files of directories not indexed yet
+        void merge(const std::vector<Listing> &listings);
+    };
+
+    // Reads directories and everything below them, on the calling thread and the free threads of pool
+    static std::vector<Listing> walk(QThreadPool *pool, const QString &root, const QStringList &directories,
+                                     const RuleChain &excludes,
+                                     const QHash<QString, std::shared_ptr<const IgnoreRules>> &rules,
+                                     const std::atomic<bool> &cancelled);
+    static Listing readDirectory(const QString &root, const QString &directory, const RuleChain &rules);
+
+    void watch(const std::vector<Listing> &listings);
+    void unwatchAll();
+    void onDirectoryChanged(const QString &path);
+    void onOverflowed();
+    void removeDirectory(const QString &directory);
+    void applyListing(const Listing &listing);
+    void flushChanges();
+    void compact();
+    void invalidateSearch();
+
+    QString m_rootPath;
+    RuleChain m_excludes;
+    std::shared_ptr<Contents> m_contents;
+    std::shared_ptr<std::atomic<bool>> m_cancelled; // Of the build in progress
+    int m_generation = 0;
+    bool m_indexing  = false;
+
+    QThreadPool m_walkers;
+    QThreadPool m_scorers;
+
+    QSet<QString> m_watched; // Absolute paths held on the DirectoryWatcher
+    QSet<QString> m_changedDirectories;
+    QTimer m_updateTimer;
+
+    // Paths that matched the last query, scored again while it grows
+    QByteArray m_lastQuery;
+    std::vector<quint32> m_candidates;
+};
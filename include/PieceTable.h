@@ -0,0 +1,95 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <functional>
+#include <vector>
+
+/**
+ * @class PieceTable
+ * @brief Editable text over a read-only buffer, such as a memory-mapped file.
+ *
+ * The text is a sequence of pieces, each one a span of either the original
+ * buffer or an append-only buffer holding every inserted byte. Edits only
+ * split and add pieces: the original buffer is never copied nor modified.
+ * Offsets are in bytes of UTF-8 text; lines are separated by '\n'.
+ *
+ * The offset and line of each piece are prefix sums, brought up to date
+ * lazily: an edit only marks the pieces from the edited one on as stale,
+ * and a query recomputes them up to the piece it looks for. Edits and
+ * queries around the same place, as when typing, cost no walk over the
+ * rest of the table.
+ *
+ * Lines are found through the offsets of the '\n' of both buffers. Those of
+ * the original buffer are supplied by the owner, who may index it in the
+ * background with indexLines() and hand the result over piecewise with
+ * appendOriginalIndex(). Until the original buffer is fully indexed, only
+ * the lines found so far are known, and the table must not be edited.
+ */
+class PieceTable
+{
+public:
+    // Sets the original text; the buffer must outlive the table
+    void setOriginal(const char *data, qint64 size);
+
+    qint64 size() const;
+    bool isEmpty() const;
+
+    void insert(qint64 offset, QByteArrayView bytes);
+    void remove(qint64 offset, qint64 length);
+    QByteArray read(qint64 offset, qint64 length) const;
+
+    // Calls visit with the successive spans of the text, without copying them
+    void forEachSpan(const std::function<bool(QByteArrayView span)> &visit) const;
+
+    // Offsets of the '\n' in [begin, end) of a buffer
+    static std::vector<qint64> indexLines(const char *data, qint64 begin, qint64 end);
+
+    // Adds the '\n' of the original buffer found up to indexedSize, in order
+    void appendOriginalIndex(const std::vector<qint64> &newlines, qint64 indexedSize);
+    bool isIndexed() const;
+
+    // Number of lines known so far; a text ending with '\n' has an empty last line
+    qint64 lineCount() const;
+    qint64 lineStart(qint64 line) const;
+    qint64 lineLength(qint64 line) const; // Without the '\n'
+    QByteArray line(qint64 line) const;
+    qint64 lineOf(qint64 offset) const;
+
+    // Pieces making up the text, one after an edit of an unedited table
+    qsizetype pieceCount() const;
+
+private:
+    struct Piece
+    {
+        bool added;    // Span of the append buffer, or of the original one
+        qint64 start;  // Offset in its buffer
+        qint64 length;
+        qint64 newlines;
+    };
+
+    const std::vector<qint64> &newlinesOf(const Piece &piece) const;
+    qint64 countNewlines(const Piece &piece, qint64 begin, qint64 end) const;
+    Piece makePiece(bool added, qint64 start, qint64 length) const;
+    qsizetype pieceAt(qint64 offset) const;
+    qsizetype pieceOfLine(qint64 line) const;
+    qsizetype split(qint64 offset);
+    void updateIndex();
+    void invalidateFrom(qsizetype piece);
+    void validate(qsizetype count) const;
+
+    const char *m_original = nullptr;
+    qint64 m_originalSize  = 0;
+    qint64 m_indexedSize   = 0;
+    std::vector<qint64> m_originalNewlines;
+
+    QByteArray m_added;
+    std::vector<qint64> m_addedNewlines;
+
+    std::vector<Piece> m_pieces;
+    mutable std::vector<qint64> m_pieceOffsets; // Offset of each piece in the text
+    mutable std::vector<qint64> m_pieceLines;   // Newlines before each piece
+    mutable qsizetype m_validPieces = 0;        // Leading pieces whose offset and line are up to date
+    qint64 m_size                   = 0;
+    qint64 m_newlines               = 0;
+};
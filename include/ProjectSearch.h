@@ -0,0 +1,122 @@
+#pragma once
+
+#include "FileManager.h"
+#include "IgnoreRules.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QRegularExpression>
+#include <QString>
+#include <QThreadPool>
+#include <QTimer>
+#include <memory>
+#include <vector>
+
+class TrigramIndex;
+struct TextFormat;
+
+/**
+ * @class ProjectSearch
+ * @brief Finds a text in every file below a directory, on worker threads.
+ *
+ * Each worker has its own queue of directories to list and files to search,
+ * and takes from the others' when it runs dry, so a large directory is
+ * shared out instead of keeping one worker busy. Directories are filtered by
+ * the same ignore rules as the tree. Files are read in blocks of ReadSize
+ * bytes, not mapped, since another program may truncate them meanwhile.
+ * Their encoding is detected as by a load (see TextFormat), and those whose
+ * first bytes hold a NUL, as binary files do, are skipped unless UTF-16.
+ *
+ * Literal text, and regular expressions that are only literal text, are
+ * found with SSE2 where available, without decoding UTF-8 files, nor
+ * Latin-1 ones for ASCII text. Other files and regular expressions are
+ * searched in the decoded text of files up to MaxRegexFileSize.
+ *
+ * Given a TrigramIndex of the same root, literal searches only read the
+ * files it lists as candidates, rather than walking the directories.
+ *
+ * One hit is reported per matching line. Hits are handed over in batches
+ * while the search runs; starting a new search cancels the previous one.
+ */
+class ProjectSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        bool caseSensitive     = false;
+        bool regularExpression = false;
+    };
+
+    struct Hit
+    {
+        QString filePath;
+        int line   = 0; // From 1
+        int column = 0; // Of the first match in the line
+        int length = 0;
+        QString text;   // The line, cut at MaxPreviewLength
+    };
+
+    static constexpr int MaxWorkers          = 8;
+    static constexpr int BatchInterval       = 50;  // ms between batches of hits
+    static constexpr int BinaryProbeSize     = 8192;
+    static constexpr qsizetype ReadSize      = 1024 * 1024; // Grown for a longer line
+    static constexpr int MaxPreviewLength    = 300; // Bytes of a line shown
+    static constexpr int MaxHits             = 20000;
+    static constexpr qint64 MaxRegexFileSize = 64 * 1024 * 1024;
+
+    explicit ProjectSearch(QObject *parent = nullptr);
+
+    // Cancels the search and waits for the workers
+    ~ProjectSearch();
+
+    // Patterns applied before those of the ignore files
+    void setExcludes(const IgnoreRules &excludes);
+
+    // Narrows the literal searches of its root; null to read every file
+    void setIndex(const TrigramIndex *index);
+
+    // Cancels the search in progress and starts searching the files below root
+    OperationResult start(const QString &root, const QString &pattern, Options options);
+    void cancel();
+    bool isRunning() const;
+
+    /**
+     * @brief Offset of the first occurrence of needle in data, or -1.
+     *
+     * Without caseSensitive, ASCII letters match either case and needle
+     * must already be in lower case.
+     */
+    static qsizetype findLiteral(const char *data, qsizetype size, const QByteArray &needle, bool caseSensitive);
+
+signals:
+    void hitsFound(const QList<ProjectSearch::Hit> &hits);
+
+    // Once every file was searched or MaxHits reached; not after cancel()
+    void finished(int searchedFiles, int hitCount);
+
+private:
+    struct Run;
+
+    static void work(const std::shared_ptr<Run> &run, int index);
+    static void listDirectory(Run &run, int index, const QString &directory,
+                              const std::vector<std::shared_ptr<const IgnoreRules>> &rules);
+    static void searchFile(Run &run, const QString &path, QList<Hit> &hits);
+
+    // Searches whole lines, the first of them numbered line; line is then that of the line after them
+    static void searchLiteral(const Run &run, const QString &path, const TextFormat &format, const char *data,
+                              qsizetype size, int &line, QList<Hit> &hits);
+    static void searchRegex(const Run &run, const QString &path, const TextFormat &format, QByteArrayView bytes,
+                            QList<Hit> &hits);
+
+    // Emits the hits found since the last batch
+    void flushHits();
+
+    std::vector<std::shared_ptr<const IgnoreRules>> m_excludes;
+    const TrigramIndex *m_index = nullptr;
+    std::shared_ptr<Run> m_run;
+    QThreadPool m_pool;
+    QTimer m_batchTimer;
+};
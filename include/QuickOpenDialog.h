@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QDialog>
+
+class PathIndex;
+class QLabel;
+class QLineEdit;
+class QListWidget;
+
+/**
+ * @class QuickOpenDialog
+ * @brief "Go to file" popup: type part of a path, pick a file to open.
+ *
+ * Results come from a PathIndex and are searched again on every keystroke,
+ * with the matched characters in bold. Up and Down move through the results
+ * without leaving the query; Return opens the selected file in the editor.
+ */
+class QuickOpenDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    static constexpr int MaxResults = 100;
+
+    explicit QuickOpenDialog(PathIndex *index, QWidget *parent = nullptr);
+
+    // Shows the dialog with the query of last time selected
+    void popup();
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) override;
+
+private:
+    void updateResults();
+    void openSelected();
+
+    PathIndex *m_index;
+    QLineEdit *m_query    = nullptr;
+    QListWidget *m_results = nullptr;
+    QLabel *m_status      = nullptr;
+};
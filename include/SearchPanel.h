@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ProjectSearch.h"
+#include "TrigramIndex.h"
+
+#include <QHash>
+#include <QTimer>
+#include <QWidget>
+
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+/**
+ * @class SearchPanel
+ * @brief Find in files: a query, and the matching lines grouped by file.
+ *
+ * Each change of the query, once typing pauses, cancels the search in
+ * progress and starts a new one. Hits are listed as they are found;
+ * activating one opens its file at that line.
+ *
+ * The project can be indexed, on disk, to search it faster. A project that
+ * has an index uses it again when opened; turning it off deletes it.
+ */
+class SearchPanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static constexpr int QueryDelay = 200; // ms after the last change of the query
+
+    explicit SearchPanel(QWidget *parent = nullptr);
+
+    // Directory searched from the next query
+    void setRootPath(const QString &path);
+
+    // Gives the focus to the query, replaced by text unless empty
+    void focusQuery(const QString &text = QString());
+
+private:
+    void startSearch();
+    void addHits(const QList<ProjectSearch::Hit> &hits);
+    void onFinished(int searchedFiles, int hitCount);
+    void openHit(QTreeWidgetItem *item);
+    void setIndexEnabled(bool enabled);
+
+    ProjectSearch m_search;
+    TrigramIndex m_index;
+    QString m_rootPath;
+
+    QLineEdit *m_query             = nullptr;
+    QCheckBox *m_caseSensitive     = nullptr;
+    QCheckBox *m_regularExpression = nullptr;
+    QCheckBox *m_useIndex          = nullptr;
+    QTreeWidget *m_results         = nullptr;
+    QLabel *m_status               = nullptr;
+    QTimer m_queryTimer;
+
+    QHash<QString, QTreeWidgetItem *> m_fileItems;
+    int m_hitCount = 0;
+};
@@ -4,6 +4,26 @@
 #include <QTextCharFormat>
 #include <QRegularExpression>
 #include <yaml-cpp/yaml.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct SyntaxDefinition;
+class SyntaxPrefilter;
+class SyntaxLexer;
+class HighlightScheduler;
+
+/**
+ * @struct SyntaxToken
+ * @brief A span of a text block matched by a single rule.
+ */
+struct SyntaxToken
+{
+    int start;
+    int length;
+    int rule; // Index in the rule list of the highlighter, followed by its region rules
+};
 
 /**
  * @class Syntax
@@ -12,7 +32,9 @@
  *
  * This class allows you to define syntax highlighting rules using regular expressions
  * and associated text formats. It applies these rules to text blocks to highlight
- * specific patterns.
+ * specific patterns. Region rules (begin/end patterns) may span several blocks;
+ * the region a block ends in is kept as its block state, so that after an edit
+ * QSyntaxHighlighter only re-highlights blocks until the state converges.
  *
  * @note This class inherits the constructor from QSyntaxHighlighter.
  */
@@ -22,7 +44,43 @@ class Syntax : public QSyntaxHighlighter
 
 public:
     Syntax(QTextDocument *parent, const YAML::Node &config);
-    ~Syntax() = default;
+    Syntax(QTextDocument *parent, std::shared_ptr<const SyntaxDefinition> definition);
+    ~Syntax();
+
+    /**
+     * @brief Moves the tokenization of off-screen blocks to a worker thread.
+     *
+     * Visible blocks are still highlighted synchronously, so typing never
+     * waits for a pass over the rest of the document. Meant for large files.
+     */
+    void setBackgroundHighlighting(bool enabled);
+    bool backgroundHighlighting() const;
+
+    // Range of blocks currently shown by the editor, highlighted first
+    void setVisibleBlocks(int firstBlock, int lastBlock);
+
+    // Documents with more blocks than this are highlighted in the background
+    static constexpr int BackgroundThreshold = 5000;
+
+    /*
+     * Bounds on the work spent matching a block, so that a rule that
+     * backtracks catastrophically cannot hang the editor. A single match
+     * attempt is bounded in PCRE2 steps, the matches of a rule and of all
+     * the rules of a block in time. A rule over its budget is skipped for
+     * the rest of the block, and disabled for the document once it ran
+     * over budget on StrikeLimit blocks.
+     */
+    static constexpr int MatchStepLimit = 500000;
+    static constexpr qint64 RuleBudget  = 5;  // Milliseconds per rule and block
+    static constexpr qint64 BlockBudget = 20; // Milliseconds per block
+    static constexpr int StrikeLimit    = 3;
+
+    // Prefixes a pattern with the PCRE2 match step limit
+    static QString boundedPattern(const QString &pattern);
+
+signals:
+    // A rule ran over its match budget; the message is meant for the status bar
+    void matchBudgetExceeded(const QString &message);
 
 protected:
     /**
@@ -38,16 +96,76 @@ public:
      * @brief Represents a single syntax highlighting rule.
      *
      * A syntax rule consists of a regular expression pattern and a text format
-     * to apply to matching text.
+     * to apply to matching text. The priority decides between rules matching
+     * at the same position; higher wins. A match of a higher priority rule may
+     * also be nested inside a token of a lower priority one.
      */
     struct SyntaxRule
     {
         QRegularExpression m_pattern;
         QTextCharFormat m_format;
+        int m_priority = 0;
+        QRegularExpression m_bounded; // m_pattern under MatchStepLimit, used for matching
     };
 
     QVector<SyntaxRule> m_syntaxRules;
 
+    /**
+     * @struct RegionRule
+     * @brief A construct that may span several blocks, such as a block comment.
+     *
+     * The region starts at a match of the begin pattern and extends to the
+     * next match of the end pattern, possibly on a later block.
+     */
+    struct RegionRule
+    {
+        QRegularExpression m_begin; // Both patterns are under MatchStepLimit
+        QRegularExpression m_end;
+        QTextCharFormat m_format;
+    };
+
+    QVector<RegionRule> m_regionRules;
+
+    /**
+     * @class MatchGuard
+     * @brief Counts the blocks on which each rule of a document ran over budget.
+     *
+     * Shared by the copies of a rule set, so it is updated from both the GUI
+     * thread and the background worker.
+     */
+    class MatchGuard
+    {
+    public:
+        using Notify = std::function<void(int rule, bool disabled)>;
+
+        MatchGuard(qsizetype ruleCount, Notify notify);
+
+        bool isDisabled(int rule) const;
+
+        // Records that a rule ran over budget on a block
+        void strike(int rule);
+
+    private:
+        std::vector<std::atomic_int> m_strikes;
+        Notify m_notify;
+    };
+
+    /**
+     * @struct RuleSet
+     * @brief Everything needed to tokenize a block, cheap to copy.
+     */
+    struct RuleSet
+    {
+        QVector<SyntaxRule> rules;
+        QVector<RegionRule> regions;
+        QString language; // Config file of the rules, for the profiler
+        std::shared_ptr<MatchGuard> guard;
+        std::shared_ptr<const SyntaxPrefilter> prefilter; // Skips the rules that cannot match a block
+        std::shared_ptr<const SyntaxLexer> lexer;         // Matches the rules it compiles in one scan, if any
+    };
+
+    RuleSet ruleSet() const;
+
     /**
      * @brief Adds a new syntax highlighting rule.
      *
@@ -60,4 +178,56 @@ public:
     void addPattern(const QString &pattern, const QTextCharFormat &format);
 
     void loadSyntaxRules(const YAML::Node &config);
+
+    /**
+     * @brief Compiles the "keywords" section of a language config into rules.
+     *
+     * The returned patterns are already optimized, so copies of the vector
+     * share both the rule storage and the compiled expressions.
+     */
+    static QVector<SyntaxRule> parseSyntaxRules(const YAML::Node &config);
+
+    // Compiles the "regions" section of a language config into region rules.
+    static QVector<RegionRule> parseRegionRules(const YAML::Node &config);
+
+    // Whether a language config opts in to the SyntaxLexer with "engine: lexer"
+    static bool usesLexer(const YAML::Node &config);
+
+    // Building blocks shared by the YAML parser and the bundled syntax tables
+    static QTextCharFormat makeFormat(const QColor &color, bool bold, bool italic);
+    static SyntaxRule compileRule(const QString &regex, const QTextCharFormat &format, int priority);
+    static bool compileRegion(const QString &begin, const QString &end, const QTextCharFormat &format,
+                              RegionRule &region);
+
+    /**
+     * @brief Matches the rules against a block, without touching any document.
+     *
+     * Safe to call from a worker thread on a copy of the rule set. The tokens
+     * are sorted and never overlap: a token starting inside another one (a
+     * keyword in a comment) is dropped, unless its rule has a higher priority.
+     * Time spent in each rule is reported to the SyntaxProfiler when enabled.
+     * Matching is bounded by the match budget, see MatchStepLimit. Rules run
+     * one by one are skipped when the prefilter rules them out. With a lexer,
+     * the rules it compiles are matched by a single scan of the automaton and
+     * only the others run one by one.
+     *
+     * @param previousState The state the previous block ended in.
+     * @return The state this block ends in: 0, or 1 + the index of the open region.
+     */
+    static int tokenize(const RuleSet &ruleSet, const QString &text, int previousState,
+                        QVector<SyntaxToken> &tokens);
+
+private:
+    void compileRules();
+    std::shared_ptr<MatchGuard> createGuard();
+    void budgetExceeded(int rule, bool disabled);
+    void applyTokens(const QVector<SyntaxToken> &tokens);
+    const QTextCharFormat &tokenFormat(int rule) const;
+
+    QString m_language;
+    std::shared_ptr<MatchGuard> m_guard;
+    std::shared_ptr<const SyntaxPrefilter> m_prefilter;
+    std::shared_ptr<const SyntaxLexer> m_lexer;
+    bool m_lexerEnabled = false;
+    std::unique_ptr<HighlightScheduler> m_scheduler;
 };
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Syntax.h"
+
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+/**
+ * @class SyntaxLexer
+ * @brief Deterministic automaton compiled from the rules of a language, scanning a block once.
+ *
+ * Rules made of literals, character classes, groups, alternations and
+ * greedy quantifiers, with \\b or ^ at their start and \\b or $ at their
+ * end, are compiled together into one DFA: a Thompson NFA per rule, then
+ * the subset construction over classes of characters that no rule tells
+ * apart. A block is scanned left to right: at each position the automaton
+ * runs until no rule can match further, the match of the highest priority
+ * rule, then the longest, becomes a token, and scanning resumes at its end.
+ * Inside a token, the rules of a higher priority are looked for with an
+ * automaton of those rules only, so that an escape still splits a string
+ * as on the regex path.
+ *
+ * The tokens differ from those of the regex path in two ways. Matches are
+ * the longest ones, where PCRE takes the first alternative that matches:
+ * "==" against =|== is one token instead of two of the same rule. And a
+ * rule that lost to a token of another rule is looked for again after it:
+ * the comment after "#fff" is found even though # in the string, where the
+ * regex path finds it, lost to the string.
+ *
+ * The other rules (lookaround, backreferences, lazy quantifiers, non-ASCII
+ * characters...) keep the per-rule regex path; fallbackRules() tells which
+ * and why. A language opts in with "engine: lexer".
+ */
+class SyntaxLexer
+{
+public:
+    struct Fallback
+    {
+        int rule;
+        QString reason;
+    };
+
+    // States of an automaton beyond which the rule being added falls back
+    static constexpr int MaxStates = 4096;
+
+    explicit SyntaxLexer(const QVector<Syntax::SyntaxRule> &rules);
+    ~SyntaxLexer();
+
+    /**
+     * @brief Appends the tokens of the compiled rules from position from to the end of the block.
+     *
+     * Tokens are sorted by start. They do not overlap, except for tokens of
+     * a higher priority inside another one, left to resolveOverlaps().
+     */
+    void tokenize(const QString &text, qsizetype from, QVector<SyntaxToken> &tokens) const;
+
+    // Whether a rule is matched by the automaton rather than one by one
+    bool compiles(int rule) const;
+    int compiledRules() const;
+    const QVector<Fallback> &fallbackRules() const;
+
+    // Why a pattern cannot be compiled into the automaton; empty if it can
+    static QString unsupportedReason(const QRegularExpression &pattern);
+
+private:
+    struct Automaton;
+
+    // Tokens starting at or after from and ending by limit
+    void scan(const Automaton &automaton, const QString &text, qsizetype from, qsizetype limit,
+              QVector<SyntaxToken> &tokens) const;
+
+    // Automaton of the rules above a priority, for the tokens inside one of that priority
+    const Automaton *nested(int priority) const;
+
+    std::unique_ptr<Automaton> m_automaton;
+    std::vector<std::pair<int, std::unique_ptr<Automaton>>> m_nested;
+    std::vector<bool> m_compiled;
+    QVector<Fallback> m_fallbacks;
+};
@@ -13,8 +13,8 @@
  * @brief Manages the creation of syntax highlighters for different file types.
  *
  * The SyntaxManager class provides functionality to create syntax highlighters
- * based on file extensions. It supports dynamic creation of highlighters by
- * utilizing configuration data and applies them to QTextDocument objects.
+ * based on file extensions. Language definitions are looked up in the
+ * SyntaxRegistry, so the YAML configuration is only parsed once per process.
  *
  * @note This class is designed to work with the Qt framework and YAML configuration.
  */
@@ -29,7 +29,4 @@ public:
      */
     static std::unique_ptr<QSyntaxHighlighter> createSyntaxHighlighter(const QString &extension, QTextDocument *doc);
     static void initializeUserSyntaxConfig();
-
-private:
-    static std::unique_ptr<QSyntaxHighlighter> createHighlighter(QTextDocument *doc, const std::vector<YAML::Node> &config, const QString &extension);
 };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Syntax.h"
+
+#include <QString>
+#include <QVector>
+#include <array>
+#include <bitset>
+#include <optional>
+
+/**
+ * @class SyntaxPrefilter
+ * @brief Skips the rules that cannot match a block, from the characters it contains.
+ *
+ * Each rule gets a signature: a set of ASCII characters, at least one of
+ * which is part of any match of its pattern (the `"` of a string rule, the
+ * digits of a number rule...). The signatures of a language are spread
+ * over up to 32 probes (a character or a character range). A block is
+ * scanned once, with SSE2/AVX2 when available, to find the probes present
+ * in it; a rule none of whose probes is present is not run at all.
+ *
+ * Rules whose required characters cannot be derived (such as `\\w+`), or
+ * would need too many probes, have no signature and always run.
+ */
+class SyntaxPrefilter
+{
+public:
+    using CharacterSet = std::bitset<128>;
+
+    explicit SyntaxPrefilter(const QVector<Syntax::SyntaxRule> &rules);
+
+    // Bit i is set if probe i occurs in the text
+    quint32 scan(const QString &text) const;
+
+    bool canMatch(int rule, quint32 present) const
+    {
+        const quint32 signature = rule < m_signatures.size() ? m_signatures[rule] : 0;
+        return signature == 0 || (signature & present) != 0;
+    }
+
+    // Number of rules that have a signature, and may be skipped
+    int filteredRules() const;
+
+    /**
+     * @brief Derives the characters at least one of which any match must contain.
+     * @return Nothing if the pattern could match without any characters we can tell.
+     */
+    static std::optional<CharacterSet> requiredCharacters(const QRegularExpression &pattern);
+
+private:
+    struct Probe
+    {
+        char16_t low;
+        char16_t high;
+    };
+
+    quint32 scanScalar(const char16_t *data, qsizetype begin, qsizetype end, quint32 found) const;
+    quint32 scanSse2(const char16_t *data, qsizetype size) const;
+    quint32 scanAvx2(const char16_t *data, qsizetype size) const;
+
+    QVector<Probe> m_probes;
+    QVector<quint32> m_signatures;        // Probes of each rule, 0 if always run
+    std::array<quint32, 128> m_charProbes{}; // Probes each ASCII character belongs to
+    quint32 m_allProbes = 0;
+};
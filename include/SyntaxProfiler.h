@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+
+/**
+ * @class SyntaxProfiler
+ * @brief Process-wide statistics of the time spent in each highlighting rule.
+ *
+ * When enabled, Syntax::tokenize records, for every rule it runs, the time
+ * spent matching, the number of matches and the bytes scanned. Statistics
+ * are kept per language config file and rule index, so that two rules
+ * sharing a pattern stay apart, and the slowest rules of a definition can
+ * be ranked and fixed. The prefilter scan, the lexer scan, region
+ * matching and overlap resolution have entries of their own. Disabled by
+ * default; the cost is then a single atomic load per block.
+ */
+class SyntaxProfiler
+{
+public:
+    static SyntaxProfiler &getInstance()
+    {
+        static SyntaxProfiler instance;
+        return instance;
+    }
+    SyntaxProfiler(const SyntaxProfiler &) = delete;
+    SyntaxProfiler &operator=(const SyntaxProfiler &) = delete;
+
+    // Work of a block done outside the rules, recorded under negative indices
+    static constexpr int Prefilter = -1;
+    static constexpr int Regions   = -2;
+    static constexpr int Overlaps  = -3;
+    static constexpr int Lexer     = -4;
+
+    // One rule run over one block, or over the part of it after a region
+    struct Sample
+    {
+        int rule;      // Index in the rules of the language, or one of the values above
+        QString label; // Pattern of the rule, or a name such as "<regions>"
+        qint64 nanoseconds;
+        qint64 matches;
+        qint64 bytes;
+    };
+
+    struct RuleStats
+    {
+        int rule = 0;
+        QString label;
+        qint64 nanoseconds = 0;
+        qint64 matches     = 0;
+        qint64 bytes       = 0;
+        qint64 blocks      = 0; // Blocks the rule ran over, once however many samples each gave
+    };
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Adds the samples of one block; thread-safe
+    void record(const QString &language, const QVector<Sample> &samples);
+
+    QStringList languages() const;
+
+    // Statistics of every rule of a language, slowest first
+    QVector<RuleStats> ranking(const QString &language) const;
+
+    /**
+     * @brief Formats the ranking of every language as a plain text table.
+     * @param limit Maximum number of rules listed per language.
+     */
+    QString report(int limit = 10) const;
+
+    // Writes the report to the debug output
+    void dump() const;
+
+    void reset();
+
+private:
+    SyntaxProfiler()  = default;
+    ~SyntaxProfiler() = default;
+
+    std::atomic_bool m_enabled{false};
+    mutable QMutex m_mutex;
+    QHash<QString, QHash<int, RuleStats>> m_stats; // Language -> rule index -> stats
+};
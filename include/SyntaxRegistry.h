@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Syntax.h"
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QFileSystemWatcher>
+#include <memory>
+
+/**
+ * @struct SyntaxDefinition
+ * @brief An immutable, compiled language definition shared by every document
+ *        of that language.
+ */
+struct SyntaxDefinition
+{
+    QString name;           // Config file the definition was loaded from
+    QStringList extensions;
+    QVector<Syntax::SyntaxRule> rules;
+    QVector<Syntax::RegionRule> regions;
+    std::shared_ptr<const SyntaxPrefilter> prefilter;
+    std::shared_ptr<const SyntaxLexer> lexer; // Only for languages with "engine: lexer"
+};
+
+/**
+ * @class SyntaxRegistry
+ * @brief Process-wide cache of the language definitions found in the syntax
+ *        config directory.
+ *
+ * The registry parses every YAML file of the syntax directory once, keys the
+ * resulting definitions by file extension and hands out shared, immutable
+ * definitions to the highlighters. The directory and its files are watched,
+ * and the cache is dropped as soon as one of them changes on disk.
+ *
+ * The bundled languages are compiled into static tables at build time (see
+ * BundledSyntax.h) and built on first lookup, without any YAML parsing.
+ * Files of the syntax directory override them; unmodified copies of the
+ * bundled files are recognized by their hash and skipped.
+ */
+class SyntaxRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SyntaxRegistry &getInstance()
+    {
+        static SyntaxRegistry instance;
+        return instance;
+    }
+    SyntaxRegistry(const SyntaxRegistry &) = delete;
+    SyntaxRegistry &operator=(const SyntaxRegistry &) = delete;
+
+    /**
+     * @brief Returns the definition registered for a file extension.
+     * @param extension The file extension (e.g., "cpp", "py").
+     * @return The shared definition, or nullptr if no language claims the extension.
+     */
+    std::shared_ptr<const SyntaxDefinition> definitionForExtension(const QString &extension);
+
+    /**
+     * @brief Resolves the syntax directory: CONFIG_DIR, then the user config
+     *        directory, then the local "config" directory.
+     */
+    static QString syntaxDirectory();
+
+    // Drop every cached definition; the next lookup reloads the directory.
+    void invalidate();
+
+signals:
+    void definitionsChanged();
+
+private:
+    SyntaxRegistry();
+    ~SyntaxRegistry() = default;
+
+    void ensureLoaded();
+    void loadDirectory(const QString &directory);
+    std::shared_ptr<const SyntaxDefinition> bundledDefinition(const QString &extension);
+    void watch(const QString &directory, const QStringList &files);
+
+    QHash<QString, std::shared_ptr<const SyntaxDefinition>> m_definitions;
+    QFileSystemWatcher m_watcher;
+    QString m_loadedDirectory;
+    bool m_loaded = false;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QStringConverter>
+
+/**
+ * @struct TextFormat
+ * @brief How a text file is stored on disk: encoding, BOM and line endings.
+ *
+ * Documents always hold '\n' line endings. The format a file was loaded
+ * with is kept alongside its document, so that saving writes the same
+ * encoding, BOM and line endings back.
+ *
+ * detect() looks at the start of a file only: a BOM, then NUL bytes typical
+ * of UTF-16 without BOM, then UTF-8 validity. Text that is not valid UTF-8
+ * is taken as Latin-1, which maps every byte to a character and back, so
+ * that such files are not rewritten with replacement characters. A load
+ * that finds invalid UTF-8 past the sample starts over as Latin-1, for the
+ * same reason.
+ *
+ * Saving writes lineEnding after every line: a file whose line endings
+ * were mixed is flagged by the load, which cannot keep them.
+ */
+struct TextFormat
+{
+    enum class LineEnding
+    {
+        LF,
+        CRLF,
+        CR
+    };
+
+    QStringConverter::Encoding encoding = QStringConverter::Utf8;
+    bool bom                            = false;
+    LineEnding lineEnding               = LineEnding::LF;
+    bool mixedLineEndings               = false; // Set by a load, not by detect()
+
+    // Bytes looked at by detect()
+    static constexpr qsizetype SampleSize = 64 * 1024;
+
+    static TextFormat detect(QByteArrayView sample);
+
+    // Whether every byte is below 0x80, scanned 16 or 32 bytes at a time
+    static bool isAscii(QByteArrayView bytes);
+
+    // Whether bytes are valid UTF-8, a sequence cut by the end of the sample aside
+    static bool isValidUtf8Prefix(QByteArrayView bytes);
+
+    // Encodes text with '\n' line endings; false in lossless if a character had no encoding
+    QByteArray encode(const QString &text, bool *lossless = nullptr) const;
+
+    // Such as "UTF-8, CRLF"
+    QString name() const;
+
+    bool operator==(const TextFormat &other) const = default;
+};
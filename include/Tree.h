@@ -6,11 +6,14 @@
 #include <QObject>
 #include <memory>
 #include <QFileInfo>
+#include <QStringList>
 
 // Forward declarations
 class QTreeView;
-class QFileSystemModel;
+class FileTreeModel;
+class PathIndex;
 class QFileIconProvider;
+class BatchJob;
 
 /**
  * @class Tree
@@ -32,15 +35,33 @@ public:
     void setupTree();
     void openFile(const QModelIndex &index);
 
-    QFileSystemModel* getModel() const;
+    FileTreeModel* getModel() const;
+
+    // Every file of the project, for "go to file"
+    PathIndex* pathIndex() const;
 
 private:
     void showContextMenu(const QPoint &pos);
     QFileInfo getPathInfo();
+
+    // Copies in the background, reporting progress, then calls isSuccessful()
+    void duplicatePath(const QFileInfo &pathInfo);
+
+    // The selected rows, or the current one when nothing is selected
+    QStringList selectedPaths() const;
+
+    void showBatchContextMenu(const QPoint &pos, const QStringList &paths);
+    void moveToFolder(const QStringList &paths);
+
+    // Runs the job with a progress dialog, and reports its result once done
+    void runBatch(BatchJob *job);
+
+    void hideDetailColumns();
     void isSuccessful(OperationResult result);
 
     std::unique_ptr<QFileIconProvider> m_iconProvider;
-    std::unique_ptr<QFileSystemModel> m_model;
+    std::unique_ptr<FileTreeModel> m_model;
+    std::unique_ptr<PathIndex> m_pathIndex;
     std::unique_ptr<QTreeView> m_tree;
 
 protected:
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "IgnoreRules.h"
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+class QLockFile;
+
+/**
+ * @class TrigramIndex
+ * @brief On-disk index of the trigrams of every file of a project, to narrow searches.
+ *
+ * A file can only hold a text if it holds each of its trigrams, its runs
+ * of three bytes, so a search only needs to read the files listed under
+ * all of them. ASCII letters are folded to lower case, which makes the
+ * index serve searches with and without case alike. Files are indexed by
+ * their text in UTF-8, the form searches look for: UTF-16 and Latin-1
+ * files are decoded first, with the format ProjectSearch detects.
+ *
+ * The index is a stack of immutable segment files, memory-mapped rather
+ * than read: each lists its files sorted by path, then for each trigram
+ * the numbers of the files holding it, stored as variable-length gaps.
+ * Files read since the last segment are kept in memory, and written as a
+ * new segment once there are enough of them, merged with the newest
+ * segments while those are not much larger; a project of n files thus
+ * has about log n segments.
+ *
+ * Segments are checked in full when the project is opened. One found
+ * damaged then or by a later read stops the index from narrowing
+ * searches, and it is removed and built again from every file.
+ *
+ * Opening a project compares the size and time of its files with the
+ * segments in the background, and reads the new and changed ones again.
+ * Then directories are followed through the DirectoryWatcher the tree
+ * uses: a file replaced, created or removed is seen, and on Linux one
+ * rewritten in place as well; elsewhere the latter is only seen when the
+ * project is opened again. Files not read yet are always candidates, so
+ * the index makes a search read fewer files, never miss one.
+ */
+class TrigramIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int MaxWorkers           = 4;
+    static constexpr int UpdateInterval       = 200; // ms
+    static constexpr int BatchSize            = 64;  // Files read by one job
+    static constexpr int MinSegmentFiles      = 1024;
+    static constexpr qint64 MaxFileSize       = 256 * 1024 * 1024; // Larger files are always candidates
+    static constexpr qint64 MaxMemoryPostings = 8 * 1024 * 1024;   // Trigrams of the files in memory
+
+    explicit TrigramIndex(QObject *parent = nullptr);
+
+    // Waits for the workers, which may be writing a segment
+    ~TrigramIndex();
+
+    // ~/.config/codeastra/index, with one directory per project
+    static QString defaultDirectory();
+
+    // Where indexes are kept, from the next setRootPath()
+    void setDirectory(const QString &directory);
+    QString directory() const;
+
+    // Patterns applied before those of the ignore files, from the next setRootPath()
+    void setExcludes(const IgnoreRules &excludes);
+
+    // Opens the index of the files below path, and brings it up to date in the background
+    void setRootPath(const QString &path);
+    QString rootPath() const;
+
+    // Stops following the project, leaving its index on disk
+    void close();
+
+    // Closes the index and deletes it
+    void removeIndex();
+
+    // Whether an index of the project at path was written
+    bool hasIndex(const QString &path) const;
+
+    // The files of the project were all listed: candidates() narrows from then on
+    bool isReady() const;
+
+    // Files read, and files left to read
+    int fileCount() const;
+    int pendingCount() const;
+
+    // Bytes of the segment files
+    qint64 diskUsage() const;
+
+    // Files, relative to the root, that may hold text, which is UTF-8; nullopt
+    // when the index cannot tell, for a text shorter than a trigram or before isReady()
+    std::optional<QStringList> candidates(const QByteArray &text) const;
+
+    // The distinct trigrams of data, sorted, ASCII letters folded, none spanning a line break
+    static std::vector<quint32> trigramsOf(const char *data, qsizetype size);
+
+signals:
+    // The files of the project were all listed
+    void ready();
+
+    // Every file known was read and the index written, each time it catches up
+    void indexed();
+
+private:
+    using RuleChain = std::vector<std::shared_ptr<const IgnoreRules>>;
+
+    enum Flag : quint32
+    {
+        Binary    = 1, // Never a candidate
+        Unindexed = 2  // Always one
+    };
+
+    struct Segment;
+
+    struct Document
+    {
+        QByteArray path; // Relative to the root
+        qint64 size     = 0;
+        qint64 modified = 0; // ms since the epoch
+        quint32 flags   = 0;
+        std::vector<quint32> trigrams;
+    };
+
+    // The files of a segment, or of the memory while it is written
+    struct Layer
+    {
+        std::shared_ptr<const Segment> segment;
+        std::shared_ptr<const std::vector<Document>> documents; // Sorted by path
+        std::vector<quint8> removed;                           // Changed or deleted since
+        int removedCount = 0;
+
+        quint32 count() const;
+        QByteArrayView path(quint32 id) const;
+        bool isCurrent(quint32 id, qint64 size, qint64 modified) const;
+        qint64 find(QByteArrayView path) const;
+
+        // Files whose path starts with prefix
+        std::pair<quint32, quint32> range(QByteArrayView prefix) const;
+
+        // Files not removed that hold every trigram, or are not indexed
+        std::vector<quint32> matching(const std::vector<quint32> &trigrams) const;
+
+        void remove(quint32 id);
+    };
+
+    struct FileState
+    {
+        QString name;
+        qint64 size     = 0;
+        qint64 modified = 0;
+    };
+
+    // A directory read by a worker, its entries filtered
+    struct Listing
+    {
+        QString directory; // Relative to the root, "" for the root
+        std::vector<FileState> files;
+        QStringList subdirectories;
+        std::shared_ptr<const IgnoreRules> rules;
+    };
+
+    struct Written
+    {
+        std::shared_ptr<const Segment> segment;
+        std::vector<std::pair<quint32, quint32>> sources; // Input and file each file of the segment comes from
+    };
+
+    // Reads directories, and everything below them when recursive, on the calling thread
+    static std::vector<Listing> list(const QString &root, const QStringList &directories, bool recursive,
+                                     const RuleChain &excludes,
+                                     const QHash<QString, std::shared_ptr<const IgnoreRules>> &rules,
+                                     const std::atomic<bool> &cancelled);
+
+    // Removes from layers the files not listed or changed since, and returns the paths to read again
+    static std::vector<QByteArray> reconcile(std::vector<Layer> &layers, const std::vector<Listing> &listings);
+
+    static std::optional<Document> read(const QString &root, const QByteArray &path);
+
+    // Merges the files of inputs still current into a new segment at path
+    static std::optional<Written> write(const QString &path, const std::vector<Layer> &inputs,
+                                        const std::atomic<bool> &cancelled);
+
+    QString indexPathOf(const QString &rootPath) const;
+    QString segmentPath(quint64 sequence) const;
+    void openSegments();
+    void onScanned(std::vector<Layer> layers, const std::vector<Listing> &listings,
+                   const std::vector<QByteArray> &changed);
+
+    void watch(const std::vector<Listing> &listings);
+    QString relativeDirectory(const QString &path) const;
+    void onDirectoryChanged(const QString &path);
+    void onFileWritten(const QString &directory, const QString &name);
+    void onOverflowed();
+    void flushChanges();
+    void scan(const QString &directory, bool recursive);
+    void applyListings(const QString &scope, bool recursive, const std::vector<Listing> &listings);
+
+    // A segment failed to read: candidates() cannot tell until rebuild() read every file again
+    bool isDamaged() const;
+    void rebuild();
+
+    bool isCurrent(const QByteArray &path, qint64 size, qint64 modified) const;
+    bool isListed(const QByteArray &path) const;
+    void markChanged(const QByteArray &path);
+    void removeCurrent(const QByteArray &path);
+
+    void readNext();
+    void applyDocuments(std::vector<std::pair<QByteArray, std::optional<Document>>> &documents);
+    void writeNext();
+    void onWritten(size_t first, std::optional<Written> &written);
+    void checkIndexed();
+
+    QString m_directory;
+    QString m_rootPath;
+    QString m_indexPath; // Of the project
+    RuleChain m_excludes;
+    std::unique_ptr<QLockFile> m_lock;
+    std::shared_ptr<std::atomic<bool>> m_cancelled; // Of the jobs of the project
+    int m_generation       = 0;
+    bool m_ready           = false;
+    bool m_writing         = false;
+    bool m_caughtUp        = false;
+    quint64 m_nextSequence = 1;
+
+    std::vector<Layer> m_layers;             // Oldest first
+    std::map<QByteArray, Document> m_memory; // Read since the last segment
+    qint64 m_memoryPostings = 0;
+    QSet<QByteArray> m_pending;              // To read
+    QSet<QByteArray> m_reading;
+    int m_readJobs = 0;
+
+    QSet<QString> m_directories;
+    QHash<QString, std::shared_ptr<const IgnoreRules>> m_rules; // Of directories with ignore files
+    QSet<QString> m_watched; // Absolute paths held on the DirectoryWatcher
+    QSet<QString> m_changedDirectories;
+    QSet<QByteArray> m_writtenFiles;
+    QTimer m_updateTimer;
+
+    QThreadPool m_pool;
+};
@@ -0,0 +1,242 @@
+#include "BatchJob.h"
+#include "CopyJob.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <algorithm>
+#include <filesystem>
+
+BatchJob::BatchJob(Operation operation, const QStringList &paths, const QString &destination, QObject *parent)
+    : QObject(parent),
+      m_operation(operation),
+      m_paths(topLevelPaths(paths)),
+      m_destination(destination.isEmpty() ? QString() : QDir::cleanPath(QFileInfo(destination).absoluteFilePath()))
+{
+    m_pool.setMaxThreadCount(1);
+
+    m_progressTimer.setInterval(ProgressInterval);
+    connect(&m_progressTimer, &QTimer::timeout, this, [this]()
+    {
+        emit progress(m_done, static_cast<int>(m_paths.size()));
+    });
+}
+
+BatchJob::~BatchJob()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void BatchJob::start()
+{
+    if (m_running)
+    {
+        return;
+    }
+
+    m_running = true;
+    m_progressTimer.start();
+    m_pool.start([this]()
+    {
+        const OperationResult result = execute();
+        QMetaObject::invokeMethod(this, [this, result]()
+        {
+            m_running = false;
+            m_progressTimer.stop();
+            emit progress(m_done, static_cast<int>(m_paths.size()));
+            emit finished(result.success, QString::fromStdString(result.message));
+        }, Qt::QueuedConnection);
+    });
+}
+
+OperationResult BatchJob::run()
+{
+    return execute();
+}
+
+void BatchJob::cancel()
+{
+    m_cancelled = true;
+}
+
+bool BatchJob::isCancelled() const
+{
+    return m_cancelled;
+}
+
+bool BatchJob::isRunning() const
+{
+    return m_running;
+}
+
+BatchJob::Operation BatchJob::operation() const
+{
+    return m_operation;
+}
+
+QStringList BatchJob::paths() const
+{
+    return m_paths;
+}
+
+QStringList BatchJob::topLevelPaths(const QStringList &paths)
+{
+    QStringList cleaned;
+    cleaned.reserve(paths.size());
+    for (const QString &path : paths)
+    {
+        cleaned << QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    }
+
+    // Shorter paths first: an ancestor is always kept before its descendants are checked
+    std::sort(cleaned.begin(), cleaned.end(), [](const QString &a, const QString &b)
+    {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+
+    QSet<QString> kept;
+    QStringList result;
+    for (const QString &path : cleaned)
+    {
+        bool covered = kept.contains(path);
+        for (qsizetype slash = path.lastIndexOf('/'); !covered && slash > 0; slash = path.lastIndexOf('/', slash - 1))
+        {
+            covered = kept.contains(path.left(slash));
+        }
+
+        if (!covered)
+        {
+            kept.insert(path);
+            result << path;
+        }
+    }
+
+    return result;
+}
+
+OperationResult BatchJob::execute()
+{
+    const char *verb = m_operation == Operation::Delete    ? "deleted"
+                     : m_operation == Operation::Duplicate ? "duplicated"
+                                                           : "moved";
+
+    QStringList failures;
+    int failed = 0;
+    for (const QString &path : m_paths)
+    {
+        if (m_cancelled)
+        {
+            break;
+        }
+
+        const OperationResult result = apply(path);
+        if (!result.success)
+        {
+            if (++failed <= MaxReportedFailures)
+            {
+                failures << QString::fromStdString(result.message);
+            }
+        }
+        ++m_done;
+    }
+
+    const int total     = static_cast<int>(m_paths.size());
+    const int succeeded = m_done - failed;
+    std::string message = std::to_string(succeeded) + " of " + std::to_string(total) + " items " + verb + ".";
+    if (m_cancelled && m_done < total)
+    {
+        message += " Cancelled.";
+    }
+    if (failed > 0)
+    {
+        message += "\n" + failures.join('\n').toStdString();
+        if (failed > MaxReportedFailures)
+        {
+            message += "\n... and " + std::to_string(failed - MaxReportedFailures) + " more.";
+        }
+    }
+
+    qDebug() << "[BatchJob]" << QString::fromStdString(message);
+
+    return {failed == 0 && m_done == total, message};
+}
+
+OperationResult BatchJob::apply(const QString &path) const
+{
+    const QFileInfo pathInfo(path);
+    if (!pathInfo.exists() && !pathInfo.isSymLink())
+    {
+        return {false, "ERROR: path does not exist: " + pathInfo.fileName().toStdString()};
+    }
+
+    switch (m_operation)
+    {
+    case Operation::Delete:
+        // Same rule as FileManager::deletePath(), without its dialog: this is a worker thread
+        if (pathInfo.absolutePath() == "/" || pathInfo.absolutePath() == QDir::homePath())
+        {
+            return {false, "ERROR: cannot delete system or home directory: " + path.toStdString()};
+        }
+        if (!QFile::moveToTrash(path))
+        {
+            return {false, "ERROR: failed to delete: " + path.toStdString()};
+        }
+        return {true, pathInfo.fileName().toStdString() + " deleted successfully."};
+
+    case Operation::Duplicate:
+        return FileManager::duplicatePath(pathInfo);
+
+    case Operation::Move:
+        return move(path);
+    }
+
+    return {false, "ERROR: unknown operation."};
+}
+
+OperationResult BatchJob::move(const QString &path) const
+{
+    if (m_destination.isEmpty() || !QFileInfo(m_destination).isDir())
+    {
+        return {false, "ERROR: invalid destination folder."};
+    }
+    if (m_destination == path || m_destination.startsWith(path + '/'))
+    {
+        return {false, "ERROR: cannot move " + path.toStdString() + " into itself."};
+    }
+
+    const std::filesystem::path source = path.toStdString();
+    const std::filesystem::path target = std::filesystem::path(m_destination.toStdString()) / source.filename();
+    if (source.parent_path() == target.parent_path())
+    {
+        return {true, source.filename().string() + " is already there."};
+    }
+
+    std::error_code error;
+    if (std::filesystem::exists(std::filesystem::symlink_status(target, error)))
+    {
+        return {false, target.filename().string() + " already exists in the destination."};
+    }
+
+    std::filesystem::rename(source, target, error);
+    if (error == std::errc::cross_device_link)
+    {
+        // Another filesystem: copy, then remove the source once the copy is complete
+        CopyJob copy(path, QString::fromStdString(target.string()));
+        const OperationResult copied = copy.run();
+        if (!copied.success)
+        {
+            return copied;
+        }
+        std::filesystem::remove_all(source, error);
+    }
+
+    if (error)
+    {
+        return {false, "ERROR: cannot move " + source.filename().string() + ": " + error.message()};
+    }
+
+    return {true, source.filename().string() + " moved successfully."};
+}
@@ -246,6 +246,31 @@ void CodeEditor::updateLineNumberArea(const QRect &rect, int dy)
     {
         updateLineNumberAreaWidth(0);
     }
+
+    QPair<int, int> visibleBlocks = visibleBlockRange();
+    if (visibleBlocks != m_visibleBlocks)
+    {
+        m_visibleBlocks = visibleBlocks;
+        emit visibleBlocksChanged(visibleBlocks.first, visibleBlocks.second);
+    }
+}
+
+QPair<int, int> CodeEditor::visibleBlockRange()
+{
+    QTextBlock block = firstVisibleBlock();
+    int first        = block.blockNumber();
+    int last         = first;
+    int top          = qRound(blockBoundingGeometry(block).translated(contentOffset()).top());
+    int height       = viewport()->height();
+
+    for (int number = first; block.isValid() && top <= height; ++number)
+    {
+        last  = number;
+        top  += qRound(blockBoundingRect(block).height());
+        block = block.next();
+    }
+
+    return {first, last};
 }
 
 void CodeEditor::resizeEvent(QResizeEvent *e)
@@ -0,0 +1,424 @@
+#include "CopyJob.h"
+
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    QString toQString(const std::filesystem::path &path)
+    {
+        return QString::fromStdString(path.string());
+    }
+}
+
+CopyJob::CopyJob(const QString &source, const QString &target, QObject *parent)
+    : QObject(parent),
+      m_source(source.toStdString()),
+      m_target(target.toStdString())
+{
+    m_runner.setMaxThreadCount(1);
+    m_workers.setMaxThreadCount(std::clamp(QThread::idealThreadCount(), 1, MaxWorkers));
+
+    m_progressTimer.setInterval(ProgressInterval);
+    connect(&m_progressTimer, &QTimer::timeout, this, [this]()
+    {
+        emit progress(copiedBytes(), totalBytes());
+    });
+}
+
+CopyJob::~CopyJob()
+{
+    cancel();
+    m_runner.waitForDone();
+    m_workers.waitForDone();
+}
+
+void CopyJob::start()
+{
+    if (m_running)
+    {
+        return;
+    }
+
+    m_running = true;
+    m_progressTimer.start();
+    m_runner.start([this]()
+    {
+        const OperationResult result = execute();
+        QMetaObject::invokeMethod(this, [this, result]()
+        {
+            m_running = false;
+            m_progressTimer.stop();
+            emit progress(copiedBytes(), totalBytes());
+            emit finished(result.success, QString::fromStdString(result.message));
+        }, Qt::QueuedConnection);
+    });
+}
+
+OperationResult CopyJob::run()
+{
+    return execute();
+}
+
+void CopyJob::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cancelled = true;
+    m_wake.wakeAll();
+}
+
+bool CopyJob::isCancelled() const
+{
+    return m_cancelled;
+}
+
+bool CopyJob::isRunning() const
+{
+    return m_running;
+}
+
+QString CopyJob::source() const
+{
+    return toQString(m_source);
+}
+
+QString CopyJob::target() const
+{
+    return toQString(m_target);
+}
+
+qint64 CopyJob::copiedBytes() const
+{
+    return m_copiedBytes;
+}
+
+qint64 CopyJob::totalBytes() const
+{
+    return m_totalBytes;
+}
+
+OperationResult CopyJob::execute()
+{
+    std::error_code error;
+    const std::filesystem::file_status status = std::filesystem::symlink_status(m_source, error);
+    if (error || !std::filesystem::exists(status))
+    {
+        return {false, "ERROR: path does not exist: " + m_source.filename().string()};
+    }
+    if (std::filesystem::exists(std::filesystem::symlink_status(m_target, error)))
+    {
+        return {false, m_target.filename().string() + " already exists."};
+    }
+
+    bool created = false;
+    if (std::filesystem::is_symlink(status))
+    {
+        std::filesystem::copy_symlink(m_source, m_target, error);
+        created = !error;
+        if (error)
+        {
+            fail(QString::fromStdString(error.message()));
+        }
+    }
+    else if (std::filesystem::is_directory(status))
+    {
+        std::filesystem::create_directory(m_target, m_source, error);
+        created = !error;
+        if (error)
+        {
+            fail(QString::fromStdString(error.message()));
+        }
+        else
+        {
+            {
+                QMutexLocker locker(&m_mutex);
+                m_directories.emplace_back(m_source, m_target);
+            }
+
+            // The calling thread walks too
+            for (int i = 1; i < m_workers.maxThreadCount(); ++i)
+            {
+                m_workers.start([this]() { walk(); });
+            }
+            walk();
+            m_workers.waitForDone();
+        }
+    }
+    else
+    {
+        // A failed copy removes its own partial target
+        created = copyFile(m_source, m_target);
+    }
+
+    if (isStopped())
+    {
+        if (created)
+        {
+            std::filesystem::remove_all(m_target, error);
+            if (error)
+            {
+                qWarning() << "[CopyJob] Cannot remove partial copy" << target() << ":" << QString::fromStdString(error.message());
+            }
+        }
+
+        if (m_failed)
+        {
+            return {false, "Cannot duplicate " + m_source.filename().string() + ": " + m_error.toStdString()};
+        }
+        return {false, "Duplication of " + m_source.filename().string() + " cancelled."};
+    }
+
+    qDebug() << "[CopyJob] Copied" << m_copiedBytes.load() << "bytes to" << target();
+
+    return {true, m_target.filename().string() + " duplicated successfully."};
+}
+
+void CopyJob::walk()
+{
+    for (;;)
+    {
+        std::pair<std::filesystem::path, std::filesystem::path> directory;
+        {
+            QMutexLocker locker(&m_mutex);
+
+            // Idle workers wait for the busy ones to discover more directories
+            while (m_directories.empty() && m_busy > 0 && !isStopped())
+            {
+                m_wake.wait(&m_mutex);
+            }
+            if (m_directories.empty() || isStopped())
+            {
+                m_wake.wakeAll();
+                return;
+            }
+
+            directory = std::move(m_directories.front());
+            m_directories.pop_front();
+            ++m_busy;
+        }
+
+        copyDirectory(directory.first, directory.second);
+
+        QMutexLocker locker(&m_mutex);
+        --m_busy;
+        m_wake.wakeAll();
+    }
+}
+
+void CopyJob::copyDirectory(const std::filesystem::path &source, const std::filesystem::path &target)
+{
+    std::error_code error;
+    std::filesystem::directory_iterator entry(source, error);
+    for (; !error && entry != std::filesystem::directory_iterator(); entry.increment(error))
+    {
+        if (isStopped())
+        {
+            return;
+        }
+
+        const std::filesystem::path from          = entry->path();
+        const std::filesystem::path to            = target / from.filename();
+        const std::filesystem::file_status status = entry->symlink_status(error);
+        if (error)
+        {
+            break;
+        }
+
+        // Links are copied as links, which also keeps a link to a parent from looping
+        if (std::filesystem::is_symlink(status))
+        {
+            std::filesystem::copy_symlink(from, to, error);
+        }
+        else if (std::filesystem::is_directory(status))
+        {
+            std::filesystem::create_directory(to, from, error);
+            if (!error)
+            {
+                QMutexLocker locker(&m_mutex);
+                m_directories.emplace_back(from, to);
+                m_wake.wakeOne();
+            }
+        }
+        else if (std::filesystem::is_regular_file(status))
+        {
+            if (!copyFile(from, to))
+            {
+                return;
+            }
+        }
+        else
+        {
+            qWarning() << "[CopyJob] Skipping special file" << toQString(from);
+        }
+
+        if (error)
+        {
+            fail(toQString(from) + ": " + QString::fromStdString(error.message()));
+            return;
+        }
+    }
+
+    if (error)
+    {
+        fail(toQString(source) + ": " + QString::fromStdString(error.message()));
+    }
+}
+
+bool CopyJob::copyFile(const std::filesystem::path &source, const std::filesystem::path &target)
+{
+#ifdef Q_OS_LINUX
+    const int in = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+    {
+        fail(toQString(source) + ": " + QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(in, &info) != 0)
+    {
+        fail(toQString(source) + ": " + QString::fromLocal8Bit(std::strerror(errno)));
+        ::close(in);
+        return false;
+    }
+    m_totalBytes += info.st_size;
+
+    const int out = ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, info.st_mode & 07777);
+    if (out < 0)
+    {
+        fail(toQString(target) + ": " + QString::fromLocal8Bit(std::strerror(errno)));
+        ::close(in);
+        return false;
+    }
+
+    bool copied = copyContents(in, out, info.st_size);
+    ::close(in);
+    if (::close(out) != 0 && copied)
+    {
+        fail(toQString(target) + ": " + QString::fromLocal8Bit(std::strerror(errno)));
+        copied = false;
+    }
+    if (!copied)
+    {
+        ::unlink(target.c_str());
+    }
+    return copied;
+#else
+    std::error_code error;
+    const std::uintmax_t size = std::filesystem::file_size(source, error);
+    if (!error)
+    {
+        m_totalBytes += static_cast<qint64>(size);
+        std::filesystem::copy_file(source, target, error);
+    }
+    if (error)
+    {
+        fail(toQString(source) + ": " + QString::fromStdString(error.message()));
+        return false;
+    }
+
+    m_copiedBytes += static_cast<qint64>(size);
+    return true;
+#endif
+}
+
+bool CopyJob::copyContents(int in, int out, qint64 size)
+{
+#ifdef Q_OS_LINUX
+    // Shares the extents on btrfs, XFS...: no data is copied at all
+    if (size > 0 && ::ioctl(out, FICLONE, in) == 0)
+    {
+        m_copiedBytes += size;
+        return true;
+    }
+
+    // Both calls continue from the file offsets, so a fallback resumes where the kernel copy stopped
+    bool kernelCopy = true;
+    std::vector<char> buffer;
+    for (;;)
+    {
+        if (isStopped())
+        {
+            return false;
+        }
+
+        ssize_t copied = 0;
+        if (kernelCopy)
+        {
+            copied = ::copy_file_range(in, nullptr, out, nullptr, CopyStep, 0);
+            if (copied < 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL))
+            {
+                kernelCopy = false;
+                continue;
+            }
+        }
+        else
+        {
+            buffer.resize(1024 * 1024);
+            copied = ::read(in, buffer.data(), buffer.size());
+            for (ssize_t written = 0; copied > 0 && written < copied;)
+            {
+                const ssize_t count = ::write(out, buffer.data() + written, copied - written);
+                if (count < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    copied = -1;
+                    break;
+                }
+                written += count;
+            }
+        }
+
+        if (copied < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fail(QString::fromLocal8Bit(std::strerror(errno)));
+            return false;
+        }
+        if (copied == 0)
+        {
+            return true;
+        }
+        m_copiedBytes += copied;
+    }
+#else
+    Q_UNUSED(in);
+    Q_UNUSED(out);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+void CopyJob::fail(const QString &message)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_failed)
+    {
+        m_error  = message;
+        m_failed = true;
+    }
+    m_wake.wakeAll();
+}
+
+bool CopyJob::isStopped() const
+{
+    return m_cancelled || m_failed;
+}
@@ -0,0 +1,139 @@
+#include "DirectoryReader.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_LINUX
+#include <cstdint>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef Q_OS_LINUX
+    // Layout of the records returned by getdents64(), which glibc does not declare
+    struct LinuxDirent64
+    {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    bool isDirectoryAt(int directory, const char *name, bool *isSymLink)
+    {
+        struct stat info;
+        if (::fstatat(directory, name, &info, AT_SYMLINK_NOFOLLOW) != 0)
+        {
+            return false;
+        }
+
+        *isSymLink = S_ISLNK(info.st_mode);
+        if (*isSymLink && ::fstatat(directory, name, &info, 0) != 0)
+        {
+            return false; // Dangling link
+        }
+        return S_ISDIR(info.st_mode);
+    }
+#endif
+}
+
+std::vector<DirectoryReader::Entry> DirectoryReader::read(const QString &path, bool *ok)
+{
+    std::vector<Entry> entries;
+
+#ifdef Q_OS_LINUX
+    const int directory = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (ok)
+    {
+        *ok = directory >= 0;
+    }
+    if (directory < 0)
+    {
+        return entries;
+    }
+
+    alignas(LinuxDirent64) char buffer[BufferSize];
+    for (;;)
+    {
+        const long size = ::syscall(SYS_getdents64, directory, buffer, sizeof(buffer));
+        if (size <= 0)
+        {
+            if (size < 0 && ok)
+            {
+                *ok = false;
+            }
+            break;
+        }
+
+        for (long offset = 0; offset < size;)
+        {
+            const auto *record = reinterpret_cast<const LinuxDirent64 *>(buffer + offset);
+            offset += record->d_reclen;
+
+            const char *name = record->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            Entry entry;
+            entry.name = QFile::decodeName(name);
+            switch (record->d_type)
+            {
+            case DT_DIR:
+                entry.isDirectory = true;
+                break;
+            case DT_REG:
+            case DT_FIFO:
+            case DT_SOCK:
+            case DT_CHR:
+            case DT_BLK:
+                break;
+            default: // DT_LNK, or DT_UNKNOWN on filesystems without types
+                entry.isDirectory = isDirectoryAt(directory, name, &entry.isSymLink);
+                break;
+            }
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    ::close(directory);
+#else
+    const QFileInfo info(path);
+    if (ok)
+    {
+        *ok = info.isDir() && info.isReadable();
+    }
+
+    QDirIterator it(path, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+    while (it.hasNext())
+    {
+        it.next();
+        const QFileInfo file = it.fileInfo();
+        entries.push_back({file.fileName(), file.isDir(), file.isSymLink()});
+    }
+#endif
+
+    return entries;
+}
+
+bool DirectoryReader::entry(const QString &path, Entry *entry)
+{
+    const QFileInfo info(path);
+    if (!info.exists() && !info.isSymLink())
+    {
+        return false;
+    }
+
+    entry->name        = info.fileName();
+    entry->isDirectory = info.isDir();
+    entry->isSymLink   = info.isSymLink();
+    return true;
+}
@@ -0,0 +1,213 @@
+#include "DirectoryWatcher.h"
+#include "DirectoryReader.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef Q_OS_LINUX
+    // Writes are reported as they happen, and when the file is closed
+    constexpr uint32_t WatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF
+                                 | IN_MOVE_SELF | IN_MODIFY | IN_CLOSE_WRITE | IN_ONLYDIR;
+#endif
+}
+
+DirectoryWatcher::DirectoryWatcher()
+{
+#ifdef Q_OS_LINUX
+    m_inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify < 0)
+    {
+        qWarning() << "[DirectoryWatcher] inotify unavailable, changes on disk will be missed:" << std::strerror(errno);
+    }
+    else
+    {
+        m_notifier = std::make_unique<QSocketNotifier>(m_inotify, QSocketNotifier::Read);
+        connect(m_notifier.get(), &QSocketNotifier::activated, this, &DirectoryWatcher::onEvents);
+    }
+#else
+    m_watcher = std::make_unique<QFileSystemWatcher>();
+    connect(m_watcher.get(), &QFileSystemWatcher::directoryChanged, this, [this](const QString &path)
+    {
+        emit entriesChanged(path, QString());
+    });
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#ifdef Q_OS_LINUX
+    m_notifier.reset();
+    if (m_inotify >= 0)
+    {
+        ::close(m_inotify);
+    }
+#endif
+}
+
+bool DirectoryWatcher::addWatch(const QString &path, Watch &watch)
+{
+#ifdef Q_OS_LINUX
+    if (m_inotify < 0)
+    {
+        return false;
+    }
+
+    const int descriptor = ::inotify_add_watch(m_inotify, QFile::encodeName(path).constData(), WatchMask);
+    if (descriptor < 0)
+    {
+        qWarning() << "[DirectoryWatcher] Cannot watch" << path << ":" << std::strerror(errno);
+        return false;
+    }
+    watch.descriptor = descriptor;
+    m_paths[descriptor] << path;
+    return true;
+#else
+    watch.descriptor = 0;
+    return m_watcher->addPath(path);
+#endif
+}
+
+bool DirectoryWatcher::watch(const QString &path)
+{
+    Watch &watch = m_watches[path];
+    if (watch.users > 0 && watch.descriptor >= 0)
+    {
+        ++watch.users;
+        return true;
+    }
+
+    if (!addWatch(path, watch))
+    {
+        if (watch.users == 0)
+        {
+            m_watches.remove(path);
+        }
+        return false;
+    }
+    ++watch.users;
+    return true;
+}
+
+QStringList DirectoryWatcher::watch(const QStringList &paths)
+{
+    QStringList failed;
+    for (const QString &path : paths)
+    {
+        if (!watch(path))
+        {
+            failed << path;
+        }
+    }
+    return failed;
+}
+
+void DirectoryWatcher::unwatch(const QString &path)
+{
+    const auto it = m_watches.find(path);
+    if (it == m_watches.end() || --it->users > 0)
+    {
+        return;
+    }
+
+#ifdef Q_OS_LINUX
+    const int descriptor = it->descriptor;
+    if (descriptor >= 0)
+    {
+        QStringList &paths = m_paths[descriptor];
+        paths.removeOne(path);
+        if (paths.isEmpty())
+        {
+            m_paths.remove(descriptor);
+            ::inotify_rm_watch(m_inotify, descriptor);
+        }
+    }
+#else
+    m_watcher->removePath(path);
+#endif
+    m_watches.erase(it);
+}
+
+void DirectoryWatcher::unwatch(const QStringList &paths)
+{
+    for (const QString &path : paths)
+    {
+        unwatch(path);
+    }
+}
+
+int DirectoryWatcher::watchCount() const
+{
+    return static_cast<int>(m_watches.size());
+}
+
+void DirectoryWatcher::onEvents()
+{
+#ifdef Q_OS_LINUX
+    alignas(struct inotify_event) char buffer[DirectoryReader::BufferSize];
+    for (;;)
+    {
+        const ssize_t size = ::read(m_inotify, buffer, sizeof(buffer));
+        if (size <= 0)
+        {
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < size;)
+        {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                qWarning() << "[DirectoryWatcher] inotify queue overflowed," << m_watches.size()
+                           << "directories may have changed";
+                emit overflowed();
+                continue;
+            }
+
+            const QStringList paths = m_paths.value(event->wd);
+            if (event->mask & IN_IGNORED)
+            {
+                // The watch is gone with the directory; its users still hold it, and may watch it again
+                m_paths.remove(event->wd);
+                for (const QString &path : paths)
+                {
+                    const auto it = m_watches.find(path);
+                    if (it != m_watches.end())
+                    {
+                        it->descriptor = -1;
+                    }
+                }
+                continue;
+            }
+
+            for (const QString &path : paths)
+            {
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                {
+                    emit directoryRemoved(path);
+                }
+                else if (event->len > 0 && (event->mask & (IN_MODIFY | IN_CLOSE_WRITE)))
+                {
+                    emit fileWritten(path, QFile::decodeName(event->name));
+                }
+                else if (event->len > 0)
+                {
+                    emit entriesChanged(path, QFile::decodeName(event->name));
+                }
+            }
+        }
+    }
+#endif
+}
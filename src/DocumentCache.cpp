@@ -0,0 +1,140 @@
+#include "DocumentCache.h"
+
+#include <QDebug>
+#include <algorithm>
+
+DocumentCache::DocumentCache(qint64 memoryBudget)
+    : m_memoryBudget(memoryBudget)
+{
+}
+
+qint64 DocumentCache::defaultMemoryBudget()
+{
+    bool ok                = false;
+    const qint64 megabytes = qEnvironmentVariable("DOCUMENT_CACHE_MB").toLongLong(&ok);
+    return ok && megabytes >= 0 ? megabytes * 1024 * 1024 : DefaultMemoryBudget;
+}
+
+qint64 DocumentCache::estimatedSize(const QTextDocument *document)
+{
+    return static_cast<qint64>(document->characterCount()) * static_cast<qint64>(sizeof(QChar))
+         + static_cast<qint64>(document->blockCount()) * BlockOverhead;
+}
+
+QStringList DocumentCache::insert(std::unique_ptr<CachedDocument> entry)
+{
+    remove(entry->filePath);
+
+    entry->memoryCost = estimatedSize(entry->document.get());
+    m_memoryUsage += entry->memoryCost;
+    m_entries.insert(m_entries.begin(), std::move(entry));
+
+    return evict();
+}
+
+std::unique_ptr<CachedDocument> DocumentCache::take(const QString &filePath)
+{
+    auto it = std::find_if(m_entries.begin(), m_entries.end(), [&filePath](const auto &entry)
+    {
+        return entry->filePath == filePath;
+    });
+    if (it == m_entries.end())
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<CachedDocument> entry = std::move(*it);
+    m_entries.erase(it);
+    m_memoryUsage -= entry->memoryCost;
+    return entry;
+}
+
+CachedDocument *DocumentCache::find(const QString &filePath) const
+{
+    for (const auto &entry : m_entries)
+    {
+        if (entry->filePath == filePath)
+        {
+            return entry.get();
+        }
+    }
+    return nullptr;
+}
+
+bool DocumentCache::contains(const QString &filePath) const
+{
+    return find(filePath) != nullptr;
+}
+
+void DocumentCache::remove(const QString &filePath)
+{
+    take(filePath);
+}
+
+void DocumentCache::clear()
+{
+    m_entries.clear();
+    m_memoryUsage = 0;
+}
+
+void DocumentCache::clearHighlighters()
+{
+    for (const auto &entry : m_entries)
+    {
+        delete entry->highlighter;
+    }
+}
+
+QStringList DocumentCache::filePaths() const
+{
+    QStringList paths;
+    for (const auto &entry : m_entries)
+    {
+        paths << entry->filePath;
+    }
+    return paths;
+}
+
+int DocumentCache::size() const
+{
+    return static_cast<int>(m_entries.size());
+}
+
+qint64 DocumentCache::memoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+qint64 DocumentCache::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+QStringList DocumentCache::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = bytes;
+    return evict();
+}
+
+QStringList DocumentCache::evict()
+{
+    QStringList evicted;
+    for (auto it = m_entries.end(); it != m_entries.begin() && m_memoryUsage > m_memoryBudget;)
+    {
+        --it;
+        if ((*it)->document->isModified())
+        {
+            continue;
+        }
+
+        evicted << (*it)->filePath;
+        m_memoryUsage -= (*it)->memoryCost;
+        it = m_entries.erase(it);
+    }
+
+    if (!evicted.isEmpty())
+    {
+        qDebug() << "[DocumentCache] Evicted" << evicted << "- now using" << m_memoryUsage << "bytes";
+    }
+    return evicted;
+}
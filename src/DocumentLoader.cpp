@@ -0,0 +1,528 @@
+#include "DocumentLoader.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QSemaphore>
+#include <QStringDecoder>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /*
+     * Decodes successive chunks of UTF-8, which may split a character or a
+     * "\r\n" pair, into text with '\n' line endings.
+     */
+    class ChunkDecoder
+    {
+    public:
+        void setEncoding(QStringConverter::Encoding encoding)
+        {
+            m_decoder = QStringDecoder(encoding);
+        }
+
+        QString decode(QByteArrayView bytes)
+        {
+            // The UTF-8 decoder has its own fast path for ASCII runs
+            QString text = m_decoder.decode(bytes);
+
+            if (m_pendingReturn)
+            {
+                text.prepend(u'\r');
+            }
+
+            // A trailing '\r' may be followed by '\n' in the next chunk
+            m_pendingReturn = text.endsWith(u'\r');
+            if (m_pendingReturn)
+            {
+                text.chop(1);
+            }
+
+            if (text.contains(u'\r'))
+            {
+                const qsizetype returns = text.count(u'\r');
+                const qsizetype pairs   = text.count(QStringLiteral("\r\n"));
+                m_endings |= (pairs > 0 ? CrLf : 0) | (returns > pairs ? Cr : 0)
+                             | (text.count(u'\n') > pairs ? Lf : 0);
+                text.replace(QStringLiteral("\r\n"), QStringLiteral("\n"));
+            }
+            else if (!(m_endings & Lf) && text.contains(u'\n'))
+            {
+                m_endings |= Lf;
+            }
+            return text;
+        }
+
+        QString finish()
+        {
+            if (m_pendingReturn)
+            {
+                m_endings |= Cr;
+            }
+            return m_pendingReturn ? QStringLiteral("\r") : QString();
+        }
+
+        bool hasError() const
+        {
+            return m_decoder.hasError();
+        }
+
+        // More than one kind of line ending was decoded
+        bool hasMixedLineEndings() const
+        {
+            return m_endings != 0 && (m_endings & (m_endings - 1)) != 0;
+        }
+
+    private:
+        enum LineEndingKind
+        {
+            Lf   = 1,
+            CrLf = 2,
+            Cr   = 4
+        };
+
+        QStringDecoder m_decoder{QStringDecoder::Utf8};
+        bool m_pendingReturn = false;
+        int m_endings        = 0;    // LineEndingKind seen so far
+    };
+
+    // Drops the pages of a consumed part of the mapping from the resident set
+    void releasePages(uchar *begin, qsizetype size)
+    {
+#ifdef Q_OS_UNIX
+        // Chunks start on a page boundary; a partial page at the end is kept
+        static const qsizetype pageSize = ::sysconf(_SC_PAGESIZE);
+        const qsizetype length          = size / pageSize * pageSize;
+        if (length > 0)
+        {
+            ::madvise(begin, static_cast<size_t>(length), MADV_DONTNEED);
+        }
+#else
+        Q_UNUSED(begin);
+        Q_UNUSED(size);
+#endif
+    }
+
+    /*
+     * Reads a file as a sequence of decoded chunks, from a mapping when the
+     * file can be mapped.
+     */
+    class ChunkReader
+    {
+    public:
+        explicit ChunkReader(qsizetype chunkSize)
+            : m_chunkSize(chunkSize)
+        {
+        }
+
+        ~ChunkReader()
+        {
+            if (m_mapped)
+            {
+                m_file.unmap(m_mapped);
+            }
+        }
+
+        // Latin-1 decodes any byte: the loads that found invalid UTF-8 start over with it
+        OperationResult open(const QString &filePath, bool latin1 = false)
+        {
+            m_file.setFileName(filePath);
+            if (!m_file.open(QIODevice::ReadOnly))
+            {
+                return {false, "Cannot open file: " + m_file.errorString().toStdString()};
+            }
+
+            m_size   = m_file.size();
+            m_mapped = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+#ifdef Q_OS_UNIX
+            if (m_mapped)
+            {
+                ::madvise(m_mapped, static_cast<size_t>(m_size), MADV_SEQUENTIAL);
+            }
+#endif
+
+            const QByteArray peeked = m_mapped ? QByteArray() : m_file.peek(TextFormat::SampleSize);
+            const QByteArrayView sample =
+                m_mapped ? QByteArrayView(m_mapped, std::min<qint64>(m_size, TextFormat::SampleSize)) : peeked;
+            m_format = TextFormat::detect(sample);
+            if (latin1)
+            {
+                // A UTF-8 BOM is kept as text, and written back as the same bytes
+                m_format.encoding = QStringConverter::Latin1;
+                m_format.bom      = false;
+            }
+            m_decoder.setEncoding(m_format.encoding);
+            return {true, std::string()};
+        }
+
+        TextFormat format() const
+        {
+            TextFormat format       = m_format;
+            format.mixedLineEndings = m_decoder.hasMixedLineEndings();
+            return format;
+        }
+
+        // Bytes past the detection sample were not UTF-8: they were decoded as replacement characters
+        bool hasInvalidUtf8() const
+        {
+            return m_format.encoding == QStringConverter::Utf8 && m_decoder.hasError();
+        }
+
+        // Decodes the next chunk; false once the file is consumed or on a read error
+        bool next(QString &text)
+        {
+            if (m_done)
+            {
+                return false;
+            }
+
+            if (m_mapped)
+            {
+                if (m_offset < m_size)
+                {
+                    const qsizetype length = static_cast<qsizetype>(std::min<qint64>(m_chunkSize, m_size - m_offset));
+                    text                   = m_decoder.decode(QByteArrayView(m_mapped + m_offset, length));
+                    releasePages(m_mapped + m_offset, length);
+                    m_offset += length;
+                    return true;
+                }
+            }
+            else if (!m_file.atEnd())
+            {
+                // Not mappable: same pipeline over buffered reads
+                const QByteArray buffer = m_file.read(m_chunkSize);
+                if (buffer.isEmpty() && m_file.error() != QFileDevice::NoError)
+                {
+                    m_error = m_file.errorString();
+                    m_done  = true;
+                    return false;
+                }
+                text = m_decoder.decode(buffer);
+                m_offset += buffer.size();
+                return true;
+            }
+
+            text   = m_decoder.finish();
+            m_done = true;
+            return true;
+        }
+
+        qint64 position() const
+        {
+            return m_offset;
+        }
+
+        qint64 size() const
+        {
+            return m_size;
+        }
+
+        OperationResult result() const
+        {
+            if (!m_error.isEmpty())
+            {
+                return {false, "Cannot read file: " + m_error.toStdString()};
+            }
+            if (m_decoder.hasError())
+            {
+                return {true, "File is not valid " + m_format.name().section(',', 0, 0).toStdString()
+                                  + ", invalid bytes were replaced."};
+            }
+            return {true, "File loaded successfully (" + m_format.name().toStdString() + ")."};
+        }
+
+    private:
+        QFile m_file;
+        uchar *m_mapped = nullptr;
+        qint64 m_size   = 0;
+        qint64 m_offset = 0;
+        qsizetype m_chunkSize;
+        ChunkDecoder m_decoder;
+        TextFormat m_format;
+        QString m_error;
+        bool m_done = false;
+    };
+}
+
+DocumentLoader::DocumentLoader(QObject *parent)
+    : QObject(parent),
+      m_generation(std::make_shared<std::atomic_int>(0))
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+DocumentLoader::~DocumentLoader()
+{
+    // The worker posts to this object, it must be gone before we are
+    cancel();
+    m_pool.waitForDone();
+}
+
+OperationResult DocumentLoader::load(const QString &filePath, QTextDocument *document, TextFormat *format)
+{
+    const bool undoEnabled = document->isUndoRedoEnabled();
+    OperationResult result;
+
+    for (const bool latin1 : {false, true})
+    {
+        ChunkReader reader(ChunkSize);
+        OperationResult opened = reader.open(filePath, latin1);
+        if (!opened.success)
+        {
+            document->setUndoRedoEnabled(undoEnabled);
+            return opened;
+        }
+
+        // Appending chunks must not build an undo history of the whole file
+        document->setUndoRedoEnabled(false);
+        document->clear();
+
+        QTextCursor cursor(document);
+        QString text;
+        while (reader.next(text) && !reader.hasInvalidUtf8())
+        {
+            cursor.insertText(text);
+        }
+        if (reader.hasInvalidUtf8())
+        {
+            continue;
+        }
+
+        result = reader.result();
+        if (!result.success)
+        {
+            document->clear();
+        }
+        else if (latin1)
+        {
+            result.message = "File is not valid UTF-8, loaded as Latin-1 to keep its bytes.";
+        }
+        if (format)
+        {
+            *format = reader.format();
+        }
+        break;
+    }
+
+    document->setUndoRedoEnabled(undoEnabled);
+    return result;
+}
+
+QByteArray DocumentLoader::hashFile(const QString &filePath)
+{
+    // Decoded exactly like a load, Latin-1 fallback included
+    for (const bool latin1 : {false, true})
+    {
+        ChunkReader reader(ChunkSize);
+        if (!reader.open(filePath, latin1).success)
+        {
+            return QByteArray();
+        }
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        QString text;
+        while (reader.next(text) && !reader.hasInvalidUtf8())
+        {
+            // A lone '\r' ends a block of the document too
+            text.replace(u'\r', u'\n');
+            hash.addData(text.toUtf8());
+        }
+        if (reader.hasInvalidUtf8())
+        {
+            continue;
+        }
+        if (!reader.result().success)
+        {
+            return QByteArray();
+        }
+        return hash.result();
+    }
+    return QByteArray();
+}
+
+QByteArray DocumentLoader::hashDocument(const QTextDocument *document)
+{
+    // Block by block: the whole text is never copied
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next())
+    {
+        if (block != document->begin())
+        {
+            hash.addData("\n");
+        }
+        hash.addData(block.text().toUtf8());
+    }
+    return hash.result();
+}
+
+QByteArray DocumentLoader::hashText(const QByteArray &text)
+{
+    return QCryptographicHash::hash(text, QCryptographicHash::Sha1);
+}
+
+OperationResult DocumentLoader::start(const QString &filePath, QTextDocument *document)
+{
+    cancel();
+
+    // Fail before touching the document, like load()
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return {false, "Cannot open file: " + file.errorString().toStdString()};
+    }
+    file.close();
+
+    m_document    = document;
+    m_filePath    = filePath;
+    m_loading     = true;
+    m_undoEnabled = document->isUndoRedoEnabled();
+    document->setUndoRedoEnabled(false);
+    document->clear();
+
+    const int generation                   = ++*m_generation;
+    std::shared_ptr<std::atomic_int> token = m_generation;
+
+    // One permit per batch in flight; released by the GUI thread once appended
+    auto permits = std::make_shared<QSemaphore>(MaxPendingBatches);
+
+    m_pool.start([this, filePath, token, generation, permits]()
+    {
+        for (const bool latin1 : {false, true})
+        {
+            ChunkReader reader(BatchSize);
+            OperationResult result = reader.open(filePath, latin1);
+
+            QString text;
+            while (result.success && reader.next(text) && !reader.hasInvalidUtf8())
+            {
+                // Wait for the GUI thread to catch up, still answering cancellation
+                while (!permits->tryAcquire(1, 50))
+                {
+                    if (token->load() != generation)
+                    {
+                        return;
+                    }
+                }
+                if (token->load() != generation)
+                {
+                    return;
+                }
+
+                QMetaObject::invokeMethod(this, [this, generation, permits, text = std::move(text),
+                                                 loaded = reader.position(), total = reader.size()]()
+                {
+                    permits->release();
+                    append(generation, text, loaded, total);
+                }, Qt::QueuedConnection);
+            }
+
+            // The chunks streamed so far are dropped, and the file streamed again as Latin-1
+            if (result.success && reader.hasInvalidUtf8())
+            {
+                QMetaObject::invokeMethod(this, [this, generation]()
+                {
+                    restart(generation);
+                }, Qt::QueuedConnection);
+                continue;
+            }
+
+            if (result.success)
+            {
+                result = reader.result();
+            }
+            if (result.success && latin1)
+            {
+                result.message = "File is not valid UTF-8, loaded as Latin-1 to keep its bytes.";
+            }
+            QMetaObject::invokeMethod(this, [this, generation, result, format = reader.format()]()
+            {
+                finish(generation, result, format);
+            }, Qt::QueuedConnection);
+            return;
+        }
+    });
+
+    return {true, std::string()};
+}
+
+void DocumentLoader::cancel()
+{
+    ++*m_generation;
+
+    if (m_loading)
+    {
+        m_loading = false;
+        if (m_document)
+        {
+            m_document->setUndoRedoEnabled(m_undoEnabled);
+        }
+    }
+}
+
+bool DocumentLoader::isLoading() const
+{
+    return m_loading;
+}
+
+QString DocumentLoader::filePath() const
+{
+    return m_filePath;
+}
+
+TextFormat DocumentLoader::format() const
+{
+    return m_format;
+}
+
+void DocumentLoader::append(int generation, const QString &text, qint64 loadedBytes, qint64 totalBytes)
+{
+    if (generation != m_generation->load() || !m_document)
+    {
+        return;
+    }
+
+    QTextCursor cursor(m_document);
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(text);
+
+    emit progress(loadedBytes, totalBytes);
+}
+
+void DocumentLoader::restart(int generation)
+{
+    if (generation != m_generation->load() || !m_document)
+    {
+        return;
+    }
+
+    m_document->clear();
+    emit progress(0, QFileInfo(m_filePath).size());
+}
+
+void DocumentLoader::finish(int generation, const OperationResult &result, const TextFormat &format)
+{
+    if (generation != m_generation->load())
+    {
+        return;
+    }
+
+    m_loading = false;
+    m_format  = format;
+    if (m_document)
+    {
+        if (!result.success)
+        {
+            m_document->clear();
+        }
+        m_document->setUndoRedoEnabled(m_undoEnabled);
+    }
+
+    emit finished(result.success, QString::fromStdString(result.message));
+}
@@ -0,0 +1,138 @@
+#include "DocumentSaver.h"
+#include "DocumentLoader.h"
+
+#include <QFileInfo>
+#include <QSaveFile>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Makes the rename itself durable, not only the content of the file
+    void syncDirectory(const QString &filePath)
+    {
+#ifdef Q_OS_UNIX
+        const QByteArray directory = QFile::encodeName(QFileInfo(filePath).absolutePath());
+        const int fd               = ::open(directory.constData(), O_RDONLY | O_DIRECTORY);
+        if (fd >= 0)
+        {
+            ::fsync(fd);
+            ::close(fd);
+        }
+#else
+        Q_UNUSED(filePath);
+#endif
+    }
+}
+
+DocumentSaver::DocumentSaver(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+DocumentSaver::~DocumentSaver()
+{
+    // Unwritten snapshots are the user's last edits: write them before leaving
+    waitForDone();
+}
+
+void DocumentSaver::save(const QString &filePath, const QString &text, const TextFormat &format)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.insert(filePath, {text, format});
+    if (!m_running)
+    {
+        m_running = true;
+        m_pool.start([this]() { run(); });
+    }
+}
+
+bool DocumentSaver::isSaving() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running;
+}
+
+void DocumentSaver::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+void DocumentSaver::run()
+{
+    for (;;)
+    {
+        QString filePath;
+        Snapshot snapshot;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_pending.isEmpty())
+            {
+                m_running = false;
+                return;
+            }
+            filePath = m_pending.firstKey();
+            snapshot = m_pending.take(filePath);
+        }
+
+        QByteArray hash;
+        const OperationResult result = write(filePath, snapshot.text, snapshot.format, &hash);
+        snapshot.text.clear();
+
+        QMetaObject::invokeMethod(this, [this, filePath, result, hash]()
+        {
+            emit finished(filePath, result.success, QString::fromStdString(result.message), hash);
+        }, Qt::QueuedConnection);
+    }
+}
+
+OperationResult DocumentSaver::write(const QString &filePath, const QString &text, const TextFormat &format,
+                                     QByteArray *hash)
+{
+    // Written back as loaded: no QIODevice::Text, line endings are those of the format
+    bool lossless       = true;
+    QByteArray contents = format.encode(text, &lossless);
+    if (!lossless)
+    {
+        TextFormat utf8;
+        utf8.lineEnding = format.lineEnding;
+        contents        = utf8.encode(text);
+    }
+
+    // QSaveFile writes next to the target, syncs on commit, then renames over the target
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return {false, "Cannot save file: " + file.errorString().toStdString()};
+    }
+
+    if (file.write(contents) != contents.size())
+    {
+        const std::string error = file.errorString().toStdString();
+        file.cancelWriting();
+        return {false, "Cannot save file: " + error};
+    }
+    if (!file.commit())
+    {
+        return {false, "Cannot save file: " + file.errorString().toStdString()};
+    }
+    syncDirectory(filePath);
+
+    if (hash)
+    {
+        const bool plainUtf8 = format == TextFormat() && lossless;
+        *hash                = DocumentLoader::hashText(plainUtf8 ? contents : text.toUtf8());
+    }
+
+    const std::string fileName = QFileInfo(filePath).fileName().toStdString();
+    if (!lossless)
+    {
+        return {true, fileName + " saved as UTF-8: some characters have no " + format.name().section(',', 0, 0).toStdString()
+                          + " encoding."};
+    }
+    return {true, fileName + " saved successfully."};
+}
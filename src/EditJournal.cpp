@@ -0,0 +1,414 @@
+#include "EditJournal.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextCursor>
+#include <algorithm>
+
+namespace
+{
+    constexpr quint32 Magic         = 0x43414A31; // "CAJ1"
+    constexpr quint8 EditRecord     = 'E';
+    constexpr quint8 SnapshotRecord = 'S';
+
+    QByteArray serialize(const std::function<void(QDataStream &)> &write)
+    {
+        QByteArray bytes;
+        QDataStream out(&bytes, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        write(out);
+        return bytes;
+    }
+
+    struct Edit
+    {
+        qint64 position;
+        qint64 removed;
+        QByteArray inserted;
+    };
+
+    struct Journal
+    {
+        bool valid = false;
+        QString filePath;
+        qint64 baseSize     = -1;
+        qint64 baseModified = 0;
+        bool hasSnapshot    = false;
+        QByteArray snapshot;
+        QVector<Edit> edits; // Following the snapshot, if any
+    };
+
+    Journal readJournal(const QString &journalPath)
+    {
+        Journal journal;
+        QFile file(journalPath);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return journal;
+        }
+
+        QDataStream in(&file);
+        in.setVersion(QDataStream::Qt_6_0);
+        quint32 magic = 0;
+        in >> magic >> journal.filePath >> journal.baseSize >> journal.baseModified;
+        if (in.status() != QDataStream::Ok || magic != Magic)
+        {
+            return journal;
+        }
+        journal.valid = true;
+
+        // A record cut short by a crash ends the journal
+        while (!in.atEnd())
+        {
+            quint8 type = 0;
+            in >> type;
+            if (type == EditRecord)
+            {
+                Edit edit;
+                in >> edit.position >> edit.removed >> edit.inserted;
+                if (in.status() != QDataStream::Ok)
+                {
+                    break;
+                }
+                journal.edits.append(edit);
+            }
+            else if (type == SnapshotRecord)
+            {
+                QByteArray snapshot;
+                in >> snapshot;
+                if (in.status() != QDataStream::Ok)
+                {
+                    break;
+                }
+                journal.hasSnapshot = true;
+                journal.snapshot    = snapshot;
+                journal.edits.clear();
+            }
+            else
+            {
+                break;
+            }
+        }
+        return journal;
+    }
+}
+
+EditJournal::EditJournal(const QString &directory, QObject *parent)
+    : QObject(parent),
+      m_directory(directory)
+{
+    m_pool.setMaxThreadCount(1);
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FlushInterval);
+    connect(&m_flushTimer, &QTimer::timeout, this, &EditJournal::flush);
+
+    // The last edits must reach the disk even if the journal outlives the application
+    if (QCoreApplication::instance())
+    {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this]()
+        {
+            flush();
+            waitForDone();
+        });
+    }
+}
+
+EditJournal::~EditJournal()
+{
+    flush();
+    waitForDone();
+}
+
+QString EditJournal::defaultDirectory()
+{
+    return QDir::homePath() + "/.config/codeastra/journal";
+}
+
+QString EditJournal::directory() const
+{
+    return m_directory;
+}
+
+QString EditJournal::journalPath(const QString &filePath) const
+{
+    if (filePath.isEmpty())
+    {
+        return m_directory + "/untitled.journal";
+    }
+
+    const QByteArray key = QFileInfo(filePath).absoluteFilePath().toUtf8();
+    return m_directory + "/" + QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex() + ".journal";
+}
+
+QString EditJournal::filePath() const
+{
+    return m_filePath;
+}
+
+bool EditJournal::isAttached() const
+{
+    return m_document != nullptr;
+}
+
+QByteArray EditJournal::header() const
+{
+    return serialize([this](QDataStream &out)
+    {
+        out << Magic << m_filePath << m_baseSize << m_baseModified;
+    });
+}
+
+void EditJournal::schedule(const std::function<void()> &job)
+{
+    m_pool.start(job);
+}
+
+void EditJournal::attach(QTextDocument *document, const QString &filePath, bool resume)
+{
+    if (m_document)
+    {
+        detach(true);
+    }
+
+    m_document    = document;
+    m_filePath    = filePath;
+    m_journalPath = journalPath(filePath);
+    m_revision    = document->revision();
+    m_buffer.clear();
+
+    const QFileInfo file(filePath);
+    m_baseSize     = file.exists() ? file.size() : -1;
+    m_baseModified = file.exists() ? file.lastModified().toMSecsSinceEpoch() : 0;
+
+    m_headerWritten = resume && QFile::exists(m_journalPath);
+    m_editBytes     = m_headerWritten ? QFileInfo(m_journalPath).size() : 0;
+    if (!m_headerWritten)
+    {
+        const QString path = m_journalPath;
+        schedule([path]() { QFile::remove(path); });
+    }
+
+    connect(document, &QTextDocument::contentsChange, this, &EditJournal::onContentsChange);
+}
+
+void EditJournal::detach(bool keep)
+{
+    if (!m_document)
+    {
+        return;
+    }
+
+    if (keep)
+    {
+        flush();
+    }
+    else
+    {
+        m_buffer.clear();
+        const QString path = m_journalPath;
+        schedule([path]() { QFile::remove(path); });
+    }
+
+    disconnect(m_document, nullptr, this, nullptr);
+    m_flushTimer.stop();
+    m_document = nullptr;
+    m_filePath.clear();
+    m_journalPath.clear();
+}
+
+void EditJournal::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    if (!m_document)
+    {
+        return;
+    }
+
+    // Highlighting passes report their blocks as replaced, without a new revision
+    const int revision = m_document->revision();
+    if (charsRemoved == charsAdded && revision == m_revision)
+    {
+        return;
+    }
+    m_revision = revision;
+
+    QString inserted;
+    if (charsAdded > 0)
+    {
+        const int last = m_document->characterCount() - 1;
+        QTextCursor cursor(m_document);
+        cursor.setPosition(std::min(position, last));
+        cursor.setPosition(std::min(position + charsAdded, last), QTextCursor::KeepAnchor);
+        inserted = cursor.selectedText();
+        inserted.replace(QChar::ParagraphSeparator, u'\n');
+    }
+
+    const QByteArray record = serialize([&](QDataStream &out)
+    {
+        out << EditRecord << qint64(position) << qint64(charsRemoved) << inserted.toUtf8();
+    });
+    m_buffer += record;
+    m_editBytes += record.size();
+
+    // Replaying should never cost more than reading the document once
+    if (m_editBytes > std::max<qint64>(CompactionThreshold, m_document->characterCount()))
+    {
+        compact();
+        return;
+    }
+
+    if (!m_flushTimer.isActive())
+    {
+        m_flushTimer.start();
+    }
+}
+
+void EditJournal::flush()
+{
+    m_flushTimer.stop();
+    if (m_buffer.isEmpty() || m_journalPath.isEmpty())
+    {
+        return;
+    }
+
+    const QByteArray bytes = m_headerWritten ? m_buffer : header() + m_buffer;
+    const QString path     = m_journalPath;
+    const QString dir      = m_directory;
+    m_headerWritten        = true;
+    m_buffer.clear();
+
+    schedule([path, dir, bytes]()
+    {
+        QDir().mkpath(dir);
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append) || file.write(bytes) != bytes.size())
+        {
+            qWarning() << "[EditJournal] Cannot write" << path << ":" << file.errorString();
+        }
+    });
+}
+
+void EditJournal::compact()
+{
+    if (!m_document)
+    {
+        return;
+    }
+
+    m_flushTimer.stop();
+    m_buffer.clear();
+    m_headerWritten = true;
+    m_editBytes     = 0;
+
+    const QByteArray snapshot = m_document->toPlainText().toUtf8();
+    const QByteArray bytes    = header() + serialize([&snapshot](QDataStream &out)
+    {
+        out << SnapshotRecord << snapshot;
+    });
+    const QString path = m_journalPath;
+    const QString dir  = m_directory;
+
+    // Replaced atomically: a crash while compacting keeps the previous journal
+    schedule([path, dir, bytes]()
+    {
+        QDir().mkpath(dir);
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size() || !file.commit())
+        {
+            qWarning() << "[EditJournal] Cannot compact" << path << ":" << file.errorString();
+        }
+    });
+}
+
+void EditJournal::markSaved()
+{
+    if (!m_document)
+    {
+        return;
+    }
+
+    m_flushTimer.stop();
+    m_buffer.clear();
+    m_headerWritten = false;
+    m_editBytes     = 0;
+    m_revision      = m_document->revision();
+
+    const QFileInfo file(m_filePath);
+    m_baseSize     = file.exists() ? file.size() : -1;
+    m_baseModified = file.exists() ? file.lastModified().toMSecsSinceEpoch() : 0;
+
+    const QString path = m_journalPath;
+    schedule([path]() { QFile::remove(path); });
+}
+
+void EditJournal::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+QStringList EditJournal::journaledFiles() const
+{
+    QStringList files;
+    const QFileInfoList journals = QDir(m_directory).entryInfoList({"*.journal"}, QDir::Files, QDir::Time);
+    for (const QFileInfo &journalFile : journals)
+    {
+        const Journal journal = readJournal(journalFile.absoluteFilePath());
+        if (journal.valid)
+        {
+            files.append(journal.filePath);
+        }
+    }
+    return files;
+}
+
+void EditJournal::discard(const QString &filePath)
+{
+    const QString path = journalPath(filePath);
+    schedule([path]() { QFile::remove(path); });
+}
+
+OperationResult EditJournal::replay(const QString &filePath, QTextDocument *document) const
+{
+    const Journal journal = readJournal(journalPath(filePath));
+    if (!journal.valid)
+    {
+        return {false, "No unsaved changes recorded."};
+    }
+
+    if (!journal.hasSnapshot && !filePath.isEmpty())
+    {
+        const QFileInfo file(filePath);
+        if (!file.exists() || file.size() != journal.baseSize
+            || file.lastModified().toMSecsSinceEpoch() != journal.baseModified)
+        {
+            return {false, "Unsaved changes to " + file.fileName().toStdString()
+                               + " were recorded against a version of the file that changed since."};
+        }
+    }
+
+    // One edit block: the whole recovery is undone at once
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    if (journal.hasSnapshot)
+    {
+        cursor.select(QTextCursor::Document);
+        cursor.insertText(QString::fromUtf8(journal.snapshot));
+    }
+    for (const Edit &edit : journal.edits)
+    {
+        const qint64 last  = document->characterCount() - 1;
+        const qint64 start = std::clamp<qint64>(edit.position, 0, last);
+        const qint64 end   = std::clamp<qint64>(edit.position + edit.removed, start, last);
+        cursor.setPosition(static_cast<int>(start));
+        cursor.setPosition(static_cast<int>(end), QTextCursor::KeepAnchor);
+        cursor.insertText(QString::fromUtf8(edit.inserted));
+    }
+    cursor.endEditBlock();
+
+    const QString name = filePath.isEmpty() ? QStringLiteral("the untitled document") : QFileInfo(filePath).fileName();
+    return {true, "Recovered unsaved changes to " + name.toStdString() + "."};
+}
@@ -2,19 +2,35 @@
 #include "CodeEditor.h"
 #include "MainWindow.h"
 #include "SyntaxManager.h"
+#include "SyntaxRegistry.h"
+#include "DocumentLoader.h"
+#include "DocumentSaver.h"
+#include "EditJournal.h"
+#include "LargeFileDocument.h"
+#include "LargeFileView.h"
+#include "CopyJob.h"
+#include "DocumentCache.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
-#include <QTextStream>
 #include <QFileInfo>
+#include <QPlainTextDocumentLayout>
+#include <QScrollBar>
+#include <QTextBlock>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
 
 
 FileManager::FileManager(CodeEditor *editor, MainWindow *mainWindow)
-    : m_editor(editor), m_mainWindow(mainWindow)
+    : m_editor(editor), m_mainWindow(mainWindow), m_loader(new DocumentLoader(this)),
+      m_saver(new DocumentSaver(this)), m_journal(new EditJournal(EditJournal::defaultDirectory(), this)),
+      m_cache(std::make_unique<DocumentCache>())
 {
+    connect(m_loader, &DocumentLoader::progress, this, &FileManager::onLoadProgress);
+    connect(m_loader, &DocumentLoader::finished, this, &FileManager::onLoadFinished);
+    connect(m_saver, &DocumentSaver::finished, this, &FileManager::onSaveFinished);
+
     qDebug() << "FileManager initialized.";
 }
 
@@ -25,7 +41,52 @@ void FileManager::initialize(CodeEditor *editor, MainWindow *mainWindow)
     m_editor     = editor;
     m_mainWindow = mainWindow;
 
-    connect(m_editor, &QPlainTextEdit::textChanged, this, [this](){m_isDirty = true;});
+    // Pick up edits of the syntax config files without reopening the document
+    connect(&SyntaxRegistry::getInstance(), &SyntaxRegistry::definitionsChanged,
+            this, &FileManager::refreshHighlighter, Qt::UniqueConnection);
+
+    // Cached documents get new highlighters when shown again
+    connect(&SyntaxRegistry::getInstance(), &SyntaxRegistry::definitionsChanged, this, [this]()
+    {
+        m_cache->clearHighlighters();
+    });
+    connect(m_editor, &CodeEditor::modificationChanged, this, &FileManager::documentsChanged, Qt::UniqueConnection);
+
+    // Cached documents go with the editor they were shown in
+    connect(m_editor, &QObject::destroyed, this, [this]()
+    {
+        m_cache->clear();
+    });
+}
+
+void FileManager::refreshHighlighter()
+{
+    if (!m_editor || m_currentFileName.isEmpty())
+    {
+        return;
+    }
+
+    delete m_currentHighlighter;
+
+    // Create and assign a new syntax highlighter based on language extension
+    m_currentHighlighter = SyntaxManager::createSyntaxHighlighter(getFileExtension(), m_editor->document()).release();
+
+    Syntax *syntax = qobject_cast<Syntax *>(m_currentHighlighter);
+    if (syntax)
+    {
+        // Rules disabled for running over their match budget are reported in the status bar
+        connect(syntax, &Syntax::matchBudgetExceeded, m_editor, &CodeEditor::statusMessageChanged);
+    }
+
+    // Large files are tokenized off the GUI thread, viewport first
+    if (syntax && m_editor->document()->blockCount() > Syntax::BackgroundThreshold)
+    {
+        syntax->setBackgroundHighlighting(true);
+
+        QPair<int, int> visibleBlocks = m_editor->visibleBlockRange();
+        syntax->setVisibleBlocks(visibleBlocks.first, visibleBlocks.second);
+        connect(m_editor, &CodeEditor::visibleBlocksChanged, syntax, &Syntax::setVisibleBlocks);
+    }
 }
 
 QString FileManager::getCurrentFileName() const
@@ -55,28 +116,46 @@ QString getLastSaved(const QFileInfo& file)
 
 bool FileManager::hasUnsavedChanges()
 {
-    if(!m_isDirty)
+    if (m_largeFile)
+    {
+        return m_largeFile->isModified();
+    }
+
+    // A document still loading is read-only, and would never match the file on disk.
+    // Otherwise the undo stack tells whether the document is back to its clean state.
+    if (!m_editor || isLoading() || !m_editor->document()->isModified())
     {
         return false;
     }
 
-    // Additional safeguard if content still matches file on disk
-    if (!m_currentFileName.isEmpty())
+    QTextDocument *document = m_editor->document();
+
+    // Edits undone by hand leave the document modified: compare it with the file,
+    // first by length, then by hash
+    if (m_currentFileName.isEmpty() || document->characterCount() != m_savedCharacters)
     {
-        QFile file(m_currentFileName);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text))
-        {
-            QTextStream in(&file);
-            QString diskContents = in.readAll();
-            if (diskContents == m_editor->toPlainText())
-            {
-                m_isDirty = false;
-                return false;
-            }
-        }
+        return true;
+    }
+
+    const QFileInfo file(m_currentFileName);
+    if (!file.exists())
+    {
+        return true;
+    }
+    if (m_savedHash.isEmpty() || file.size() != m_savedSize || file.lastModified() != m_savedModified)
+    {
+        m_savedSize     = file.size();
+        m_savedModified = file.lastModified();
+        m_savedHash     = DocumentLoader::hashFile(m_currentFileName);
+    }
+
+    if (m_savedHash.isEmpty() || DocumentLoader::hashDocument(document) != m_savedHash)
+    {
+        return true;
     }
 
-    return true; // nothing changed
+    document->setModified(false);
+    return false;
 }
 
 int FileManager::buildUnsavedChangesMessage() const
@@ -118,6 +197,10 @@ bool FileManager::promptUnsavedChanges()
     {
         return false;
     }
+    else
+    {
+        m_journal->detach(false);
+    }
 
     // if discard selected, continue without saving.   
     return true;
@@ -125,15 +208,32 @@ bool FileManager::promptUnsavedChanges()
 
 void FileManager::newFile()
 {
-    if (!promptUnsavedChanges())
+    // A file stays open in its tab; only an untitled document would be lost
+    if (isCacheable())
+    {
+        stashCurrentDocument();
+    }
+    else if (!promptUnsavedChanges())
     {
         return;
     }
 
+    showUntitledDocument();
+}
+
+void FileManager::showUntitledDocument()
+{
+    cancelLoading();
+    closeLargeFile();
+    m_journal->detach(m_saver->isSaving());
     m_currentFileName = "";
+    m_documentPath.clear();
     m_editor->clear();
     m_mainWindow->setWindowTitle("Untitle ~ Code Astra");
-    m_isDirty = false;
+    m_textFormat = TextFormat();
+    recordSavedState(QByteArray());
+    m_journal->attach(m_editor->document(), QString());
+    emit documentsChanged();
 }
 
 void FileManager::saveFile()
@@ -146,36 +246,106 @@ void FileManager::saveFile()
 
     // qDebug() << "Saving file:" << m_currentFileName;
 
-    QFile file(m_currentFileName);
-    if (!file.open(QFile::WriteOnly | QFile::Text))
+    // Saving now would truncate the file to the part loaded so far
+    if (isLoading())
     {
-        QMessageBox::warning(nullptr, "Error", "Cannot save file: " + file.errorString());
+        emit m_editor->statusMessageChanged("Cannot save while the file is loading.");
         return;
     }
 
-    QTextStream out(&file);
-    if (m_editor)
+    // Written on the document's worker thread; saved() reports the result
+    if (m_largeFile)
     {
-        out << m_editor->toPlainText();
+        OperationResult result = m_largeFile->save(m_currentFileName);
+        if (!result.success)
+        {
+            QMessageBox::warning(nullptr, "Error", QString::fromStdString(result.message));
+            return;
+        }
+        emit m_editor->statusMessageChanged(QString::fromStdString(result.message));
+        return;
     }
-    else
+
+    if (!m_editor)
     {
         QMessageBox::critical(nullptr, "Error", "Editor is not initialized.");
         return;
     }
-    file.close();
 
-    if (m_mainWindow)
+    // The snapshot is written on a worker thread; the editor stays usable meanwhile.
+    // The document is clean as of the snapshot, until the write fails.
+    m_saver->save(m_currentFileName, m_editor->toPlainText(), m_textFormat);
+    m_textFormat.mixedLineEndings = false;
+    recordSavedState(QByteArray());
+
+    // Saved under a new name: the journal and the tab follow the document
+    if (m_journal->isAttached() && m_journal->filePath() != m_currentFileName)
     {
-        m_mainWindow->setWindowTitle("CodeAstra ~ " + QFileInfo(m_currentFileName).fileName());
+        m_journal->detach(false);
+        m_journal->attach(m_editor->document(), m_currentFileName);
     }
-    else
+    if (m_documentPath != m_currentFileName)
     {
-        qWarning() << "MainWindow is not initialized in FileManager.";
+        m_openFiles.removeAll(m_documentPath);
+        m_cache->remove(m_currentFileName);
+        m_documentPath = m_currentFileName;
+        addOpenDocument(m_currentFileName);
+    }
+    m_savedSize = -1;
+    emit m_editor->statusMessageChanged("Saving " + QFileInfo(m_currentFileName).fileName() + "...");
+}
+
+void FileManager::onSaveFinished(const QString &filePath, bool success, const QString &message, const QByteArray &hash)
+{
+    if (!m_editor)
+    {
+        return;
+    }
+
+    if (!success)
+    {
+        if (filePath == m_currentFileName && !m_largeFile)
+        {
+            m_editor->document()->setModified(true);
+        }
+        QMessageBox::warning(nullptr, "Error", message);
+        return;
+    }
+
+    // A later save of the same file is still queued: its snapshot is the clean state
+    if (filePath == m_currentFileName && !m_largeFile && !m_saver->isSaving())
+    {
+        const QFileInfo file(filePath);
+        m_savedSize     = file.size();
+        m_savedModified = file.lastModified();
+        m_savedHash     = hash;
+
+        // Edits made while writing are not in the file: the journal keeps them as a snapshot
+        if (m_editor->document()->isModified())
+        {
+            m_journal->compact();
+        }
+        else
+        {
+            m_journal->markSaved();
+        }
     }
 
-    m_isDirty = false;
-    emit m_editor->statusMessageChanged("File saved successfully.");
+    // Put aside while it was written: the cached copy now matches the file
+    CachedDocument *cached = m_cache->find(filePath);
+    if (cached && !m_saver->isSaving())
+    {
+        const QFileInfo file(filePath);
+        cached->savedSize     = file.size();
+        cached->savedModified = file.lastModified();
+        cached->savedHash     = hash;
+    }
+
+    if (m_mainWindow && filePath == m_currentFileName)
+    {
+        m_mainWindow->setWindowTitle("CodeAstra ~ " + QFileInfo(filePath).fileName());
+    }
+    emit m_editor->statusMessageChanged(message);
 }
 
 void FileManager::saveFileAs()
@@ -203,8 +373,7 @@ void FileManager::openFile()
     if (!fileName.isEmpty())
     {
         // qDebug() << "Opening file: " << fileName;
-        m_currentFileName = fileName;
-        loadFileInEditor(fileName);
+        switchToFile(fileName);
     }
     else
     {
@@ -216,31 +385,94 @@ void FileManager::loadFileInEditor(const QString &filePath)
 {
     // qDebug() << "Loading file:" << filePath;
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!m_editor)
     {
-        QMessageBox::warning(nullptr, "Error", "Cannot open file: " + file.errorString());
+        QMessageBox::critical(nullptr, "Error", "Editor is not initialized.");
         return;
     }
 
-    QTextStream in(&file);
-    if (m_editor)
+    // A file still loading is abandoned for the new one
+    cancelLoading();
+    m_pendingLine = 0;
+
+    // The document shown waits in the cache for its tab to be selected again. Otherwise,
+    // unsaved changes left behind stay in the journal, to be recovered when the file is reopened
+    if (isCacheable())
     {
-        m_editor->blockSignals(true);
-        m_editor->setPlainText(in.readAll());
-        m_editor->blockSignals(false);
+        stashCurrentDocument();
+    }
+    else
+    {
+        m_journal->detach(m_saver->isSaving() || hasUnsavedChanges());
+    }
+    m_documentPath.clear();
+
+    if (restoreDocument(filePath))
+    {
+        return;
+    }
+
+    // Files too large for QTextDocument are edited in place instead; UTF-16 ones are streamed below
+    if (QFileInfo(filePath).size() > LargeFileDocument::Threshold && LargeFileDocument::canOpen(filePath))
+    {
+        const OperationResult result = openLargeFile(filePath);
+        if (!result.success)
+        {
+            // The previous large file would otherwise stay shown under the new path
+            closeLargeFile();
+            abandonLoad(filePath, QString::fromStdString(result.message));
+        }
+        return;
+    }
+    closeLargeFile();
 
-        delete m_currentHighlighter;
+    // The previous highlighter would otherwise highlight every loaded chunk
+    if (m_currentHighlighter)
+    {
+        m_currentHighlighter->setDocument(nullptr);
+    }
+
+    // Large files are streamed: the first chunks show up while the rest loads
+    const bool streaming = QFileInfo(filePath).size() > DocumentLoader::StreamingThreshold;
 
-        // Create and assign a new syntax highlighter based on language extension
-        m_currentHighlighter = SyntaxManager::createSyntaxHighlighter(getFileExtension(), m_editor->document()).release();
+    OperationResult result;
+    if (streaming)
+    {
+        result = m_loader->start(filePath, m_editor->document());
     }
     else
     {
-        QMessageBox::critical(nullptr, "Error", "Editor is not initialized.");
+        m_editor->blockSignals(true);
+        result = DocumentLoader::load(filePath, m_editor->document(), &m_textFormat);
+        m_editor->blockSignals(false);
+    }
+
+    if (!result.success)
+    {
+        if (m_currentHighlighter)
+        {
+            m_currentHighlighter->setDocument(m_editor->document());
+        }
+        abandonLoad(filePath, QString::fromStdString(result.message));
+        return;
+    }
+
+    addOpenDocument(filePath);
+
+    if (streaming)
+    {
+        m_editor->setReadOnly(true);
+        m_loadPercent = -1;
+        if (m_mainWindow)
+        {
+            m_mainWindow->setWindowTitle("CodeAstra ~ " + QFileInfo(filePath).fileName() + " (loading)");
+        }
         return;
     }
-    file.close();
+
+    m_editor->moveCursor(QTextCursor::Start);
+    refreshHighlighter();
+    emit m_editor->statusMessageChanged(QString::fromStdString(result.message));
 
     if (m_mainWindow)
     {
@@ -251,7 +483,523 @@ void FileManager::loadFileInEditor(const QString &filePath)
         qWarning() << "MainWindow is not initialized in FileManager.";
     }
 
-    m_isDirty = false;
+    m_documentPath = filePath;
+    recordSavedState(QByteArray());
+    startJournal(filePath);
+    checkLineEndings();
+}
+
+void FileManager::recordSavedState(const QByteArray &hash)
+{
+    // The hash of a loaded file is only computed if an unsaved changes check needs it
+    const QFileInfo file(m_currentFileName);
+    m_savedSize       = file.exists() ? file.size() : -1;
+    m_savedModified   = file.exists() ? file.lastModified() : QDateTime();
+    m_savedHash       = hash;
+    m_savedCharacters = m_editor->document()->characterCount();
+    m_editor->document()->setModified(false);
+}
+
+void FileManager::checkLineEndings()
+{
+    if (!m_textFormat.mixedLineEndings)
+    {
+        return;
+    }
+
+    // The document no longer matches the file, whatever its hash says
+    m_savedCharacters = -1;
+    m_editor->document()->setModified(true);
+    emit m_editor->statusMessageChanged("Mixed line endings: saving will write " + m_textFormat.name().section(", ", 1)
+                                        + " everywhere.");
+}
+
+void FileManager::startJournal(const QString &filePath)
+{
+    QTextDocument *document = m_editor->document();
+
+    // Changes left unsaved by a previous session are replayed onto the file as loaded
+    bool recovered = false;
+    if (QFile::exists(m_journal->journalPath(filePath)))
+    {
+        OperationResult result = m_journal->replay(filePath, document);
+        recovered              = result.success;
+        if (recovered)
+        {
+            emit m_editor->statusMessageChanged(QString::fromStdString(result.message));
+        }
+        else
+        {
+            qWarning() << "[FileManager]" << QString::fromStdString(result.message);
+        }
+    }
+
+    m_journal->attach(document, filePath, recovered);
+}
+
+void FileManager::recoverUnsavedChanges()
+{
+    if (!m_editor)
+    {
+        return;
+    }
+
+    const QStringList files = m_journal->journaledFiles();
+    if (!files.isEmpty())
+    {
+        const QString filePath = files.first();
+        const QString name     = filePath.isEmpty() ? QString("an untitled document") : QFileInfo(filePath).fileName();
+        const auto answer      = QMessageBox::question(nullptr, "Recover unsaved changes",
+                                                       "CodeAstra was closed with unsaved changes to " + name
+                                                           + ". Would you like to recover them?");
+        if (answer == QMessageBox::Yes && !filePath.isEmpty())
+        {
+            m_currentFileName = filePath;
+            loadFileInEditor(filePath);
+            return;
+        }
+        if (answer != QMessageBox::Yes)
+        {
+            m_journal->discard(filePath);
+            m_journal->waitForDone();
+        }
+    }
+
+    // The untitled document shown at startup is journaled too
+    if (m_currentFileName.isEmpty() && !m_journal->isAttached())
+    {
+        startJournal(QString());
+    }
+}
+
+bool FileManager::isLoading() const
+{
+    return m_loader->isLoading();
+}
+
+LargeFileDocument *FileManager::largeFile() const
+{
+    return m_largeFile.get();
+}
+
+OperationResult FileManager::openLargeFile(const QString &filePath)
+{
+    auto document          = std::make_unique<LargeFileDocument>();
+    OperationResult result = document->open(filePath);
+    if (!result.success)
+    {
+        return result;
+    }
+
+    // The code editor gives its memory back while the large file is shown
+    delete m_currentHighlighter;
+    m_currentHighlighter = nullptr;
+    m_editor->blockSignals(true);
+    m_editor->clear();
+    m_editor->blockSignals(false);
+
+    const QString fileName = QFileInfo(filePath).fileName();
+    connect(document.get(), &LargeFileDocument::indexProgress, this, [this, fileName](qint64 indexed, qint64 total)
+    {
+        const int percent = static_cast<int>(indexed * 100 / total);
+        if (percent != m_loadPercent)
+        {
+            m_loadPercent = percent;
+            emit m_editor->statusMessageChanged(QString("Indexing %1... %2%").arg(fileName).arg(percent));
+        }
+    });
+    connect(document.get(), &LargeFileDocument::indexed, this, [this, fileName]()
+    {
+        emit m_editor->statusMessageChanged(fileName + " indexed, editing enabled.");
+        if (m_mainWindow)
+        {
+            m_mainWindow->setWindowTitle("CodeAstra ~ " + fileName);
+        }
+    });
+
+    connect(document.get(), &LargeFileDocument::saved, this, [this](bool success, const QString &message)
+    {
+        if (!success)
+        {
+            QMessageBox::warning(nullptr, "Error", message);
+            return;
+        }
+
+        if (m_mainWindow)
+        {
+            m_mainWindow->setWindowTitle("CodeAstra ~ " + QFileInfo(m_currentFileName).fileName());
+        }
+        emit m_editor->statusMessageChanged(message);
+    });
+
+    closeLargeFile();
+    m_largeFile    = std::move(document);
+    m_loadPercent  = -1;
+    m_documentPath = filePath;
+    addOpenDocument(filePath);
+    emit m_editor->statusMessageChanged(QString::fromStdString(result.message));
+
+    if (m_mainWindow)
+    {
+        LargeFileView *view = m_mainWindow->largeFileView();
+        view->setDocument(m_largeFile.get());
+        view->setSyntax(SyntaxRegistry::getInstance().definitionForExtension(QFileInfo(filePath).suffix().toLower()));
+        m_mainWindow->showLargeFileView(true);
+        m_mainWindow->setWindowTitle("CodeAstra ~ " + fileName + (m_largeFile->isIndexed() ? "" : " (indexing)"));
+    }
+
+    return result;
+}
+
+void FileManager::closeLargeFile()
+{
+    if (!m_largeFile)
+    {
+        return;
+    }
+
+    if (m_mainWindow)
+    {
+        m_mainWindow->largeFileView()->setDocument(nullptr);
+        m_mainWindow->showLargeFileView(false);
+    }
+    m_largeFile.reset();
+}
+
+bool FileManager::switchToFile(const QString &filePath)
+{
+    if (filePath == m_currentFileName)
+    {
+        return true;
+    }
+
+    // A document kept in the cache keeps its unsaved changes: no need to ask
+    if (!isCacheable() && !promptUnsavedChanges())
+    {
+        return false;
+    }
+
+    m_currentFileName = filePath;
+    loadFileInEditor(filePath);
+    return true;
+}
+
+bool FileManager::openFileAtLine(const QString &filePath, int line)
+{
+    if (!switchToFile(filePath) || m_currentFileName != filePath)
+    {
+        return false;
+    }
+
+    if (m_largeFile)
+    {
+        if (m_mainWindow)
+        {
+            m_mainWindow->largeFileView()->goToLine(line - 1);
+        }
+    }
+    else if (isLoading())
+    {
+        m_pendingLine = line;
+    }
+    else
+    {
+        moveToLine(line);
+    }
+    return true;
+}
+
+void FileManager::moveToLine(int line)
+{
+    if (!m_editor)
+    {
+        return;
+    }
+
+    const QTextBlock block = m_editor->document()->findBlockByNumber(line - 1);
+    if (!block.isValid())
+    {
+        return;
+    }
+
+    m_editor->setTextCursor(QTextCursor(block));
+    m_editor->centerCursor();
+    m_editor->setFocus();
+}
+
+void FileManager::closeDocument(const QString &filePath)
+{
+    if (filePath != m_currentFileName)
+    {
+        CachedDocument *cached = m_cache->find(filePath);
+        if (!cached || !cached->document->isModified())
+        {
+            m_cache->remove(filePath);
+            m_openFiles.removeAll(filePath);
+            emit documentsChanged();
+            return;
+        }
+
+        // Shown first, for the user to see which changes the prompt is about
+        if (!switchToFile(filePath) || filePath != m_currentFileName)
+        {
+            return;
+        }
+    }
+
+    if (!promptUnsavedChanges())
+    {
+        return;
+    }
+
+    // Closed, not put aside: the next document is loaded into the editor's own
+    m_openFiles.removeAll(filePath);
+    m_documentPath.clear();
+
+    const QStringList cached = m_cache->filePaths();
+    const QString next       = !cached.isEmpty() ? cached.first() : m_openFiles.isEmpty() ? QString() : m_openFiles.last();
+    if (next.isEmpty())
+    {
+        showUntitledDocument();
+        return;
+    }
+
+    m_currentFileName = next;
+    loadFileInEditor(next);
+}
+
+QStringList FileManager::openDocuments() const
+{
+    return m_openFiles;
+}
+
+bool FileManager::isDocumentModified(const QString &filePath) const
+{
+    if (filePath == m_currentFileName)
+    {
+        return m_largeFile ? m_largeFile->isModified() : m_editor && m_editor->document()->isModified();
+    }
+
+    const CachedDocument *cached = m_cache->find(filePath);
+    return cached && cached->document->isModified();
+}
+
+DocumentCache *FileManager::documentCache() const
+{
+    return m_cache.get();
+}
+
+bool FileManager::isCacheable() const
+{
+    return m_editor && !m_largeFile && !isLoading() && !m_documentPath.isEmpty();
+}
+
+void FileManager::stashCurrentDocument()
+{
+    QTextDocument *document = m_editor->document();
+
+    // The journal keeps unsaved edits, and is restarted from a snapshot when the document is shown again
+    m_journal->detach(m_saver->isSaving() || document->isModified());
+
+    auto entry         = std::make_unique<CachedDocument>();
+    entry->filePath    = m_documentPath;
+    entry->highlighter = m_currentHighlighter;
+    entry->format      = m_textFormat;
+
+    const QTextCursor cursor = m_editor->textCursor();
+    entry->cursorPosition    = cursor.position();
+    entry->anchorPosition    = cursor.anchor();
+    entry->horizontalScroll  = m_editor->horizontalScrollBar()->value();
+    entry->verticalScroll    = m_editor->verticalScrollBar()->value();
+
+    entry->savedSize       = m_savedSize;
+    entry->savedModified   = m_savedModified;
+    entry->savedHash       = m_savedHash;
+    entry->savedCharacters = m_savedCharacters;
+
+    // A document out of view does not follow the editor's viewport
+    if (Syntax *syntax = qobject_cast<Syntax *>(m_currentHighlighter))
+    {
+        disconnect(m_editor, &CodeEditor::visibleBlocksChanged, syntax, &Syntax::setVisibleBlocks);
+    }
+
+    // The editor deletes a document it owns when given another: the cache owns it from now on
+    document->setParent(nullptr);
+    m_editor->setDocument(createDocument());
+    entry->document.reset(document);
+    m_currentHighlighter = nullptr;
+    m_documentPath.clear();
+
+    m_cache->insert(std::move(entry));
+}
+
+bool FileManager::restoreDocument(const QString &filePath)
+{
+    std::unique_ptr<CachedDocument> cached = m_cache->take(filePath);
+    if (!cached)
+    {
+        return false;
+    }
+
+    // An unmodified copy of a file changed on disk since is stale: the file is read again
+    const QFileInfo file(filePath);
+    if (!cached->document->isModified()
+        && (!file.exists() || file.size() != cached->savedSize || file.lastModified() != cached->savedModified))
+    {
+        return false;
+    }
+
+    closeLargeFile();
+
+    // The document in the editor is empty, or was not worth caching
+    QTextDocument *previous = m_editor->document();
+    QTextDocument *document = cached->document.release();
+    previous->setParent(nullptr);
+    document->setParent(m_editor);
+    m_editor->setDocument(document);
+    delete m_currentHighlighter;
+    delete previous;
+
+    m_currentHighlighter = cached->highlighter;
+    m_currentFileName    = filePath;
+    m_documentPath       = filePath;
+    m_textFormat         = cached->format;
+    m_savedSize          = cached->savedSize;
+    m_savedModified      = cached->savedModified;
+    m_savedHash          = cached->savedHash;
+    m_savedCharacters    = cached->savedCharacters;
+
+    if (!m_currentHighlighter)
+    {
+        refreshHighlighter();
+    }
+    else if (Syntax *syntax = qobject_cast<Syntax *>(m_currentHighlighter); syntax && syntax->backgroundHighlighting())
+    {
+        connect(m_editor, &CodeEditor::visibleBlocksChanged, syntax, &Syntax::setVisibleBlocks);
+    }
+
+    QTextCursor cursor(document);
+    cursor.setPosition(cached->anchorPosition);
+    cursor.setPosition(cached->cursorPosition, QTextCursor::KeepAnchor);
+    m_editor->setTextCursor(cursor);
+    m_editor->horizontalScrollBar()->setValue(cached->horizontalScroll);
+    m_editor->verticalScrollBar()->setValue(cached->verticalScroll);
+
+    m_journal->attach(document, filePath);
+    if (document->isModified())
+    {
+        m_journal->compact();
+    }
+
+    if (m_mainWindow)
+    {
+        m_mainWindow->setWindowTitle("CodeAstra ~ " + file.fileName());
+    }
+    addOpenDocument(filePath);
+    return true;
+}
+
+QTextDocument *FileManager::createDocument() const
+{
+    QTextDocument *current  = m_editor->document();
+    QTextDocument *document = new QTextDocument(m_editor);
+    document->setDocumentLayout(new QPlainTextDocumentLayout(document));
+    document->setDefaultFont(current->defaultFont());
+    document->setDefaultTextOption(current->defaultTextOption());
+    return document;
+}
+
+void FileManager::addOpenDocument(const QString &filePath)
+{
+    if (!m_openFiles.contains(filePath))
+    {
+        m_openFiles << filePath;
+    }
+    emit documentsChanged();
+}
+
+void FileManager::cancelLoading()
+{
+    if (!isLoading())
+    {
+        return;
+    }
+
+    m_loader->cancel();
+    if (m_editor)
+    {
+        m_editor->setReadOnly(false);
+    }
+}
+
+void FileManager::onLoadProgress(qint64 loadedBytes, qint64 totalBytes)
+{
+    if (!m_editor || totalBytes <= 0)
+    {
+        return;
+    }
+
+    // One status update per percent
+    const int percent = static_cast<int>(loadedBytes * 100 / totalBytes);
+    if (percent != m_loadPercent)
+    {
+        m_loadPercent = percent;
+        emit m_editor->statusMessageChanged(
+            QString("Loading %1... %2%").arg(QFileInfo(m_loader->filePath()).fileName()).arg(percent));
+    }
+}
+
+void FileManager::onLoadFinished(bool success, const QString &message)
+{
+    if (!m_editor)
+    {
+        return;
+    }
+
+    m_editor->setReadOnly(false);
+
+    const int pendingLine = m_pendingLine;
+    m_pendingLine         = 0;
+
+    if (!success)
+    {
+        abandonLoad(m_loader->filePath(), message);
+        return;
+    }
+
+    refreshHighlighter();
+    emit m_editor->statusMessageChanged(message);
+
+    if (m_mainWindow)
+    {
+        m_mainWindow->setWindowTitle("CodeAstra ~ " + QFileInfo(m_loader->filePath()).fileName());
+    }
+
+    m_textFormat   = m_loader->format();
+    m_documentPath = m_loader->filePath();
+    recordSavedState(QByteArray());
+    startJournal(m_loader->filePath());
+    checkLineEndings();
+
+    if (pendingLine > 0)
+    {
+        moveToLine(pendingLine);
+    }
+}
+
+void FileManager::abandonLoad(const QString &filePath, const QString &message)
+{
+    // Never leave an empty or partial copy that could be saved over the file
+    m_openFiles.removeAll(filePath);
+    m_currentFileName.clear();
+    m_documentPath.clear();
+    m_textFormat = TextFormat();
+    emit documentsChanged();
+    if (m_mainWindow)
+    {
+        m_mainWindow->setWindowTitle("Untitle ~ Code Astra");
+    }
+    QMessageBox::warning(nullptr, "Error", message);
 }
 
 QString FileManager::getFileExtension() const
@@ -431,6 +1179,22 @@ OperationResult FileManager::newFolder(const QFileInfo &pathInfo, QString newFol
     return {true, newPath.filename().string() + " created successfully."};
 }
 
+// The first free "<name>_copy<ext>", "<name>_copy1<ext>"... next to the path
+std::filesystem::path duplicateTarget(const std::filesystem::path &filePath)
+{
+    std::string fileName           = filePath.stem().string();
+    std::filesystem::path dupPath  = filePath.parent_path() / (fileName + "_copy" + filePath.extension().c_str());
+
+    int counter = 1;
+    while (QFileInfo(dupPath).exists())
+    {
+        dupPath = filePath.parent_path() / (fileName + "_copy" + std::to_string(counter) + filePath.extension().c_str());
+        counter++;
+    }
+
+    return dupPath;
+}
+
 OperationResult FileManager::duplicatePath(const QFileInfo &pathInfo)
 {
     std::filesystem::path filePath = pathInfo.absoluteFilePath().toStdString();
@@ -441,26 +1205,31 @@ OperationResult FileManager::duplicatePath(const QFileInfo &pathInfo)
         return {false , "ERROR: invalid path."};
     }
 
-    std::string fileName           = filePath.stem().string();
-    std::filesystem::path dupPath  = filePath.parent_path() / (fileName + "_copy" + filePath.extension().c_str());
+    std::filesystem::path dupPath = duplicateTarget(filePath);
 
-    int counter = 1;
-    while (QFileInfo(dupPath).exists())
+    CopyJob job(QString::fromStdString(filePath.string()), QString::fromStdString(dupPath.string()));
+    OperationResult result = job.run();
+    if (result.success)
     {
-        dupPath = filePath.parent_path() / (fileName + "_copy" + std::to_string(counter) + filePath.extension().c_str());
-        counter++;
+        qDebug() << "Duplicated file to:" << QString::fromStdString(dupPath.string());
     }
 
-    try
-    {
-        std::filesystem::copy(filePath, dupPath, std::filesystem::copy_options::recursive); // copy_option is needed for duplicating nested directories
-    }
-    catch (const std::filesystem::filesystem_error &e)
+    return result;
+}
+
+CopyJob *FileManager::duplicatePathAsync(const QFileInfo &pathInfo, QObject *parent)
+{
+    std::filesystem::path filePath = pathInfo.absoluteFilePath().toStdString();
+
+    if (!isValidPath(filePath))
     {
-        return {false, e.what()};
+        return nullptr;
     }
 
-    qDebug() << "Duplicated file to:" << QString::fromStdString(dupPath.string());
+    std::filesystem::path dupPath = duplicateTarget(filePath);
+
+    CopyJob *job = new CopyJob(QString::fromStdString(filePath.string()), QString::fromStdString(dupPath.string()), parent);
+    job->start();
 
-    return {true, dupPath.filename().string() + " duplicated successfully."};
+    return job;
 }
@@ -0,0 +1,1102 @@
+#include "FileTreeModel.h"
+#include "DirectoryWatcher.h"
+
+#include <QAbstractFileIconProvider>
+#include <QColor>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMimeData>
+#include <QThread>
+#include <QUrl>
+#include <algorithm>
+
+namespace
+{
+    // Directories first, then names without case, with case breaking ties
+    bool lessThan(bool leftIsDirectory, QStringView left, bool rightIsDirectory, QStringView right)
+    {
+        if (leftIsDirectory != rightIsDirectory)
+        {
+            return leftIsDirectory;
+        }
+
+        const int order = left.compare(right, Qt::CaseInsensitive);
+        return order != 0 ? order < 0 : left.compare(right, Qt::CaseSensitive) < 0;
+    }
+
+    QString joinPath(const QString &directory, const QString &name)
+    {
+        return directory.endsWith('/') ? directory + name : directory + '/' + name;
+    }
+}
+
+FileTreeModel::FileTreeModel(QObject *parent)
+    : QAbstractItemModel(parent)
+{
+    m_pool.setMaxThreadCount(std::max(QThread::idealThreadCount(), 2));
+
+    m_coalesceTimer.setSingleShot(true);
+    m_coalesceTimer.setInterval(CoalesceInterval);
+    connect(&m_coalesceTimer, &QTimer::timeout, this, &FileTreeModel::flushChanges);
+
+    // Writes are only followed for ignore files
+    DirectoryWatcher &watcher = DirectoryWatcher::getInstance();
+    connect(&watcher, &DirectoryWatcher::entriesChanged, this, &FileTreeModel::onEntriesChanged);
+    connect(&watcher, &DirectoryWatcher::fileWritten, this, [this](const QString &directory, const QString &name)
+    {
+        if (IgnoreRules::isIgnoreFile(name))
+        {
+            onEntriesChanged(directory, name);
+        }
+    });
+    connect(&watcher, &DirectoryWatcher::directoryRemoved, this, &FileTreeModel::onDirectoryRemoved);
+    connect(&watcher, &DirectoryWatcher::overflowed, this, &FileTreeModel::onOverflowed);
+
+    clear();
+}
+
+FileTreeModel::~FileTreeModel()
+{
+    // Workers call back into the model, which must outlive them
+    m_pool.clear();
+    m_pool.waitForDone();
+
+    DirectoryWatcher::getInstance().unwatch(m_watches.values());
+}
+
+QModelIndex FileTreeModel::setRootPath(const QString &path)
+{
+    const QString rootPath = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    if (!m_rootPath.isEmpty() && rootPath != m_rootPath)
+    {
+        clear();
+    }
+    m_rootPath = rootPath;
+
+    const QModelIndex root = index(rootPath);
+    m_rootNode             = root.isValid() ? nodeOf(root) : NoNode;
+    if (canFetchMore(root))
+    {
+        fetchMore(root);
+    }
+    return root;
+}
+
+QString FileTreeModel::rootPath() const
+{
+    return m_rootPath;
+}
+
+void FileTreeModel::setExcludes(const IgnoreRules &excludes)
+{
+    m_excludes = excludes.isEmpty() ? nullptr : std::make_shared<const IgnoreRules>(excludes);
+    rescanSubtree(m_rootNode);
+}
+
+void FileTreeModel::setShowIgnored(bool show)
+{
+    if (m_showIgnored != show)
+    {
+        m_showIgnored = show;
+        rescanSubtree(m_rootNode);
+    }
+}
+
+bool FileTreeModel::showIgnored() const
+{
+    return m_showIgnored;
+}
+
+void FileTreeModel::setIconProvider(QAbstractFileIconProvider *provider)
+{
+    m_folderIcon   = provider ? provider->icon(QAbstractFileIconProvider::Folder) : QIcon();
+    m_fileIcon     = provider ? provider->icon(QAbstractFileIconProvider::File) : QIcon();
+}
+
+QModelIndex FileTreeModel::index(const QString &path, int column)
+{
+    const quint32 id = nodeAt(path, true);
+    if (id == NoNode || id == 0 || column != 0)
+    {
+        return QModelIndex();
+    }
+    return indexOf(id);
+}
+
+QModelIndex FileTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    const std::vector<quint32> &children = childrenOf(nodeOf(parent));
+    if (row < 0 || row >= static_cast<int>(children.size()) || column != 0)
+    {
+        return QModelIndex();
+    }
+    return createIndex(row, 0, static_cast<quintptr>(children[row]));
+}
+
+QModelIndex FileTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid())
+    {
+        return QModelIndex();
+    }
+    return indexOf(m_nodes[nodeOf(child)].parent);
+}
+
+QString FileTreeModel::filePath(const QModelIndex &index) const
+{
+    return index.isValid() ? pathOf(nodeOf(index)) : QString();
+}
+
+QString FileTreeModel::fileName(const QModelIndex &index) const
+{
+    return index.isValid() ? m_names.name(m_nodes[nodeOf(index)].name).toString() : QString();
+}
+
+QFileInfo FileTreeModel::fileInfo(const QModelIndex &index) const
+{
+    return QFileInfo(filePath(index));
+}
+
+bool FileTreeModel::isDir(const QModelIndex &index) const
+{
+    return index.isValid() && m_nodes[nodeOf(index)].isDirectory;
+}
+
+bool FileTreeModel::isIgnored(const QModelIndex &index) const
+{
+    return index.isValid() && m_nodes[nodeOf(index)].isIgnored;
+}
+
+bool FileTreeModel::isFetched(const QModelIndex &index) const
+{
+    return index.isValid() && m_nodes[nodeOf(index)].state == State::Fetched;
+}
+
+int FileTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+    {
+        return 0;
+    }
+    return static_cast<int>(childrenOf(nodeOf(parent)).size());
+}
+
+int FileTreeModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return 1;
+}
+
+bool FileTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    const quint32 id = nodeOf(parent);
+    const Node &node = m_nodes[id];
+    if (!node.isDirectory)
+    {
+        return false;
+    }
+
+    // Unlisted directories get an expander until they turn out to be empty
+    return node.state != State::Fetched || !childrenOf(id).empty();
+}
+
+QVariant FileTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+    {
+        return QVariant();
+    }
+
+    const Node &node = m_nodes[nodeOf(index)];
+    switch (role)
+    {
+    case Qt::DisplayRole:
+    case Qt::EditRole:
+    case FileNameRole:
+        return m_names.name(node.name).toString();
+    case Qt::DecorationRole:
+        return node.isDirectory ? m_folderIcon : m_fileIcon;
+    case Qt::ForegroundRole:
+        return node.isIgnored ? QVariant(QColor(Qt::gray)) : QVariant();
+    case FilePathRole:
+        return filePath(index);
+    default:
+        return QVariant();
+    }
+}
+
+QVariant FileTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (section == 0 && orientation == Qt::Horizontal && role == Qt::DisplayRole)
+    {
+        return tr("Name");
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags FileTreeModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+    {
+        return Qt::ItemIsDropEnabled;
+    }
+
+    Qt::ItemFlags flags = Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
+    flags |= m_nodes[nodeOf(index)].isDirectory ? Qt::ItemIsDropEnabled : Qt::ItemNeverHasChildren;
+    return flags;
+}
+
+bool FileTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    const Node &node = m_nodes[nodeOf(parent)];
+    return node.isDirectory && node.state == State::Unfetched;
+}
+
+void FileTreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (canFetchMore(parent))
+    {
+        startReading(nodeOf(parent));
+    }
+}
+
+Qt::DropActions FileTreeModel::supportedDropActions() const
+{
+    return Qt::CopyAction | Qt::MoveAction | Qt::LinkAction;
+}
+
+QStringList FileTreeModel::mimeTypes() const
+{
+    return {QStringLiteral("text/uri-list")};
+}
+
+QMimeData *FileTreeModel::mimeData(const QModelIndexList &indexes) const
+{
+    QList<QUrl> urls;
+    for (const QModelIndex &index : indexes)
+    {
+        if (index.column() == 0)
+        {
+            urls << QUrl::fromLocalFile(filePath(index));
+        }
+    }
+
+    QMimeData *data = new QMimeData();
+    data->setUrls(urls);
+    return data;
+}
+
+bool FileTreeModel::dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column,
+                                 const QModelIndex &parent)
+{
+    Q_UNUSED(row);
+    Q_UNUSED(column);
+
+    if (!data->hasUrls() || !(supportedDropActions() & action))
+    {
+        return false;
+    }
+
+    QString directory = parent.isValid() ? filePath(parent) : m_rootPath;
+    if (parent.isValid() && !isDir(parent))
+    {
+        directory = QFileInfo(directory).path();
+    }
+
+    // The watch on the target directory picks up the new rows
+    bool success = true;
+    for (const QUrl &url : data->urls())
+    {
+        const QString source = url.toLocalFile();
+        const QString target = joinPath(directory, QFileInfo(source).fileName());
+        if (source.isEmpty() || source == target)
+        {
+            continue;
+        }
+
+        bool done = false;
+        switch (action)
+        {
+        case Qt::CopyAction:
+            done = QFile::copy(source, target);
+            break;
+        case Qt::LinkAction:
+            done = QFile::link(source, target);
+            break;
+        default:
+            done = QFile::rename(source, target);
+            break;
+        }
+
+        if (!done)
+        {
+            qWarning() << "[FileTreeModel] Cannot drop" << source << "into" << directory;
+            success = false;
+        }
+    }
+    return success;
+}
+
+int FileTreeModel::nodeCount() const
+{
+    return static_cast<int>(m_nodes.size() - m_freeNodes.size()) - 1;
+}
+
+int FileTreeModel::watchCount() const
+{
+    return m_watches.size();
+}
+
+qint64 FileTreeModel::memoryUsage() const
+{
+    qint64 usage = static_cast<qint64>(m_nodes.capacity() * sizeof(Node) + m_freeNodes.capacity() * sizeof(quint32)
+                                       + m_children.capacity() * sizeof(std::vector<quint32>)
+                                       + m_freeChildren.capacity() * sizeof(quint32));
+    for (const std::vector<quint32> &children : m_children)
+    {
+        usage += static_cast<qint64>(children.capacity() * sizeof(quint32));
+    }
+    return usage + m_names.memoryUsage();
+}
+
+quint32 FileTreeModel::allocateNode(quint32 parent, const DirectoryReader::Entry &entry)
+{
+    quint32 id;
+    if (!m_freeNodes.empty())
+    {
+        id = m_freeNodes.back();
+        m_freeNodes.pop_back();
+    }
+    else
+    {
+        id = static_cast<quint32>(m_nodes.size());
+        m_nodes.emplace_back();
+    }
+
+    quint32 children = NoChildren;
+    if (entry.isDirectory)
+    {
+        if (!m_freeChildren.empty())
+        {
+            children = m_freeChildren.back();
+            m_freeChildren.pop_back();
+        }
+        else
+        {
+            children = static_cast<quint32>(m_children.size());
+            m_children.emplace_back();
+        }
+    }
+
+    Node &node       = m_nodes[id];
+    node.name        = m_names.intern(entry.name);
+    node.parent      = parent;
+    node.children    = children;
+    node.isDirectory = entry.isDirectory;
+    node.isSymLink   = entry.isSymLink;
+    node.isIgnored   = entry.isIgnored;
+    node.isBusy      = false;
+    node.state       = State::Unfetched;
+    return id;
+}
+
+void FileTreeModel::freeSubtree(quint32 id)
+{
+    std::vector<quint32> stack{id};
+    while (!stack.empty())
+    {
+        const quint32 current = stack.back();
+        stack.pop_back();
+
+        Node &node = m_nodes[current];
+        if (node.children != NoChildren)
+        {
+            std::vector<quint32> &children = m_children[node.children];
+            stack.insert(stack.end(), children.begin(), children.end());
+            std::vector<quint32>().swap(children);
+            m_freeChildren.push_back(node.children);
+        }
+
+        unwatch(current);
+        m_pending.remove(current);
+        m_ignoreRules.remove(current);
+
+        // A new serial makes results still on their way for this node stale
+        const quint32 serial = node.serial + 1;
+        node                 = Node();
+        node.serial          = serial;
+        m_freeNodes.push_back(current);
+    }
+}
+
+QModelIndex FileTreeModel::indexOf(quint32 id) const
+{
+    if (id == 0 || id == NoNode)
+    {
+        return QModelIndex();
+    }
+    return createIndex(rowOf(id), 0, static_cast<quintptr>(id));
+}
+
+int FileTreeModel::rowOf(quint32 id) const
+{
+    const Node &node = m_nodes[id];
+    return lowerBound(node.parent, m_names.name(node.name), node.isDirectory);
+}
+
+const std::vector<quint32> &FileTreeModel::childrenOf(quint32 id) const
+{
+    static const std::vector<quint32> none;
+    const quint32 children = m_nodes[id].children;
+    return children == NoChildren ? none : m_children[children];
+}
+
+quint32 FileTreeModel::nodeOf(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<quint32>(index.internalId()) : 0;
+}
+
+QString FileTreeModel::pathOf(quint32 id) const
+{
+    QStringList names;
+    for (quint32 current = id; current != 0 && current != NoNode; current = m_nodes[current].parent)
+    {
+        names.prepend(m_names.name(m_nodes[current].name).toString());
+    }
+
+    if (names.isEmpty())
+    {
+        return QString();
+    }
+
+    // The top level node is a root such as "/" or "C:/"
+    const QString root = names.takeFirst();
+    return root + names.join('/');
+}
+
+FileTreeModel::Ticket FileTreeModel::ticketOf(quint32 id) const
+{
+    return {id, m_nodes[id].serial, m_generation};
+}
+
+bool FileTreeModel::isCurrent(const Ticket &ticket) const
+{
+    return ticket.generation == m_generation && ticket.id < m_nodes.size()
+           && m_nodes[ticket.id].serial == ticket.serial && m_nodes[ticket.id].parent != NoNode;
+}
+
+quint32 FileTreeModel::nodeAt(const QString &path, bool create)
+{
+    const QString cleanPath = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    const int slash         = cleanPath.indexOf('/');
+    if (slash < 0)
+    {
+        return NoNode;
+    }
+
+    QString current = cleanPath.left(slash + 1);
+    quint32 id      = 0;
+    DirectoryReader::Entry entry;
+
+    const QStringList names = cleanPath.mid(slash + 1).split('/', Qt::SkipEmptyParts);
+    for (int i = -1; i < names.size(); ++i)
+    {
+        const QString name = i < 0 ? current : names[i];
+        if (i >= 0)
+        {
+            if (!m_nodes[id].isDirectory)
+            {
+                return NoNode;
+            }
+            current = joinPath(current, name);
+        }
+
+        quint32 child = findChild(id, name);
+        if (child == NoNode)
+        {
+            if (!create || !DirectoryReader::entry(current, &entry))
+            {
+                return NoNode;
+            }
+
+            // Listed ahead of its parent; the parent's listing keeps the node
+            entry.name = name;
+            child      = insertChild(id, entry);
+        }
+        id = child;
+    }
+    return id;
+}
+
+bool FileTreeModel::ignoreRulesOf(quint32 id, bool withOwn, RuleChain *chain, QString *relativePath) const
+{
+    chain->clear();
+    if (m_rootNode == NoNode)
+    {
+        return false;
+    }
+
+    std::vector<quint32> directories;
+    quint32 current = id;
+    for (; current != m_rootNode; current = m_nodes[current].parent)
+    {
+        if (current == 0 || current == NoNode)
+        {
+            return false;
+        }
+        directories.push_back(current);
+    }
+    directories.push_back(m_rootNode);
+
+    if (m_excludes)
+    {
+        chain->push_back(m_excludes);
+    }
+    for (auto it = directories.crbegin(); it != directories.crend(); ++it)
+    {
+        if (*it == id && !withOwn)
+        {
+            continue;
+        }
+
+        const auto rules = m_ignoreRules.constFind(*it);
+        if (rules != m_ignoreRules.cend())
+        {
+            chain->push_back(rules.value());
+        }
+    }
+
+    // Names below the root, in the order read from the root down
+    QStringList names;
+    for (auto it = directories.crbegin() + 1; it != directories.crend(); ++it)
+    {
+        names << m_names.name(m_nodes[*it].name).toString();
+    }
+    *relativePath = names.join('/');
+    return true;
+}
+
+void FileTreeModel::rescanSubtree(quint32 id)
+{
+    if (id == NoNode || id == 0)
+    {
+        return;
+    }
+
+    std::vector<quint32> stack{id};
+    while (!stack.empty())
+    {
+        const quint32 current = stack.back();
+        stack.pop_back();
+
+        // Directories being read are read again once done
+        if (m_nodes[current].state == State::Unfetched)
+        {
+            continue;
+        }
+
+        m_pending[current].rescan = true;
+        for (const quint32 child : childrenOf(current))
+        {
+            if (m_nodes[child].isDirectory)
+            {
+                stack.push_back(child);
+            }
+        }
+    }
+
+    if (!m_pending.isEmpty() && !m_coalesceTimer.isActive())
+    {
+        m_coalesceTimer.start();
+    }
+}
+
+void FileTreeModel::clear()
+{
+    beginResetModel();
+
+    DirectoryWatcher::getInstance().unwatch(m_watches.values());
+    m_watches.clear();
+    m_watchedNodes.clear();
+    m_pending.clear();
+    m_ignoreRules.clear();
+    m_coalesceTimer.stop();
+    m_rootNode = NoNode;
+
+    // Node 0 is the invisible root, whose children are the top level roots
+    Node root;
+    root.parent      = 0;
+    root.children    = 0;
+    root.isDirectory = true;
+    root.state       = State::Fetched;
+
+    m_nodes.assign(1, root);
+    m_freeNodes.clear();
+    m_children.assign(1, {});
+    m_freeChildren.clear();
+    m_names = NamePool();
+    ++m_generation;
+
+    endResetModel();
+}
+
+int FileTreeModel::lowerBound(quint32 parent, QStringView name, bool isDirectory) const
+{
+    const std::vector<quint32> &children = childrenOf(parent);
+    const auto it = std::lower_bound(children.begin(), children.end(), name, [&](quint32 child, QStringView value)
+    {
+        const Node &node = m_nodes[child];
+        return lessThan(node.isDirectory, m_names.name(node.name), isDirectory, value);
+    });
+    return static_cast<int>(it - children.begin());
+}
+
+quint32 FileTreeModel::findChild(quint32 parent, QStringView name) const
+{
+    const std::vector<quint32> &children = childrenOf(parent);
+    for (const bool isDirectory : {true, false})
+    {
+        const int row = lowerBound(parent, name, isDirectory);
+        if (row < static_cast<int>(children.size()))
+        {
+            const Node &node = m_nodes[children[row]];
+            if (node.isDirectory == isDirectory && m_names.name(node.name) == name)
+            {
+                return children[row];
+            }
+        }
+    }
+    return NoNode;
+}
+
+quint32 FileTreeModel::insertChild(quint32 parent, const DirectoryReader::Entry &entry)
+{
+    const int row = lowerBound(parent, entry.name, entry.isDirectory);
+    beginInsertRows(indexOf(parent), row, row);
+
+    const quint32 id                = allocateNode(parent, entry);
+    std::vector<quint32> &children = m_children[m_nodes[parent].children];
+    children.insert(children.begin() + row, id);
+
+    endInsertRows();
+    return id;
+}
+
+void FileTreeModel::removeChild(quint32 parent, QStringView name)
+{
+    const quint32 id = findChild(parent, name);
+    if (id == NoNode)
+    {
+        return;
+    }
+
+    const int row = rowOf(id);
+    beginRemoveRows(indexOf(parent), row, row);
+
+    std::vector<quint32> &children = m_children[m_nodes[parent].children];
+    children.erase(children.begin() + row);
+    freeSubtree(id);
+
+    endRemoveRows();
+}
+
+void FileTreeModel::applyListing(const Ticket &ticket, const std::vector<DirectoryReader::Entry> &entries,
+                                 const std::shared_ptr<const IgnoreRules> &rules)
+{
+    if (!isCurrent(ticket))
+    {
+        return;
+    }
+
+    const quint32 id   = ticket.id;
+    m_nodes[id].state  = State::Fetched;
+    m_nodes[id].isBusy = false;
+
+    if (rules)
+    {
+        m_ignoreRules.insert(id, rules);
+    }
+    else
+    {
+        m_ignoreRules.remove(id);
+    }
+
+    const QModelIndex parent = indexOf(id);
+    const quint32 slot       = m_nodes[id].children;
+
+    if (m_children[slot].empty())
+    {
+        // First listing: the entries are sorted already, and go in at once
+        if (!entries.empty())
+        {
+            beginInsertRows(parent, 0, static_cast<int>(entries.size()) - 1);
+            std::vector<quint32> children;
+            children.reserve(entries.size());
+            for (const DirectoryReader::Entry &entry : entries)
+            {
+                children.push_back(allocateNode(id, entry));
+            }
+            m_children[slot] = std::move(children);
+            endInsertRows();
+        }
+    }
+    else
+    {
+        // Listed again: remove the rows that are gone, in contiguous runs,
+        // then insert the new ones where they belong
+        QHash<quint32, bool> listed;
+        listed.reserve(static_cast<qsizetype>(entries.size()));
+        for (const DirectoryReader::Entry &entry : entries)
+        {
+            listed.insert(m_names.intern(entry.name), entry.isDirectory);
+        }
+
+        const auto isListed = [&](quint32 child)
+        {
+            const auto it = listed.constFind(m_nodes[child].name);
+            return it != listed.cend() && it.value() == m_nodes[child].isDirectory;
+        };
+
+        for (int last = static_cast<int>(m_children[slot].size()) - 1; last >= 0;)
+        {
+            if (isListed(m_children[slot][last]))
+            {
+                --last;
+                continue;
+            }
+
+            int first = last;
+            while (first > 0 && !isListed(m_children[slot][first - 1]))
+            {
+                --first;
+            }
+
+            beginRemoveRows(parent, first, last);
+            std::vector<quint32> &children = m_children[slot];
+            const std::vector<quint32> removed(children.begin() + first, children.begin() + last + 1);
+            children.erase(children.begin() + first, children.begin() + last + 1);
+            for (const quint32 child : removed)
+            {
+                freeSubtree(child);
+            }
+            endRemoveRows();
+
+            last = first - 1;
+        }
+
+        for (const DirectoryReader::Entry &entry : entries)
+        {
+            const quint32 child = findChild(id, entry.name);
+            if (child == NoNode)
+            {
+                insertChild(id, entry);
+            }
+            else
+            {
+                setIgnored(child, entry.isIgnored);
+            }
+        }
+    }
+
+    emit directoryLoaded(pathOf(id));
+}
+
+void FileTreeModel::applyChanges(const Ticket &ticket, const std::vector<DirectoryReader::Entry> &present,
+                                 const QStringList &absent)
+{
+    if (!isCurrent(ticket))
+    {
+        return;
+    }
+
+    const quint32 id   = ticket.id;
+    m_nodes[id].isBusy = false;
+
+    for (const QString &name : absent)
+    {
+        removeChild(id, name);
+    }
+
+    for (const DirectoryReader::Entry &entry : present)
+    {
+        const quint32 child = findChild(id, entry.name);
+        if (child != NoNode)
+        {
+            if (m_nodes[child].isDirectory == entry.isDirectory)
+            {
+                setIgnored(child, entry.isIgnored);
+                continue;
+            }
+            removeChild(id, entry.name); // Replaced by an entry of another type
+        }
+        insertChild(id, entry);
+    }
+}
+
+void FileTreeModel::setIgnored(quint32 id, bool isIgnored)
+{
+    if (m_nodes[id].isIgnored != isIgnored)
+    {
+        m_nodes[id].isIgnored = isIgnored;
+
+        const QModelIndex index = indexOf(id);
+        emit dataChanged(index, index, {Qt::ForegroundRole});
+    }
+}
+
+void FileTreeModel::startReading(quint32 id)
+{
+    // Watched before reading, so that no change falls between the two
+    watch(id);
+
+    m_nodes[id].state  = State::Fetching;
+    m_nodes[id].isBusy = true;
+
+    RuleChain rules;
+    QString relativePath;
+    const bool isFiltered = ignoreRulesOf(id, false, &rules, &relativePath);
+
+    const Ticket ticket     = ticketOf(id);
+    const QString path      = pathOf(id);
+    const bool showIgnored  = m_showIgnored;
+    m_pool.start([this, ticket, path, isFiltered, rules, relativePath, showIgnored]() mutable
+    {
+        std::vector<DirectoryReader::Entry> entries = DirectoryReader::read(path);
+
+        // The ignore files of the directory apply to its own entries
+        std::shared_ptr<const IgnoreRules> ownRules;
+        if (isFiltered)
+        {
+            ownRules = IgnoreRules::readDirectory(path, relativePath, entries);
+            if (ownRules)
+            {
+                rules.push_back(ownRules);
+            }
+            IgnoreRules::markIgnored(entries, rules, relativePath, showIgnored);
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const DirectoryReader::Entry &left, const DirectoryReader::Entry &right)
+        {
+            return lessThan(left.isDirectory, left.name, right.isDirectory, right.name);
+        });
+
+        QMetaObject::invokeMethod(this, [this, ticket, entries = std::move(entries), rules = std::move(ownRules)]()
+        {
+            applyListing(ticket, entries, rules);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void FileTreeModel::startChecking(quint32 id, const QStringList &names)
+{
+    m_nodes[id].isBusy = true;
+
+    RuleChain rules;
+    QString relativePath;
+    ignoreRulesOf(id, true, &rules, &relativePath);
+
+    const Ticket ticket    = ticketOf(id);
+    const QString path     = pathOf(id);
+    const bool showIgnored = m_showIgnored;
+    m_pool.start([this, ticket, path, names, rules, relativePath, showIgnored]()
+    {
+        std::vector<DirectoryReader::Entry> present;
+        QStringList absent;
+        for (const QString &name : names)
+        {
+            DirectoryReader::Entry entry;
+            if (DirectoryReader::entry(joinPath(path, name), &entry))
+            {
+                entry.name = name;
+                present.push_back(std::move(entry));
+            }
+            else
+            {
+                absent << name;
+            }
+        }
+
+        // Hidden ignored entries are as good as gone
+        IgnoreRules::markIgnored(present, rules, relativePath, true);
+        if (!showIgnored)
+        {
+            for (const DirectoryReader::Entry &entry : present)
+            {
+                if (entry.isIgnored)
+                {
+                    absent << entry.name;
+                }
+            }
+            std::erase_if(present, [](const DirectoryReader::Entry &entry) { return entry.isIgnored; });
+        }
+
+        QMetaObject::invokeMethod(this, [this, ticket, present = std::move(present), absent = std::move(absent)]()
+        {
+            applyChanges(ticket, present, absent);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void FileTreeModel::watch(quint32 id)
+{
+    if (m_watches.contains(id))
+    {
+        return;
+    }
+
+    const QString path = pathOf(id);
+    if (!m_watchedNodes.contains(path) && DirectoryWatcher::getInstance().watch(path))
+    {
+        m_watches.insert(id, path);
+        m_watchedNodes.insert(path, id);
+    }
+}
+
+void FileTreeModel::unwatch(quint32 id)
+{
+    const auto it = m_watches.constFind(id);
+    if (it == m_watches.cend())
+    {
+        return;
+    }
+
+    DirectoryWatcher::getInstance().unwatch(it.value());
+    m_watchedNodes.remove(it.value());
+    m_watches.erase(it);
+}
+
+void FileTreeModel::onEntriesChanged(const QString &directory, const QString &name)
+{
+    const quint32 id = m_watchedNodes.value(directory, NoNode);
+    if (id == NoNode)
+    {
+        return;
+    }
+
+    // Without a name, the watcher only knows that something changed
+    if (name.isEmpty())
+    {
+        m_pending[id].rescan = true;
+        if (!m_coalesceTimer.isActive())
+        {
+            m_coalesceTimer.start();
+        }
+        return;
+    }
+    markChanged(id, name);
+}
+
+void FileTreeModel::onDirectoryRemoved(const QString &directory)
+{
+    // Also seen by the parent when it is watched; not when it is the root
+    const quint32 id = m_watchedNodes.value(directory, NoNode);
+    if (id == NoNode)
+    {
+        return;
+    }
+
+    const quint32 parent = m_nodes[id].parent;
+    if (parent != 0)
+    {
+        markChanged(parent, m_names.name(m_nodes[id].name).toString());
+    }
+}
+
+void FileTreeModel::onOverflowed()
+{
+    // Events were lost: every watched directory is read again
+    for (auto it = m_watches.cbegin(); it != m_watches.cend(); ++it)
+    {
+        m_pending[it.key()].rescan = true;
+    }
+    if (!m_pending.isEmpty())
+    {
+        m_coalesceTimer.start();
+    }
+}
+
+void FileTreeModel::markChanged(quint32 id, const QString &name)
+{
+    // New patterns may hide or show entries anywhere below
+    if (IgnoreRules::isIgnoreFile(name))
+    {
+        rescanSubtree(id);
+        return;
+    }
+
+    PendingChanges &changes = m_pending[id];
+    if (!changes.rescan)
+    {
+        changes.names.insert(name);
+        if (changes.names.size() > RescanThreshold)
+        {
+            changes.rescan = true;
+            changes.names.clear();
+        }
+    }
+
+    if (!m_coalesceTimer.isActive())
+    {
+        m_coalesceTimer.start();
+    }
+}
+
+void FileTreeModel::suspendChanges()
+{
+    ++m_suspended;
+}
+
+void FileTreeModel::resumeChanges()
+{
+    if (m_suspended == 0 || --m_suspended > 0)
+    {
+        return;
+    }
+    if (!m_pending.isEmpty())
+    {
+        flushChanges();
+    }
+}
+
+void FileTreeModel::flushChanges()
+{
+    // Kept for resumeChanges(), which flushes them all at once
+    if (m_suspended > 0)
+    {
+        return;
+    }
+
+    QHash<quint32, PendingChanges> pending;
+    pending.swap(m_pending);
+
+    for (auto it = pending.begin(); it != pending.end(); ++it)
+    {
+        const quint32 id = it.key();
+        const Node &node = m_nodes[id];
+
+        // Results of one directory are applied in order: wait for the one in flight
+        if (node.isBusy)
+        {
+            m_pending.insert(id, std::move(it.value()));
+            continue;
+        }
+
+        if (it->rescan)
+        {
+            if (node.state == State::Fetched)
+            {
+                startReading(id);
+            }
+        }
+        else
+        {
+            startChecking(id, it->names.values());
+        }
+    }
+
+    if (!m_pending.isEmpty())
+    {
+        m_coalesceTimer.start();
+    }
+}
@@ -0,0 +1,369 @@
+#include "HighlightScheduler.h"
+
+#include <QTextDocument>
+#include <QElapsedTimer>
+#include <QHash>
+
+namespace
+{
+    // Publish at least every BatchSize blocks or BatchInterval milliseconds
+    constexpr qsizetype BatchSize  = 512;
+    constexpr qint64 BatchInterval = 16;
+}
+
+HighlightScheduler::HighlightScheduler(Syntax *syntax, QTextDocument *document)
+    : m_syntax(syntax),
+      m_document(document),
+      m_generation(std::make_shared<std::atomic_int>(0)),
+      m_blockCount(document->blockCount())
+{
+    m_pool.setMaxThreadCount(1);
+
+    m_passTimer.setSingleShot(true);
+    m_passTimer.setInterval(20);
+    connect(&m_passTimer, &QTimer::timeout, this, &HighlightScheduler::startPass);
+    connect(m_document, &QTextDocument::contentsChange, this, &HighlightScheduler::onContentsChange);
+
+    markDirty(0, m_blockCount - 1);
+}
+
+HighlightScheduler::~HighlightScheduler()
+{
+    // The worker posts to this object, it must be gone before we are
+    cancel();
+    m_pool.waitForDone();
+}
+
+void HighlightScheduler::setVisibleBlocks(int firstBlock, int lastBlock)
+{
+    m_firstVisible = firstBlock;
+    m_lastVisible  = lastBlock;
+
+    // Re-prioritize only if something on screen still waits for its tokens
+    QTextBlock block = m_document->findBlockByNumber(firstBlock);
+    for (int number = firstBlock; block.isValid() && number <= lastBlock; ++number, block = block.next())
+    {
+        if (!storedData(block))
+        {
+            cancel();
+            requestPass(number, lastBlock);
+            return;
+        }
+    }
+}
+
+bool HighlightScheduler::isVisible(int blockNumber) const
+{
+    return blockNumber >= m_firstVisible && blockNumber <= m_lastVisible;
+}
+
+const HighlightData *HighlightScheduler::storedData(const QTextBlock &block) const
+{
+    const HighlightData *data = static_cast<const HighlightData *>(block.userData());
+    if (!data || data->revision != block.revision())
+    {
+        return nullptr;
+    }
+
+    return data;
+}
+
+const HighlightData *HighlightScheduler::cachedData(const QTextBlock &block, int previousState) const
+{
+    const HighlightData *data = storedData(block);
+    if (!data || data->previousState != previousState)
+    {
+        return nullptr;
+    }
+
+    return data;
+}
+
+const HighlightData *HighlightScheduler::previousData(const QTextBlock &block) const
+{
+    return static_cast<const HighlightData *>(block.userData());
+}
+
+void HighlightScheduler::store(QTextBlock block, int previousState, int state, const QVector<SyntaxToken> &tokens)
+{
+    HighlightData *data = new HighlightData;
+    data->revision      = block.revision();
+    data->previousState = previousState;
+    data->state         = state;
+    data->tokens        = tokens;
+    block.setUserData(data);
+}
+
+void HighlightScheduler::requestPass(int firstBlock, int lastBlock)
+{
+    markDirty(firstBlock, lastBlock);
+    schedulePass();
+}
+
+void HighlightScheduler::markDirty(int firstBlock, int lastBlock)
+{
+    m_dirtyFirst = qMin(m_dirtyFirst, qMax(0, firstBlock));
+    m_dirtyLast  = qMax(m_dirtyLast, lastBlock);
+}
+
+void HighlightScheduler::schedulePass()
+{
+    if (m_passRunning)
+    {
+        m_passPending = true;
+        return;
+    }
+
+    if (!m_passTimer.isActive())
+    {
+        m_passTimer.start();
+    }
+}
+
+void HighlightScheduler::reset()
+{
+    cancel();
+    for (QTextBlock block = m_document->begin(); block.isValid(); block = block.next())
+    {
+        block.setUserData(nullptr);
+    }
+    markDirty(0, m_document->blockCount() - 1);
+}
+
+void HighlightScheduler::cancel()
+{
+    ++*m_generation;
+
+    // What the cancelled pass did not publish is done by the next one
+    if (m_passRunning)
+    {
+        markDirty(m_passFirst, m_passLast);
+    }
+}
+
+void HighlightScheduler::onContentsChange(int position, int /* charsRemoved */, int charsAdded)
+{
+    // Results of the running pass are addressed by block number
+    const int blockCount = m_document->blockCount();
+    if (blockCount != m_blockCount)
+    {
+        const int firstBlock = m_document->findBlock(position).blockNumber();
+        const int lastBlock  = m_document->findBlock(position + charsAdded).blockNumber();
+
+        // Ranges past the edit moved with their blocks; widening them is enough
+        const int added = blockCount - m_blockCount;
+        if (added > 0 && m_dirtyLast >= firstBlock)
+        {
+            m_dirtyLast += added;
+        }
+        if (added > 0 && m_passLast >= firstBlock)
+        {
+            m_passLast += added;
+        }
+
+        m_blockCount = blockCount;
+        cancel();
+        requestPass(firstBlock, lastBlock);
+    }
+}
+
+void HighlightScheduler::startPass()
+{
+    if (m_passRunning)
+    {
+        m_passPending = true;
+        return;
+    }
+
+    const int first = m_dirtyFirst;
+    const int last  = qMin(m_dirtyLast, m_document->blockCount() - 1);
+    m_dirtyFirst    = std::numeric_limits<int>::max();
+    m_dirtyLast     = -1;
+    if (first > last)
+    {
+        return;
+    }
+
+    // Snapshot from the first block that needs work in the dirty range, and
+    // past it while the stored states do not chain up. Blocks in between
+    // whose cache matches the chain are kept without their text: the worker
+    // only needs their cached states. Nothing before the range is walked.
+    QTextBlock block                  = m_document->findBlockByNumber(first);
+    const QTextBlock previous         = block.previous();
+    const HighlightData *previousData = storedData(previous);
+
+    QVector<BlockSnapshot> blocks;
+    qsizetype lastDirty = -1;
+    int incoming        = previousData ? previousData->state : qMax(0, previous.userState());
+    for (int number = first; block.isValid(); block = block.next(), ++number)
+    {
+        const HighlightData *data = storedData(block);
+        const bool clean          = data && data->previousState == incoming;
+        if (clean && number > last)
+        {
+            break;
+        }
+        if (clean && blocks.isEmpty())
+        {
+            incoming = data->state;
+            continue;
+        }
+
+        BlockSnapshot snapshot{number, block.revision(), incoming,
+                               data ? data->previousState : -1, data ? data->state : 0,
+                               !clean, clean ? QString() : block.text(), {}};
+        blocks.append(std::move(snapshot));
+        if (!clean)
+        {
+            lastDirty = blocks.size() - 1;
+        }
+
+        incoming = clean ? data->state : qMax(0, block.userState());
+    }
+
+    blocks.resize(lastDirty + 1);
+    if (blocks.isEmpty())
+    {
+        return;
+    }
+
+    QVector<qsizetype> visible;
+    for (qsizetype i = 0; i < blocks.size(); ++i)
+    {
+        if (blocks[i].hasText && isVisible(blocks[i].number))
+        {
+            visible.append(i);
+        }
+    }
+
+    m_passRunning        = true;
+    m_passFirst          = blocks.first().number;
+    m_passLast           = blocks.last().number;
+    const int generation = ++*m_generation;
+
+    // The worker only sees copies: rules may be reloaded while it runs
+    Syntax::RuleSet ruleSet                = m_syntax->ruleSet();
+    std::shared_ptr<std::atomic_int> token = m_generation;
+
+    m_pool.start([this, ruleSet, token, generation, visible, blocks = std::move(blocks)]() mutable
+    {
+        QVector<BlockSnapshot> batch;
+        QElapsedTimer timer;
+        timer.start();
+
+        auto flush = [this, generation, &batch, &timer]()
+        {
+            if (!batch.isEmpty())
+            {
+                QMetaObject::invokeMethod(this, [this, generation, batch = std::move(batch)]()
+                {
+                    publish(generation, batch);
+                }, Qt::QueuedConnection);
+                batch = QVector<BlockSnapshot>();
+            }
+            timer.restart();
+        };
+
+        // Viewport first, assuming the state stored before each visible block
+        // is right; the ordered pass below fixes them up if it was not
+        QHash<int, qsizetype> done;
+        for (qsizetype index : visible)
+        {
+            if (token->load() != generation)
+            {
+                break;
+            }
+
+            BlockSnapshot &block = blocks[index];
+            block.state          = Syntax::tokenize(ruleSet, block.text, block.previousState, block.tokens);
+            done.insert(block.number, index);
+            batch.append(block);
+        }
+        flush();
+
+        int state = blocks.isEmpty() ? 0 : blocks.first().previousState;
+        for (BlockSnapshot &block : blocks)
+        {
+            if (token->load() != generation)
+            {
+                break;
+            }
+
+            // Converged: the cached tokens were computed for this state
+            if (block.cachedPrevious == state)
+            {
+                state = block.cachedState;
+                continue;
+            }
+
+            auto visibleBlock = done.constFind(block.number);
+            if (visibleBlock != done.constEnd() && block.previousState == state)
+            {
+                state = block.state;
+                continue;
+            }
+
+            // The chain diverged on a block we have no text for; publishing
+            // the previous block makes the GUI request a pass from here
+            if (!block.hasText)
+            {
+                break;
+            }
+
+            block.previousState = state;
+            block.state         = Syntax::tokenize(ruleSet, block.text, state, block.tokens);
+            state               = block.state;
+            batch.append(block);
+
+            if (batch.size() >= BatchSize || timer.elapsed() >= BatchInterval)
+            {
+                flush();
+            }
+        }
+        flush();
+
+        QMetaObject::invokeMethod(this, [this]() { finishPass(); }, Qt::QueuedConnection);
+    });
+}
+
+void HighlightScheduler::finishPass()
+{
+    m_passRunning = false;
+    if (m_passPending)
+    {
+        m_passPending = false;
+        schedulePass();
+    }
+}
+
+void HighlightScheduler::publish(int generation, const QVector<BlockSnapshot> &batch)
+{
+    if (generation != m_generation->load())
+    {
+        return;
+    }
+
+    bool stale = false;
+    for (const BlockSnapshot &result : batch)
+    {
+        QTextBlock block = m_document->findBlockByNumber(result.number);
+
+        // The block was edited after the snapshot, a later pass will catch it
+        if (!block.isValid() || block.revision() != result.revision || block.text() != result.text)
+        {
+            markDirty(result.number, result.number);
+            stale = true;
+            continue;
+        }
+
+        store(block, result.previousState, result.state, result.tokens);
+
+        // Applies the tokens, and carries on to the next blocks if the state changed
+        m_syntax->rehighlightBlock(block);
+    }
+
+    if (stale)
+    {
+        schedulePass();
+    }
+}
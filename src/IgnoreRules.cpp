@@ -0,0 +1,420 @@
+#include "IgnoreRules.h"
+
+#include <QDir>
+#include <QFile>
+
+namespace
+{
+    bool hasWildcard(QStringView pattern)
+    {
+        for (const QChar c : pattern)
+        {
+            if (c == u'*' || c == u'?' || c == u'[' || c == u'\\')
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Matches c against the class opening at pattern[start]; end is past its "]".
+    // False when the class is not closed, and "[" is then a plain character.
+    bool matchClass(QStringView pattern, qsizetype start, QChar c, qsizetype *end, bool *matched)
+    {
+        qsizetype i        = start + 1;
+        const bool negated = i < pattern.size() && (pattern[i] == u'!' || pattern[i] == u'^');
+        if (negated)
+        {
+            ++i;
+        }
+
+        bool found = false;
+        for (bool first = true; i < pattern.size() && (first || pattern[i] != u']'); first = false)
+        {
+            QChar low = pattern[i];
+            if (low == u'\\' && i + 1 < pattern.size())
+            {
+                low = pattern[++i];
+            }
+
+            if (i + 2 < pattern.size() && pattern[i + 1] == u'-' && pattern[i + 2] != u']')
+            {
+                found = found || (c >= low && c <= pattern[i + 2]);
+                i += 3;
+            }
+            else
+            {
+                found = found || c == low;
+                ++i;
+            }
+        }
+
+        if (i >= pattern.size())
+        {
+            return false;
+        }
+
+        *end     = i + 1;
+        *matched = found != negated;
+        return true;
+    }
+
+    bool matchFrom(QStringView pattern, qsizetype p, QStringView text, qsizetype t)
+    {
+        while (p < pattern.size())
+        {
+            const QChar c = pattern[p];
+            if (c == u'*')
+            {
+                const bool isSegment = p + 1 < pattern.size() && pattern[p + 1] == u'*' && (p == 0 || pattern[p - 1] == u'/');
+                if (isSegment && p + 2 == pattern.size())
+                {
+                    return true; // Trailing "**": everything below
+                }
+                if (isSegment && pattern[p + 2] == u'/')
+                {
+                    // "**/": zero or more whole directories
+                    for (qsizetype k = t; k <= text.size(); ++k)
+                    {
+                        if ((k == t || text[k - 1] == u'/') && matchFrom(pattern, p + 3, text, k))
+                        {
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+
+                while (p < pattern.size() && pattern[p] == u'*')
+                {
+                    ++p;
+                }
+                for (qsizetype k = t;; ++k)
+                {
+                    if (matchFrom(pattern, p, text, k))
+                    {
+                        return true;
+                    }
+                    if (k == text.size() || text[k] == u'/')
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            if (t == text.size())
+            {
+                return false;
+            }
+
+            if (c == u'?')
+            {
+                if (text[t] == u'/')
+                {
+                    return false;
+                }
+                ++p;
+                ++t;
+                continue;
+            }
+
+            qsizetype end = 0;
+            bool matched  = false;
+            if (c == u'[' && matchClass(pattern, p, text[t], &end, &matched))
+            {
+                if (!matched || text[t] == u'/')
+                {
+                    return false;
+                }
+                p = end;
+                ++t;
+                continue;
+            }
+
+            QChar literal = c;
+            if (c == u'\\' && p + 1 < pattern.size())
+            {
+                literal = pattern[++p];
+            }
+            if (text[t] != literal)
+            {
+                return false;
+            }
+            ++p;
+            ++t;
+        }
+        return t == text.size();
+    }
+}
+
+IgnoreRules::IgnoreRules(const QString &base)
+    : m_base(base)
+{
+}
+
+void IgnoreRules::addPatterns(const QString &text)
+{
+    for (const QStringView line : QStringView(text).split(u'\n'))
+    {
+        addPattern(line);
+    }
+}
+
+bool IgnoreRules::addFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    addPatterns(QString::fromUtf8(file.readAll()));
+    return true;
+}
+
+QString IgnoreRules::base() const
+{
+    return m_base;
+}
+
+bool IgnoreRules::isEmpty() const
+{
+    return m_rules.empty();
+}
+
+int IgnoreRules::size() const
+{
+    return static_cast<int>(m_rules.size());
+}
+
+bool IgnoreRules::isChanged(const std::shared_ptr<const IgnoreRules> &previous,
+                            const std::shared_ptr<const IgnoreRules> &current)
+{
+    // A pattern edited in place keeps the count of rules: they are compared one by one
+    if (!previous || !current)
+    {
+        return bool(previous) != bool(current);
+    }
+    return previous != current && !(*previous == *current);
+}
+
+IgnoreRules::Match IgnoreRules::match(QStringView path, bool isDirectory) const
+{
+    const qsizetype slash = path.lastIndexOf(u'/');
+    const QStringView name = slash < 0 ? path : path.mid(slash + 1);
+
+    // The last matching pattern decides
+    for (auto rule = m_rules.crbegin(); rule != m_rules.crend(); ++rule)
+    {
+        if (rule->directoryOnly && !isDirectory)
+        {
+            continue;
+        }
+
+        const QStringView subject = rule->isAnchored ? path : name;
+        bool matched              = false;
+        switch (rule->kind)
+        {
+        case Kind::Name:
+            matched = subject == rule->pattern;
+            break;
+        case Kind::Suffix:
+            matched = subject.endsWith(rule->pattern);
+            break;
+        case Kind::Glob:
+            matched = globMatch(rule->pattern, subject);
+            break;
+        }
+
+        if (matched)
+        {
+            return rule->isNegated ? Match::Included : Match::Ignored;
+        }
+    }
+    return Match::None;
+}
+
+bool IgnoreRules::isIgnored(const std::vector<std::shared_ptr<const IgnoreRules>> &rules, QStringView path,
+                            bool isDirectory)
+{
+    // Rules of a deeper directory override those above it
+    for (auto it = rules.crbegin(); it != rules.crend(); ++it)
+    {
+        const QString &base = (*it)->m_base;
+        const QStringView relative = base.isEmpty() ? path : path.mid(base.size() + 1);
+
+        const Match match = (*it)->match(relative, isDirectory);
+        if (match != Match::None)
+        {
+            return match == Match::Ignored;
+        }
+    }
+    return false;
+}
+
+const QStringList &IgnoreRules::fileNames()
+{
+    static const QStringList names = {".gitignore", ".ignore"};
+    return names;
+}
+
+bool IgnoreRules::isIgnoreFile(QStringView name)
+{
+    return name == u".gitignore" || name == u".ignore";
+}
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::readDirectory(const QString &path, const QString &relativePath,
+                                                             const std::vector<DirectoryReader::Entry> &entries)
+{
+    std::shared_ptr<IgnoreRules> rules;
+    for (const DirectoryReader::Entry &entry : entries)
+    {
+        if (!entry.isDirectory && isIgnoreFile(entry.name))
+        {
+            if (!rules)
+            {
+                rules = std::make_shared<IgnoreRules>(relativePath);
+            }
+            rules->addFile(QDir(path).filePath(entry.name));
+        }
+    }
+
+    if (rules && rules->isEmpty())
+    {
+        rules.reset();
+    }
+    return rules;
+}
+
+void IgnoreRules::markIgnored(std::vector<DirectoryReader::Entry> &entries,
+                              const std::vector<std::shared_ptr<const IgnoreRules>> &rules, const QString &relativePath,
+                              bool keepIgnored)
+{
+    if (rules.empty())
+    {
+        return;
+    }
+
+    for (DirectoryReader::Entry &entry : entries)
+    {
+        const QString path = relativePath.isEmpty() ? entry.name : relativePath + '/' + entry.name;
+        entry.isIgnored    = isIgnored(rules, path, entry.isDirectory);
+    }
+
+    if (!keepIgnored)
+    {
+        std::erase_if(entries, [](const DirectoryReader::Entry &entry) { return entry.isIgnored; });
+    }
+}
+
+std::vector<std::shared_ptr<const IgnoreRules>> IgnoreRules::rulesAbove(
+    const QString &directory, const std::vector<std::shared_ptr<const IgnoreRules>> &excludes,
+    const QHash<QString, std::shared_ptr<const IgnoreRules>> &rules)
+{
+    std::vector<std::shared_ptr<const IgnoreRules>> chain = excludes;
+    if (directory.isEmpty())
+    {
+        return chain;
+    }
+
+    const auto add = [&](const QString &ancestor)
+    {
+        const auto it = rules.constFind(ancestor);
+        if (it != rules.cend())
+        {
+            chain.push_back(it.value());
+        }
+    };
+
+    add(QString(""));
+    for (qsizetype slash = directory.indexOf('/'); slash >= 0; slash = directory.indexOf('/', slash + 1))
+    {
+        add(directory.left(slash));
+    }
+    return chain;
+}
+
+QString IgnoreRules::userExcludeFile()
+{
+    return QDir::homePath() + "/.config/codeastra/exclude";
+}
+
+IgnoreRules IgnoreRules::userExcludes()
+{
+    IgnoreRules rules;
+    rules.addPattern(u".git/");
+    rules.addFile(userExcludeFile());
+    return rules;
+}
+
+bool IgnoreRules::globMatch(QStringView pattern, QStringView text)
+{
+    return matchFrom(pattern, 0, text, 0);
+}
+
+void IgnoreRules::addPattern(QStringView line)
+{
+    if (line.endsWith(u'\r'))
+    {
+        line.chop(1);
+    }
+
+    // Trailing spaces are dropped, unless escaped
+    while (line.endsWith(u' ') && !line.endsWith(u"\\ "))
+    {
+        line.chop(1);
+    }
+
+    if (line.isEmpty() || line.startsWith(u'#'))
+    {
+        return;
+    }
+
+    Rule rule;
+    if (line.startsWith(u'!'))
+    {
+        rule.isNegated = true;
+        line           = line.mid(1);
+    }
+    else if (line.startsWith(u"\\!") || line.startsWith(u"\\#"))
+    {
+        line = line.mid(1);
+    }
+
+    if (line.endsWith(u'/'))
+    {
+        rule.directoryOnly = true;
+        line.chop(1);
+    }
+
+    // A slash anywhere but at the end anchors the pattern to the directory
+    rule.isAnchored = line.contains(u'/');
+    if (line.startsWith(u'/'))
+    {
+        line = line.mid(1);
+    }
+
+    // "**/name" matches name at any depth, as if there was no slash
+    if (line.startsWith(u"**/") && !line.mid(3).contains(u'/'))
+    {
+        line            = line.mid(3);
+        rule.isAnchored = false;
+    }
+
+    if (line.isEmpty())
+    {
+        return;
+    }
+
+    if (!hasWildcard(line))
+    {
+        rule.kind = Kind::Name;
+    }
+    else if (!rule.isAnchored && line.startsWith(u'*') && !hasWildcard(line.mid(1)))
+    {
+        rule.kind = Kind::Suffix;
+        line      = line.mid(1);
+    }
+
+    rule.pattern = line.toString();
+    m_rules.push_back(std::move(rule));
+}
@@ -0,0 +1,325 @@
+#include "LargeFileDocument.h"
+
+#include <QSaveFile>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    // Encodings whose '\n' is the byte the piece table splits lines on
+    bool isByteEncoding(QStringConverter::Encoding encoding)
+    {
+        return encoding == QStringConverter::Utf8 || encoding == QStringConverter::Latin1;
+    }
+}
+
+LargeFileDocument::LargeFileDocument(QObject *parent)
+    : QObject(parent),
+      m_generation(std::make_shared<std::atomic_int>(0))
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+LargeFileDocument::~LargeFileDocument()
+{
+    close();
+}
+
+void LargeFileDocument::close()
+{
+    // The indexer and a save read the mapping: they must be done before the file is unmapped
+    ++*m_generation;
+    m_pool.waitForDone();
+    m_saving = false;
+
+    m_text.setOriginal(nullptr, 0);
+    if (m_mapped)
+    {
+        m_file.unmap(m_mapped);
+        m_mapped = nullptr;
+    }
+    m_file.close();
+}
+
+bool LargeFileDocument::canOpen(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        // open() reports the error
+        return true;
+    }
+
+    return isByteEncoding(TextFormat::detect(file.read(TextFormat::SampleSize)).encoding);
+}
+
+OperationResult LargeFileDocument::open(const QString &filePath)
+{
+    close();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        return {false, "Cannot open file: " + m_file.errorString().toStdString()};
+    }
+
+    const qint64 size = m_file.size();
+    if (size > 0)
+    {
+        m_mapped = m_file.map(0, size);
+        if (!m_mapped)
+        {
+            return {false, "Cannot map file: " + m_file.errorString().toStdString()};
+        }
+    }
+
+    m_format = TextFormat::detect(QByteArrayView(m_mapped, std::min<qint64>(size, TextFormat::SampleSize)));
+    if (!isByteEncoding(m_format.encoding))
+    {
+        const std::string name = m_format.name().section(',', 0, 0).toStdString();
+        close();
+        return {false, name + " files cannot be opened in large file mode."};
+    }
+
+    m_text.setOriginal(reinterpret_cast<const char *>(m_mapped), size);
+    setModified(false);
+    startIndexing();
+
+    return {true, QFileInfo(filePath).fileName().toStdString() + " opened in large file mode ("
+                      + m_format.name().toStdString() + ")."};
+}
+
+void LargeFileDocument::startIndexing()
+{
+    const int generation                   = ++*m_generation;
+    std::shared_ptr<std::atomic_int> token = m_generation;
+    const char *data                       = reinterpret_cast<const char *>(m_mapped);
+    const qint64 size                      = m_text.size();
+
+    if (size == 0)
+    {
+        m_text.appendOriginalIndex({}, 0);
+        emit indexed();
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+    ::madvise(m_mapped, static_cast<size_t>(size), MADV_SEQUENTIAL);
+#endif
+
+    m_pool.start([this, data, size, token, generation]()
+    {
+        for (qint64 begin = 0; begin < size; begin += IndexChunkSize)
+        {
+            if (token->load() != generation)
+            {
+                return;
+            }
+
+            const qint64 end              = std::min(size, begin + IndexChunkSize);
+            std::vector<qint64> newlines = PieceTable::indexLines(data, begin, end);
+
+            // The table is only touched on the GUI thread
+            QMetaObject::invokeMethod(this, [this, token, generation, end, size, newlines = std::move(newlines)]()
+            {
+                if (token->load() != generation)
+                {
+                    return;
+                }
+
+                const qint64 firstLine = std::max<qint64>(0, m_text.lineCount() - 1);
+                m_text.appendOriginalIndex(newlines, end);
+                emit indexProgress(end, size);
+                emit contentsChanged(firstLine);
+                if (m_text.isIndexed())
+                {
+                    emit indexed();
+                }
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+OperationResult LargeFileDocument::save(const QString &filePath)
+{
+    if (!isIndexed())
+    {
+        return {false, "Cannot save while the file is being indexed."};
+    }
+    if (m_saving)
+    {
+        return {false, "The file is already being saved."};
+    }
+
+    // Writing hundreds of megabytes would freeze the GUI thread: the pieces are
+    // streamed from the worker, and edits are ignored until it is done
+    m_saving                               = true;
+    const int generation                   = m_generation->load();
+    std::shared_ptr<std::atomic_int> token = m_generation;
+    m_pool.start([this, filePath, token, generation]()
+    {
+        const OperationResult result = write(filePath, m_text);
+        QMetaObject::invokeMethod(this, [this, token, generation, result]()
+        {
+            if (token->load() != generation)
+            {
+                return;
+            }
+
+            m_saving = false;
+            if (result.success)
+            {
+                setModified(false);
+            }
+            emit saved(result.success, QString::fromStdString(result.message));
+        }, Qt::QueuedConnection);
+    });
+
+    return {true, "Saving " + QFileInfo(filePath).fileName().toStdString() + "..."};
+}
+
+OperationResult LargeFileDocument::write(const QString &filePath, const PieceTable &text)
+{
+    // Written next to the target then renamed over it: the mapped original is
+    // still read while writing, and is never truncated
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return {false, "Cannot save file: " + file.errorString().toStdString()};
+    }
+
+    bool written = true;
+    text.forEachSpan([&file, &written](QByteArrayView span)
+    {
+        // Large pieces are written in slices so that a failure stops early
+        constexpr qsizetype slice = 16 * 1024 * 1024;
+        for (qsizetype offset = 0; offset < span.size(); offset += slice)
+        {
+            const QByteArrayView part = span.sliced(offset, std::min(slice, span.size() - offset));
+            if (file.write(part.data(), part.size()) != part.size())
+            {
+                written = false;
+                return false;
+            }
+        }
+        return true;
+    });
+
+    if (!written)
+    {
+        const std::string error = file.errorString().toStdString();
+        file.cancelWriting();
+        return {false, "Cannot save file: " + error};
+    }
+    if (!file.commit())
+    {
+        return {false, "Cannot save file: " + file.errorString().toStdString()};
+    }
+
+    return {true, "File saved successfully."};
+}
+
+const PieceTable &LargeFileDocument::text() const
+{
+    return m_text;
+}
+
+TextFormat LargeFileDocument::format() const
+{
+    return m_format;
+}
+
+qint64 LargeFileDocument::textStart() const
+{
+    return m_format.bom && m_text.size() >= 3 ? 3 : 0;
+}
+
+QString LargeFileDocument::decode(QByteArrayView bytes) const
+{
+    return m_format.encoding == QStringConverter::Latin1 ? QString::fromLatin1(bytes) : QString::fromUtf8(bytes);
+}
+
+QByteArray LargeFileDocument::encode(const QString &text, bool *lossless) const
+{
+    if (m_format.encoding == QStringConverter::Latin1)
+    {
+        if (lossless)
+        {
+            *lossless = std::all_of(text.cbegin(), text.cend(), [](QChar c) { return c.unicode() <= 0xFF; });
+        }
+        return text.toLatin1();
+    }
+
+    if (lossless)
+    {
+        *lossless = true;
+    }
+    return text.toUtf8();
+}
+
+QByteArray LargeFileDocument::lineEnding() const
+{
+    // Lines are split on '\n' only: files with CR endings get '\n' too
+    return m_format.lineEnding == TextFormat::LineEnding::CRLF ? QByteArrayLiteral("\r\n") : QByteArrayLiteral("\n");
+}
+
+QString LargeFileDocument::filePath() const
+{
+    return m_file.fileName();
+}
+
+bool LargeFileDocument::isIndexed() const
+{
+    return m_text.isIndexed();
+}
+
+bool LargeFileDocument::isSaving() const
+{
+    return m_saving;
+}
+
+bool LargeFileDocument::isEditable() const
+{
+    return isIndexed() && !m_saving;
+}
+
+bool LargeFileDocument::isModified() const
+{
+    return m_modified;
+}
+
+void LargeFileDocument::setModified(bool modified)
+{
+    if (modified != m_modified)
+    {
+        m_modified = modified;
+        emit modificationChanged(modified);
+    }
+}
+
+void LargeFileDocument::insert(qint64 offset, const QByteArray &bytes)
+{
+    if (!isEditable() || bytes.isEmpty())
+    {
+        return;
+    }
+
+    m_text.insert(offset, bytes);
+    setModified(true);
+    emit contentsChanged(m_text.lineOf(offset));
+}
+
+void LargeFileDocument::remove(qint64 offset, qint64 length)
+{
+    if (!isEditable() || length <= 0)
+    {
+        return;
+    }
+
+    m_text.remove(offset, length);
+    setModified(true);
+    emit contentsChanged(m_text.lineOf(offset));
+}
@@ -0,0 +1,556 @@
+#include "LargeFileView.h"
+#include "LargeFileDocument.h"
+#include "SyntaxRegistry.h"
+
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <algorithm>
+#include <climits>
+
+namespace
+{
+    // Bytes of the first column UTF-16 units of UTF-8 text, one unit per invalid byte
+    qint64 utf8Offset(QByteArrayView bytes, int column)
+    {
+        qint64 offset = 0;
+        for (int units = 0; units < column && offset < bytes.size(); ++units)
+        {
+            const uchar lead = static_cast<uchar>(bytes[offset]);
+            const int length = lead >= 0xF0 && lead <= 0xF4 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC2 ? 2 : 1;
+            int valid        = 1;
+            while (valid < length && offset + valid < bytes.size()
+                   && (static_cast<uchar>(bytes[offset + valid]) & 0xC0) == 0x80)
+            {
+                ++valid;
+            }
+            if (lead < 0x80 || valid < length || lead > 0xF4)
+            {
+                offset += 1;
+                continue;
+            }
+
+            // Characters above U+FFFF take a surrogate pair
+            offset += length;
+            units += length == 4 ? 1 : 0;
+        }
+        return offset;
+    }
+}
+
+LargeFileView::LargeFileView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+{
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    updateScrollBars();
+}
+
+void LargeFileView::setDocument(LargeFileDocument *document)
+{
+    if (m_document)
+    {
+        disconnect(m_document, nullptr, this, nullptr);
+    }
+
+    m_document     = document;
+    m_cursorLine   = 0;
+    m_cursorColumn = 0;
+    m_contentWidth = 0;
+
+    if (m_document)
+    {
+        connect(m_document, &LargeFileDocument::contentsChanged, this, &LargeFileView::onContentsChanged);
+    }
+
+    verticalScrollBar()->setValue(0);
+    horizontalScrollBar()->setValue(0);
+    onContentsChanged();
+}
+
+void LargeFileView::setSyntax(std::shared_ptr<const SyntaxDefinition> definition)
+{
+    m_definition = std::move(definition);
+    m_ruleSet    = Syntax::RuleSet();
+    if (m_definition)
+    {
+        m_ruleSet = {m_definition->rules, m_definition->regions, m_definition->name, nullptr, m_definition->prefilter,
+                     m_definition->lexer};
+    }
+
+    viewport()->update();
+}
+
+void LargeFileView::goToLine(qint64 line)
+{
+    setCursorPosition(line, 0);
+    setFocus();
+}
+
+void LargeFileView::onContentsChanged()
+{
+    updateScrollBars();
+    viewport()->update();
+}
+
+qint64 LargeFileView::lineCount() const
+{
+    return m_document ? m_document->text().lineCount() : 0;
+}
+
+qint64 LargeFileView::lineStart(qint64 line) const
+{
+    // The BOM is kept in the file, out of reach of the cursor
+    return m_document->text().lineStart(line) + (line == 0 ? m_document->textStart() : 0);
+}
+
+QByteArray LargeFileView::lineBytes(qint64 line, bool *complete) const
+{
+    if (complete)
+    {
+        *complete = true;
+    }
+    if (!m_document || line < 0 || line >= lineCount())
+    {
+        return QByteArray();
+    }
+
+    const PieceTable &text = m_document->text();
+    const qint64 start     = lineStart(line);
+    const qint64 length    = text.lineStart(line) + text.lineLength(line) - start;
+    const qint64 maxBytes  = qint64(MaxDrawnLength) * 4;
+    if (complete)
+    {
+        *complete = length <= maxBytes;
+    }
+    return text.read(start, std::min(length, maxBytes));
+}
+
+QString LargeFileView::lineText(qint64 line, bool *complete) const
+{
+    bool read              = true;
+    const QByteArray bytes = lineBytes(line, &read);
+    QString decoded        = m_document ? m_document->decode(bytes) : QString();
+
+    // Lines of files with "\r\n" endings
+    if (read && decoded.endsWith(u'\r'))
+    {
+        decoded.chop(1);
+    }
+    if (complete)
+    {
+        *complete = read && decoded.size() <= MaxDrawnLength;
+    }
+    decoded.truncate(MaxDrawnLength);
+    return decoded;
+}
+
+int LargeFileView::lineHeight() const
+{
+    return fontMetrics().height();
+}
+
+int LargeFileView::gutterWidth() const
+{
+    // Same metrics as CodeEditor::lineNumberAreaWidth
+    const int digits = static_cast<int>(QString::number(std::max<qint64>(1, lineCount())).size());
+    return 3 + fontMetrics().horizontalAdvance(QLatin1Char('9')) * digits + 15;
+}
+
+QString LargeFileView::displayText(const QString &text, QVector<int> &columns) const
+{
+    QString display;
+    display.reserve(text.size());
+    columns.resize(text.size() + 1);
+
+    for (qsizetype i = 0; i < text.size(); ++i)
+    {
+        columns[i] = static_cast<int>(display.size());
+        if (text[i] == u'\t')
+        {
+            display += QString(TabWidth - display.size() % TabWidth, u' ');
+        }
+        else
+        {
+            display += text[i];
+        }
+    }
+    columns[text.size()] = static_cast<int>(display.size());
+    return display;
+}
+
+const QTextCharFormat &LargeFileView::tokenFormat(int rule) const
+{
+    if (rule < m_ruleSet.rules.size())
+    {
+        return m_ruleSet.rules[rule].m_format;
+    }
+
+    return m_ruleSet.regions[rule - m_ruleSet.rules.size()].m_format;
+}
+
+void LargeFileView::updateScrollBars()
+{
+    const int height       = lineHeight();
+    const int visibleLines = std::max(1, viewport()->height() / height);
+    const qint64 maximum   = std::max<qint64>(0, lineCount() - visibleLines);
+
+    verticalScrollBar()->setRange(0, static_cast<int>(std::min<qint64>(maximum, INT_MAX)));
+    verticalScrollBar()->setPageStep(visibleLines);
+    verticalScrollBar()->setSingleStep(1);
+
+    const int textWidth = viewport()->width() - gutterWidth();
+    horizontalScrollBar()->setRange(0, std::max(0, m_contentWidth - textWidth));
+    horizontalScrollBar()->setPageStep(std::max(1, textWidth));
+    horizontalScrollBar()->setSingleStep(fontMetrics().horizontalAdvance(QLatin1Char(' ')));
+}
+
+void LargeFileView::scrollContentsBy(int, int)
+{
+    // Everything is drawn from the scroll bar values
+    viewport()->update();
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void LargeFileView::paintEvent(QPaintEvent *event)
+{
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().color(QPalette::Base));
+    if (!m_document)
+    {
+        return;
+    }
+
+    const QFontMetrics metrics = fontMetrics();
+    const int height           = lineHeight();
+    const int gutter           = gutterWidth();
+    const int scrollX          = horizontalScrollBar()->value();
+    const qint64 first         = verticalScrollBar()->value();
+    const qint64 last          = std::min(lineCount(), first + viewport()->height() / height + 1);
+    const bool highlighting    = !m_ruleSet.rules.isEmpty() || !m_ruleSet.regions.isEmpty();
+
+    // Recover the region the viewport starts in from the lines above it
+    QVector<SyntaxToken> tokens;
+    int state = 0;
+    if (!m_ruleSet.regions.isEmpty())
+    {
+        for (qint64 line = std::max<qint64>(0, first - RegionLookBehind); line < first; ++line)
+        {
+            state = Syntax::tokenize(m_ruleSet, lineText(line), state, tokens);
+        }
+    }
+
+    QColor lineColor = QColor(Qt::lightGray).lighter(60);
+    lineColor.setAlpha(80);
+
+    painter.setClipRect(gutter, 0, viewport()->width() - gutter, viewport()->height());
+
+    int contentWidth = m_contentWidth;
+    int y            = 0;
+    for (qint64 line = first; line < last; ++line, y += height)
+    {
+        const QString text = lineText(line);
+
+        tokens.clear();
+        if (highlighting)
+        {
+            state = Syntax::tokenize(m_ruleSet, text, state, tokens);
+        }
+
+        if (line == m_cursorLine)
+        {
+            painter.fillRect(gutter, y, viewport()->width() - gutter, height, lineColor);
+        }
+
+        QVector<int> columns;
+        const QString display = displayText(text, columns);
+        const int left        = gutter + 4 - scrollX;
+        int x                 = left;
+
+        auto drawSpan = [&](int from, int to, const QTextCharFormat *format)
+        {
+            if (to <= from)
+            {
+                return;
+            }
+
+            QFont font   = this->font();
+            QColor color = palette().color(QPalette::Text);
+            if (format)
+            {
+                if (format->hasProperty(QTextFormat::ForegroundBrush))
+                {
+                    color = format->foreground().color();
+                }
+                font.setBold(format->fontWeight() > QFont::Normal);
+                font.setItalic(format->fontItalic());
+            }
+
+            const QString span = display.mid(from, to - from);
+            painter.setFont(font);
+            painter.setPen(color);
+            painter.drawText(x, y + metrics.ascent(), span);
+            x += QFontMetrics(font).horizontalAdvance(span);
+        };
+
+        int drawn = 0;
+        for (const SyntaxToken &token : tokens)
+        {
+            const int start = columns[token.start];
+            const int end   = columns[token.start + token.length];
+            drawSpan(drawn, start, nullptr);
+            drawSpan(start, end, &tokenFormat(token.rule));
+            drawn = end;
+        }
+        drawSpan(drawn, static_cast<int>(display.size()), nullptr);
+        contentWidth = std::max(contentWidth, x - left + 8);
+
+        if (line == m_cursorLine && hasFocus())
+        {
+            const int column = columns[std::min<qsizetype>(m_cursorColumn, text.size())];
+            const int cursorX = left + metrics.horizontalAdvance(display.left(column));
+            painter.fillRect(cursorX, y, 1, height, palette().color(QPalette::Text));
+        }
+    }
+
+    // Line numbers, drawn like the ones of CodeEditor
+    painter.setClipping(false);
+    painter.setFont(font());
+    painter.fillRect(0, 0, gutter, viewport()->height(), palette().color(QPalette::Base));
+    painter.setPen(palette().color(QPalette::WindowText));
+    painter.drawLine(gutter - 4, 0, gutter - 4, viewport()->height());
+    painter.setPen(Qt::darkGray);
+    y = 0;
+    for (qint64 line = first; line < last; ++line, y += height)
+    {
+        painter.drawText(0, y, gutter, height, Qt::AlignCenter, QString::number(line + 1));
+    }
+
+    // The widest line seen so far sets the horizontal range
+    if (contentWidth != m_contentWidth)
+    {
+        m_contentWidth = contentWidth;
+        updateScrollBars();
+    }
+}
+
+void LargeFileView::setCursorPosition(qint64 line, int column)
+{
+    m_cursorLine   = std::clamp<qint64>(line, 0, std::max<qint64>(0, lineCount() - 1));
+    m_cursorColumn = std::clamp(column, 0, static_cast<int>(lineText(m_cursorLine).size()));
+    ensureCursorVisible();
+    viewport()->update();
+}
+
+void LargeFileView::ensureCursorVisible()
+{
+    const int visibleLines = std::max(1, viewport()->height() / lineHeight());
+    const qint64 first     = verticalScrollBar()->value();
+    if (m_cursorLine < first)
+    {
+        verticalScrollBar()->setValue(static_cast<int>(std::min<qint64>(m_cursorLine, INT_MAX)));
+    }
+    else if (m_cursorLine >= first + visibleLines)
+    {
+        verticalScrollBar()->setValue(static_cast<int>(std::min<qint64>(m_cursorLine - visibleLines + 1, INT_MAX)));
+    }
+
+    QVector<int> columns;
+    const QString text    = lineText(m_cursorLine);
+    const QString display = displayText(text, columns);
+    const int cursorX     = fontMetrics().horizontalAdvance(
+        display.left(columns[std::min<qsizetype>(m_cursorColumn, text.size())]));
+    const int textWidth   = viewport()->width() - gutterWidth() - 8;
+    const int scrollX     = horizontalScrollBar()->value();
+
+    if (cursorX > m_contentWidth)
+    {
+        m_contentWidth = cursorX + 8;
+        updateScrollBars();
+    }
+    if (cursorX < scrollX)
+    {
+        horizontalScrollBar()->setValue(cursorX);
+    }
+    else if (cursorX > scrollX + textWidth)
+    {
+        horizontalScrollBar()->setValue(cursorX - textWidth);
+    }
+}
+
+qint64 LargeFileView::offsetAt(qint64 line, int column) const
+{
+    const QByteArray bytes = lineBytes(line);
+    if (m_document->format().encoding == QStringConverter::Latin1)
+    {
+        return lineStart(line) + std::min<qint64>(column, bytes.size());
+    }
+
+    return lineStart(line) + utf8Offset(bytes, column);
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event)
+{
+    if (!m_document || event->button() != Qt::LeftButton)
+    {
+        QAbstractScrollArea::mousePressEvent(event);
+        return;
+    }
+
+    const qint64 line = verticalScrollBar()->value() + event->position().toPoint().y() / lineHeight();
+    const int x       = event->position().toPoint().x() - gutterWidth() - 4 + horizontalScrollBar()->value();
+
+    QVector<int> columns;
+    const QString text    = lineText(std::min(line, lineCount() - 1));
+    const QString display = displayText(text, columns);
+
+    // First character whose middle is right of the click
+    int column = 0;
+    while (column < text.size())
+    {
+        const int start = fontMetrics().horizontalAdvance(display.left(columns[column]));
+        const int end   = fontMetrics().horizontalAdvance(display.left(columns[column + 1]));
+        if (x < (start + end) / 2)
+        {
+            break;
+        }
+        ++column;
+    }
+
+    setCursorPosition(line, column);
+}
+
+void LargeFileView::keyPressEvent(QKeyEvent *event)
+{
+    if (!m_document || lineCount() == 0)
+    {
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+
+    bool complete          = true;
+    const QString text     = lineText(m_cursorLine, &complete);
+    const int column       = std::min(m_cursorColumn, static_cast<int>(text.size()));
+    const int pageLines    = std::max(1, viewport()->height() / lineHeight() - 1);
+    const bool control     = event->modifiers() & Qt::ControlModifier;
+    const bool editable    = m_document->isEditable();
+    LargeFileDocument *doc = m_document;
+
+    switch (event->key())
+    {
+    case Qt::Key_Left:
+        if (column > 0)
+        {
+            setCursorPosition(m_cursorLine, column - 1);
+        }
+        else if (m_cursorLine > 0)
+        {
+            setCursorPosition(m_cursorLine - 1, INT_MAX);
+        }
+        return;
+    case Qt::Key_Right:
+        if (column < text.size())
+        {
+            setCursorPosition(m_cursorLine, column + 1);
+        }
+        else if (m_cursorLine + 1 < lineCount())
+        {
+            setCursorPosition(m_cursorLine + 1, 0);
+        }
+        return;
+    case Qt::Key_Up:
+        setCursorPosition(m_cursorLine - 1, m_cursorColumn);
+        return;
+    case Qt::Key_Down:
+        setCursorPosition(m_cursorLine + 1, m_cursorColumn);
+        return;
+    case Qt::Key_PageUp:
+        setCursorPosition(m_cursorLine - pageLines, m_cursorColumn);
+        return;
+    case Qt::Key_PageDown:
+        setCursorPosition(m_cursorLine + pageLines, m_cursorColumn);
+        return;
+    case Qt::Key_Home:
+        setCursorPosition(control ? 0 : m_cursorLine, 0);
+        return;
+    case Qt::Key_End:
+        setCursorPosition(control ? lineCount() - 1 : m_cursorLine, INT_MAX);
+        return;
+    default:
+        break;
+    }
+
+    if (!editable)
+    {
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+
+    switch (event->key())
+    {
+    case Qt::Key_Backspace:
+        if (column > 0)
+        {
+            const int count     = column >= 2 && text[column - 1].isLowSurrogate() ? 2 : 1;
+            const qint64 offset = offsetAt(m_cursorLine, column - count);
+            m_cursorColumn      = column - count;
+            doc->remove(offset, offsetAt(m_cursorLine, column) - offset);
+        }
+        else if (m_cursorLine > 0)
+        {
+            // Joins with the previous line, "\r\n" included
+            const qint64 start  = lineStart(m_cursorLine);
+            const qint64 ending = doc->text().read(start - 2, 2) == "\r\n" ? 2 : 1;
+            setCursorPosition(m_cursorLine - 1, INT_MAX);
+            doc->remove(start - ending, ending);
+        }
+        ensureCursorVisible();
+        return;
+    case Qt::Key_Delete:
+        if (column < text.size())
+        {
+            const int count     = column + 1 < text.size() && text[column].isHighSurrogate() ? 2 : 1;
+            const qint64 offset = offsetAt(m_cursorLine, column);
+            doc->remove(offset, offsetAt(m_cursorLine, column + count) - offset);
+        }
+        else if (complete && m_cursorLine + 1 < lineCount())
+        {
+            const qint64 end    = doc->text().lineStart(m_cursorLine + 1);
+            const qint64 ending = doc->text().read(end - 2, 2) == "\r\n" ? 2 : 1;
+            doc->remove(end - ending, ending);
+        }
+        return;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        doc->insert(offsetAt(m_cursorLine, column), doc->lineEnding());
+        setCursorPosition(m_cursorLine + 1, 0);
+        return;
+    default:
+        break;
+    }
+
+    const QString typed = event->text();
+    if (!typed.isEmpty() && !control && (typed[0].isPrint() || typed[0] == u'\t'))
+    {
+        // Characters the file's encoding cannot hold are not typed in
+        bool lossless          = true;
+        const QByteArray bytes = doc->encode(typed, &lossless);
+        if (!lossless)
+        {
+            return;
+        }
+
+        doc->insert(offsetAt(m_cursorLine, column), bytes);
+        setCursorPosition(m_cursorLine, column + static_cast<int>(typed.size()));
+        return;
+    }
+
+    QAbstractScrollArea::keyPressEvent(event);
+}
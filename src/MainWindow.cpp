@@ -1,7 +1,12 @@
 #include "MainWindow.h"
 #include "Tree.h"
 #include "CodeEditor.h"
+#include "LargeFileView.h"
 #include "FileManager.h"
+#include "SyntaxProfiler.h"
+#include "QuickOpenDialog.h"
+#include "SearchPanel.h"
+#include "FileTreeModel.h"
 
 #include <QMenuBar>
 #include <QFileDialog>
@@ -9,10 +14,16 @@
 #include <QStatusBar>
 #include <QApplication>
 #include <QDesktopServices>
+#include <QDockWidget>
+#include <QPushButton>
+#include <QStackedWidget>
+#include <QTabBar>
+#include <QVBoxLayout>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
     m_editor(std::make_unique<CodeEditor>(this)),
+    m_largeFileView(std::make_unique<LargeFileView>(this)),
     m_tree(nullptr),
     m_fileManager(&FileManager::getInstance())
 {
@@ -30,6 +41,7 @@ MainWindow::MainWindow(QWidget *parent)
     int spaceWidth = metrics.horizontalAdvance(" ");
     m_editor->setTabStopDistance(spaceWidth * 4);
     m_editor->setLineWrapMode(QPlainTextEdit::NoWrap);
+    m_largeFileView->setFont(m_editor->font());
 
     initTree();
     createMenuBar();
@@ -45,7 +57,41 @@ void MainWindow::initTree()
 
     m_tree = std::make_unique<Tree>(splitter);
 
-    splitter->addWidget(m_editor.get());
+    // Open files are tabs above the editor; switching tabs swaps the editor's document
+    QWidget *editorPane = new QWidget(splitter);
+    m_tabBar            = new QTabBar(editorPane);
+    m_tabBar->setDocumentMode(true);
+    m_tabBar->setTabsClosable(true);
+    m_tabBar->setExpanding(false);
+    m_tabBar->setElideMode(Qt::ElideRight);
+    m_tabBar->hide();
+
+    connect(m_tabBar, &QTabBar::currentChanged, this, [this](int index)
+    {
+        // Back to the tab shown if the user cancelled
+        if (index >= 0 && !m_fileManager->switchToFile(m_tabBar->tabData(index).toString()))
+        {
+            updateTabs();
+        }
+    });
+    connect(m_tabBar, &QTabBar::tabCloseRequested, this, [this](int index)
+    {
+        m_fileManager->closeDocument(m_tabBar->tabData(index).toString());
+    });
+    connect(m_fileManager, &FileManager::documentsChanged, this, &MainWindow::updateTabs);
+
+    // The editor and the large file view take turns in the same pane
+    m_editorStack = new QStackedWidget(editorPane);
+    m_editorStack->addWidget(m_editor.get());
+    m_editorStack->addWidget(m_largeFileView.get());
+
+    QVBoxLayout *layout = new QVBoxLayout(editorPane);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->setSpacing(0);
+    layout->addWidget(m_tabBar);
+    layout->addWidget(m_editorStack);
+
+    splitter->addWidget(editorPane);
     splitter->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
     splitter->setHandleWidth(5);
     splitter->setSizes(QList<int>() << 150 << 800);
@@ -55,6 +101,56 @@ void MainWindow::initTree()
     splitter->setOpaqueResize(true);
 }
 
+void MainWindow::updateTabs()
+{
+    if (!m_tabBar)
+    {
+        return;
+    }
+
+    const QStringList files = m_fileManager->openDocuments();
+    const QSignalBlocker blocker(m_tabBar);
+
+    while (m_tabBar->count() > files.size())
+    {
+        m_tabBar->removeTab(m_tabBar->count() - 1);
+    }
+    for (int i = 0; i < files.size(); ++i)
+    {
+        const QString title = QFileInfo(files[i]).fileName() + (m_fileManager->isDocumentModified(files[i]) ? " *" : "");
+        if (i < m_tabBar->count())
+        {
+            m_tabBar->setTabText(i, title);
+        }
+        else
+        {
+            m_tabBar->addTab(title);
+        }
+        m_tabBar->setTabToolTip(i, files[i]);
+        m_tabBar->setTabData(i, files[i]);
+    }
+
+    m_tabBar->setCurrentIndex(files.indexOf(m_fileManager->getCurrentFileName()));
+    m_tabBar->setVisible(!files.isEmpty());
+}
+
+LargeFileView *MainWindow::largeFileView() const
+{
+    return m_largeFileView.get();
+}
+
+void MainWindow::showLargeFileView(bool show)
+{
+    if (!m_editorStack)
+    {
+        return;
+    }
+
+    QWidget *widget = show ? static_cast<QWidget *>(m_largeFileView.get()) : m_editor.get();
+    m_editorStack->setCurrentWidget(widget);
+    widget->setFocus();
+}
+
 void MainWindow::createMenuBar()
 {
     QMenuBar *menuBar = new QMenuBar(this);
@@ -88,6 +184,8 @@ void MainWindow::createFileActions(QMenu *fileMenu)
         }
     }));
     fileMenu->addAction(createAction(QIcon(), tr("&Open"), QKeySequence::Open, tr("Open an existing file"), [this]() { m_fileManager->openFile(); }));
+    fileMenu->addAction(createAction(QIcon(), tr("&Go to File..."), QKeySequence(Qt::CTRL | Qt::Key_P), tr("Open a file of the project by typing part of its path"), [this]() { showQuickOpen(); }));
+    fileMenu->addAction(createAction(QIcon(), tr("&Find in Files..."), QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_F), tr("Search the files of the project"), [this]() { showSearchPanel(); }));
     fileMenu->addSeparator();
     fileMenu->addAction(createAction(QIcon(), tr("&Save"), QKeySequence::Save, tr("Save the current file"), [this]() { m_fileManager->saveFile(); }));
     fileMenu->addAction(createAction(QIcon(), tr("Save &As"), QKeySequence::SaveAs, tr("Save the file with a new name"), [this]() { m_fileManager->saveFileAs(); }));
@@ -110,6 +208,24 @@ void MainWindow::createAppActions(QMenu *appMenu)
     QAction *aboutAction = new QAction("About CodeAstra", this);
     connect(aboutAction, &QAction::triggered, this, &MainWindow::showAbout);
     appMenu->addAction(aboutAction);
+
+    appMenu->addSeparator();
+
+    // Debug tools: per-rule timings of the syntax highlighter
+    QAction *profileAction = new QAction(tr("Profile Syntax Highlighting"), this);
+    profileAction->setCheckable(true);
+    profileAction->setChecked(SyntaxProfiler::getInstance().isEnabled());
+    profileAction->setStatusTip(tr("Record the time spent in each syntax rule"));
+    connect(profileAction, &QAction::toggled, this, [](bool enabled)
+    {
+        SyntaxProfiler::getInstance().setEnabled(enabled);
+    });
+    appMenu->addAction(profileAction);
+
+    QAction *reportAction = new QAction(tr("Syntax Highlighting Profile..."), this);
+    reportAction->setStatusTip(tr("Show the slowest syntax rules per language"));
+    connect(reportAction, &QAction::triggered, this, &MainWindow::showHighlightProfile);
+    appMenu->addAction(reportAction);
 }
 
 QAction *MainWindow::createAction(const QIcon &icon, const QString &text, const QKeySequence &shortcut, const QString &statusTip, const std::function<void()> &slot)
@@ -167,3 +283,50 @@ void MainWindow::showAbout()
 
     QMessageBox::about(this, tr("About"), aboutText);
 }
+
+void MainWindow::showQuickOpen()
+{
+    if (!m_quickOpen)
+    {
+        m_quickOpen = new QuickOpenDialog(m_tree->pathIndex(), this);
+    }
+    m_quickOpen->popup();
+}
+
+void MainWindow::showSearchPanel()
+{
+    if (!m_searchDock)
+    {
+        m_searchPanel = new SearchPanel(this);
+        m_searchDock  = new QDockWidget(tr("Find in Files"), this);
+        m_searchDock->setObjectName("FindInFiles");
+        m_searchDock->setWidget(m_searchPanel);
+        addDockWidget(Qt::BottomDockWidgetArea, m_searchDock);
+    }
+
+    // The project may have changed since the last search
+    m_searchPanel->setRootPath(m_tree->getModel()->rootPath());
+    m_searchDock->show();
+    m_searchDock->raise();
+    m_searchPanel->focusQuery(m_editor->textCursor().selectedText());
+}
+
+void MainWindow::showHighlightProfile()
+{
+    SyntaxProfiler &profiler = SyntaxProfiler::getInstance();
+
+    QMessageBox box(this);
+    box.setWindowTitle(tr("Syntax Highlighting Profile"));
+    box.setText(profiler.isEnabled()
+                    ? tr("Slowest syntax rules per language config file.")
+                    : tr("Profiling is disabled: enable \"Profile Syntax Highlighting\" and edit or scroll a file."));
+    box.setDetailedText(profiler.report());
+    QPushButton *resetButton = box.addButton(tr("Reset"), QMessageBox::ResetRole);
+    box.addButton(QMessageBox::Close);
+    box.exec();
+
+    if (box.clickedButton() == resetButton)
+    {
+        profiler.reset();
+    }
+}
@@ -0,0 +1,69 @@
+#include "NamePool.h"
+
+#include <QHash>
+
+NamePool::NamePool()
+    : m_offsets{0},
+      m_slots(1024, 0)
+{
+}
+
+quint32 NamePool::intern(QStringView name)
+{
+    const size_t mask = m_slots.size() - 1;
+    for (size_t slot = qHash(name) & mask;; slot = (slot + 1) & mask)
+    {
+        const quint32 stored = m_slots[slot];
+        if (stored == 0)
+        {
+            const quint32 id = static_cast<quint32>(size());
+            m_characters.insert(m_characters.end(), name.utf16(), name.utf16() + name.size());
+            m_offsets.push_back(static_cast<quint32>(m_characters.size()));
+            m_slots[slot] = id + 1;
+
+            // At most half full, so that probes stay short
+            if (static_cast<size_t>(size()) * 2 > m_slots.size())
+            {
+                grow();
+            }
+            return id;
+        }
+
+        if (this->name(stored - 1) == name)
+        {
+            return stored - 1;
+        }
+    }
+}
+
+QStringView NamePool::name(quint32 id) const
+{
+    return QStringView(m_characters.data() + m_offsets[id], m_offsets[id + 1] - m_offsets[id]);
+}
+
+int NamePool::size() const
+{
+    return static_cast<int>(m_offsets.size() - 1);
+}
+
+qint64 NamePool::memoryUsage() const
+{
+    return static_cast<qint64>(m_characters.capacity() * sizeof(char16_t) + m_offsets.capacity() * sizeof(quint32)
+                               + m_slots.capacity() * sizeof(quint32));
+}
+
+void NamePool::grow()
+{
+    std::vector<quint32> slots(m_slots.size() * 2, 0);
+    const size_t mask = slots.size() - 1;
+    for (quint32 id = 0; id < static_cast<quint32>(size()); ++id)
+    {
+        size_t slot = qHash(name(id)) & mask;
+        while (slots[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id + 1;
+    }
+    m_slots.swap(slots);
+}
@@ -0,0 +1,968 @@
+#include "PathIndex.h"
+#include "DirectoryWatcher.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QThread>
+#include <QWaitCondition>
+#include <algorithm>
+#include <deque>
+
+namespace
+{
+    constexpr int ScoreMatch        = 16;
+    constexpr int ScoreGapStart     = -3;
+    constexpr int ScoreGapExtension = -1;
+
+    constexpr int BonusSlash       = 10; // First character of a path component
+    constexpr int BonusBoundary    = 8;  // After "_", "-", "." or a space
+    constexpr int BonusCamel       = 7;  // "aB" or "a1"
+    constexpr int BonusConsecutive = 4;
+    constexpr int BonusName        = 2;  // In the file name rather than the directories
+    constexpr int BonusFirstFactor = 2;  // Applied to the bonus of the first character of the query
+
+    // Only ASCII is folded: a search must not decode UTF-8
+    struct FoldTable
+    {
+        unsigned char lower[256];
+
+        constexpr FoldTable()
+            : lower()
+        {
+            for (int c = 0; c < 256; ++c)
+            {
+                lower[c] = static_cast<unsigned char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+            }
+        }
+    };
+    constexpr FoldTable Fold;
+
+    inline char fold(char c)
+    {
+        return static_cast<char>(Fold.lower[static_cast<unsigned char>(c)]);
+    }
+
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // Letters and digits have a bit each, other characters share the rest
+    inline quint64 characterBit(char c)
+    {
+        const unsigned char folded = static_cast<unsigned char>(fold(c));
+        if (folded >= 'a' && folded <= 'z')
+        {
+            return quint64(1) << (folded - 'a');
+        }
+        if (folded >= '0' && folded <= '9')
+        {
+            return quint64(1) << (26 + folded - '0');
+        }
+        return quint64(1) << (36 + folded % 28);
+    }
+
+    // A path lacking one of the bits of a query cannot match it, whatever the order
+    quint64 maskOf(const char *text, qsizetype length)
+    {
+        quint64 mask = 0;
+        for (qsizetype i = 0; i < length; ++i)
+        {
+            mask |= characterBit(text[i]);
+        }
+        return mask;
+    }
+
+    // Start of the last component of path
+    int nameStartOf(const char *path, int length)
+    {
+        int i = length;
+        while (i > 0 && path[i - 1] != '/')
+        {
+            --i;
+        }
+        return i;
+    }
+
+    int bonusAt(const char *path, int i)
+    {
+        if (i == 0 || path[i - 1] == '/')
+        {
+            return BonusSlash;
+        }
+
+        const char previous = path[i - 1];
+        const char current  = path[i];
+        if (previous == '_' || previous == '-' || previous == '.' || previous == ' ')
+        {
+            return BonusBoundary;
+        }
+        if ((previous >= 'a' && previous <= 'z' && current >= 'A' && current <= 'Z')
+            || (!isDigit(previous) && isDigit(current)))
+        {
+            return BonusCamel;
+        }
+        return 0;
+    }
+
+    // Scores the shortest match of query in path[from, length) ending first.
+    // The forward pass finds where it ends, the backward one where it starts
+    // at the latest, so "abc" in "a/x/abc" is not spread over the directories.
+    int scoreFrom(const char *query, int queryLength, const char *path, int from, int length, int nameStart,
+                  std::vector<int> *positions)
+    {
+        int end = -1;
+        for (int i = from, k = 0; i < length; ++i)
+        {
+            if (fold(path[i]) == query[k] && ++k == queryLength)
+            {
+                end = i;
+                break;
+            }
+        }
+        if (end < 0)
+        {
+            return -1;
+        }
+
+        int start = end;
+        for (int k = queryLength - 1;; --start)
+        {
+            if (fold(path[start]) == query[k] && --k < 0)
+            {
+                break;
+            }
+        }
+
+        int score            = 0;
+        int runBonus         = 0;
+        bool previousMatched = false;
+        bool inGap           = false;
+        for (int i = start, k = 0; i <= end; ++i)
+        {
+            if (k < queryLength && fold(path[i]) == query[k])
+            {
+                // A run keeps the bonus of its first character
+                int bonus = bonusAt(path, i);
+                if (previousMatched)
+                {
+                    bonus = std::max({bonus, runBonus, BonusConsecutive});
+                }
+                runBonus = bonus;
+
+                score += ScoreMatch + (k == 0 ? bonus * BonusFirstFactor : bonus) + (i >= nameStart ? BonusName : 0);
+                if (positions)
+                {
+                    positions->push_back(i);
+                }
+                previousMatched = true;
+                inGap           = false;
+                ++k;
+            }
+            else
+            {
+                score += inGap ? ScoreGapExtension : ScoreGapStart;
+                previousMatched = false;
+                inGap           = true;
+            }
+        }
+
+        // Long gaps must not read as "no match"
+        return std::max(score, 0);
+    }
+
+    int scorePath(const char *query, int queryLength, const char *path, int length, std::vector<int> *positions)
+    {
+        if (queryLength == 0)
+        {
+            return 0;
+        }
+        if (queryLength > length)
+        {
+            return -1;
+        }
+
+        const int nameStart = nameStartOf(path, length);
+        int best = scoreFrom(query, queryLength, path, 0, length, nameStart, positions);
+        if (best < 0 || nameStart == 0)
+        {
+            return best;
+        }
+
+        // The first match may run through the directories while the name has a better one
+        std::vector<int> namePositions;
+        const int name = scoreFrom(query, queryLength, path, nameStart, length, nameStart,
+                                   positions ? &namePositions : nullptr);
+        if (name > best)
+        {
+            best = name;
+            if (positions)
+            {
+                *positions = std::move(namePositions);
+            }
+        }
+        return best;
+    }
+
+    QByteArray foldQuery(const QString &query)
+    {
+        QByteArray folded;
+        for (const char c : query.toUtf8())
+        {
+            if (c != ' ')
+            {
+                folded += fold(c);
+            }
+        }
+        return folded;
+    }
+
+    // Either may be "", for the root
+    QString joinPath(const QString &directory, const QString &name)
+    {
+        if (directory.isEmpty() || name.isEmpty())
+        {
+            return directory.isEmpty() ? name : directory;
+        }
+        return directory.endsWith('/') ? directory + name : directory + '/' + name;
+    }
+
+    QString parentOf(const QString &directory)
+    {
+        const qsizetype slash = directory.lastIndexOf('/');
+        return slash < 0 ? QString("") : directory.left(slash);
+    }
+}
+
+PathIndex::PathIndex(QObject *parent)
+    : QObject(parent),
+      m_contents(std::make_shared<Contents>())
+{
+    m_walkers.setMaxThreadCount(std::clamp(QThread::idealThreadCount(), 2, MaxWorkers));
+    m_scorers.setMaxThreadCount(MaxWorkers - 1);
+
+    m_updateTimer.setSingleShot(true);
+    m_updateTimer.setInterval(UpdateInterval);
+    connect(&m_updateTimer, &QTimer::timeout, this, &PathIndex::flushChanges);
+
+    // Directories are read again as a whole, whichever name changed
+    DirectoryWatcher &watcher = DirectoryWatcher::getInstance();
+    connect(&watcher, &DirectoryWatcher::entriesChanged, this, &PathIndex::onDirectoryChanged);
+    connect(&watcher, &DirectoryWatcher::fileWritten, this, [this](const QString &directory, const QString &name)
+    {
+        if (IgnoreRules::isIgnoreFile(name))
+        {
+            onDirectoryChanged(directory);
+        }
+    });
+    connect(&watcher, &DirectoryWatcher::overflowed, this, &PathIndex::onOverflowed);
+}
+
+PathIndex::~PathIndex()
+{
+    // Workers call back into the index, which must outlive them
+    if (m_cancelled)
+    {
+        *m_cancelled = true;
+    }
+    m_walkers.clear();
+    m_walkers.waitForDone();
+    m_scorers.waitForDone();
+    unwatchAll();
+}
+
+void PathIndex::setRootPath(const QString &path)
+{
+    if (m_cancelled)
+    {
+        *m_cancelled = true;
+    }
+
+    m_rootPath = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+
+    unwatchAll();
+    m_changedDirectories.clear();
+    m_updateTimer.stop();
+
+    m_contents = std::make_shared<Contents>();
+    invalidateSearch();
+
+    m_indexing           = true;
+    const int generation = ++m_generation;
+    m_cancelled          = std::make_shared<std::atomic<bool>>(false);
+    m_walkers.start([this, root = m_rootPath, excludes = m_excludes, generation, cancelled = m_cancelled]()
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        auto listings = std::make_shared<std::vector<Listing>>(
+            walk(&m_walkers, root, {QString("")}, excludes, {}, *cancelled));
+        auto contents = std::make_shared<Contents>();
+        contents->merge(*listings);
+        if (*cancelled)
+        {
+            return;
+        }
+
+        qDebug() << "[PathIndex] Indexed" << contents->offsets.size() - 1 << "files in" << listings->size()
+                 << "directories of" << root << "in" << timer.elapsed() << "ms";
+
+        QMetaObject::invokeMethod(this, [this, generation, contents, listings]()
+        {
+            if (generation != m_generation)
+            {
+                return;
+            }
+
+            m_contents = contents;
+            m_indexing = false;
+            invalidateSearch();
+            watch(*listings);
+            emit indexed();
+        }, Qt::QueuedConnection);
+    });
+}
+
+QString PathIndex::rootPath() const
+{
+    return m_rootPath;
+}
+
+void PathIndex::setExcludes(const IgnoreRules &excludes)
+{
+    m_excludes.clear();
+    if (!excludes.isEmpty())
+    {
+        m_excludes.push_back(std::make_shared<const IgnoreRules>(excludes));
+    }
+}
+
+bool PathIndex::isIndexing() const
+{
+    return m_indexing;
+}
+
+int PathIndex::size() const
+{
+    return static_cast<int>(m_contents->offsets.size() - 1) - m_contents->removedCount;
+}
+
+qint64 PathIndex::memoryUsage() const
+{
+    const Contents &contents = *m_contents;
+    qint64 bytes = static_cast<qint64>(contents.characters.capacity() + contents.removed.capacity())
+                 + static_cast<qint64>(contents.offsets.capacity() + m_candidates.capacity()) * sizeof(quint32)
+                 + static_cast<qint64>(contents.masks.capacity()) * sizeof(quint64);
+    for (auto it = contents.directories.cbegin(); it != contents.directories.cend(); ++it)
+    {
+        bytes += static_cast<qint64>(sizeof(Directory) + it.value().files.capacity() * sizeof(quint32))
+               + it.key().size() * 2;
+        for (const QString &subdirectory : it.value().subdirectories)
+        {
+            bytes += sizeof(QString) + subdirectory.size() * 2;
+        }
+    }
+    return bytes;
+}
+
+QString PathIndex::path(quint32 id) const
+{
+    const Contents &contents = *m_contents;
+    if (id + 1 >= contents.offsets.size())
+    {
+        return QString();
+    }
+
+    const quint32 start = contents.offsets[id];
+    return QString::fromUtf8(contents.characters.data() + start, contents.offsets[id + 1] - start);
+}
+
+QString PathIndex::absolutePath(quint32 id) const
+{
+    return joinPath(m_rootPath, path(id));
+}
+
+std::vector<PathIndex::Match> PathIndex::search(const QString &query, int limit)
+{
+    const QByteArray folded = foldQuery(query);
+    if (folded.isEmpty() || limit <= 0)
+    {
+        invalidateSearch();
+        return {};
+    }
+
+    // Paths that did not match the start of the query cannot match the rest of it
+    const bool narrows       = !m_lastQuery.isEmpty() && folded.startsWith(m_lastQuery);
+    const quint64 queryMask  = maskOf(folded.constData(), folded.size());
+    const Contents &contents = *m_contents;
+    const size_t count       = narrows ? m_candidates.size() : contents.offsets.size() - 1;
+
+    const auto better = [&contents](const Match &left, const Match &right)
+    {
+        if (left.score != right.score)
+        {
+            return left.score > right.score;
+        }
+
+        const quint32 leftLength  = contents.offsets[left.id + 1] - contents.offsets[left.id];
+        const quint32 rightLength = contents.offsets[right.id + 1] - contents.offsets[right.id];
+        return leftLength != rightLength ? leftLength < rightLength : left.id < right.id;
+    };
+
+    struct Chunk
+    {
+        std::vector<quint32> matched;
+        std::vector<Match> best; // Heap whose front is the worst kept
+    };
+
+    const int chunkCount = static_cast<int>(
+        std::clamp<size_t>(count / MinChunk, 1, std::min(MaxWorkers, std::max(QThread::idealThreadCount(), 1))));
+    std::vector<Chunk> chunks(chunkCount);
+
+    const auto scoreChunk = [&](int index)
+    {
+        Chunk &chunk           = chunks[index];
+        const size_t begin     = count * index / chunkCount;
+        const size_t end       = count * (index + 1) / chunkCount;
+        const char *characters = contents.characters.data();
+        for (size_t k = begin; k < end; ++k)
+        {
+            const quint32 id = narrows ? m_candidates[k] : static_cast<quint32>(k);
+            if (contents.removed[id] || (contents.masks[id] & queryMask) != queryMask)
+            {
+                continue;
+            }
+
+            const quint32 start = contents.offsets[id];
+            const int score     = scorePath(folded.constData(), static_cast<int>(folded.size()), characters + start,
+                                            static_cast<int>(contents.offsets[id + 1] - start), nullptr);
+            if (score < 0)
+            {
+                continue;
+            }
+
+            chunk.matched.push_back(id);
+            const Match match{id, score};
+            if (static_cast<int>(chunk.best.size()) < limit)
+            {
+                chunk.best.push_back(match);
+                std::push_heap(chunk.best.begin(), chunk.best.end(), better);
+            }
+            else if (better(match, chunk.best.front()))
+            {
+                std::pop_heap(chunk.best.begin(), chunk.best.end(), better);
+                chunk.best.back() = match;
+                std::push_heap(chunk.best.begin(), chunk.best.end(), better);
+            }
+        }
+    };
+
+    // The calling thread scores the first chunk
+    QSemaphore done;
+    for (int index = 1; index < chunkCount; ++index)
+    {
+        m_scorers.start([&scoreChunk, &done, index]()
+        {
+            scoreChunk(index);
+            done.release();
+        });
+    }
+    scoreChunk(0);
+    done.acquire(chunkCount - 1);
+
+    std::vector<quint32> candidates;
+    std::vector<Match> matches;
+    for (Chunk &chunk : chunks)
+    {
+        candidates.insert(candidates.end(), chunk.matched.cbegin(), chunk.matched.cend());
+        matches.insert(matches.end(), chunk.best.cbegin(), chunk.best.cend());
+    }
+
+    std::sort(matches.begin(), matches.end(), better);
+    if (static_cast<int>(matches.size()) > limit)
+    {
+        matches.resize(limit);
+    }
+
+    m_lastQuery  = folded;
+    m_candidates = std::move(candidates);
+    return matches;
+}
+
+int PathIndex::matchCount() const
+{
+    return static_cast<int>(m_candidates.size());
+}
+
+int PathIndex::score(const char *query, int queryLength, const char *path, int pathLength)
+{
+    return scorePath(query, queryLength, path, pathLength, nullptr);
+}
+
+QList<int> PathIndex::matchPositions(const QString &query, const QString &path)
+{
+    const QByteArray folded = foldQuery(query);
+    const QByteArray bytes  = path.toUtf8();
+
+    std::vector<int> positions;
+    if (scorePath(folded.constData(), static_cast<int>(folded.size()), bytes.constData(),
+                  static_cast<int>(bytes.size()), &positions) < 0)
+    {
+        return {};
+    }
+
+    // From UTF-8 offsets to QString ones
+    QList<int> result;
+    int index = 0;
+    size_t next = 0;
+    for (int i = 0; i < bytes.size() && next < positions.size(); ++i)
+    {
+        const unsigned char c = static_cast<unsigned char>(bytes[i]);
+        if ((c & 0xC0) == 0x80)
+        {
+            continue;
+        }
+        if (i == positions[next])
+        {
+            result << index;
+            ++next;
+        }
+        index += c >= 0xF0 ? 2 : 1;
+    }
+    return result;
+}
+
+quint32 PathIndex::Contents::add(const QString &path)
+{
+    const QByteArray bytes = path.toUtf8();
+    characters.insert(characters.end(), bytes.cbegin(), bytes.cend());
+    offsets.push_back(static_cast<quint32>(characters.size()));
+    masks.push_back(maskOf(bytes.constData(), bytes.size()));
+    removed.push_back(0);
+    return static_cast<quint32>(offsets.size() - 2);
+}
+
+QString PathIndex::Contents::fileName(quint32 id) const
+{
+    const char *path = characters.data() + offsets[id];
+    const int length = static_cast<int>(offsets[id + 1] - offsets[id]);
+    const int start  = nameStartOf(path, length);
+    return QString::fromUtf8(path + start, length - start);
+}
+
+void PathIndex::Contents::merge(const std::vector<Listing> &listings)
+{
+    for (const Listing &listing : listings)
+    {
+        // Listings come after that of their parent, which may have gone meanwhile
+        if (directories.contains(listing.directory)
+            || (!listing.directory.isEmpty() && !directories.contains(parentOf(listing.directory))))
+        {
+            continue;
+        }
+
+        Directory &directory = directories[listing.directory];
+        directory.subdirectories = listing.subdirectories;
+        directory.files.reserve(listing.files.size());
+        for (const QString &file : listing.files)
+        {
+            directory.files.push_back(add(joinPath(listing.directory, file)));
+        }
+
+        if (listing.rules)
+        {
+            rules.insert(listing.directory, listing.rules);
+        }
+    }
+}
+
+std::vector<PathIndex::Listing> PathIndex::walk(QThreadPool *pool, const QString &root, const QStringList &directories,
+                                                const RuleChain &excludes,
+                                                const QHash<QString, std::shared_ptr<const IgnoreRules>> &rules,
+                                                const std::atomic<bool> &cancelled)
+{
+    struct Pending
+    {
+        QString directory;
+        RuleChain rules;
+    };
+
+    QMutex mutex;
+    QWaitCondition wake;
+    std::deque<Pending> pending;
+    std::vector<Listing> listings;
+    int busy = 0;
+
+    for (const QString &directory : directories)
+    {
+        pending.push_back({directory, IgnoreRules::rulesAbove(directory, excludes, rules)});
+    }
+
+    const auto work = [&]()
+    {
+        for (;;)
+        {
+            Pending next;
+            {
+                QMutexLocker locker(&mutex);
+
+                // Idle workers wait for the busy ones to discover more directories
+                while (pending.empty() && busy > 0 && !cancelled)
+                {
+                    wake.wait(&mutex);
+                }
+                if (pending.empty() || cancelled)
+                {
+                    wake.wakeAll();
+                    return;
+                }
+
+                next = std::move(pending.front());
+                pending.pop_front();
+                ++busy;
+            }
+
+            Listing listing = readDirectory(root, next.directory, next.rules);
+            if (listing.rules)
+            {
+                next.rules.push_back(listing.rules);
+            }
+
+            QMutexLocker locker(&mutex);
+            for (const QString &subdirectory : listing.subdirectories)
+            {
+                pending.push_back({joinPath(next.directory, subdirectory), next.rules});
+            }
+            listings.push_back(std::move(listing));
+            --busy;
+            wake.wakeAll();
+        }
+    };
+
+    // Helpers only take threads that are free now, so walks never wait on each other
+    QSemaphore finished;
+    int helpers = 0;
+    for (; helpers + 1 < MaxWorkers; ++helpers)
+    {
+        const bool started = pool->tryStart([&work, &finished]()
+        {
+            work();
+            finished.release();
+        });
+        if (!started)
+        {
+            break;
+        }
+    }
+
+    // The calling thread walks too
+    work();
+    finished.acquire(helpers);
+    return listings;
+}
+
+PathIndex::Listing PathIndex::readDirectory(const QString &root, const QString &directory, const RuleChain &rules)
+{
+    const QString path = joinPath(root, directory);
+    std::vector<DirectoryReader::Entry> entries = DirectoryReader::read(path);
+
+    Listing listing;
+    listing.directory = directory;
+
+    // The ignore files of the directory apply to its own entries
+    RuleChain chain = rules;
+    listing.rules   = IgnoreRules::readDirectory(path, directory, entries);
+    if (listing.rules)
+    {
+        chain.push_back(listing.rules);
+    }
+    IgnoreRules::markIgnored(entries, chain, directory, false);
+
+    for (const DirectoryReader::Entry &entry : entries)
+    {
+        if (!entry.isDirectory)
+        {
+            listing.files << entry.name;
+        }
+        else if (!entry.isSymLink)
+        {
+            // Links to directories are not followed, which also keeps them from looping
+            listing.subdirectories << entry.name;
+        }
+    }
+    return listing;
+}
+
+void PathIndex::watch(const std::vector<Listing> &listings)
+{
+    QStringList paths;
+    paths.reserve(static_cast<qsizetype>(listings.size()));
+    for (const Listing &listing : listings)
+    {
+        const QString path = joinPath(m_rootPath, listing.directory);
+        if (!m_watched.contains(path))
+        {
+            paths << path;
+        }
+    }
+
+    if (!paths.isEmpty())
+    {
+        const QStringList failed = DirectoryWatcher::getInstance().watch(paths);
+        for (const QString &path : paths)
+        {
+            m_watched.insert(path);
+        }
+        for (const QString &path : failed)
+        {
+            m_watched.remove(path);
+        }
+        if (!failed.isEmpty())
+        {
+            qWarning() << "[PathIndex] Cannot watch" << failed.size() << "directories, changes to them will be missed";
+        }
+    }
+}
+
+void PathIndex::unwatchAll()
+{
+    DirectoryWatcher::getInstance().unwatch(m_watched.values());
+    m_watched.clear();
+}
+
+void PathIndex::onDirectoryChanged(const QString &path)
+{
+    // The watcher reports the directories of every user
+    if (!m_watched.contains(path))
+    {
+        return;
+    }
+
+    QString directory = QDir(m_rootPath).relativeFilePath(path);
+    if (directory == ".")
+    {
+        directory = "";
+    }
+
+    m_changedDirectories.insert(directory);
+    if (!m_updateTimer.isActive())
+    {
+        m_updateTimer.start();
+    }
+}
+
+void PathIndex::onOverflowed()
+{
+    // Events were lost: every directory is read again
+    for (auto it = m_contents->directories.cbegin(); it != m_contents->directories.cend(); ++it)
+    {
+        m_changedDirectories.insert(it.key());
+    }
+    if (!m_changedDirectories.isEmpty() && !m_updateTimer.isActive())
+    {
+        m_updateTimer.start();
+    }
+}
+
+void PathIndex::flushChanges()
+{
+    for (const QString &directory : std::as_const(m_changedDirectories))
+    {
+        if (!m_contents->directories.contains(directory))
+        {
+            continue;
+        }
+
+        const RuleChain rules = IgnoreRules::rulesAbove(directory, m_excludes, m_contents->rules);
+        m_walkers.start([this, root = m_rootPath, directory, rules, generation = m_generation]()
+        {
+            Listing listing = readDirectory(root, directory, rules);
+            QMetaObject::invokeMethod(this, [this, generation, listing = std::move(listing)]()
+            {
+                if (generation == m_generation)
+                {
+                    applyListing(listing);
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+    m_changedDirectories.clear();
+}
+
+void PathIndex::applyListing(const Listing &listing)
+{
+    Contents &contents = *m_contents;
+    const auto it      = contents.directories.find(listing.directory);
+    if (it == contents.directories.end())
+    {
+        return; // Removed meanwhile
+    }
+
+    // New ignore rules may hide or show anything below: the subdirectories are read again
+    const std::shared_ptr<const IgnoreRules> previousRules = contents.rules.value(listing.directory);
+    const bool rulesChanged = IgnoreRules::isChanged(previousRules, listing.rules);
+    if (listing.rules)
+    {
+        contents.rules.insert(listing.directory, listing.rules);
+    }
+    else
+    {
+        contents.rules.remove(listing.directory);
+    }
+
+    bool isChanged = rulesChanged;
+    QSet<QString> listed(listing.files.cbegin(), listing.files.cend());
+    std::vector<quint32> files;
+    files.reserve(listing.files.size());
+    for (const quint32 id : it.value().files)
+    {
+        if (listed.remove(contents.fileName(id)))
+        {
+            files.push_back(id);
+        }
+        else
+        {
+            contents.removed[id] = 1;
+            ++contents.removedCount;
+            isChanged = true;
+        }
+    }
+    for (const QString &file : listing.files)
+    {
+        if (listed.contains(file))
+        {
+            files.push_back(contents.add(joinPath(listing.directory, file)));
+            isChanged = true;
+        }
+    }
+    it.value().files = std::move(files);
+
+    const QSet<QString> before(it.value().subdirectories.cbegin(), it.value().subdirectories.cend());
+    const QSet<QString> after(listing.subdirectories.cbegin(), listing.subdirectories.cend());
+    const QSet<QString> removed = rulesChanged ? before : before - after;
+    const QSet<QString> added   = rulesChanged ? after : after - before;
+    it.value().subdirectories   = listing.subdirectories;
+
+    // it is not used past here: removing directories may move the others
+    for (const QString &subdirectory : removed)
+    {
+        removeDirectory(joinPath(listing.directory, subdirectory));
+        isChanged = true;
+    }
+
+    if (!added.isEmpty())
+    {
+        QStringList directories;
+        for (const QString &subdirectory : added)
+        {
+            directories << joinPath(listing.directory, subdirectory);
+        }
+
+        m_walkers.start([this, root = m_rootPath, directories, excludes = m_excludes, rules = contents.rules,
+                         generation = m_generation, cancelled = m_cancelled]()
+        {
+            std::vector<Listing> listings = walk(&m_walkers, root, directories, excludes, rules, *cancelled);
+            QMetaObject::invokeMethod(this, [this, generation, listings = std::move(listings)]()
+            {
+                if (generation != m_generation)
+                {
+                    return;
+                }
+
+                m_contents->merge(listings);
+                watch(listings);
+                invalidateSearch();
+                emit changed();
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    if (!isChanged)
+    {
+        return;
+    }
+
+    if (contents.removedCount > MinChunk && contents.removedCount > size())
+    {
+        compact();
+    }
+    invalidateSearch();
+    emit changed();
+}
+
+void PathIndex::removeDirectory(const QString &directory)
+{
+    Contents &contents = *m_contents;
+    QStringList paths;
+    QStringList pending = {directory};
+    while (!pending.isEmpty())
+    {
+        const QString current = pending.takeLast();
+        const auto it         = contents.directories.constFind(current);
+        if (it == contents.directories.cend())
+        {
+            continue;
+        }
+
+        for (const quint32 id : it.value().files)
+        {
+            contents.removed[id] = 1;
+        }
+        contents.removedCount += static_cast<int>(it.value().files.size());
+        for (const QString &subdirectory : it.value().subdirectories)
+        {
+            pending << joinPath(current, subdirectory);
+        }
+
+        contents.directories.erase(it);
+        contents.rules.remove(current);
+        paths << joinPath(m_rootPath, current);
+    }
+
+    paths.removeIf([this](const QString &path) { return !m_watched.remove(path); });
+    DirectoryWatcher::getInstance().unwatch(paths);
+}
+
+void PathIndex::compact()
+{
+    const Contents &contents = *m_contents;
+    auto compacted           = std::make_shared<Contents>();
+    compacted->characters.reserve(contents.characters.size());
+    compacted->offsets.reserve(contents.offsets.size() - contents.removedCount);
+    compacted->masks.reserve(contents.offsets.size() - contents.removedCount);
+    compacted->removed.reserve(contents.offsets.size() - contents.removedCount);
+    compacted->rules = contents.rules;
+
+    for (auto it = contents.directories.cbegin(); it != contents.directories.cend(); ++it)
+    {
+        Directory directory;
+        directory.subdirectories = it.value().subdirectories;
+        directory.files.reserve(it.value().files.size());
+        for (const quint32 id : it.value().files)
+        {
+            const char *start = contents.characters.data() + contents.offsets[id];
+            const char *end   = contents.characters.data() + contents.offsets[id + 1];
+            compacted->characters.insert(compacted->characters.end(), start, end);
+            compacted->offsets.push_back(static_cast<quint32>(compacted->characters.size()));
+            compacted->masks.push_back(contents.masks[id]);
+            compacted->removed.push_back(0);
+            directory.files.push_back(static_cast<quint32>(compacted->offsets.size() - 2));
+        }
+        compacted->directories.insert(it.key(), std::move(directory));
+    }
+
+    qDebug() << "[PathIndex] Compacted" << contents.removedCount << "removed paths";
+    m_contents = compacted;
+    invalidateSearch();
+}
+
+void PathIndex::invalidateSearch()
+{
+    m_lastQuery.clear();
+    m_candidates.clear();
+}
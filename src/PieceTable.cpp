@@ -0,0 +1,334 @@
+#include "PieceTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+void PieceTable::setOriginal(const char *data, qint64 size)
+{
+    m_original     = data;
+    m_originalSize = size;
+    m_indexedSize  = 0;
+    m_originalNewlines.clear();
+    m_added.clear();
+    m_addedNewlines.clear();
+
+    m_pieces.clear();
+    if (size > 0)
+    {
+        m_pieces.push_back({false, 0, size, 0});
+    }
+    updateIndex();
+}
+
+qint64 PieceTable::size() const
+{
+    return m_size;
+}
+
+bool PieceTable::isEmpty() const
+{
+    return m_size == 0;
+}
+
+qsizetype PieceTable::pieceCount() const
+{
+    return static_cast<qsizetype>(m_pieces.size());
+}
+
+const std::vector<qint64> &PieceTable::newlinesOf(const Piece &piece) const
+{
+    return piece.added ? m_addedNewlines : m_originalNewlines;
+}
+
+qint64 PieceTable::countNewlines(const Piece &piece, qint64 begin, qint64 end) const
+{
+    const std::vector<qint64> &newlines = newlinesOf(piece);
+    return std::lower_bound(newlines.begin(), newlines.end(), end)
+           - std::lower_bound(newlines.begin(), newlines.end(), begin);
+}
+
+PieceTable::Piece PieceTable::makePiece(bool added, qint64 start, qint64 length) const
+{
+    Piece piece{added, start, length, 0};
+    piece.newlines = countNewlines(piece, start, start + length);
+    return piece;
+}
+
+void PieceTable::updateIndex()
+{
+    m_size     = 0;
+    m_newlines = 0;
+    for (const Piece &piece : m_pieces)
+    {
+        m_size += piece.length;
+        m_newlines += piece.newlines;
+    }
+    invalidateFrom(0);
+}
+
+void PieceTable::invalidateFrom(qsizetype piece)
+{
+    m_validPieces = std::min(m_validPieces, piece);
+}
+
+void PieceTable::validate(qsizetype count) const
+{
+    // Entries past m_validPieces are stale, whatever the size of the arrays
+    m_pieceOffsets.resize(m_pieces.size());
+    m_pieceLines.resize(m_pieces.size());
+
+    count = std::min(count, static_cast<qsizetype>(m_pieces.size()));
+    for (qsizetype i = m_validPieces; i < count; ++i)
+    {
+        m_pieceOffsets[i] = i == 0 ? 0 : m_pieceOffsets[i - 1] + m_pieces[i - 1].length;
+        m_pieceLines[i]   = i == 0 ? 0 : m_pieceLines[i - 1] + m_pieces[i - 1].newlines;
+    }
+    m_validPieces = std::max(m_validPieces, count);
+}
+
+qsizetype PieceTable::pieceAt(qint64 offset) const
+{
+    // Up to the piece holding offset, the last one at the end of the text
+    const qsizetype pieces = static_cast<qsizetype>(m_pieces.size());
+    validate(m_validPieces);
+    while (m_validPieces < pieces
+           && (m_validPieces == 0
+               || m_pieceOffsets[m_validPieces - 1] + m_pieces[m_validPieces - 1].length <= offset))
+    {
+        validate(m_validPieces + 1);
+    }
+
+    // Last piece starting at or before offset
+    auto it = std::upper_bound(m_pieceOffsets.begin(), m_pieceOffsets.begin() + m_validPieces, offset);
+    return static_cast<qsizetype>(it - m_pieceOffsets.begin()) - 1;
+}
+
+qsizetype PieceTable::pieceOfLine(qint64 line) const
+{
+    // Up to the piece holding the '\n' ending line - 1
+    const qsizetype pieces = static_cast<qsizetype>(m_pieces.size());
+    validate(m_validPieces);
+    while (m_validPieces < pieces
+           && (m_validPieces == 0
+               || m_pieceLines[m_validPieces - 1] + m_pieces[m_validPieces - 1].newlines < line))
+    {
+        validate(m_validPieces + 1);
+    }
+
+    // Last piece with fewer newlines before it than the line number
+    auto it = std::upper_bound(m_pieceLines.begin(), m_pieceLines.begin() + m_validPieces, line - 1);
+    return static_cast<qsizetype>(it - m_pieceLines.begin()) - 1;
+}
+
+qsizetype PieceTable::split(qint64 offset)
+{
+    if (offset >= m_size)
+    {
+        return static_cast<qsizetype>(m_pieces.size());
+    }
+
+    const qsizetype index = pieceAt(offset);
+    const qint64 inside   = offset - m_pieceOffsets[index];
+    if (inside == 0)
+    {
+        return index;
+    }
+
+    const Piece piece = m_pieces[index];
+    m_pieces[index]   = makePiece(piece.added, piece.start, inside);
+    m_pieces.insert(m_pieces.begin() + index + 1,
+                    makePiece(piece.added, piece.start + inside, piece.length - inside));
+    invalidateFrom(index + 1);
+    return index + 1;
+}
+
+void PieceTable::insert(qint64 offset, QByteArrayView bytes)
+{
+    if (bytes.isEmpty())
+    {
+        return;
+    }
+    offset = std::clamp<qint64>(offset, 0, m_size);
+
+    const qint64 start = m_added.size();
+    qint64 newlines    = 0;
+    for (qsizetype i = 0; i < bytes.size(); ++i)
+    {
+        if (bytes[i] == '\n')
+        {
+            m_addedNewlines.push_back(start + i);
+            ++newlines;
+        }
+    }
+    m_added.append(bytes);
+
+    // Typing extends the piece of the previous keystroke
+    if (offset > 0)
+    {
+        const qsizetype previous = pieceAt(offset - 1);
+        Piece &piece             = m_pieces[previous];
+        if (piece.added && piece.start + piece.length == start
+            && m_pieceOffsets[previous] + piece.length == offset)
+        {
+            piece.length += bytes.size();
+            piece.newlines += newlines;
+            m_size += bytes.size();
+            m_newlines += newlines;
+            invalidateFrom(previous + 1);
+            return;
+        }
+    }
+
+    const qsizetype index = split(offset);
+    m_pieces.insert(m_pieces.begin() + index, makePiece(true, start, bytes.size()));
+    m_size += bytes.size();
+    m_newlines += newlines;
+    invalidateFrom(index);
+}
+
+void PieceTable::remove(qint64 offset, qint64 length)
+{
+    offset = std::clamp<qint64>(offset, 0, m_size);
+    length = std::clamp<qint64>(length, 0, m_size - offset);
+    if (length == 0)
+    {
+        return;
+    }
+
+    const qsizetype first = split(offset);
+    const qsizetype last  = split(offset + length);
+    for (qsizetype index = first; index < last; ++index)
+    {
+        m_newlines -= m_pieces[index].newlines;
+    }
+    m_pieces.erase(m_pieces.begin() + first, m_pieces.begin() + last);
+    m_size -= length;
+    invalidateFrom(first);
+}
+
+QByteArray PieceTable::read(qint64 offset, qint64 length) const
+{
+    offset = std::clamp<qint64>(offset, 0, m_size);
+    length = std::clamp<qint64>(length, 0, m_size - offset);
+
+    QByteArray bytes;
+    bytes.reserve(length);
+    const qsizetype first = length > 0 ? pieceAt(offset) : 0;
+    qint64 inside         = length > 0 ? offset - m_pieceOffsets[first] : 0;
+    for (qsizetype index = first; length > 0; ++index)
+    {
+        // Only the first piece is read from its middle: the offsets of the next ones may be stale
+        const Piece &piece = m_pieces[index];
+        const qint64 count = std::min(length, piece.length - inside);
+        const char *buffer = piece.added ? m_added.constData() : m_original;
+
+        bytes.append(buffer + piece.start + inside, count);
+        length -= count;
+        inside = 0;
+    }
+    return bytes;
+}
+
+void PieceTable::forEachSpan(const std::function<bool(QByteArrayView span)> &visit) const
+{
+    for (const Piece &piece : m_pieces)
+    {
+        const char *buffer = piece.added ? m_added.constData() : m_original;
+        if (!visit(QByteArrayView(buffer + piece.start, piece.length)))
+        {
+            return;
+        }
+    }
+}
+
+std::vector<qint64> PieceTable::indexLines(const char *data, qint64 begin, qint64 end)
+{
+    std::vector<qint64> newlines;
+    const char *position = data + begin;
+    const char *last     = data + end;
+    while (position < last)
+    {
+        // memchr is vectorized by the C library
+        const void *found = std::memchr(position, '\n', static_cast<std::size_t>(last - position));
+        if (!found)
+        {
+            break;
+        }
+        const char *newline = static_cast<const char *>(found);
+        newlines.push_back(newline - data);
+        position = newline + 1;
+    }
+    return newlines;
+}
+
+void PieceTable::appendOriginalIndex(const std::vector<qint64> &newlines, qint64 indexedSize)
+{
+    m_originalNewlines.insert(m_originalNewlines.end(), newlines.begin(), newlines.end());
+    m_indexedSize = std::min(indexedSize, m_originalSize);
+
+    for (Piece &piece : m_pieces)
+    {
+        if (!piece.added)
+        {
+            piece.newlines = countNewlines(piece, piece.start, piece.start + piece.length);
+        }
+    }
+    updateIndex();
+}
+
+bool PieceTable::isIndexed() const
+{
+    return m_indexedSize >= m_originalSize;
+}
+
+qint64 PieceTable::lineCount() const
+{
+    // The line after the last known '\n' is complete only once all is indexed
+    return isIndexed() ? m_newlines + 1 : m_newlines;
+}
+
+qint64 PieceTable::lineStart(qint64 line) const
+{
+    if (line <= 0)
+    {
+        return 0;
+    }
+    line = std::min(line, m_newlines);
+
+    const qsizetype index = pieceOfLine(line);
+    const Piece &piece    = m_pieces[index];
+
+    const std::vector<qint64> &newlines = newlinesOf(piece);
+    const auto first   = std::lower_bound(newlines.begin(), newlines.end(), piece.start);
+    const qint64 found = *(first + (line - m_pieceLines[index] - 1));
+    return m_pieceOffsets[index] + (found - piece.start) + 1;
+}
+
+qint64 PieceTable::lineLength(qint64 line) const
+{
+    const qint64 start = lineStart(line);
+    const qint64 end   = line < m_newlines ? lineStart(line + 1) - 1 : m_size;
+    return end - start;
+}
+
+QByteArray PieceTable::line(qint64 line) const
+{
+    return read(lineStart(line), lineLength(line));
+}
+
+qint64 PieceTable::lineOf(qint64 offset) const
+{
+    if (offset >= m_size)
+    {
+        return m_newlines;
+    }
+    if (offset <= 0)
+    {
+        return 0;
+    }
+
+    const qsizetype index = pieceAt(offset);
+    const Piece &piece    = m_pieces[index];
+    const qint64 inside   = offset - m_pieceOffsets[index];
+    return m_pieceLines[index] + countNewlines(piece, piece.start, piece.start + inside);
+}
@@ -0,0 +1,678 @@
+#include "ProjectSearch.h"
+#include "TextFormat.h"
+#include "TrigramIndex.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringDecoder>
+#include <QThread>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <deque>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PROJECT_SEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    using RuleChain = std::vector<std::shared_ptr<const IgnoreRules>>;
+
+    inline char foldAscii(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    bool equalFolded(const char *text, const char *needle, qsizetype length)
+    {
+        for (qsizetype i = 0; i < length; ++i)
+        {
+            if (foldAscii(text[i]) != needle[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    qsizetype findScalar(const char *data, qsizetype from, qsizetype size, const QByteArray &needle, bool caseSensitive)
+    {
+        const qsizetype length = needle.size();
+        if (caseSensitive)
+        {
+            // memchr is vectorized by the C library
+            const char *end = data + size - length + 1;
+            for (const char *p = data + from; p < end; ++p)
+            {
+                p = static_cast<const char *>(std::memchr(p, needle[0], static_cast<std::size_t>(end - p)));
+                if (!p)
+                {
+                    return -1;
+                }
+                if (std::memcmp(p + 1, needle.constData() + 1, static_cast<std::size_t>(length - 1)) == 0)
+                {
+                    return p - data;
+                }
+            }
+            return -1;
+        }
+
+        for (qsizetype i = from; i + length <= size; ++i)
+        {
+            if (foldAscii(data[i]) == needle[0] && equalFolded(data + i + 1, needle.constData() + 1, length - 1))
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+#ifdef PROJECT_SEARCH_SSE2
+    // ASCII upper case letters to lower case; bytes above 0x7f are negative and left alone
+    inline __m128i foldSse2(__m128i chunk)
+    {
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('A' - 1)),
+                                            _mm_cmplt_epi8(chunk, _mm_set1_epi8('Z' + 1)));
+        return _mm_add_epi8(chunk, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    }
+
+    // Compares 16 positions at once with the first and the last byte of the
+    // needle; only positions where both match are compared in full
+    qsizetype findSse2(const char *data, qsizetype size, const QByteArray &needle, bool caseSensitive)
+    {
+        const qsizetype length = needle.size();
+        const __m128i first    = _mm_set1_epi8(needle[0]);
+        const __m128i last     = _mm_set1_epi8(needle[length - 1]);
+
+        qsizetype i = 0;
+        for (; i + length - 1 + 16 <= size; i += 16)
+        {
+            __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + length - 1));
+            if (!caseSensitive)
+            {
+                head = foldSse2(head);
+                tail = foldSse2(tail);
+            }
+
+            unsigned mask = static_cast<unsigned>(
+                _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+            for (; mask != 0; mask &= mask - 1)
+            {
+                const qsizetype at = i + std::countr_zero(mask);
+                const bool equal   = caseSensitive
+                                     ? std::memcmp(data + at + 1, needle.constData() + 1,
+                                                   static_cast<std::size_t>(length - 1)) == 0
+                                     : equalFolded(data + at + 1, needle.constData() + 1, length - 1);
+                if (equal)
+                {
+                    return at;
+                }
+            }
+        }
+        return findScalar(data, i, size, needle, caseSensitive);
+    }
+#endif
+
+    QString joinPath(const QString &directory, const QString &name)
+    {
+        if (directory.isEmpty() || name.isEmpty())
+        {
+            return directory.isEmpty() ? name : directory;
+        }
+        return directory.endsWith('/') ? directory + name : directory + '/' + name;
+    }
+
+    bool isLiteralPattern(const QString &pattern)
+    {
+        static const QString special = "\\^$.|?*+()[]{}";
+        return std::none_of(pattern.cbegin(), pattern.cend(), [](QChar c) { return special.contains(c); });
+    }
+
+    bool isAscii(const QString &text)
+    {
+        return std::all_of(text.cbegin(), text.cend(), [](QChar c) { return c.unicode() < 0x80; });
+    }
+}
+
+struct ProjectSearch::Run
+{
+    struct Task
+    {
+        QString path; // Relative to the root
+        bool isDirectory = false;
+        RuleChain rules; // Of a directory, from the directories above it
+    };
+
+    struct Queue
+    {
+        QMutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    QString root;
+    QByteArray literal; // In lower case unless caseSensitive; empty for a regular expression
+    QRegularExpression regex; // Also of a literal, for the files it cannot be found in undecoded
+    bool caseSensitive = false;
+
+    // Each worker takes from the back of its queue, and steals from the front of the others
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<int> pending{0};     // Tasks queued or running
+    std::atomic<quint64> version{0}; // Bumped whenever tasks are queued
+    std::atomic<int> running{0};     // Workers not done yet
+    QMutex idleMutex;
+    QWaitCondition idle;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<int> searchedFiles{0};
+    std::atomic<int> hitCount{0};
+
+    QMutex hitsMutex;
+    QList<Hit> hits; // Not handed over yet
+};
+
+ProjectSearch::ProjectSearch(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(std::clamp(QThread::idealThreadCount(), 1, MaxWorkers));
+
+    m_batchTimer.setInterval(BatchInterval);
+    connect(&m_batchTimer, &QTimer::timeout, this, &ProjectSearch::flushHits);
+}
+
+ProjectSearch::~ProjectSearch()
+{
+    // Workers of cancelled searches hold their own state, but call back into the search
+    cancel();
+    m_pool.waitForDone();
+}
+
+void ProjectSearch::setExcludes(const IgnoreRules &excludes)
+{
+    m_excludes.clear();
+    if (!excludes.isEmpty())
+    {
+        m_excludes.push_back(std::make_shared<const IgnoreRules>(excludes));
+    }
+}
+
+void ProjectSearch::setIndex(const TrigramIndex *index)
+{
+    m_index = index;
+}
+
+OperationResult ProjectSearch::start(const QString &root, const QString &pattern, Options options)
+{
+    cancel();
+
+    if (pattern.isEmpty())
+    {
+        return {false, "Nothing to search for."};
+    }
+    if (root.isEmpty() || !QFileInfo(root).isDir())
+    {
+        return {false, "No project folder to search."};
+    }
+
+    auto run           = std::make_shared<Run>();
+    run->root          = QDir::cleanPath(QFileInfo(root).absoluteFilePath());
+    run->caseSensitive = options.caseSensitive;
+
+    QRegularExpression::PatternOptions patternOptions = QRegularExpression::MultilineOption;
+    if (!options.caseSensitive)
+    {
+        patternOptions |= QRegularExpression::CaseInsensitiveOption;
+    }
+
+    const bool isLiteral = !options.regularExpression || isLiteralPattern(pattern);
+    run->regex = QRegularExpression(isLiteral ? QRegularExpression::escape(pattern) : pattern, patternOptions);
+    if (!run->regex.isValid())
+    {
+        return {false, "Invalid regular expression: " + run->regex.errorString().toStdString()};
+    }
+    run->regex.optimize();
+
+    // Only ASCII letters are folded without decoding the files
+    if (isLiteral && (options.caseSensitive || isAscii(pattern)))
+    {
+        run->literal = pattern.toUtf8();
+        if (!options.caseSensitive)
+        {
+            std::transform(run->literal.begin(), run->literal.end(), run->literal.begin(), foldAscii);
+        }
+    }
+
+    const int workers = m_pool.maxThreadCount();
+    for (int i = 0; i < workers; ++i)
+    {
+        run->queues.push_back(std::make_unique<Run::Queue>());
+    }
+    // The index lists the files that may match, already filtered by the ignore rules
+    std::optional<QStringList> candidates;
+    if (m_index && !run->literal.isEmpty() && m_index->rootPath() == run->root)
+    {
+        candidates = m_index->candidates(run->literal);
+    }
+
+    if (candidates)
+    {
+        for (qsizetype i = 0; i < candidates->size(); ++i)
+        {
+            run->queues[i % workers]->tasks.push_back({candidates->at(i), false, {}});
+        }
+        run->pending = static_cast<int>(candidates->size());
+    }
+    else
+    {
+        run->queues[0]->tasks.push_back({QString(""), true, m_excludes});
+        run->pending = 1;
+    }
+    run->running = workers;
+
+    m_run = run;
+    m_batchTimer.start();
+
+    for (int i = 0; i < workers; ++i)
+    {
+        m_pool.start([this, run, i]()
+        {
+            work(run, i);
+            if (--run->running > 0)
+            {
+                return;
+            }
+
+            QMetaObject::invokeMethod(this, [this, run]()
+            {
+                if (run != m_run)
+                {
+                    return;
+                }
+
+                flushHits();
+                m_batchTimer.stop();
+                m_run.reset();
+                emit finished(run->searchedFiles, std::min(run->hitCount.load(), MaxHits));
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    return {true, "Searching " + run->root.toStdString()};
+}
+
+void ProjectSearch::cancel()
+{
+    m_batchTimer.stop();
+    if (!m_run)
+    {
+        return;
+    }
+
+    m_run->cancelled = true;
+    {
+        QMutexLocker locker(&m_run->idleMutex);
+        m_run->idle.wakeAll();
+    }
+    m_run.reset();
+}
+
+bool ProjectSearch::isRunning() const
+{
+    return m_run != nullptr;
+}
+
+qsizetype ProjectSearch::findLiteral(const char *data, qsizetype size, const QByteArray &needle, bool caseSensitive)
+{
+    if (needle.isEmpty() || needle.size() > size)
+    {
+        return -1;
+    }
+
+#ifdef PROJECT_SEARCH_SSE2
+    return findSse2(data, size, needle, caseSensitive);
+#else
+    return findScalar(data, 0, size, needle, caseSensitive);
+#endif
+}
+
+void ProjectSearch::work(const std::shared_ptr<Run> &run, int index)
+{
+    Run &state      = *run;
+    const int count = static_cast<int>(state.queues.size());
+    QList<Hit> hits;
+
+    for (;;)
+    {
+        const quint64 seen = state.version;
+
+        Run::Task task;
+        bool found = false;
+        for (int k = 0; !found && k < count; ++k)
+        {
+            Run::Queue &queue = *state.queues[(index + k) % count];
+            QMutexLocker locker(&queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                // Its own most recent task, or the oldest of another worker: a directory near the top
+                if (k == 0)
+                {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                found = true;
+            }
+        }
+
+        if (found)
+        {
+            if (!state.cancelled)
+            {
+                if (task.isDirectory)
+                {
+                    listDirectory(state, index, task.path, task.rules);
+                }
+                else
+                {
+                    searchFile(state, task.path, hits);
+                }
+            }
+
+            if (!hits.isEmpty())
+            {
+                QMutexLocker locker(&state.hitsMutex);
+                state.hits.append(std::move(hits));
+                hits.clear();
+            }
+
+            if (--state.pending == 0)
+            {
+                QMutexLocker locker(&state.idleMutex);
+                state.idle.wakeAll();
+            }
+            continue;
+        }
+
+        // Idle workers wait for others to queue more, unless tasks were queued since they looked
+        QMutexLocker locker(&state.idleMutex);
+        if (state.pending == 0 || state.cancelled)
+        {
+            return;
+        }
+        if (state.version == seen)
+        {
+            state.idle.wait(&state.idleMutex);
+        }
+    }
+}
+
+void ProjectSearch::listDirectory(Run &run, int index, const QString &directory, const RuleChain &rules)
+{
+    const QString path = joinPath(run.root, directory);
+    std::vector<DirectoryReader::Entry> entries = DirectoryReader::read(path);
+
+    // The ignore files of the directory apply to its own entries
+    RuleChain chain = rules;
+    if (std::shared_ptr<const IgnoreRules> own = IgnoreRules::readDirectory(path, directory, entries))
+    {
+        chain.push_back(std::move(own));
+    }
+    IgnoreRules::markIgnored(entries, chain, directory, false);
+
+    std::vector<Run::Task> tasks;
+    tasks.reserve(entries.size());
+    for (const DirectoryReader::Entry &entry : entries)
+    {
+        if (!entry.isDirectory)
+        {
+            tasks.push_back({joinPath(directory, entry.name), false, {}});
+        }
+        else if (!entry.isSymLink)
+        {
+            // Links to directories are not followed, which also keeps them from looping
+            tasks.push_back({joinPath(directory, entry.name), true, chain});
+        }
+    }
+    if (tasks.empty())
+    {
+        return;
+    }
+
+    run.pending += static_cast<int>(tasks.size());
+    {
+        Run::Queue &queue = *run.queues[index];
+        QMutexLocker locker(&queue.mutex);
+        std::move(tasks.begin(), tasks.end(), std::back_inserter(queue.tasks));
+    }
+
+    QMutexLocker locker(&run.idleMutex);
+    ++run.version;
+    run.idle.wakeAll();
+}
+
+void ProjectSearch::searchFile(Run &run, const QString &path, QList<Hit> &hits)
+{
+    QFile file(joinPath(run.root, path));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+
+    const qint64 size = file.size();
+    if (size <= 0 || (run.literal.isEmpty() && size > MaxRegexFileSize))
+    {
+        return;
+    }
+
+    // Read rather than mapped: a mapped file truncated meanwhile by another program raises SIGBUS
+    QByteArray block(static_cast<qsizetype>(std::min<qint64>(size, ReadSize)), Qt::Uninitialized);
+    qint64 filled = std::max<qint64>(file.read(block.data(), block.size()), 0);
+    bool atEnd    = filled < block.size() || file.atEnd();
+
+    // NUL bytes are binary, unless the text is UTF-16
+    const TextFormat format =
+        TextFormat::detect(QByteArrayView(block.constData(), std::min<qint64>(filled, TextFormat::SampleSize)));
+    const bool isWide  = format.encoding == QStringConverter::Utf16LE || format.encoding == QStringConverter::Utf16BE;
+    const qint64 probe = std::min<qint64>(filled, BinaryProbeSize);
+    if (filled == 0 || (!isWide && std::memchr(block.constData(), 0, static_cast<std::size_t>(probe))))
+    {
+        return;
+    }
+
+    // The literal is UTF-8, which Latin-1 files share for ASCII only
+    const bool isLiteral = !run.literal.isEmpty()
+                        && (format.encoding == QStringConverter::Utf8
+                            || (format.encoding == QStringConverter::Latin1 && TextFormat::isAscii(run.literal)));
+    if (!isLiteral && size > MaxRegexFileSize)
+    {
+        return;
+    }
+    ++run.searchedFiles;
+
+    const qsizetype before = hits.size();
+    if (isLiteral)
+    {
+        if (format.bom)
+        {
+            filled -= 3;
+            std::memmove(block.data(), block.constData() + 3, static_cast<std::size_t>(filled));
+        }
+
+        // Each block is searched up to its last line break, the rest of it with the next one
+        int line = 1;
+        for (;;)
+        {
+            const qsizetype end = atEnd ? filled : QByteArrayView(block.constData(), filled).lastIndexOf('\n') + 1;
+            searchLiteral(run, file.fileName(), format, block.constData(), end, line, hits);
+            if (atEnd || run.cancelled)
+            {
+                break;
+            }
+
+            // A line longer than a block makes it grow
+            const qsizetype kept = filled - end;
+            std::memmove(block.data(), block.constData() + end, static_cast<std::size_t>(kept));
+            if (block.size() - kept < ReadSize)
+            {
+                block.resize(kept + ReadSize);
+            }
+            const qint64 read = file.read(block.data() + kept, block.size() - kept);
+            filled            = kept + std::max<qint64>(read, 0);
+            atEnd             = read <= 0 || file.atEnd();
+        }
+    }
+    else
+    {
+        // Decoded at once, as the matches of an expression may span lines
+        block.resize(static_cast<qsizetype>(size));
+        while (!atEnd && filled < size)
+        {
+            const qint64 read = file.read(block.data() + filled, size - filled);
+            filled += std::max<qint64>(read, 0);
+            atEnd = read <= 0;
+        }
+        searchRegex(run, file.fileName(), format, QByteArrayView(block.constData(), filled), hits);
+    }
+
+    // The hits past MaxHits are dropped, and the search stops there
+    const int found = static_cast<int>(hits.size() - before);
+    const int total = run.hitCount.fetch_add(found) + found;
+    if (total >= MaxHits)
+    {
+        hits.resize(std::max<qsizetype>(before, hits.size() - (total - MaxHits)));
+        run.cancelled = true;
+    }
+}
+
+void ProjectSearch::searchLiteral(const Run &run, const QString &path, const TextFormat &format, const char *data,
+                                  qsizetype size, int &line, QList<Hit> &hits)
+{
+    const QByteArray &needle = run.literal;
+    const int length         = static_cast<int>(QString::fromUtf8(needle).size());
+    const auto decode        = [&format](const char *bytes, qsizetype count)
+    {
+        return format.encoding == QStringConverter::Latin1 ? QString::fromLatin1(bytes, count)
+                                                           : QString::fromUtf8(bytes, count);
+    };
+
+    qsizetype lineStart = 0;
+    qsizetype counted   = 0; // Newlines are counted up to there
+    qsizetype position  = 0;
+    while (position < size && !run.cancelled)
+    {
+        const qsizetype found = findLiteral(data + position, size - position, needle, run.caseSensitive);
+        if (found < 0)
+        {
+            break;
+        }
+
+        const qsizetype at = position + found;
+        for (const char *p = data + counted;
+             (p = static_cast<const char *>(std::memchr(p, '\n', static_cast<std::size_t>(data + at - p)))); ++p)
+        {
+            ++line;
+            lineStart = p - data + 1;
+        }
+        counted = at;
+
+        const char *newline     = static_cast<const char *>(std::memchr(data + at, '\n',
+                                                                    static_cast<std::size_t>(size - at)));
+        const qsizetype lineEnd = newline ? newline - data : size;
+
+        Hit hit;
+        hit.filePath = path;
+        hit.line     = line;
+        hit.column   = static_cast<int>(decode(data + lineStart, at - lineStart).size());
+        hit.length   = length;
+        hit.text     = decode(data + lineStart, std::min<qsizetype>(lineEnd - lineStart, MaxPreviewLength));
+        hits.append(std::move(hit));
+
+        // One hit per line
+        position = lineEnd + 1;
+    }
+
+    // The next block starts on the line after the last break counted
+    for (const char *p = data + counted;
+         (p = static_cast<const char *>(std::memchr(p, '\n', static_cast<std::size_t>(data + size - p)))); ++p)
+    {
+        ++line;
+    }
+}
+
+void ProjectSearch::searchRegex(const Run &run, const QString &path, const TextFormat &format, QByteArrayView bytes,
+                                QList<Hit> &hits)
+{
+    // An initial BOM is skipped by the decoder
+    QStringDecoder decoder(format.encoding);
+    const QString text = decoder.decode(bytes);
+
+    int line            = 1;
+    qsizetype lineStart = 0;
+    qsizetype counted   = 0;
+    qsizetype position  = 0;
+    while (position <= text.size() && !run.cancelled)
+    {
+        const QRegularExpressionMatch match = run.regex.match(text, position);
+        if (!match.hasMatch())
+        {
+            break;
+        }
+
+        const qsizetype at = match.capturedStart();
+        for (qsizetype i = counted; i < at; ++i)
+        {
+            if (text[i] == u'\n')
+            {
+                ++line;
+                lineStart = i + 1;
+            }
+        }
+        counted = at;
+
+        qsizetype lineEnd = text.indexOf(u'\n', at);
+        if (lineEnd < 0)
+        {
+            lineEnd = text.size();
+        }
+
+        Hit hit;
+        hit.filePath = path;
+        hit.line     = line;
+        hit.column   = static_cast<int>(at - lineStart);
+        hit.length   = static_cast<int>(match.capturedLength());
+        hit.text     = text.mid(lineStart, std::min<qsizetype>(lineEnd - lineStart, MaxPreviewLength));
+        hits.append(std::move(hit));
+
+        position = lineEnd + 1;
+    }
+}
+
+void ProjectSearch::flushHits()
+{
+    if (!m_run)
+    {
+        return;
+    }
+
+    QList<Hit> hits;
+    {
+        QMutexLocker locker(&m_run->hitsMutex);
+        hits.swap(m_run->hits);
+    }
+
+    if (!hits.isEmpty())
+    {
+        emit hitsFound(hits);
+    }
+}
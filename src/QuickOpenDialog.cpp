@@ -0,0 +1,205 @@
+#include "QuickOpenDialog.h"
+#include "PathIndex.h"
+#include "FileManager.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QLocale>
+#include <QPainter>
+#include <QStyledItemDelegate>
+#include <QVBoxLayout>
+#include <algorithm>
+
+namespace
+{
+    constexpr int PathRole      = Qt::UserRole;
+    constexpr int PositionsRole = Qt::UserRole + 1;
+
+    // Draws the relative path with the characters matching the query in bold
+    class MatchDelegate : public QStyledItemDelegate
+    {
+    public:
+        using QStyledItemDelegate::QStyledItemDelegate;
+
+        void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override
+        {
+            QStyleOptionViewItem background = option;
+            initStyleOption(&background, index);
+            const QString text = background.text;
+            background.text.clear();
+
+            QStyle *style = background.widget ? background.widget->style() : QApplication::style();
+            style->drawControl(QStyle::CE_ItemViewItem, &background, painter, background.widget);
+
+            const QList<int> positions = index.data(PositionsRole).value<QList<int>>();
+            const QRect rect = style->subElementRect(QStyle::SE_ItemViewItemText, &background, background.widget);
+
+            QFont bold = background.font;
+            bold.setBold(true);
+
+            painter->save();
+            painter->setPen(background.palette.color(option.state & QStyle::State_Selected ? QPalette::HighlightedText
+                                                                                             : QPalette::Text));
+
+            // Runs of matched or unmatched characters, left to right
+            int x       = rect.left() + 2;
+            int start   = 0;
+            qsizetype k = 0;
+            while (start < text.size() && x < rect.right())
+            {
+                const bool matched = k < positions.size() && positions[k] == start;
+                int end            = start + 1;
+                if (matched)
+                {
+                    ++k;
+                    while (end < text.size() && k < positions.size() && positions[k] == end)
+                    {
+                        ++end;
+                        ++k;
+                    }
+                }
+                else
+                {
+                    const int next = k < positions.size() ? positions[k] : static_cast<int>(text.size());
+                    end            = std::max(end, next);
+                }
+
+                const QString run = text.mid(start, end - start);
+                painter->setFont(matched ? bold : background.font);
+                painter->drawText(QRect(x, rect.top(), rect.right() - x, rect.height()), Qt::AlignLeft | Qt::AlignVCenter,
+                                  run);
+                x += QFontMetrics(painter->font()).horizontalAdvance(run);
+                start = end;
+            }
+            painter->restore();
+        }
+    };
+}
+
+QuickOpenDialog::QuickOpenDialog(PathIndex *index, QWidget *parent)
+    : QDialog(parent),
+      m_index(index)
+{
+    setWindowTitle(tr("Go to File"));
+    resize(600, 400);
+
+    m_query = new QLineEdit(this);
+    m_query->setPlaceholderText(tr("Type part of a file path"));
+    m_query->setClearButtonEnabled(true);
+    m_query->installEventFilter(this);
+
+    m_results = new QListWidget(this);
+    m_results->setItemDelegate(new MatchDelegate(m_results));
+    m_results->setUniformItemSizes(true);
+    m_results->setFocusPolicy(Qt::NoFocus);
+
+    m_status = new QLabel(this);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_query);
+    layout->addWidget(m_results);
+    layout->addWidget(m_status);
+
+    connect(m_query, &QLineEdit::textChanged, this, &QuickOpenDialog::updateResults);
+    connect(m_results, &QListWidget::itemActivated, this, &QuickOpenDialog::openSelected);
+
+    // The index fills up in the background and follows the disk
+    connect(m_index, &PathIndex::indexed, this, &QuickOpenDialog::updateResults);
+    connect(m_index, &PathIndex::changed, this, [this]()
+    {
+        if (isVisible())
+        {
+            updateResults();
+        }
+    });
+}
+
+void QuickOpenDialog::popup()
+{
+    updateResults();
+    m_query->selectAll();
+    m_query->setFocus();
+    show();
+    raise();
+    activateWindow();
+}
+
+bool QuickOpenDialog::eventFilter(QObject *obj, QEvent *event)
+{
+    if (obj == m_query && event->type() == QEvent::KeyPress)
+    {
+        QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+        switch (keyEvent->key())
+        {
+        case Qt::Key_Up:
+        case Qt::Key_Down:
+        case Qt::Key_PageUp:
+        case Qt::Key_PageDown:
+            QApplication::sendEvent(m_results, event);
+            return true;
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+            openSelected();
+            return true;
+        default:
+            break;
+        }
+    }
+    return QDialog::eventFilter(obj, event);
+}
+
+void QuickOpenDialog::updateResults()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString query = m_query->text();
+    const std::vector<PathIndex::Match> matches = m_index->search(query, MaxResults);
+    const qint64 elapsed = timer.elapsed();
+
+    m_results->clear();
+    for (const PathIndex::Match &match : matches)
+    {
+        const QString path    = m_index->path(match.id);
+        QListWidgetItem *item = new QListWidgetItem(path, m_results);
+        item->setData(PathRole, m_index->absolutePath(match.id));
+        item->setData(PositionsRole, QVariant::fromValue(PathIndex::matchPositions(query, path)));
+        item->setToolTip(item->data(PathRole).toString());
+    }
+    m_results->setCurrentRow(0);
+
+    const QLocale locale;
+    if (m_index->isIndexing())
+    {
+        m_status->setText(tr("Indexing %1...").arg(m_index->rootPath()));
+    }
+    else if (query.trimmed().isEmpty())
+    {
+        m_status->setText(tr("%1 files").arg(locale.toString(m_index->size())));
+    }
+    else
+    {
+        m_status->setText(tr("%1 of %2 files in %3 ms")
+                              .arg(locale.toString(m_index->matchCount()),
+                                   locale.toString(m_index->size()), QString::number(elapsed)));
+    }
+}
+
+void QuickOpenDialog::openSelected()
+{
+    const QListWidgetItem *item = m_results->currentItem();
+    if (!item)
+    {
+        return;
+    }
+
+    const QString filePath = item->data(PathRole).toString();
+    accept();
+
+    // Recently used files are swapped back in from the document cache
+    FileManager::getInstance().switchToFile(filePath);
+}
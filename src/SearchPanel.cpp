@@ -0,0 +1,187 @@
+#include "SearchPanel.h"
+#include "FileManager.h"
+
+#include <QCheckBox>
+#include <QDir>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QLocale>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+namespace
+{
+    constexpr int PathRole = Qt::UserRole;
+    constexpr int LineRole = Qt::UserRole + 1;
+}
+
+SearchPanel::SearchPanel(QWidget *parent)
+    : QWidget(parent)
+{
+    const IgnoreRules excludes = IgnoreRules::userExcludes();
+    m_search.setExcludes(excludes);
+    m_index.setExcludes(excludes);
+
+    m_query = new QLineEdit(this);
+    m_query->setPlaceholderText(tr("Search in files"));
+    m_query->setClearButtonEnabled(true);
+
+    m_caseSensitive     = new QCheckBox(tr("Match Case"), this);
+    m_regularExpression = new QCheckBox(tr("Regular Expression"), this);
+    m_useIndex          = new QCheckBox(tr("Index"), this);
+    m_useIndex->setToolTip(tr("Keep an index of the project in %1 to search it faster").arg(TrigramIndex::defaultDirectory()));
+
+    m_results = new QTreeWidget(this);
+    m_results->setHeaderHidden(true);
+    m_results->setUniformRowHeights(true);
+    m_results->setColumnCount(1);
+    m_results->header()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+    m_status = new QLabel(this);
+
+    QHBoxLayout *queryLayout = new QHBoxLayout;
+    queryLayout->addWidget(m_query, 1);
+    queryLayout->addWidget(m_caseSensitive);
+    queryLayout->addWidget(m_regularExpression);
+    queryLayout->addWidget(m_useIndex);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addLayout(queryLayout);
+    layout->addWidget(m_results);
+    layout->addWidget(m_status);
+
+    // Searches start once typing pauses, replacing the one in progress
+    m_queryTimer.setSingleShot(true);
+    m_queryTimer.setInterval(QueryDelay);
+    connect(&m_queryTimer, &QTimer::timeout, this, &SearchPanel::startSearch);
+    connect(m_query, &QLineEdit::textChanged, &m_queryTimer, qOverload<>(&QTimer::start));
+    connect(m_query, &QLineEdit::returnPressed, this, &SearchPanel::startSearch);
+    connect(m_caseSensitive, &QCheckBox::toggled, this, &SearchPanel::startSearch);
+    connect(m_regularExpression, &QCheckBox::toggled, this, &SearchPanel::startSearch);
+
+    connect(m_useIndex, &QCheckBox::toggled, this, &SearchPanel::setIndexEnabled);
+
+    connect(&m_search, &ProjectSearch::hitsFound, this, &SearchPanel::addHits);
+    connect(&m_search, &ProjectSearch::finished, this, &SearchPanel::onFinished);
+    connect(m_results, &QTreeWidget::itemClicked, this, &SearchPanel::openHit);
+}
+
+void SearchPanel::setRootPath(const QString &path)
+{
+    if (path == m_rootPath)
+    {
+        return;
+    }
+
+    m_rootPath = path;
+    m_index.close();
+
+    // Projects indexed before are indexed again
+    const bool hasIndex = !path.isEmpty() && m_index.hasIndex(path);
+    if (m_useIndex->isChecked() != hasIndex)
+    {
+        m_useIndex->setChecked(hasIndex);
+    }
+    else if (hasIndex)
+    {
+        setIndexEnabled(true);
+    }
+}
+
+void SearchPanel::focusQuery(const QString &text)
+{
+    if (!text.isEmpty())
+    {
+        m_query->setText(text);
+    }
+    m_query->selectAll();
+    m_query->setFocus();
+}
+
+void SearchPanel::startSearch()
+{
+    m_queryTimer.stop();
+    m_results->clear();
+    m_fileItems.clear();
+    m_hitCount = 0;
+
+    if (m_query->text().isEmpty())
+    {
+        m_search.cancel();
+        m_status->clear();
+        return;
+    }
+
+    ProjectSearch::Options options;
+    options.caseSensitive     = m_caseSensitive->isChecked();
+    options.regularExpression = m_regularExpression->isChecked();
+
+    const OperationResult result = m_search.start(m_rootPath, m_query->text(), options);
+    m_status->setText(result.success ? tr("Searching...") : QString::fromStdString(result.message));
+}
+
+void SearchPanel::addHits(const QList<ProjectSearch::Hit> &hits)
+{
+    const QDir root(m_rootPath);
+    for (const ProjectSearch::Hit &hit : hits)
+    {
+        QTreeWidgetItem *&fileItem = m_fileItems[hit.filePath];
+        if (!fileItem)
+        {
+            fileItem = new QTreeWidgetItem(m_results);
+            fileItem->setData(0, PathRole, hit.filePath);
+            fileItem->setToolTip(0, hit.filePath);
+            fileItem->setExpanded(true);
+        }
+
+        QTreeWidgetItem *item = new QTreeWidgetItem(fileItem);
+        item->setText(0, QString("%1: %2").arg(hit.line).arg(hit.text.trimmed()));
+        item->setData(0, PathRole, hit.filePath);
+        item->setData(0, LineRole, hit.line);
+
+        fileItem->setText(0, QString("%1 (%2)").arg(root.relativeFilePath(hit.filePath)).arg(fileItem->childCount()));
+    }
+
+    m_hitCount += static_cast<int>(hits.size());
+    m_status->setText(tr("Searching... %1 hits in %2 files").arg(m_hitCount).arg(m_fileItems.size()));
+}
+
+void SearchPanel::onFinished(int searchedFiles, int hitCount)
+{
+    const QLocale locale;
+    QString text = tr("%1 hits in %2 of %3 files")
+                       .arg(locale.toString(hitCount), locale.toString(static_cast<qlonglong>(m_fileItems.size())),
+                            locale.toString(searchedFiles));
+    if (hitCount >= ProjectSearch::MaxHits)
+    {
+        text += tr(", stopped at %1").arg(locale.toString(ProjectSearch::MaxHits));
+    }
+    m_status->setText(text);
+}
+
+void SearchPanel::setIndexEnabled(bool enabled)
+{
+    if (enabled)
+    {
+        m_index.setRootPath(m_rootPath);
+        m_search.setIndex(&m_index);
+    }
+    else
+    {
+        m_search.setIndex(nullptr);
+        m_index.removeIndex();
+    }
+}
+
+void SearchPanel::openHit(QTreeWidgetItem *item)
+{
+    if (!item || !item->parent())
+    {
+        return;
+    }
+
+    FileManager::getInstance().openFileAtLine(item->data(0, PathRole).toString(), item->data(0, LineRole).toInt());
+}
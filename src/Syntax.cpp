@@ -1,4 +1,14 @@
 #include "Syntax.h"
+#include "SyntaxRegistry.h"
+#include "SyntaxPrefilter.h"
+#include "SyntaxLexer.h"
+#include "HighlightScheduler.h"
+#include "SyntaxProfiler.h"
+
+#include <QTextBlock>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <optional>
 
 Syntax::Syntax(QTextDocument *parent, const YAML::Node &config)
     : QSyntaxHighlighter(parent)
@@ -7,36 +17,632 @@ Syntax::Syntax(QTextDocument *parent, const YAML::Node &config)
     loadSyntaxRules(config);
 }
 
+Syntax::Syntax(QTextDocument *parent, std::shared_ptr<const SyntaxDefinition> definition)
+    : QSyntaxHighlighter(parent)
+{
+    // QVector is implicitly shared: the rules are not copied nor recompiled
+    m_syntaxRules  = definition->rules;
+    m_regionRules  = definition->regions;
+    m_language     = definition->name;
+    m_prefilter    = definition->prefilter;
+    m_lexer        = definition->lexer;
+    m_lexerEnabled = static_cast<bool>(m_lexer);
+    m_guard        = createGuard();
+}
+
+Syntax::~Syntax() {}
+
+Syntax::RuleSet Syntax::ruleSet() const
+{
+    return {m_syntaxRules, m_regionRules, m_language, m_guard, m_prefilter, m_lexer};
+}
+
 void Syntax::highlightBlock(const QString &text)
 {
-    for (const SyntaxRule &rule : m_syntaxRules)
+    const int previousState = qMax(0, previousBlockState());
+
+    if (m_scheduler)
+    {
+        const HighlightData *data = m_scheduler->cachedData(currentBlock(), previousState);
+        if (data)
+        {
+            applyTokens(data->tokens);
+            setCurrentBlockState(data->state);
+            return;
+        }
+
+        // Off-screen blocks are tokenized by the worker, never on the GUI thread.
+        // Their state is left untouched, which stops the re-highlight here, and
+        // so are their formats until the worker publishes new ones.
+        const int number = currentBlock().blockNumber();
+        if (!m_scheduler->isVisible(number))
+        {
+            if (const HighlightData *previous = m_scheduler->previousData(currentBlock()))
+            {
+                applyTokens(previous->tokens);
+            }
+            m_scheduler->requestPass(number, number);
+            return;
+        }
+    }
+
+    // Reused between blocks to avoid an allocation per line
+    thread_local QVector<SyntaxToken> tokens;
+
+    const int state = tokenize(ruleSet(), text, previousState, tokens);
+    applyTokens(tokens);
+    setCurrentBlockState(state);
+
+    if (m_scheduler)
+    {
+        m_scheduler->store(currentBlock(), previousState, state, tokens);
+    }
+}
+
+namespace
+{
+    /*
+     * Turns the raw matches of every rule into sorted, non-overlapping tokens.
+     * The leftmost match wins; between matches starting at the same position
+     * the highest priority wins, then the longest, then the first rule. A
+     * match strictly inside an accepted token is dropped unless its rule has a
+     * higher priority, in which case it splits the token (e.g. an escape
+     * sequence inside a string).
+     */
+    void resolveOverlaps(const Syntax::RuleSet &ruleSet, QVector<SyntaxToken> &matches,
+                         QVector<SyntaxToken> &tokens)
+    {
+        auto priority = [&ruleSet](const SyntaxToken &token)
+        {
+            return token.rule < ruleSet.rules.size() ? ruleSet.rules[token.rule].m_priority : 0;
+        };
+
+        std::sort(matches.begin(), matches.end(), [&priority](const SyntaxToken &a, const SyntaxToken &b)
+        {
+            if (a.start != b.start)
+            {
+                return a.start < b.start;
+            }
+            if (priority(a) != priority(b))
+            {
+                return priority(a) > priority(b);
+            }
+            if (a.length != b.length)
+            {
+                return a.length > b.length;
+            }
+            return a.rule < b.rule;
+        });
+
+        for (const SyntaxToken &match : matches)
+        {
+            if (match.length <= 0)
+            {
+                continue;
+            }
+
+            if (tokens.isEmpty() || match.start >= tokens.last().start + tokens.last().length)
+            {
+                tokens.append(match);
+                continue;
+            }
+
+            SyntaxToken &last = tokens.last();
+            const int lastEnd = last.start + last.length;
+            if (match.start < last.start || match.start + match.length > lastEnd
+                || priority(match) <= priority(last))
+            {
+                continue;
+            }
+
+            const SyntaxToken tail{match.start + match.length, lastEnd - match.start - match.length, last.rule};
+            last.length = match.start - last.start;
+            if (last.length == 0)
+            {
+                tokens.removeLast();
+            }
+            tokens.append(match);
+            if (tail.length > 0)
+            {
+                tokens.append(tail);
+            }
+        }
+    }
+
+    /*
+     * Tokenizes a block with region rules and returns the state it ends in.
+     * The line rules only apply outside the regions: they run from the start
+     * of the block, or from where the region carried over from the previous
+     * block ends, up to the next begin marker, and again after each region
+     * that closes on the block. A begin marker inside a line token (e.g. "/*"
+     * in a string) is not one.
+     */
+    template <typename TokenizeLine>
+    int tokenizeRegions(const Syntax::RuleSet &ruleSet, const QString &text, int previousState,
+                        TokenizeLine &&tokenizeLine, QVector<SyntaxToken> &lineTokens, QVector<SyntaxToken> &tokens)
+    {
+        const int firstRegionRule = static_cast<int>(ruleSet.rules.size());
+
+        auto insideToken = [&lineTokens](qsizetype position)
+        {
+            auto next = std::upper_bound(lineTokens.cbegin(), lineTokens.cend(), position,
+                                         [](qsizetype value, const SyntaxToken &token) { return value < token.start; });
+            if (next == lineTokens.cbegin())
+            {
+                return false;
+            }
+
+            const SyntaxToken &token = *(next - 1);
+            return token.start < position && position < token.start + token.length;
+        };
+
+        int state       = previousState <= ruleSet.regions.size() ? previousState : 0;
+        qsizetype pos   = 0;
+        qsizetype begin = 0;
+
+        while (true)
+        {
+            if (state > 0)
+            {
+                const Syntax::RegionRule &region = ruleSet.regions[state - 1];
+                QRegularExpressionMatch end      = pos <= text.size() ? region.m_end.match(text, pos)
+                                                                      : QRegularExpressionMatch();
+                if (!end.hasMatch())
+                {
+                    tokens.append({static_cast<int>(begin), static_cast<int>(text.size() - begin), firstRegionRule + state - 1});
+                    return state;
+                }
+
+                tokens.append({static_cast<int>(begin), static_cast<int>(end.capturedEnd() - begin), firstRegionRule + state - 1});
+                pos   = end.capturedEnd();
+                state = 0;
+            }
+
+            tokenizeLine(pos, lineTokens);
+
+            // Earliest begin marker; on a tie the first region in the config wins
+            qsizetype bestStart = -1;
+            qsizetype bestEnd   = -1;
+            int bestRegion      = -1;
+            for (int i = 0; i < ruleSet.regions.size(); ++i)
+            {
+                QRegularExpressionMatch match = ruleSet.regions[i].m_begin.match(text, pos);
+                while (match.hasMatch() && insideToken(match.capturedStart()))
+                {
+                    match = ruleSet.regions[i].m_begin.match(text, qMax(match.capturedEnd(), match.capturedStart() + 1));
+                }
+
+                if (match.hasMatch() && (bestStart < 0 || match.capturedStart() < bestStart))
+                {
+                    bestStart  = match.capturedStart();
+                    bestEnd    = match.capturedEnd();
+                    bestRegion = i;
+                }
+            }
+
+            // Line tokens before the marker end before it, as it is not inside one
+            for (const SyntaxToken &token : std::as_const(lineTokens))
+            {
+                if (bestRegion >= 0 && token.start >= bestStart)
+                {
+                    break;
+                }
+                tokens.append(token);
+            }
+
+            if (bestRegion < 0)
+            {
+                return 0;
+            }
+
+            state = bestRegion + 1;
+            begin = bestStart;
+            pos   = qMax(bestEnd, bestStart + 1);
+        }
+    }
+}
+
+int Syntax::tokenize(const RuleSet &ruleSet, const QString &text, int previousState,
+                     QVector<SyntaxToken> &tokens)
+{
+    // Scratch buffers reused for every block tokenized on this thread
+    thread_local QVector<SyntaxToken> matches;
+    thread_local QVector<SyntaxToken> lineTokens;
+    thread_local QVector<SyntaxProfiler::Sample> samples;
+
+    tokens.clear();
+
+    const bool profiling = SyntaxProfiler::getInstance().isEnabled();
+    QElapsedTimer timer;
+    if (profiling)
+    {
+        samples.clear();
+        timer.start();
+    }
+
+    QElapsedTimer blockTimer;
+    blockTimer.start();
+
+    // Charges the time since the last sample, or restart(), to a rule
+    auto sample = [profiling, &timer](int rule, const QString &label, qsizetype matchCount, qsizetype scanned)
+    {
+        if (profiling)
+        {
+            samples.append({rule, label, timer.nsecsElapsed(), matchCount,
+                            scanned * static_cast<qint64>(sizeof(QChar))});
+            timer.restart();
+        }
+    };
+    auto restart = [profiling, &timer]()
+    {
+        if (profiling)
+        {
+            timer.restart();
+        }
+    };
+
+    // Probes of the prefilter found in the block, scanned on first use
+    std::optional<quint32> present;
+    auto filteredOut = [&text, &ruleSet, &present, &sample](int ruleIndex)
+    {
+        if (!ruleSet.prefilter)
+        {
+            return false;
+        }
+        if (!present)
+        {
+            present = ruleSet.prefilter->scan(text);
+            sample(SyntaxProfiler::Prefilter, QStringLiteral("<prefilter>"), 0, text.size());
+        }
+        return !ruleSet.prefilter->canMatch(ruleIndex, *present);
+    };
+
+    auto appendMatches = [&text, &sample, &restart, &ruleSet, &blockTimer, &filteredOut](const SyntaxRule &rule,
+                                                                                         int ruleIndex, qsizetype from)
+    {
+        // Rules built by hand may lack the bounded pattern
+        const QRegularExpression &pattern = rule.m_bounded.pattern().isEmpty() ? rule.m_pattern : rule.m_bounded;
+        if (!pattern.isValid() || blockTimer.elapsed() >= BlockBudget
+            || (ruleSet.guard && ruleSet.guard->isDisabled(ruleIndex)) || filteredOut(ruleIndex))
+        {
+            // Not charged to the next rule either
+            restart();
+            return;
+        }
+
+        QElapsedTimer ruleTimer;
+        ruleTimer.start();
+
+        const qsizetype before = matches.size();
+        bool overBudget        = false;
+        qsizetype offset       = from;
+        while (offset <= text.size())
+        {
+            // Invalid means PCRE2 gave up after MatchStepLimit steps
+            QRegularExpressionMatch match = pattern.match(text, offset);
+            if (!match.isValid() || ruleTimer.elapsed() >= RuleBudget)
+            {
+                overBudget = true;
+                break;
+            }
+            if (!match.hasMatch())
+            {
+                break;
+            }
+
+            matches.append({static_cast<int>(match.capturedStart()),
+                            static_cast<int>(match.capturedLength()),
+                            ruleIndex});
+            offset = match.capturedLength() > 0 ? match.capturedEnd() : match.capturedStart() + 1;
+        }
+
+        // The rule is skipped for the whole block rather than half applied
+        if (overBudget)
+        {
+            matches.resize(before);
+            if (ruleSet.guard)
+            {
+                ruleSet.guard->strike(ruleIndex);
+            }
+        }
+
+        sample(ruleIndex, rule.m_pattern.pattern(), matches.size() - before, text.size() - from);
+    };
+
+    // The line rules from position from to the end of the block
+    auto tokenizeLine = [&text, &ruleSet, &appendMatches, &sample, &restart](qsizetype from, QVector<SyntaxToken> &resolved)
+    {
+        // The time until here went to matching the regions, if any
+        if (ruleSet.regions.isEmpty())
+        {
+            restart();
+        }
+        else
+        {
+            sample(SyntaxProfiler::Regions, QStringLiteral("<regions>"), 0, 0);
+        }
+
+        matches.clear();
+        resolved.clear();
+        for (int i = 0; i < ruleSet.rules.size(); ++i)
+        {
+            if (ruleSet.lexer && ruleSet.lexer->compiles(i))
+            {
+                continue;
+            }
+            appendMatches(ruleSet.rules[i], i, from);
+        }
+
+        if (ruleSet.lexer)
+        {
+            const qsizetype before = matches.size();
+            ruleSet.lexer->tokenize(text, from, matches);
+            sample(SyntaxProfiler::Lexer, QStringLiteral("<lexer>"), matches.size() - before, text.size() - from);
+        }
+
+        resolveOverlaps(ruleSet, matches, resolved);
+        sample(SyntaxProfiler::Overlaps, QStringLiteral("<overlaps>"), resolved.size(), 0);
+    };
+
+    int state = 0;
+    if (ruleSet.regions.isEmpty())
+    {
+        tokenizeLine(0, tokens);
+    }
+    else
+    {
+        state = tokenizeRegions(ruleSet, text, previousState, tokenizeLine, lineTokens, tokens);
+        sample(SyntaxProfiler::Regions, QStringLiteral("<regions>"),
+               std::count_if(tokens.cbegin(), tokens.cend(), [&ruleSet](const SyntaxToken &token)
+        {
+            return token.rule >= ruleSet.rules.size();
+        }), text.size());
+    }
+
+    if (profiling)
+    {
+        SyntaxProfiler::getInstance().record(ruleSet.language, samples);
+    }
+
+    return state;
+}
+
+void Syntax::applyTokens(const QVector<SyntaxToken> &tokens)
+{
+    // Tokens are sorted and disjoint: adjacent ones with the same format
+    // are merged so that each span costs a single setFormat call
+    qsizetype i = 0;
+    while (i < tokens.size())
     {
-        QRegularExpressionMatchIterator matchIterator = rule.m_pattern.globalMatch(text);
-        while (matchIterator.hasNext())
+        const QTextCharFormat &format = tokenFormat(tokens[i].rule);
+        const int start               = tokens[i].start;
+        int end                       = start + tokens[i].length;
+
+        for (++i; i < tokens.size() && tokens[i].start == end; ++i)
         {
-            QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.m_format);
+            if (tokens[i].rule != tokens[i - 1].rule && tokenFormat(tokens[i].rule) != format)
+            {
+                break;
+            }
+            end += tokens[i].length;
         }
+
+        setFormat(start, end - start, format);
+    }
+}
+
+const QTextCharFormat &Syntax::tokenFormat(int rule) const
+{
+    if (rule < m_syntaxRules.size())
+    {
+        return m_syntaxRules[rule].m_format;
+    }
+
+    return m_regionRules[rule - m_syntaxRules.size()].m_format;
+}
+
+void Syntax::setBackgroundHighlighting(bool enabled)
+{
+    if (enabled == static_cast<bool>(m_scheduler))
+    {
+        return;
+    }
+
+    m_scheduler.reset();
+    if (enabled)
+    {
+        m_scheduler = std::make_unique<HighlightScheduler>(this, document());
+    }
+}
+
+bool Syntax::backgroundHighlighting() const
+{
+    return static_cast<bool>(m_scheduler);
+}
+
+void Syntax::setVisibleBlocks(int firstBlock, int lastBlock)
+{
+    if (m_scheduler)
+    {
+        m_scheduler->setVisibleBlocks(firstBlock, lastBlock);
     }
 }
 
 void Syntax::addPattern(const QString &pattern, const QTextCharFormat &format)
 {
-    SyntaxRule rule;
-    rule.m_pattern = QRegularExpression(pattern);
-    rule.m_format  = format;
-    m_syntaxRules.append(rule);
+    m_syntaxRules.append(compileRule(pattern, format, 0));
+    compileRules();
 }
 
 void Syntax::loadSyntaxRules(const YAML::Node &config)
 {
-    m_syntaxRules.clear();
+    m_syntaxRules  = parseSyntaxRules(config);
+    m_regionRules  = parseRegionRules(config);
+    m_lexerEnabled = usesLexer(config);
+    compileRules();
+}
 
-    if (!config["keywords"])
+void Syntax::compileRules()
+{
+    // The prefilter and the guard refer to rules by index, they must follow the rule list
+    m_prefilter = std::make_shared<SyntaxPrefilter>(m_syntaxRules);
+    m_lexer     = m_lexerEnabled ? std::make_shared<SyntaxLexer>(m_syntaxRules) : nullptr;
+    m_guard     = createGuard();
+
+    // Cached tokens refer to the previous rules by index
+    if (m_scheduler)
+    {
+        m_scheduler->reset();
+    }
+}
+
+QString Syntax::boundedPattern(const QString &pattern)
+{
+    return QString("(*LIMIT_MATCH=%1)").arg(MatchStepLimit) + pattern;
+}
+
+std::shared_ptr<Syntax::MatchGuard> Syntax::createGuard()
+{
+    // May be called from the worker: report on the GUI thread
+    return std::make_shared<MatchGuard>(m_syntaxRules.size(), [this](int rule, bool disabled)
+    {
+        QMetaObject::invokeMethod(this, [this, rule, disabled]()
+        {
+            budgetExceeded(rule, disabled);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void Syntax::budgetExceeded(int rule, bool disabled)
+{
+    // The rules may have been reloaded in the meantime
+    if (rule >= m_syntaxRules.size())
+    {
+        return;
+    }
+
+    QString pattern = m_syntaxRules[rule].m_pattern.pattern();
+    if (pattern.size() > 40)
+    {
+        pattern = pattern.left(37) + "...";
+    }
+
+    QString message = disabled
+                          ? QString("Syntax rule \"%1\" is too slow and was disabled for this document.").arg(pattern)
+                          : QString("Syntax rule \"%1\" ran over its match budget and was skipped on a line.").arg(pattern);
+    qWarning() << "[Syntax]" << message << "Language:" << m_language;
+    emit matchBudgetExceeded(message);
+}
+
+Syntax::MatchGuard::MatchGuard(qsizetype ruleCount, Notify notify)
+    : m_strikes(static_cast<size_t>(ruleCount)),
+      m_notify(std::move(notify))
+{
+}
+
+bool Syntax::MatchGuard::isDisabled(int rule) const
+{
+    return static_cast<size_t>(rule) < m_strikes.size() && m_strikes[rule].load(std::memory_order_relaxed) >= StrikeLimit;
+}
+
+void Syntax::MatchGuard::strike(int rule)
+{
+    if (static_cast<size_t>(rule) >= m_strikes.size())
     {
         return;
     }
 
+    // Report the first strike, and the one that disables the rule
+    const int strikes = m_strikes[rule].fetch_add(1, std::memory_order_relaxed) + 1;
+    if ((strikes == 1 || strikes == StrikeLimit) && m_notify)
+    {
+        m_notify(rule, strikes == StrikeLimit);
+    }
+}
+
+namespace
+{
+    // Reads the color and font style of a rule; false if the rule must be skipped
+    bool parseFormat(const YAML::Node &rule, QTextCharFormat &format)
+    {
+        QColor color;
+        try
+        {
+            std::string colorStr = rule["color"].as<std::string>();
+            color                = QColor(QString::fromStdString(colorStr));
+        }
+        catch(const YAML::Exception e)
+        {
+            qWarning() << " YAML exception when parsion the color in syntax file" << e.what();
+            return false;
+        }
+
+        //checks if the color is a valid color
+        if(!color.isValid())
+        {
+            qWarning() << "Invalid Color : Skipping...";
+            return false;
+        }
+
+        format = Syntax::makeFormat(color,
+                                    rule["bold"] && rule["bold"].as<bool>(),
+                                    rule["italic"] && rule["italic"].as<bool>());
+        return true;
+    }
+}
+
+QTextCharFormat Syntax::makeFormat(const QColor &color, bool bold, bool italic)
+{
+    QTextCharFormat format;
+    format.setForeground(color);
+    if (bold)
+    {
+        format.setFontWeight(QFont::Bold);
+    }
+    if (italic)
+    {
+        format.setFontItalic(true);
+    }
+
+    return format;
+}
+
+Syntax::SyntaxRule Syntax::compileRule(const QString &regex, const QTextCharFormat &format, int priority)
+{
+    // Compile once here so that every copy shares the compiled pattern
+    QRegularExpression pattern(regex);
+    pattern.optimize();
+    QRegularExpression bounded(boundedPattern(regex));
+    bounded.optimize();
+
+    return {pattern, format, priority, bounded};
+}
+
+bool Syntax::compileRegion(const QString &begin, const QString &end, const QTextCharFormat &format, RegionRule &region)
+{
+    QRegularExpression beginPattern(boundedPattern(begin));
+    QRegularExpression endPattern(boundedPattern(end));
+    if (!beginPattern.isValid() || !endPattern.isValid())
+    {
+        qWarning() << "Invalid region pattern : Skipping..." << beginPattern.errorString() << endPattern.errorString();
+        return false;
+    }
+
+    beginPattern.optimize();
+    endPattern.optimize();
+    region = {beginPattern, endPattern, format};
+    return true;
+}
+
+QVector<Syntax::SyntaxRule> Syntax::parseSyntaxRules(const YAML::Node &config)
+{
+    QVector<SyntaxRule> syntaxRules;
+
+    if (!config["keywords"])
+    {
+        return syntaxRules;
+    }
+
     auto keywords = config["keywords"];
     for (const auto &category : keywords)
     {
@@ -50,7 +656,7 @@ void Syntax::loadSyntaxRules(const YAML::Node &config)
             QString regex;
             try
             {
-                std::string regexStr = rule["regex"].as<std::string>(); //will throw exception if the key does not exist 
+                std::string regexStr = rule["regex"].as<std::string>(); //will throw exception if the key does not exist
                 regex                = QString::fromStdString(regexStr);
             }
             catch(const YAML::Exception e)
@@ -59,39 +665,76 @@ void Syntax::loadSyntaxRules(const YAML::Node &config)
                 continue;
             }
 
-            QColor color;
-            try
+            // Create a QTextCharFormat for the rule
+            QTextCharFormat format;
+            if (!parseFormat(rule, format))
             {
-                std::string colorStr = rule["color"].as<std::string>();
-                color                = QColor(QString::fromStdString(colorStr));
+                continue;
             }
-            catch(const YAML::Exception e)
+
+            int priority = 0;
+            if (rule["priority"])
             {
-                qWarning() << " YAML exception when parsion the color in syntax file" << e.what();
-                continue;
+                priority = rule["priority"].as<int>();
             }
 
-            //checks if the color is a valid color
-            if(!color.isValid())
+            // Append the rule to the list of syntax rules
+            syntaxRules.append(compileRule(regex, format, priority));
+        }
+    }
+
+    return syntaxRules;
+}
+
+QVector<Syntax::RegionRule> Syntax::parseRegionRules(const YAML::Node &config)
+{
+    QVector<RegionRule> regionRules;
+
+    if (!config["regions"])
+    {
+        return regionRules;
+    }
+
+    for (const auto &category : config["regions"])
+    {
+        for (const auto &rule : category.second)
+        {
+            if (!rule["begin"] || !rule["end"])
             {
-                qWarning() << "Invalid Color : Skipping...";
+                qWarning() << "Region rule without begin or end pattern : Skipping...";
                 continue;
             }
 
-            // Create a QTextCharFormat for the rule
             QTextCharFormat format;
-            format.setForeground(color);
-            if (rule["bold"] && rule["bold"].as<bool>())
+            if (!parseFormat(rule, format))
             {
-                format.setFontWeight(QFont::Bold);
+                continue;
             }
-            if (rule["italic"] && rule["italic"].as<bool>())
+
+            RegionRule region;
+            if (compileRegion(QString::fromStdString(rule["begin"].as<std::string>()),
+                              QString::fromStdString(rule["end"].as<std::string>()), format, region))
             {
-                format.setFontItalic(true);
+                regionRules.append(region);
             }
-
-            // Append the rule to the list of syntax rules
-            m_syntaxRules.append({QRegularExpression(regex), format});
         }
     }
+
+    return regionRules;
+}
+
+bool Syntax::usesLexer(const YAML::Node &config)
+{
+    const YAML::Node engine = config["engine"];
+    if (!engine || !engine.IsScalar())
+    {
+        return false;
+    }
+
+    const std::string name = engine.as<std::string>();
+    if (name != "lexer" && name != "regex")
+    {
+        qWarning() << "[Syntax] Unknown engine" << QString::fromStdString(name) << ": Using regex.";
+    }
+    return name == "lexer";
 }
@@ -0,0 +1,1168 @@
+#include "SyntaxLexer.h"
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <iterator>
+#include <map>
+#include <optional>
+
+namespace
+{
+    // The ASCII characters, then one symbol for every other character: rules
+    // with non-ASCII characters fall back, so no automaton tells those apart
+    constexpr int SymbolCount = 129;
+    constexpr int OtherSymbol = 128;
+
+    // Repetition counts and NFA sizes beyond which a rule falls back
+    constexpr int MaxRepeat    = 32;
+    constexpr int MaxNfaStates = 32768;
+
+    using SymbolSet = std::bitset<SymbolCount>;
+
+    bool isWordCharacter(char16_t c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    }
+
+    // \b as PCRE2 sees it without Unicode properties: only ASCII letters and digits are word characters
+    bool isWordBoundary(const char16_t *data, qsizetype size, qsizetype position)
+    {
+        const bool before = position > 0 && isWordCharacter(data[position - 1]);
+        const bool after  = position < size && isWordCharacter(data[position]);
+        return before != after;
+    }
+
+    SymbolSet symbolRange(char16_t low, char16_t high)
+    {
+        SymbolSet set;
+        for (char16_t c = low; c <= high; ++c)
+        {
+            set.set(c);
+        }
+        return set;
+    }
+
+    SymbolSet wordSymbols()
+    {
+        return symbolRange('a', 'z') | symbolRange('A', 'Z') | symbolRange('0', '9') | symbolRange('_', '_');
+    }
+
+    SymbolSet spaceSymbols()
+    {
+        // \s of PCRE2 without Unicode properties
+        return symbolRange('\t', '\r') | symbolRange(' ', ' ');
+    }
+
+    SymbolSet allSymbols()
+    {
+        return SymbolSet().set();
+    }
+
+    struct Node
+    {
+        enum class Kind
+        {
+            Symbols,
+            Sequence,
+            Alternation,
+            Repeat,
+            WordBoundary,
+            TextStart,
+            TextEnd
+        };
+
+        Kind kind = Kind::Sequence;
+        SymbolSet symbols;
+        std::vector<Node> children;
+        int min = 1;
+        int max = 1; // -1 for no bound
+
+        bool isAssertion() const
+        {
+            return kind == Kind::WordBoundary || kind == Kind::TextStart || kind == Kind::TextEnd;
+        }
+    };
+
+    /*
+     * Parses the subset of PCRE2 syntax a DFA can match. Anything else sets
+     * the reason the rule falls back, and stops the parse.
+     */
+    class PatternParser
+    {
+    public:
+        explicit PatternParser(const QString &pattern)
+            : m_pattern(pattern)
+        {
+        }
+
+        std::optional<Node> parse()
+        {
+            Node root = parseAlternation();
+            if (m_reason.isEmpty() && m_pos != m_pattern.size())
+            {
+                fail("unbalanced parenthesis");
+            }
+            if (!m_reason.isEmpty())
+            {
+                return std::nullopt;
+            }
+            return root;
+        }
+
+        const QString &reason() const
+        {
+            return m_reason;
+        }
+
+    private:
+        bool atEnd() const
+        {
+            return m_pos >= m_pattern.size();
+        }
+
+        char16_t peek(qsizetype offset = 0) const
+        {
+            return m_pos + offset < m_pattern.size() ? m_pattern.at(m_pos + offset).unicode() : u'\0';
+        }
+
+        void fail(const QString &reason)
+        {
+            if (m_reason.isEmpty())
+            {
+                m_reason = reason;
+            }
+            m_pos = m_pattern.size();
+        }
+
+        static Node symbols(const SymbolSet &set)
+        {
+            Node node;
+            node.kind    = Node::Kind::Symbols;
+            node.symbols = set;
+            return node;
+        }
+
+        static Node assertion(Node::Kind kind)
+        {
+            Node node;
+            node.kind = kind;
+            return node;
+        }
+
+        static int hexValue(char16_t c)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        Node parseAlternation()
+        {
+            Node alternation;
+            alternation.kind = Node::Kind::Alternation;
+            while (true)
+            {
+                alternation.children.push_back(parseSequence());
+                if (!atEnd() && peek() == '|')
+                {
+                    ++m_pos;
+                    continue;
+                }
+                break;
+            }
+
+            if (alternation.children.size() == 1)
+            {
+                return std::move(alternation.children.front());
+            }
+            return alternation;
+        }
+
+        Node parseSequence()
+        {
+            Node sequence;
+            sequence.kind = Node::Kind::Sequence;
+            while (!atEnd() && peek() != '|' && peek() != ')')
+            {
+                Node atom = parseAtom();
+                sequence.children.push_back(parseQuantifier(std::move(atom)));
+            }
+
+            if (sequence.children.size() == 1)
+            {
+                return std::move(sequence.children.front());
+            }
+            return sequence;
+        }
+
+        Node parseQuantifier(Node atom)
+        {
+            int min = 0;
+            int max = -1;
+            switch (peek())
+            {
+            case '?':
+                max = 1;
+                ++m_pos;
+                break;
+            case '*':
+                ++m_pos;
+                break;
+            case '+':
+                min = 1;
+                ++m_pos;
+                break;
+            case '{':
+            {
+                // Only {n}, {n,} and {n,m} are quantifiers, anything else is a literal brace
+                qsizetype end  = m_pos + 1;
+                bool hasDigits = false;
+                while (end < m_pattern.size() && m_pattern.at(end).isDigit())
+                {
+                    min       = std::min(min * 10 + m_pattern.at(end).digitValue(), MaxRepeat + 1);
+                    hasDigits = true;
+                    ++end;
+                }
+                if (!hasDigits)
+                {
+                    return atom;
+                }
+                max = min;
+                if (end < m_pattern.size() && m_pattern.at(end) == ',')
+                {
+                    ++end;
+                    max = -1;
+                    if (end < m_pattern.size() && m_pattern.at(end).isDigit())
+                    {
+                        max = 0;
+                        while (end < m_pattern.size() && m_pattern.at(end).isDigit())
+                        {
+                            max = std::min(max * 10 + m_pattern.at(end).digitValue(), MaxRepeat + 1);
+                            ++end;
+                        }
+                    }
+                }
+                if (end >= m_pattern.size() || m_pattern.at(end) != '}')
+                {
+                    return atom;
+                }
+                m_pos = end + 1;
+                if (min > MaxRepeat || max > MaxRepeat || (max >= 0 && max < min))
+                {
+                    fail("repetition count over " + QString::number(MaxRepeat));
+                    return atom;
+                }
+                break;
+            }
+            default:
+                return atom;
+            }
+
+            // The automaton always takes the longest match
+            if (peek() == '?')
+            {
+                fail("lazy quantifier");
+                return atom;
+            }
+            if (peek() == '+')
+            {
+                fail("possessive quantifier");
+                return atom;
+            }
+            if (atom.isAssertion())
+            {
+                fail("quantified assertion");
+                return atom;
+            }
+
+            Node repeat;
+            repeat.kind = Node::Kind::Repeat;
+            repeat.min  = min;
+            repeat.max  = max;
+            repeat.children.push_back(std::move(atom));
+            return repeat;
+        }
+
+        Node parseAtom()
+        {
+            const char16_t c = peek();
+            switch (c)
+            {
+            case '(':
+                return parseGroup();
+            case '[':
+                return parseClass();
+            case '\\':
+            {
+                ++m_pos;
+                bool isBoundary = false;
+                const std::optional<SymbolSet> set = parseEscape(false, isBoundary);
+                if (isBoundary)
+                {
+                    return assertion(Node::Kind::WordBoundary);
+                }
+                return symbols(set.value_or(SymbolSet()));
+            }
+            case '.':
+                ++m_pos;
+                return symbols(allSymbols().reset('\n'));
+            case '^':
+                ++m_pos;
+                return assertion(Node::Kind::TextStart);
+            case '$':
+                ++m_pos;
+                return assertion(Node::Kind::TextEnd);
+            case '?':
+            case '*':
+            case '+':
+                fail("quantifier without an atom");
+                return {};
+            default:
+                ++m_pos;
+                if (c >= 128)
+                {
+                    fail("non-ASCII character");
+                    return {};
+                }
+                return symbols(SymbolSet().set(c));
+            }
+        }
+
+        Node parseGroup()
+        {
+            ++m_pos; // (
+            if (peek() == '*')
+            {
+                fail("verb");
+                return {};
+            }
+
+            if (peek() == '?')
+            {
+                const char16_t kind = peek(1);
+                if (kind == ':')
+                {
+                    m_pos += 2;
+                }
+                else if (kind == '=' || kind == '!')
+                {
+                    fail("lookahead");
+                    return {};
+                }
+                else if (kind == '<' && (peek(2) == '=' || peek(2) == '!'))
+                {
+                    fail("lookbehind");
+                    return {};
+                }
+                else if (kind == '<' || kind == '\'' || kind == 'P')
+                {
+                    fail("named group");
+                    return {};
+                }
+                else if (kind == '>')
+                {
+                    fail("atomic group");
+                    return {};
+                }
+                else
+                {
+                    fail("inline option or special group");
+                    return {};
+                }
+            }
+
+            Node inner = parseAlternation();
+            if (peek() != ')')
+            {
+                fail("unbalanced parenthesis");
+                return {};
+            }
+            ++m_pos;
+            return inner;
+        }
+
+        /*
+         * The characters of an escape, after its backslash. Outside a class,
+         * \b is a word boundary, reported through isBoundary; inside one it is
+         * a backspace.
+         */
+        std::optional<SymbolSet> parseEscape(bool inClass, bool &isBoundary)
+        {
+            isBoundary = false;
+            if (atEnd())
+            {
+                fail("trailing backslash");
+                return std::nullopt;
+            }
+
+            const char16_t c = peek();
+            ++m_pos;
+            switch (c)
+            {
+            case 'd':
+                return symbolRange('0', '9');
+            case 'D':
+                return ~symbolRange('0', '9');
+            case 'w':
+                return wordSymbols();
+            case 'W':
+                return ~wordSymbols();
+            case 's':
+                return spaceSymbols();
+            case 'S':
+                return ~spaceSymbols();
+            case 'n':
+                return SymbolSet().set('\n');
+            case 't':
+                return SymbolSet().set('\t');
+            case 'r':
+                return SymbolSet().set('\r');
+            case 'f':
+                return SymbolSet().set('\f');
+            case 'e':
+                return SymbolSet().set(0x1b);
+            case 'a':
+                return SymbolSet().set(0x07);
+            case 'b':
+                if (inClass)
+                {
+                    return SymbolSet().set(0x08);
+                }
+                isBoundary = true;
+                return std::nullopt;
+            case 'x':
+            {
+                int value = 0;
+                if (peek() == '{')
+                {
+                    ++m_pos;
+                    while (!atEnd() && peek() != '}' && hexValue(peek()) >= 0)
+                    {
+                        value = std::min(value * 16 + hexValue(peek()), 0x10FFFF);
+                        ++m_pos;
+                    }
+                    if (peek() != '}')
+                    {
+                        fail("malformed \\x escape");
+                        return std::nullopt;
+                    }
+                    ++m_pos;
+                }
+                else
+                {
+                    for (int digits = 0; digits < 2 && hexValue(peek()) >= 0; ++digits)
+                    {
+                        value = value * 16 + hexValue(peek());
+                        ++m_pos;
+                    }
+                }
+                if (value >= 128)
+                {
+                    fail("non-ASCII character");
+                    return std::nullopt;
+                }
+                return SymbolSet().set(value);
+            }
+            default:
+                break;
+            }
+
+            if (c >= '1' && c <= '9')
+            {
+                fail("backreference");
+                return std::nullopt;
+            }
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+            {
+                // \B, \A, \z, \G, \K, \p, \Q, \h, \v, octal...
+                fail(QString("unsupported escape \\") + QChar(c));
+                return std::nullopt;
+            }
+            if (c >= 128)
+            {
+                fail("non-ASCII character");
+                return std::nullopt;
+            }
+
+            // An escaped punctuation character stands for itself
+            return SymbolSet().set(c);
+        }
+
+        // A single character of a class, for the ends of a range
+        std::optional<char16_t> classCharacter()
+        {
+            if (peek() != '\\')
+            {
+                const char16_t c = peek();
+                ++m_pos;
+                if (c >= 128)
+                {
+                    fail("non-ASCII character");
+                    return std::nullopt;
+                }
+                return c;
+            }
+
+            ++m_pos;
+            bool isBoundary = false;
+            const std::optional<SymbolSet> set = parseEscape(true, isBoundary);
+            if (!set || set->count() != 1)
+            {
+                fail("class escape in a range");
+                return std::nullopt;
+            }
+            for (char16_t c = 0; c < 128; ++c)
+            {
+                if (set->test(c))
+                {
+                    return c;
+                }
+            }
+            return std::nullopt;
+        }
+
+        Node parseClass()
+        {
+            ++m_pos; // [
+            bool negated = false;
+            if (peek() == '^')
+            {
+                negated = true;
+                ++m_pos;
+            }
+
+            SymbolSet set;
+            bool first = true;
+            while (!atEnd() && (peek() != ']' || first))
+            {
+                first = false;
+                if (peek() == '[' && peek(1) == ':')
+                {
+                    fail("POSIX class");
+                    return {};
+                }
+
+                // Class escapes such as \w are no range ends
+                if (peek() == '\\' && QStringLiteral("dDwWsS").contains(QChar(peek(1))))
+                {
+                    ++m_pos;
+                    bool isBoundary = false;
+                    set |= parseEscape(true, isBoundary).value_or(SymbolSet());
+                    continue;
+                }
+
+                const std::optional<char16_t> low = classCharacter();
+                if (!low)
+                {
+                    return {};
+                }
+                char16_t high = *low;
+                if (peek() == '-' && peek(1) != ']' && m_pos + 1 < m_pattern.size())
+                {
+                    ++m_pos;
+                    const std::optional<char16_t> end = classCharacter();
+                    if (!end)
+                    {
+                        return {};
+                    }
+                    high = *end;
+                    if (high < *low)
+                    {
+                        fail("inverted range");
+                        return {};
+                    }
+                }
+                set |= symbolRange(*low, high);
+            }
+
+            if (peek() != ']')
+            {
+                fail("unterminated class");
+                return {};
+            }
+            ++m_pos;
+
+            return symbols(negated ? ~set : set);
+        }
+
+        const QString m_pattern;
+        qsizetype m_pos = 0;
+        QString m_reason;
+    };
+
+    // A top-level alternative of a rule, with the assertions at its ends taken out
+    struct Alternative
+    {
+        Node node;
+        bool wordBoundaryBefore = false;
+        bool textStart          = false;
+        bool wordBoundaryAfter  = false;
+        bool textEnd            = false;
+    };
+
+    bool containsAssertion(const Node &node)
+    {
+        return node.isAssertion()
+            || std::any_of(node.children.cbegin(), node.children.cend(), containsAssertion);
+    }
+
+    // Splits a parsed pattern in alternatives; false if an assertion is left inside one
+    bool splitAlternatives(Node root, std::vector<Alternative> &alternatives)
+    {
+        std::vector<Node> branches;
+        if (root.kind == Node::Kind::Alternation)
+        {
+            branches = std::move(root.children);
+        }
+        else
+        {
+            branches.push_back(std::move(root));
+        }
+
+        for (Node &branch : branches)
+        {
+            Alternative alternative;
+            std::vector<Node> items;
+            if (branch.kind == Node::Kind::Sequence)
+            {
+                items = std::move(branch.children);
+            }
+            else
+            {
+                items.push_back(std::move(branch));
+            }
+
+            auto first = items.begin();
+            for (; first != items.end() && first->isAssertion() && first->kind != Node::Kind::TextEnd; ++first)
+            {
+                (first->kind == Node::Kind::WordBoundary ? alternative.wordBoundaryBefore : alternative.textStart) = true;
+            }
+            auto last = items.end();
+            for (; last != first && (last - 1)->isAssertion() && (last - 1)->kind != Node::Kind::TextStart; --last)
+            {
+                (((last - 1)->kind == Node::Kind::WordBoundary) ? alternative.wordBoundaryAfter : alternative.textEnd) = true;
+            }
+
+            alternative.node.kind = Node::Kind::Sequence;
+            alternative.node.children.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+            if (containsAssertion(alternative.node))
+            {
+                return false;
+            }
+            alternatives.push_back(std::move(alternative));
+        }
+        return true;
+    }
+
+    // Why a pattern cannot be compiled, or its alternatives
+    QString analyze(const QRegularExpression &pattern, std::vector<Alternative> &alternatives)
+    {
+        if (!pattern.isValid())
+        {
+            return "invalid pattern";
+        }
+        if (pattern.patternOptions() != QRegularExpression::NoPatternOption)
+        {
+            return "pattern options";
+        }
+
+        PatternParser parser(pattern.pattern());
+        std::optional<Node> root = parser.parse();
+        if (!root)
+        {
+            return parser.reason();
+        }
+        if (!splitAlternatives(std::move(*root), alternatives))
+        {
+            return "assertion inside the pattern";
+        }
+        return QString();
+    }
+
+    struct CompiledRule
+    {
+        int rule;
+        int priority;
+        std::vector<Alternative> alternatives;
+    };
+}
+
+struct SyntaxLexer::Automaton
+{
+    struct Accept
+    {
+        int rule;
+        int priority;
+        bool wordBoundaryAfter;
+        bool textEnd;
+    };
+
+    std::array<quint8, SymbolCount> classOf{};
+    int classCount = 0;
+    std::vector<qint32> transitions; // state * classCount + class; -1 when no rule can go on
+    std::vector<qint32> acceptOffsets; // Accepts of state s are [acceptOffsets[s], acceptOffsets[s + 1])
+    std::vector<Accept> accepts;       // Of each state, by descending priority then rule
+    std::array<qint32, 4> starts{};    // By (at the start of the text) | (at a word boundary) << 1
+
+    static std::unique_ptr<Automaton> build(const std::vector<const CompiledRule *> &rules);
+};
+
+namespace
+{
+    /*
+     * Thompson NFA, built backwards: each node is compiled with the state it
+     * leads to, so no fragment needs patching.
+     */
+    class NfaBuilder
+    {
+    public:
+        struct State
+        {
+            SymbolSet symbols;     // Consumed, when consuming
+            std::vector<int> next; // Epsilon moves, or the single state after a consuming one
+            bool consumes = false;
+            int accept    = -1;    // Index of the accept, for final states
+        };
+
+        std::vector<State> states;
+        bool overflowed = false;
+
+        int add(State state)
+        {
+            if (states.size() >= static_cast<std::size_t>(MaxNfaStates))
+            {
+                overflowed = true;
+                return 0;
+            }
+            states.push_back(std::move(state));
+            return static_cast<int>(states.size() - 1);
+        }
+
+        int build(const Node &node, int next)
+        {
+            if (overflowed)
+            {
+                return next;
+            }
+
+            switch (node.kind)
+            {
+            case Node::Kind::Symbols:
+                return add({node.symbols, {next}, true});
+            case Node::Kind::Sequence:
+                for (auto it = node.children.crbegin(); it != node.children.crend(); ++it)
+                {
+                    next = build(*it, next);
+                }
+                return next;
+            case Node::Kind::Alternation:
+            {
+                State split;
+                for (const Node &child : node.children)
+                {
+                    split.next.push_back(build(child, next));
+                }
+                return add(std::move(split));
+            }
+            case Node::Kind::Repeat:
+            {
+                const Node &child = node.children.front();
+                int tail          = next;
+                if (node.max < 0)
+                {
+                    // The loop state goes through the child back to itself, or on
+                    const int loop = add({});
+                    if (overflowed)
+                    {
+                        return next;
+                    }
+                    const int body          = build(child, loop);
+                    states[loop].next       = {body, next};
+                    tail                    = loop;
+                }
+                else
+                {
+                    // Nested optional copies: (x(x)?)?
+                    for (int i = node.min; i < node.max; ++i)
+                    {
+                        State optional;
+                        optional.next = {build(child, tail), next};
+                        tail          = add(std::move(optional));
+                    }
+                }
+                for (int i = 0; i < node.min; ++i)
+                {
+                    tail = build(child, tail);
+                }
+                return tail;
+            }
+            default:
+                // Assertions were taken out of the alternatives
+                return next;
+            }
+        }
+
+        // Adds the consuming and final states of the epsilon closure of state to set; visited
+        // receives every state marked in seen
+        void close(int state, std::vector<int> &set, std::vector<bool> &seen, std::vector<int> &visited) const
+        {
+            std::vector<int> pending{state};
+            while (!pending.empty())
+            {
+                const int current = pending.back();
+                pending.pop_back();
+                if (seen[current])
+                {
+                    continue;
+                }
+                seen[current] = true;
+                visited.push_back(current);
+
+                const State &s = states[current];
+                if (s.consumes || s.accept >= 0)
+                {
+                    set.push_back(current);
+                }
+                if (!s.consumes)
+                {
+                    pending.insert(pending.end(), s.next.cbegin(), s.next.cend());
+                }
+            }
+        }
+    };
+}
+
+std::unique_ptr<SyntaxLexer::Automaton> SyntaxLexer::Automaton::build(const std::vector<const CompiledRule *> &rules)
+{
+    auto automaton = std::make_unique<Automaton>();
+
+    NfaBuilder nfa;
+    nfa.add({}); // 0 is never reached: the state add() returns on overflow
+
+    struct Entry
+    {
+        int state;
+        bool wordBoundary;
+        bool textStart;
+    };
+    std::vector<Entry> entries;
+    for (const CompiledRule *rule : rules)
+    {
+        for (const Alternative &alternative : rule->alternatives)
+        {
+            NfaBuilder::State final;
+            final.accept = static_cast<int>(automaton->accepts.size());
+            automaton->accepts.push_back({rule->rule, rule->priority, alternative.wordBoundaryAfter, alternative.textEnd});
+            const int accept = nfa.add(std::move(final));
+            entries.push_back({nfa.build(alternative.node, accept), alternative.wordBoundaryBefore, alternative.textStart});
+        }
+    }
+    if (nfa.overflowed)
+    {
+        return nullptr;
+    }
+
+    // Symbols no consumed set tells apart share a class
+    std::array<int, SymbolCount> classOf{};
+    int classCount = 1;
+    for (const NfaBuilder::State &state : nfa.states)
+    {
+        if (!state.consumes)
+        {
+            continue;
+        }
+        std::map<std::pair<int, bool>, int> split;
+        for (int symbol = 0; symbol < SymbolCount; ++symbol)
+        {
+            const auto key = std::make_pair(classOf[symbol], bool(state.symbols.test(symbol)));
+            auto found     = split.try_emplace(key, static_cast<int>(split.size())).first;
+            classOf[symbol] = found->second;
+        }
+        classCount = static_cast<int>(split.size());
+    }
+    std::vector<int> representative(classCount, -1);
+    for (int symbol = 0; symbol < SymbolCount; ++symbol)
+    {
+        automaton->classOf[symbol] = static_cast<quint8>(classOf[symbol]);
+        if (representative[classOf[symbol]] < 0)
+        {
+            representative[classOf[symbol]] = symbol;
+        }
+    }
+    automaton->classCount = classCount;
+
+    // Subset construction; DFA states are the sorted consuming and final NFA states they stand for
+    std::map<std::vector<int>, int> ids;
+    std::vector<std::vector<int>> subsets;
+    std::vector<bool> seen(nfa.states.size());
+    std::vector<int> visited;
+    auto stateOf = [&](const std::vector<int> &seeds) -> int
+    {
+        std::vector<int> subset;
+        for (const int seed : seeds)
+        {
+            nfa.close(seed, subset, seen, visited);
+        }
+        for (const int state : visited)
+        {
+            seen[state] = false;
+        }
+        visited.clear();
+        if (subset.empty())
+        {
+            return -1;
+        }
+        std::sort(subset.begin(), subset.end());
+
+        auto [it, inserted] = ids.try_emplace(subset, static_cast<int>(subsets.size()));
+        if (inserted)
+        {
+            subsets.push_back(std::move(subset));
+        }
+        return it->second;
+    };
+
+    for (int condition = 0; condition < 4; ++condition)
+    {
+        const bool atTextStart    = condition & 1;
+        const bool atWordBoundary = condition & 2;
+        std::vector<int> seeds;
+        for (const Entry &entry : entries)
+        {
+            if ((!entry.textStart || atTextStart) && (!entry.wordBoundary || atWordBoundary))
+            {
+                seeds.push_back(entry.state);
+            }
+        }
+        automaton->starts[condition] = stateOf(seeds);
+    }
+
+    for (std::size_t current = 0; current < subsets.size(); ++current)
+    {
+        if (subsets.size() > static_cast<std::size_t>(MaxStates))
+        {
+            return nullptr;
+        }
+
+        for (int symbolClass = 0; symbolClass < classCount; ++symbolClass)
+        {
+            const int symbol = representative[symbolClass];
+            std::vector<int> seeds;
+            for (const int state : subsets[current])
+            {
+                const NfaBuilder::State &s = nfa.states[state];
+                if (s.consumes && s.symbols.test(symbol))
+                {
+                    seeds.push_back(s.next.front());
+                }
+            }
+            automaton->transitions.push_back(seeds.empty() ? -1 : stateOf(seeds));
+        }
+    }
+
+    // The accepts of each state, best first
+    std::vector<Accept> accepts;
+    automaton->acceptOffsets.push_back(0);
+    for (const std::vector<int> &subset : subsets)
+    {
+        const qsizetype first = accepts.size();
+        for (const int state : subset)
+        {
+            if (nfa.states[state].accept >= 0)
+            {
+                accepts.push_back(automaton->accepts[nfa.states[state].accept]);
+            }
+        }
+        std::sort(accepts.begin() + first, accepts.end(), [](const Accept &a, const Accept &b)
+        {
+            return a.priority != b.priority ? a.priority > b.priority : a.rule < b.rule;
+        });
+        automaton->acceptOffsets.push_back(static_cast<qint32>(accepts.size()));
+    }
+    automaton->accepts = std::move(accepts);
+
+    return automaton;
+}
+
+SyntaxLexer::SyntaxLexer(const QVector<Syntax::SyntaxRule> &rules)
+    : m_compiled(rules.size(), false)
+{
+    std::vector<CompiledRule> parsed;
+    for (int i = 0; i < rules.size(); ++i)
+    {
+        std::vector<Alternative> alternatives;
+        const QString reason = analyze(rules[i].m_pattern, alternatives);
+        if (!reason.isEmpty())
+        {
+            m_fallbacks.append({i, reason});
+            continue;
+        }
+        parsed.push_back({i, rules[i].m_priority, std::move(alternatives)});
+    }
+
+    // Rules are added in order; one that makes the automaton too large falls back
+    std::vector<const CompiledRule *> accepted;
+    for (const CompiledRule &rule : parsed)
+    {
+        accepted.push_back(&rule);
+        std::unique_ptr<Automaton> automaton = Automaton::build(accepted);
+        if (!automaton)
+        {
+            accepted.pop_back();
+            m_fallbacks.append({rule.rule, "automaton over " + QString::number(MaxStates) + " states"});
+            continue;
+        }
+        m_automaton           = std::move(automaton);
+        m_compiled[rule.rule] = true;
+    }
+    std::sort(m_fallbacks.begin(), m_fallbacks.end(), [](const Fallback &a, const Fallback &b)
+    {
+        return a.rule < b.rule;
+    });
+
+    // For each priority below the highest, the rules above it
+    std::vector<int> priorities;
+    for (const CompiledRule *rule : accepted)
+    {
+        priorities.push_back(rule->priority);
+    }
+    std::sort(priorities.begin(), priorities.end());
+    priorities.erase(std::unique(priorities.begin(), priorities.end()), priorities.end());
+    for (std::size_t i = 0; i + 1 < priorities.size(); ++i)
+    {
+        std::vector<const CompiledRule *> above;
+        std::copy_if(accepted.cbegin(), accepted.cend(), std::back_inserter(above), [&](const CompiledRule *rule)
+        {
+            return rule->priority > priorities[i];
+        });
+        if (std::unique_ptr<Automaton> automaton = Automaton::build(above))
+        {
+            m_nested.emplace_back(priorities[i], std::move(automaton));
+        }
+    }
+}
+
+SyntaxLexer::~SyntaxLexer() = default;
+
+QString SyntaxLexer::unsupportedReason(const QRegularExpression &pattern)
+{
+    std::vector<Alternative> alternatives;
+    return analyze(pattern, alternatives);
+}
+
+bool SyntaxLexer::compiles(int rule) const
+{
+    return rule >= 0 && rule < static_cast<int>(m_compiled.size()) && m_compiled[rule];
+}
+
+int SyntaxLexer::compiledRules() const
+{
+    return static_cast<int>(std::count(m_compiled.cbegin(), m_compiled.cend(), true));
+}
+
+const QVector<SyntaxLexer::Fallback> &SyntaxLexer::fallbackRules() const
+{
+    return m_fallbacks;
+}
+
+const SyntaxLexer::Automaton *SyntaxLexer::nested(int priority) const
+{
+    for (const auto &[below, automaton] : m_nested)
+    {
+        if (below == priority)
+        {
+            return automaton.get();
+        }
+    }
+    return nullptr;
+}
+
+void SyntaxLexer::tokenize(const QString &text, qsizetype from, QVector<SyntaxToken> &tokens) const
+{
+    if (m_automaton)
+    {
+        scan(*m_automaton, text, from, text.size(), tokens);
+    }
+}
+
+void SyntaxLexer::scan(const Automaton &automaton, const QString &text, qsizetype from, qsizetype limit,
+                       QVector<SyntaxToken> &tokens) const
+{
+    const char16_t *data = reinterpret_cast<const char16_t *>(text.utf16());
+    const qsizetype size = text.size();
+
+    // Characters outside the BMP are one character to PCRE2, and one symbol here
+    auto width = [data, size](qsizetype position)
+    {
+        return QChar::isHighSurrogate(data[position]) && position + 1 < size && QChar::isLowSurrogate(data[position + 1])
+                   ? 2
+                   : 1;
+    };
+
+    qsizetype position = from;
+    while (position < limit)
+    {
+        const int condition = (position == 0 ? 1 : 0) | (isWordBoundary(data, size, position) ? 2 : 0);
+        int state           = automaton.starts[condition];
+
+        const Automaton::Accept *best = nullptr;
+        qsizetype bestEnd             = position;
+        qsizetype end                 = position;
+        while (state >= 0)
+        {
+            if (end > position)
+            {
+                // The best accept of the state whose assertions hold here
+                for (qint32 i = automaton.acceptOffsets[state]; i < automaton.acceptOffsets[state + 1]; ++i)
+                {
+                    const Automaton::Accept &accept = automaton.accepts[i];
+                    if ((accept.wordBoundaryAfter && !isWordBoundary(data, size, end))
+                        || (accept.textEnd && end != size && !(end == size - 1 && data[end] == '\n')))
+                    {
+                        continue;
+                    }
+                    if (!best || accept.priority >= best->priority)
+                    {
+                        best    = &accept;
+                        bestEnd = end;
+                    }
+                    break;
+                }
+            }
+
+            if (end >= size)
+            {
+                break;
+            }
+            const char16_t c = data[end];
+            state            = automaton.transitions[static_cast<std::size_t>(state) * automaton.classCount
+                                          + automaton.classOf[c < 128 ? c : OtherSymbol]];
+            end += width(end);
+        }
+
+        // A match running past the token it is nested in is dropped, as by resolveOverlaps()
+        if (!best || bestEnd > limit)
+        {
+            position += width(position);
+            continue;
+        }
+
+        tokens.append({static_cast<int>(position), static_cast<int>(bestEnd - position), best->rule});
+        if (const Automaton *inside = nested(best->priority))
+        {
+            scan(*inside, text, position + 1, bestEnd, tokens);
+        }
+        position = bestEnd;
+    }
+}
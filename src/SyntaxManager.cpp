@@ -1,5 +1,7 @@
 #include "SyntaxManager.h"
+#include "BundledSyntax.h"
 #include "Syntax.h"
+#include "SyntaxRegistry.h"
 
 #include <QDir>
 #include <QFile>
@@ -43,88 +45,53 @@ void SyntaxManager::initializeUserSyntaxConfig()
     else
     {
         qDebug() << "[Setup] User syntax directory already exists. Skipping first-run config.";
-    }
-}
-
-std::unique_ptr<QSyntaxHighlighter> SyntaxManager::createSyntaxHighlighter(const QString &extension, QTextDocument *doc)
-{
-    QString baseDir;
 
-    if (qEnvironmentVariableIsSet("CONFIG_DIR"))
-    {
-        baseDir = qEnvironmentVariable("CONFIG_DIR");
-    }
-    else
-    {
-        QString userSyntaxDir = QDir::homePath() + "/.config/codeastra/syntax";
-        if (QDir(userSyntaxDir).exists())
-        {
-            baseDir = userSyntaxDir;
-        }
-        else
+        // Copies of an earlier release left unedited would hide what the bundled files gained since
+        for (const PreviousBundledSyntax &previous : previousBundledSyntax)
         {
-            baseDir = "config";
-        }
-    }
-
-#ifdef DEBUG
-    qDebug() <<  "[SyntaxManager] Using config directory:" << baseDir;
-#endif
+            const QString fileName = QString::fromUtf8(previous.name);
+            const QString destPath = userSyntaxDir + "/" + fileName;
 
-    QDir syntaxDir(baseDir);
-    QStringList yamlFilePath = syntaxDir.entryList({"*.yaml", "*.yml"}, QDir::Files);
+            QFile copy(destPath);
+            if (!copy.open(QIODevice::ReadOnly))
+            {
+                continue;
+            }
+            const QByteArray content = copy.readAll();
+            copy.close();
+            if (bundledSyntaxHash(content.constData(), static_cast<std::size_t>(content.size())) != previous.hash)
+            {
+                continue;
+            }
 
-    std::vector<YAML::Node> config;
-    // Iterate over all YAML files and store their contents as separate nodes
-    for (const QString &fileName : yamlFilePath)
-    {
-        QFile file(syntaxDir.filePath(fileName));
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text))
-        {
-            YAML::Node fileConfig = YAML::Load(file.readAll().toStdString());
-            file.close();
-#ifdef DEBUG
-            qDebug() << "[SyntaxManager] Loaded config for extension:" << extension << "from:" << file.fileName();
-#endif
-            config.push_back(fileConfig);
-        }
-        else
-        {
-            qWarning() << "[SyntaxManager] Failed to open syntax config for extension:" << extension << "at:" << yamlFilePath;
-            return nullptr;
+            QFile resFile(":/resources/syntax/" + fileName);
+            if (QFile::remove(destPath) && resFile.copy(destPath))
+            {
+                qDebug() << "[Setup] Refreshed unmodified config:" << fileName;
+            }
+            else
+            {
+                qWarning() << "[Setup] Failed to refresh:" << destPath;
+            }
         }
     }
-
-    return createHighlighter(doc, config, extension);
 }
 
-std::unique_ptr<QSyntaxHighlighter> SyntaxManager::createHighlighter(QTextDocument *doc, const std::vector<YAML::Node> &config, const QString &extension)
+std::unique_ptr<QSyntaxHighlighter> SyntaxManager::createSyntaxHighlighter(const QString &extension, QTextDocument *doc)
 {
-
 #ifdef DEBUG
     qDebug() << "[SyntaxManager] Creating highlighter for extension:" << extension;
 #endif
 
-    for (const auto &node : config)
+    // Definitions are parsed once per process and shared between documents
+    std::shared_ptr<const SyntaxDefinition> definition = SyntaxRegistry::getInstance().definitionForExtension(extension);
+    if (!definition)
     {
-        if (node["extensions"])
-        {
-            for (const auto &ext : node["extensions"])
-            {
-                std::string extensionInConfig = ext.as<std::string>();
-                if (extensionInConfig == extension.toStdString())
-                {
-                    return std::make_unique<Syntax>(doc, node);
-                }
-            }
-        }
-        else
-        {
-            qDebug() << "[SyntaxManager] No extensions key in YAML config.";
-        }
-    }
 #ifdef DEBUG
-    qDebug() << "[SyntaxManager] No matching highlighter found for extension:" << extension;
+        qDebug() << "[SyntaxManager] No matching highlighter found for extension:" << extension;
 #endif
-    return nullptr;
+        return nullptr;
+    }
+
+    return std::make_unique<Syntax>(doc, definition);
 }
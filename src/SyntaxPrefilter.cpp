@@ -0,0 +1,763 @@
+#include "SyntaxPrefilter.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SYNTAX_PREFILTER_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define SYNTAX_PREFILTER_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+namespace
+{
+    // Rules needing more ranges than this are not worth a probe: they are
+    // made of letters, which nearly every block contains
+    constexpr int MaxRangesPerRule = 4;
+    constexpr int MaxProbes        = 32;
+
+    using CharacterSet = SyntaxPrefilter::CharacterSet;
+
+    /*
+     * Walks a PCRE2 pattern and computes, for each sequence, the smallest
+     * character set of a mandatory atom. A group requires the union of the
+     * sets of its alternatives, and nothing if one of them requires nothing.
+     * Constructs that change how the pattern is read ((?i), \Q...\E, verbs)
+     * make the whole analysis fail.
+     */
+    class RequirementParser
+    {
+    public:
+        RequirementParser(const QString &pattern, bool caseless)
+            : m_pattern(pattern), m_caseless(caseless)
+        {
+        }
+
+        std::optional<CharacterSet> parse()
+        {
+            std::optional<CharacterSet> required = parseAlternation();
+            if (m_failed || m_pos != m_pattern.size())
+            {
+                return std::nullopt;
+            }
+            return required;
+        }
+
+    private:
+        struct Atom
+        {
+            std::optional<CharacterSet> set; // Characters one of which the atom consumes
+            bool zeroWidth = false;
+        };
+
+        bool atEnd() const
+        {
+            return m_pos >= m_pattern.size();
+        }
+
+        char16_t peek(qsizetype offset = 0) const
+        {
+            return m_pos + offset < m_pattern.size() ? m_pattern.at(m_pos + offset).unicode() : u'\0';
+        }
+
+        CharacterSet single(char16_t c) const
+        {
+            CharacterSet set;
+            if (c >= 128)
+            {
+                return set;
+            }
+
+            set.set(c);
+            if (m_caseless && c >= 'a' && c <= 'z')
+            {
+                set.set(c - 'a' + 'A');
+            }
+            else if (m_caseless && c >= 'A' && c <= 'Z')
+            {
+                set.set(c - 'A' + 'a');
+            }
+            return set;
+        }
+
+        static int hexValue(char16_t c)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        static CharacterSet digits()
+        {
+            CharacterSet set;
+            for (char c = '0'; c <= '9'; ++c)
+            {
+                set.set(c);
+            }
+            return set;
+        }
+
+        std::optional<CharacterSet> parseAlternation()
+        {
+            CharacterSet required;
+            bool everyBranch = true;
+            while (true)
+            {
+                std::optional<CharacterSet> branch = parseSequence();
+                if (branch)
+                {
+                    required |= *branch;
+                }
+                else
+                {
+                    everyBranch = false;
+                }
+
+                if (!atEnd() && peek() == '|')
+                {
+                    ++m_pos;
+                    continue;
+                }
+                break;
+            }
+
+            return everyBranch && required.any() ? std::optional<CharacterSet>(required) : std::nullopt;
+        }
+
+        std::optional<CharacterSet> parseSequence()
+        {
+            std::optional<CharacterSet> best;
+            while (!atEnd() && peek() != '|' && peek() != ')' && !m_failed)
+            {
+                Atom atom            = parseAtom();
+                const bool mandatory = parseQuantifier();
+                if (mandatory && !atom.zeroWidth && atom.set && atom.set->any()
+                    && (!best || atom.set->count() < best->count()))
+                {
+                    best = atom.set;
+                }
+            }
+            return best;
+        }
+
+        // Consumes a quantifier if there is one; false if it allows zero repetitions
+        bool parseQuantifier()
+        {
+            bool mandatory = true;
+            switch (peek())
+            {
+            case '?':
+            case '*':
+                mandatory = false;
+                ++m_pos;
+                break;
+            case '+':
+                ++m_pos;
+                break;
+            case '{':
+            {
+                // Only {n}, {n,} and {n,m} are quantifiers, anything else is a literal brace
+                qsizetype end = m_pos + 1;
+                qsizetype min = 0;
+                bool hasDigits = false;
+                while (end < m_pattern.size() && m_pattern.at(end).isDigit())
+                {
+                    min       = min * 10 + m_pattern.at(end).digitValue();
+                    hasDigits = true;
+                    ++end;
+                }
+                if (!hasDigits)
+                {
+                    return true;
+                }
+                if (end < m_pattern.size() && m_pattern.at(end) == ',')
+                {
+                    ++end;
+                    while (end < m_pattern.size() && m_pattern.at(end).isDigit())
+                    {
+                        ++end;
+                    }
+                }
+                if (end >= m_pattern.size() || m_pattern.at(end) != '}')
+                {
+                    return true;
+                }
+                m_pos     = end + 1;
+                mandatory = min > 0;
+                break;
+            }
+            default:
+                return true;
+            }
+
+            // Lazy or possessive
+            if (peek() == '?' || peek() == '+')
+            {
+                ++m_pos;
+            }
+            return mandatory;
+        }
+
+        Atom parseAtom()
+        {
+            const char16_t c = peek();
+            switch (c)
+            {
+            case '(':
+                return parseGroup();
+            case '[':
+                return {parseClass(), false};
+            case '\\':
+                return parseEscape();
+            case '.':
+                ++m_pos;
+                return {};
+            case '^':
+            case '$':
+                ++m_pos;
+                return {std::nullopt, true};
+            case '?':
+            case '*':
+            case '+':
+                // A quantifier without an atom: not a pattern we understand
+                m_failed = true;
+                ++m_pos;
+                return {};
+            default:
+                ++m_pos;
+                return {c < 128 ? std::optional<CharacterSet>(single(c)) : std::nullopt, false};
+            }
+        }
+
+        Atom parseGroup()
+        {
+            ++m_pos; // (
+            bool zeroWidth = false;
+
+            if (peek() == '*')
+            {
+                m_failed = true; // Verbs such as (*UCP)
+                return {};
+            }
+
+            if (peek() == '?')
+            {
+                const char16_t kind = peek(1);
+                if (kind == ':' || kind == '>' || kind == '|')
+                {
+                    m_pos += 2;
+                }
+                else if (kind == '=' || kind == '!')
+                {
+                    // A positive lookahead consumes nothing, but its characters must be in the block
+                    zeroWidth = kind == '!';
+                    m_pos += 2;
+                }
+                else if (kind == '<' && (peek(2) == '=' || peek(2) == '!'))
+                {
+                    zeroWidth = peek(2) == '!';
+                    m_pos += 3;
+                }
+                else if (kind == '<' || kind == '\'' || (kind == 'P' && peek(2) == '<'))
+                {
+                    // Named group
+                    const char16_t close = kind == '\'' ? u'\'' : u'>';
+                    while (!atEnd() && peek() != close)
+                    {
+                        ++m_pos;
+                    }
+                    ++m_pos;
+                }
+                else if (kind == '#')
+                {
+                    while (!atEnd() && peek() != ')')
+                    {
+                        ++m_pos;
+                    }
+                    ++m_pos;
+                    return {std::nullopt, true};
+                }
+                else
+                {
+                    m_failed = true; // Inline options, conditionals, recursion...
+                    return {};
+                }
+            }
+
+            std::optional<CharacterSet> required = parseAlternation();
+            if (peek() != ')')
+            {
+                m_failed = true;
+                return {};
+            }
+            ++m_pos;
+
+            if (zeroWidth)
+            {
+                return {std::nullopt, true};
+            }
+            return {required, false};
+        }
+
+        // Returns the set of an escape in a class or outside; nothing if too wide
+        std::optional<CharacterSet> escapeSet(char16_t c, bool &zeroWidth)
+        {
+            zeroWidth = false;
+            switch (c)
+            {
+            case 'd':
+                return digits();
+            case 'n':
+                return single('\n');
+            case 't':
+                return single('\t');
+            case 'r':
+                return single('\r');
+            case 'f':
+                return single('\f');
+            case 'e':
+                return single(0x1b);
+            case 'a':
+                return single(0x07);
+            case 'b':
+            case 'B':
+            case 'A':
+            case 'z':
+            case 'Z':
+            case 'G':
+            case 'K':
+                zeroWidth = true;
+                return std::nullopt;
+            case 'Q':
+            case 'E':
+                m_failed = true;
+                return std::nullopt;
+            case 'x':
+            {
+                // \xhh or \x{hhhh}
+                int value = 0;
+                if (peek() == '{')
+                {
+                    ++m_pos;
+                    while (!atEnd() && peek() != '}')
+                    {
+                        value = qMin(value * 16 + qMax(hexValue(peek()), 0), 0x10000);
+                        ++m_pos;
+                    }
+                    ++m_pos;
+                }
+                else
+                {
+                    for (int i = 0; i < 2 && hexValue(peek()) >= 0; ++i)
+                    {
+                        value = value * 16 + hexValue(peek());
+                        ++m_pos;
+                    }
+                }
+                return value > 0 && value < 128 ? std::optional<CharacterSet>(single(static_cast<char16_t>(value))) : std::nullopt;
+            }
+            case 'p':
+            case 'P':
+            case 'k':
+            case 'g':
+            case 'o':
+                // Properties and references: skip the name, match anything
+                if (peek() == '{' || peek() == '<' || peek() == '\'')
+                {
+                    const char16_t close = peek() == '{' ? u'}' : (peek() == '<' ? u'>' : u'\'');
+                    while (!atEnd() && peek() != close)
+                    {
+                        ++m_pos;
+                    }
+                    ++m_pos;
+                }
+                else if (!atEnd())
+                {
+                    ++m_pos;
+                }
+                return std::nullopt;
+            case 'c':
+                ++m_pos;
+                return std::nullopt;
+            default:
+                if (c >= '0' && c <= '9')
+                {
+                    // Backreference or octal escape
+                    while (QChar(peek()).isDigit())
+                    {
+                        ++m_pos;
+                    }
+                    return std::nullopt;
+                }
+                if (QChar(c).isLetter())
+                {
+                    return std::nullopt; // \w, \s, \h, \R...
+                }
+                return single(c); // Escaped punctuation
+            }
+        }
+
+        Atom parseEscape()
+        {
+            ++m_pos; // backslash
+            if (atEnd())
+            {
+                m_failed = true;
+                return {};
+            }
+
+            const char16_t c = peek();
+            ++m_pos;
+
+            bool zeroWidth = false;
+            std::optional<CharacterSet> set = escapeSet(c, zeroWidth);
+            return {set, zeroWidth};
+        }
+
+        std::optional<CharacterSet> parseClass()
+        {
+            ++m_pos; // [
+            bool negated = false;
+            if (peek() == '^')
+            {
+                negated = true;
+                ++m_pos;
+            }
+
+            CharacterSet set;
+            bool representable = true;
+            bool first         = true;
+            int previous       = -1; // Last single character, for ranges
+
+            while (!atEnd() && (peek() != ']' || first))
+            {
+                first = false;
+
+                if (peek() == '[' && peek(1) == ':')
+                {
+                    // POSIX class such as [:alpha:]
+                    while (!atEnd() && !(peek() == ':' && peek(1) == ']'))
+                    {
+                        ++m_pos;
+                    }
+                    m_pos += 2;
+                    representable = false;
+                    previous      = -1;
+                    continue;
+                }
+
+                int current = -1;
+                if (peek() == '\\')
+                {
+                    ++m_pos;
+                    const char16_t c = peek();
+                    ++m_pos;
+                    bool zeroWidth = false;
+
+                    // \b is a backspace inside a class
+                    std::optional<CharacterSet> escaped = c == 'b' ? single(0x08) : escapeSet(c, zeroWidth);
+                    if (!escaped)
+                    {
+                        representable = false;
+                    }
+                    else
+                    {
+                        set |= *escaped;
+                        if (!QChar(c).isLetterOrNumber())
+                        {
+                            current = c; // Escaped punctuation may start a range
+                        }
+                    }
+                }
+                else
+                {
+                    const char16_t c = peek();
+                    ++m_pos;
+
+                    if (c == '-' && previous >= 0 && peek() != ']' && !atEnd())
+                    {
+                        // Range: previous was already added, add the rest
+                        char16_t high = peek();
+                        if (high == '\\')
+                        {
+                            ++m_pos;
+                            high = peek();
+                        }
+                        ++m_pos;
+
+                        if (high >= 128)
+                        {
+                            representable = false;
+                        }
+                        for (int ch = previous + 1; ch <= high && ch < 128; ++ch)
+                        {
+                            set |= single(static_cast<char16_t>(ch));
+                        }
+                        previous = -1;
+                        continue;
+                    }
+
+                    if (c >= 128)
+                    {
+                        representable = false;
+                    }
+                    else
+                    {
+                        set |= single(c);
+                        current = c;
+                    }
+                }
+                previous = current;
+            }
+
+            if (atEnd())
+            {
+                m_failed = true;
+                return std::nullopt;
+            }
+            ++m_pos; // ]
+
+            if (negated || !representable || set.none())
+            {
+                return std::nullopt;
+            }
+            return set;
+        }
+
+        const QString &m_pattern;
+        bool m_caseless;
+        qsizetype m_pos = 0;
+        bool m_failed   = false;
+    };
+
+    // Splits a character set into ranges of consecutive characters
+    QVector<QPair<char16_t, char16_t>> ranges(const CharacterSet &set)
+    {
+        QVector<QPair<char16_t, char16_t>> result;
+        for (int c = 0; c < 128; ++c)
+        {
+            if (!set.test(c))
+            {
+                continue;
+            }
+
+            int end = c;
+            while (end + 1 < 128 && set.test(end + 1))
+            {
+                ++end;
+            }
+            result.append({static_cast<char16_t>(c), static_cast<char16_t>(end)});
+            c = end;
+        }
+        return result;
+    }
+
+#ifdef SYNTAX_PREFILTER_AVX2
+    bool hasAvx2()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+#endif
+}
+
+std::optional<SyntaxPrefilter::CharacterSet> SyntaxPrefilter::requiredCharacters(const QRegularExpression &pattern)
+{
+    const QRegularExpression::PatternOptions options = pattern.patternOptions();
+    if (!pattern.isValid() || options.testFlag(QRegularExpression::ExtendedPatternSyntaxOption))
+    {
+        return std::nullopt;
+    }
+
+    const QString source = pattern.pattern();
+    RequirementParser parser(source, options.testFlag(QRegularExpression::CaseInsensitiveOption));
+    return parser.parse();
+}
+
+SyntaxPrefilter::SyntaxPrefilter(const QVector<Syntax::SyntaxRule> &rules)
+    : m_signatures(rules.size(), 0)
+{
+    for (qsizetype rule = 0; rule < rules.size(); ++rule)
+    {
+        std::optional<CharacterSet> required = requiredCharacters(rules[rule].m_pattern);
+        if (!required)
+        {
+            continue;
+        }
+
+        const QVector<QPair<char16_t, char16_t>> ruleRanges = ranges(*required);
+        if (ruleRanges.size() > MaxRangesPerRule)
+        {
+            continue;
+        }
+
+        quint32 signature = 0;
+        for (const QPair<char16_t, char16_t> &range : ruleRanges)
+        {
+            qsizetype probe = 0;
+            while (probe < m_probes.size() && (m_probes[probe].low != range.first || m_probes[probe].high != range.second))
+            {
+                ++probe;
+            }
+
+            if (probe == m_probes.size())
+            {
+                if (m_probes.size() == MaxProbes)
+                {
+                    signature = 0; // Out of probes, the rule always runs
+                    break;
+                }
+                m_probes.append({range.first, range.second});
+            }
+            signature |= 1u << probe;
+        }
+        m_signatures[rule] = signature;
+    }
+
+    for (qsizetype probe = 0; probe < m_probes.size(); ++probe)
+    {
+        for (char16_t c = m_probes[probe].low; c <= m_probes[probe].high; ++c)
+        {
+            m_charProbes[c] |= 1u << probe;
+        }
+        m_allProbes |= 1u << probe;
+    }
+}
+
+int SyntaxPrefilter::filteredRules() const
+{
+    return static_cast<int>(std::count_if(m_signatures.cbegin(), m_signatures.cend(), [](quint32 signature) { return signature != 0; }));
+}
+
+quint32 SyntaxPrefilter::scan(const QString &text) const
+{
+    if (m_allProbes == 0)
+    {
+        return 0;
+    }
+
+    const char16_t *data = reinterpret_cast<const char16_t *>(text.utf16());
+#ifdef SYNTAX_PREFILTER_AVX2
+    if (hasAvx2())
+    {
+        return scanAvx2(data, text.size());
+    }
+#endif
+#ifdef SYNTAX_PREFILTER_SSE2
+    return scanSse2(data, text.size());
+#else
+    return scanScalar(data, 0, text.size(), 0);
+#endif
+}
+
+quint32 SyntaxPrefilter::scanScalar(const char16_t *data, qsizetype begin, qsizetype end, quint32 found) const
+{
+    for (qsizetype i = begin; i < end && found != m_allProbes; ++i)
+    {
+        if (data[i] < 128)
+        {
+            found |= m_charProbes[data[i]];
+        }
+    }
+    return found;
+}
+
+#ifdef SYNTAX_PREFILTER_SSE2
+quint32 SyntaxPrefilter::scanSse2(const char16_t *data, qsizetype size) const
+{
+    quint32 found = 0;
+    qsizetype i   = 0;
+
+    // Only the probes not found yet are tested, most blocks stop testing early
+    for (; i + 8 <= size && found != m_allProbes; i += 8)
+    {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        for (quint32 missing = m_allProbes & ~found; missing != 0; missing &= missing - 1)
+        {
+            const int probe = std::countr_zero(missing);
+            const Probe &range = m_probes[probe];
+
+            __m128i hit;
+            if (range.low == range.high)
+            {
+                hit = _mm_cmpeq_epi16(chunk, _mm_set1_epi16(static_cast<short>(range.low)));
+            }
+            else
+            {
+                // Signed compares: characters above 0x7fff are negative, never in an ASCII range
+                hit = _mm_and_si128(_mm_cmpgt_epi16(chunk, _mm_set1_epi16(static_cast<short>(range.low - 1))),
+                                    _mm_cmplt_epi16(chunk, _mm_set1_epi16(static_cast<short>(range.high + 1))));
+            }
+
+            if (_mm_movemask_epi8(hit) != 0)
+            {
+                found |= 1u << probe;
+            }
+        }
+    }
+
+    return scanScalar(data, i, size, found);
+}
+#endif
+
+#ifdef SYNTAX_PREFILTER_AVX2
+__attribute__((target("avx2")))
+quint32 SyntaxPrefilter::scanAvx2(const char16_t *data, qsizetype size) const
+{
+    quint32 found = 0;
+    qsizetype i   = 0;
+
+    for (; i + 16 <= size && found != m_allProbes; i += 16)
+    {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        for (quint32 missing = m_allProbes & ~found; missing != 0; missing &= missing - 1)
+        {
+            const int probe = std::countr_zero(missing);
+            const Probe &range = m_probes[probe];
+
+            __m256i hit;
+            if (range.low == range.high)
+            {
+                hit = _mm256_cmpeq_epi16(chunk, _mm256_set1_epi16(static_cast<short>(range.low)));
+            }
+            else
+            {
+                hit = _mm256_and_si256(_mm256_cmpgt_epi16(chunk, _mm256_set1_epi16(static_cast<short>(range.low - 1))),
+                                       _mm256_cmpgt_epi16(_mm256_set1_epi16(static_cast<short>(range.high + 1)), chunk));
+            }
+
+            if (_mm256_movemask_epi8(hit) != 0)
+            {
+                found |= 1u << probe;
+            }
+        }
+    }
+
+    return scanScalar(data, i, size, found);
+}
+#else
+quint32 SyntaxPrefilter::scanAvx2(const char16_t *data, qsizetype size) const
+{
+    return scanSse2(data, size);
+}
+#endif
+
+#ifndef SYNTAX_PREFILTER_SSE2
+quint32 SyntaxPrefilter::scanSse2(const char16_t *data, qsizetype size) const
+{
+    return scanScalar(data, 0, size, 0);
+}
+#endif
@@ -0,0 +1,110 @@
+#include "SyntaxProfiler.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QSet>
+#include <algorithm>
+
+void SyntaxProfiler::setEnabled(bool enabled)
+{
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void SyntaxProfiler::record(const QString &language, const QVector<Sample> &samples)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QHash<int, RuleStats> &rules = m_stats[language];
+    QSet<int> seen;
+    for (const Sample &sample : samples)
+    {
+        RuleStats &stats = rules[sample.rule];
+        stats.rule        = sample.rule;
+        stats.label       = sample.label;
+        stats.nanoseconds += sample.nanoseconds;
+        stats.matches     += sample.matches;
+        stats.bytes       += sample.bytes;
+
+        // A block split by regions runs its rules once per part
+        if (!seen.contains(sample.rule))
+        {
+            seen.insert(sample.rule);
+            ++stats.blocks;
+        }
+    }
+}
+
+QStringList SyntaxProfiler::languages() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QStringList languages = m_stats.keys();
+    languages.sort();
+    return languages;
+}
+
+QVector<SyntaxProfiler::RuleStats> SyntaxProfiler::ranking(const QString &language) const
+{
+    QVector<RuleStats> ranking;
+    {
+        QMutexLocker locker(&m_mutex);
+        ranking = m_stats.value(language).values();
+    }
+
+    std::sort(ranking.begin(), ranking.end(), [](const RuleStats &a, const RuleStats &b)
+    {
+        return a.nanoseconds > b.nanoseconds;
+    });
+    return ranking;
+}
+
+QString SyntaxProfiler::report(int limit) const
+{
+    QString report;
+    for (const QString &language : languages())
+    {
+        const QVector<RuleStats> rules = ranking(language);
+
+        qint64 total = 0;
+        for (const RuleStats &stats : rules)
+        {
+            total += stats.nanoseconds;
+        }
+
+        report += QString("%1: %2 ms\n")
+                      .arg(language.isEmpty() ? "(unnamed rules)" : language)
+                      .arg(total / 1e6, 0, 'f', 2);
+
+        for (qsizetype i = 0; i < rules.size() && i < limit; ++i)
+        {
+            const RuleStats &stats = rules[i];
+            const double share     = total > 0 ? 100.0 * stats.nanoseconds / total : 0.0;
+            const double mbPerSec  = stats.nanoseconds > 0 ? stats.bytes * 1e3 / stats.nanoseconds : 0.0;
+
+            report += QString("  %1 ms %2% %3 matches %4 MB/s  %5\n")
+                          .arg(stats.nanoseconds / 1e6, 9, 'f', 2)
+                          .arg(share, 5, 'f', 1)
+                          .arg(stats.matches, 9)
+                          .arg(mbPerSec, 8, 'f', 1)
+                          .arg(stats.rule >= 0 ? QString("#%1 %2").arg(stats.rule).arg(stats.label) : stats.label);
+        }
+    }
+
+    if (report.isEmpty())
+    {
+        report = "No highlighting samples recorded.\n";
+    }
+
+    return report;
+}
+
+void SyntaxProfiler::dump() const
+{
+    qDebug().noquote() << "[SyntaxProfiler] Slowest highlighting rules per language:\n" + report();
+}
+
+void SyntaxProfiler::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_stats.clear();
+}
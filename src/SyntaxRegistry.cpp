@@ -0,0 +1,259 @@
+#include "SyntaxRegistry.h"
+#include "SyntaxPrefilter.h"
+#include "SyntaxLexer.h"
+#include "BundledSyntax.h"
+
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <QColor>
+#include <algorithm>
+
+SyntaxRegistry::SyntaxRegistry()
+{
+    connect(&m_watcher, &QFileSystemWatcher::directoryChanged, this, &SyntaxRegistry::invalidate);
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &SyntaxRegistry::invalidate);
+}
+
+QString SyntaxRegistry::syntaxDirectory()
+{
+    if (qEnvironmentVariableIsSet("CONFIG_DIR"))
+    {
+        return qEnvironmentVariable("CONFIG_DIR");
+    }
+
+    QString userSyntaxDir = QDir::homePath() + "/.config/codeastra/syntax";
+    if (QDir(userSyntaxDir).exists())
+    {
+        return userSyntaxDir;
+    }
+
+    return "config";
+}
+
+std::shared_ptr<const SyntaxDefinition> SyntaxRegistry::definitionForExtension(const QString &extension)
+{
+    ensureLoaded();
+
+    const QString key = extension.toLower();
+    auto definition   = m_definitions.constFind(key);
+    if (definition != m_definitions.constEnd())
+    {
+        return definition.value();
+    }
+
+    return bundledDefinition(key);
+}
+
+std::shared_ptr<const SyntaxDefinition> SyntaxRegistry::bundledDefinition(const QString &extension)
+{
+    // Built on first use: languages that are never opened cost nothing
+    for (const BundledSyntax &bundled : bundledSyntaxDefinitions())
+    {
+        const char *const *end = bundled.extensions + bundled.extensionCount;
+        if (std::find_if(bundled.extensions, end, [&extension](const char *ext)
+        {
+            return extension.compare(QLatin1String(ext), Qt::CaseInsensitive) == 0;
+        }) == end)
+        {
+            continue;
+        }
+
+        auto definition  = std::make_shared<SyntaxDefinition>();
+        definition->name = QString::fromUtf8(bundled.name);
+        for (std::size_t i = 0; i < bundled.extensionCount; ++i)
+        {
+            definition->extensions << QString::fromUtf8(bundled.extensions[i]).toLower();
+        }
+
+        for (std::size_t i = 0; i < bundled.ruleCount; ++i)
+        {
+            const BundledRule &rule = bundled.rules[i];
+            const QColor color(QString::fromUtf8(rule.color));
+            if (!color.isValid())
+            {
+                qWarning() << "[SyntaxRegistry] Invalid color in bundled" << bundled.name << ": Skipping...";
+                continue;
+            }
+
+            definition->rules.append(Syntax::compileRule(QString::fromUtf8(rule.regex),
+                                                         Syntax::makeFormat(color, rule.bold, rule.italic),
+                                                         rule.priority));
+        }
+
+        for (std::size_t i = 0; i < bundled.regionCount; ++i)
+        {
+            const BundledRegion &rule = bundled.regions[i];
+            const QColor color(QString::fromUtf8(rule.color));
+            Syntax::RegionRule region;
+            if (color.isValid()
+                && Syntax::compileRegion(QString::fromUtf8(rule.begin), QString::fromUtf8(rule.end),
+                                         Syntax::makeFormat(color, rule.bold, rule.italic), region))
+            {
+                definition->regions.append(region);
+            }
+        }
+
+        definition->prefilter = std::make_shared<SyntaxPrefilter>(definition->rules);
+        if (bundled.lexer)
+        {
+            definition->lexer = std::make_shared<SyntaxLexer>(definition->rules);
+        }
+
+        // User files keep the extensions they claim
+        std::shared_ptr<const SyntaxDefinition> shared = std::move(definition);
+        for (const QString &ext : shared->extensions)
+        {
+            if (!m_definitions.contains(ext))
+            {
+                m_definitions.insert(ext, shared);
+            }
+        }
+
+        return m_definitions.value(extension);
+    }
+
+    return nullptr;
+}
+
+void SyntaxRegistry::invalidate()
+{
+    if (!m_loaded)
+    {
+        return;
+    }
+
+#ifdef DEBUG
+    qDebug() << "[SyntaxRegistry] Syntax directory changed, dropping cached definitions.";
+#endif
+
+    m_definitions.clear();
+    m_loaded = false;
+    emit definitionsChanged();
+}
+
+void SyntaxRegistry::ensureLoaded()
+{
+    // CONFIG_DIR may be changed at runtime, so the cache is keyed by directory
+    QString directory = syntaxDirectory();
+    if (m_loaded && directory == m_loadedDirectory)
+    {
+        return;
+    }
+
+    loadDirectory(directory);
+}
+
+void SyntaxRegistry::loadDirectory(const QString &directory)
+{
+    m_definitions.clear();
+    m_loadedDirectory = directory;
+    m_loaded          = true;
+
+#ifdef DEBUG
+    qDebug() << "[SyntaxRegistry] Loading syntax definitions from:" << directory;
+#endif
+
+    QDir syntaxDir(directory);
+    QStringList yamlFiles = syntaxDir.entryList({"*.yaml", "*.yml"}, QDir::Files);
+
+    // Unmodified copies of the bundled files are served from the static tables
+    QHash<QString, std::uint64_t> bundledHashes;
+    for (const BundledSyntax &bundled : bundledSyntaxDefinitions())
+    {
+        bundledHashes.insert(QString::fromUtf8(bundled.name), bundled.hash);
+    }
+
+    for (const QString &fileName : yamlFiles)
+    {
+        QFile file(syntaxDir.filePath(fileName));
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning() << "[SyntaxRegistry] Failed to open syntax config:" << file.fileName();
+            continue;
+        }
+
+        // Copies of an earlier version too: they were never edited, only not refreshed yet
+        const QByteArray content = file.readAll();
+        const std::uint64_t hash = bundledSyntaxHash(content.constData(), static_cast<std::size_t>(content.size()));
+        auto bundledHash         = bundledHashes.constFind(fileName);
+        if (bundledHash != bundledHashes.constEnd()
+            && (bundledHash.value() == hash || isPreviousBundledSyntax(fileName.toStdString(), hash)))
+        {
+            continue;
+        }
+
+        // Files are reloaded as they are saved, so a half-edited one must fail here, whichever step throws
+        std::shared_ptr<const SyntaxDefinition> shared;
+        try
+        {
+            const YAML::Node config = YAML::Load(content.toStdString());
+            if (!config["extensions"])
+            {
+                qDebug() << "[SyntaxRegistry] No extensions key in YAML config:" << fileName;
+                continue;
+            }
+
+            auto definition       = std::make_shared<SyntaxDefinition>();
+            definition->name      = fileName;
+            definition->rules     = Syntax::parseSyntaxRules(config);
+            definition->regions   = Syntax::parseRegionRules(config);
+            definition->prefilter = std::make_shared<SyntaxPrefilter>(definition->rules);
+            if (Syntax::usesLexer(config))
+            {
+                definition->lexer = std::make_shared<SyntaxLexer>(definition->rules);
+                for (const SyntaxLexer::Fallback &fallback : definition->lexer->fallbackRules())
+                {
+                    qDebug() << "[SyntaxRegistry]" << fileName << "rule" << fallback.rule
+                             << "falls back to the regex path:" << fallback.reason;
+                }
+            }
+            for (const auto &ext : config["extensions"])
+            {
+                definition->extensions << QString::fromStdString(ext.as<std::string>()).toLower();
+            }
+            shared = std::move(definition);
+        }
+        catch (const YAML::Exception &e)
+        {
+            qWarning() << "[SyntaxRegistry] Failed to load" << fileName << ":" << e.what();
+            continue;
+        }
+
+        for (const QString &ext : shared->extensions)
+        {
+            // First file in directory order wins; user files override the bundled ones
+            if (!m_definitions.contains(ext))
+            {
+                m_definitions.insert(ext, shared);
+            }
+        }
+    }
+
+    watch(directory, yamlFiles);
+}
+
+void SyntaxRegistry::watch(const QString &directory, const QStringList &files)
+{
+    if (!m_watcher.files().isEmpty())
+    {
+        m_watcher.removePaths(m_watcher.files());
+    }
+    if (!m_watcher.directories().isEmpty())
+    {
+        m_watcher.removePaths(m_watcher.directories());
+    }
+
+    if (!QDir(directory).exists())
+    {
+        return;
+    }
+
+    QDir dir(directory);
+    QStringList paths{dir.absolutePath()};
+    for (const QString &fileName : files)
+    {
+        paths << dir.absoluteFilePath(fileName);
+    }
+    m_watcher.addPaths(paths);
+}
@@ -0,0 +1,334 @@
+#include "TextFormat.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXT_FORMAT_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    struct LineEndingCounts
+    {
+        qsizetype lf   = 0; // Every '\n', "\r\n" included
+        qsizetype cr   = 0; // Every '\r', "\r\n" included
+        qsizetype crlf = 0;
+    };
+
+    // Counts in 8-bit text, 16 bytes at a time
+    LineEndingCounts countLineEndings(QByteArrayView bytes)
+    {
+        LineEndingCounts counts;
+        const char *data     = bytes.data();
+        const qsizetype size = bytes.size();
+        qsizetype i          = 0;
+        bool previousReturn  = false;
+
+#ifdef TEXT_FORMAT_SSE2
+        const __m128i returns  = _mm_set1_epi8('\r');
+        const __m128i newlines = _mm_set1_epi8('\n');
+        for (; i + 16 <= size; i += 16)
+        {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            const quint32 cr    = static_cast<quint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, returns)));
+            const quint32 lf    = static_cast<quint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newlines)));
+            if ((cr | lf) == 0)
+            {
+                previousReturn = false;
+                continue;
+            }
+
+            // A '\n' whose previous byte, possibly in the previous chunk, is a '\r'
+            const quint32 crBefore = (cr << 1) | (previousReturn ? 1u : 0u);
+            counts.cr += std::popcount(cr);
+            counts.lf += std::popcount(lf);
+            counts.crlf += std::popcount(crBefore & lf);
+            previousReturn = (cr & 0x8000u) != 0;
+        }
+#endif
+
+        for (; i < size; ++i)
+        {
+            const char c = data[i];
+            if (c == '\r')
+            {
+                ++counts.cr;
+            }
+            else if (c == '\n')
+            {
+                ++counts.lf;
+                if (previousReturn)
+                {
+                    ++counts.crlf;
+                }
+            }
+            previousReturn = c == '\r';
+        }
+        return counts;
+    }
+
+    LineEndingCounts countLineEndings(const QString &text)
+    {
+        LineEndingCounts counts;
+        for (qsizetype i = 0; i < text.size(); ++i)
+        {
+            if (text[i] == u'\r')
+            {
+                ++counts.cr;
+            }
+            else if (text[i] == u'\n')
+            {
+                ++counts.lf;
+                if (i > 0 && text[i - 1] == u'\r')
+                {
+                    ++counts.crlf;
+                }
+            }
+        }
+        return counts;
+    }
+
+    TextFormat::LineEnding dominantLineEnding(const LineEndingCounts &counts)
+    {
+        const qsizetype lf = counts.lf - counts.crlf;
+        const qsizetype cr = counts.cr - counts.crlf;
+        if (counts.crlf > lf && counts.crlf >= cr)
+        {
+            return TextFormat::LineEnding::CRLF;
+        }
+        if (cr > lf)
+        {
+            return TextFormat::LineEnding::CR;
+        }
+        return TextFormat::LineEnding::LF;
+    }
+
+    // UTF-16 without BOM: mostly ASCII text has a NUL in every other byte
+    bool looksLikeUtf16(QByteArrayView sample, bool &littleEndian)
+    {
+        const qsizetype size = std::min<qsizetype>(sample.size(), 4096) & ~qsizetype(1);
+        if (size < 4)
+        {
+            return false;
+        }
+
+        qsizetype evenZeros = 0;
+        qsizetype oddZeros  = 0;
+        for (qsizetype i = 0; i < size; i += 2)
+        {
+            evenZeros += sample[i] == 0;
+            oddZeros += sample[i + 1] == 0;
+        }
+
+        const qsizetype units = size / 2;
+        if (oddZeros * 10 >= units * 4 && evenZeros * 10 < units)
+        {
+            littleEndian = true;
+            return true;
+        }
+        if (evenZeros * 10 >= units * 4 && oddZeros * 10 < units)
+        {
+            littleEndian = false;
+            return true;
+        }
+        return false;
+    }
+}
+
+bool TextFormat::isAscii(QByteArrayView bytes)
+{
+    const char *data     = bytes.data();
+    const qsizetype size = bytes.size();
+    qsizetype i          = 0;
+
+#ifdef TEXT_FORMAT_SSE2
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m128i first  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(first, second)) != 0)
+        {
+            return false;
+        }
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+        if (static_cast<uchar>(data[i]) >= 0x80)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TextFormat::isValidUtf8Prefix(QByteArrayView bytes)
+{
+    const uchar *data    = reinterpret_cast<const uchar *>(bytes.data());
+    const qsizetype size = bytes.size();
+    qsizetype i          = 0;
+
+    while (i < size)
+    {
+        // ASCII runs are skipped 32 bytes at a time
+        if (data[i] < 0x80)
+        {
+            while (i + 32 <= size && isAscii(QByteArrayView(data + i, 32)))
+            {
+                i += 32;
+            }
+            while (i < size && data[i] < 0x80)
+            {
+                ++i;
+            }
+            continue;
+        }
+
+        qsizetype length = 0;
+        uchar low        = 0x80;
+        uchar high       = 0xBF;
+        const uchar lead = data[i];
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            length = 2;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            length = 3;
+            low    = lead == 0xE0 ? 0xA0 : 0x80; // Overlong
+            high   = lead == 0xED ? 0x9F : 0xBF; // Surrogates
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            length = 4;
+            low    = lead == 0xF0 ? 0x90 : 0x80; // Overlong
+            high   = lead == 0xF4 ? 0x8F : 0xBF; // Above U+10FFFF
+        }
+        else
+        {
+            return false;
+        }
+
+        for (qsizetype k = 1; k < length; ++k)
+        {
+            if (i + k >= size)
+            {
+                return true; // Cut by the end of the sample
+            }
+            const uchar next = data[i + k];
+            if (next < (k == 1 ? low : 0x80) || next > (k == 1 ? high : 0xBF))
+            {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+TextFormat TextFormat::detect(QByteArrayView sample)
+{
+    TextFormat format;
+    QByteArrayView text = sample;
+
+    if (sample.startsWith("\xEF\xBB\xBF"))
+    {
+        format.bom = true;
+        text       = sample.sliced(3);
+    }
+    else if (sample.startsWith("\xFF\xFE"))
+    {
+        format.encoding = QStringConverter::Utf16LE;
+        format.bom      = true;
+        text            = sample.sliced(2);
+    }
+    else if (sample.startsWith("\xFE\xFF"))
+    {
+        format.encoding = QStringConverter::Utf16BE;
+        format.bom      = true;
+        text            = sample.sliced(2);
+    }
+    else
+    {
+        bool littleEndian = true;
+        if (looksLikeUtf16(sample, littleEndian))
+        {
+            format.encoding = littleEndian ? QStringConverter::Utf16LE : QStringConverter::Utf16BE;
+        }
+        else if (!isAscii(sample) && !isValidUtf8Prefix(sample))
+        {
+            format.encoding = QStringConverter::Latin1;
+        }
+    }
+
+    if (format.encoding == QStringConverter::Utf16LE || format.encoding == QStringConverter::Utf16BE)
+    {
+        QStringDecoder decoder(format.encoding, QStringDecoder::Flag::Stateless);
+        format.lineEnding = dominantLineEnding(countLineEndings(QString(decoder(text))));
+    }
+    else
+    {
+        format.lineEnding = dominantLineEnding(countLineEndings(text));
+    }
+    return format;
+}
+
+QByteArray TextFormat::encode(const QString &text, bool *lossless) const
+{
+    QString converted;
+    const QString *source = &text;
+    if (lineEnding == LineEnding::CRLF)
+    {
+        converted = QString(text).replace(u'\n', QStringLiteral("\r\n"));
+        source    = &converted;
+    }
+    else if (lineEnding == LineEnding::CR)
+    {
+        converted = QString(text).replace(u'\n', u'\r');
+        source    = &converted;
+    }
+
+    // The common case needs no encoder state
+    if (encoding == QStringConverter::Utf8 && !bom)
+    {
+        if (lossless)
+        {
+            *lossless = true;
+        }
+        return source->toUtf8();
+    }
+
+    QStringEncoder encoder(encoding, bom ? QStringEncoder::Flag::WriteBom : QStringEncoder::Flag::Default);
+    QByteArray bytes = encoder.encode(*source);
+    if (lossless)
+    {
+        *lossless = !encoder.hasError();
+    }
+    return bytes;
+}
+
+QString TextFormat::name() const
+{
+    QString encodingName = QStringConverter::nameForEncoding(encoding);
+    if (encoding == QStringConverter::Latin1)
+    {
+        encodingName = "Latin-1";
+    }
+    if (bom)
+    {
+        encodingName += " BOM";
+    }
+
+    switch (lineEnding)
+    {
+    case LineEnding::CRLF:
+        return encodingName + ", CRLF";
+    case LineEnding::CR:
+        return encodingName + ", CR";
+    default:
+        return encodingName + ", LF";
+    }
+}
@@ -1,9 +1,12 @@
 #include "Tree.h"
 #include "CodeEditor.h"
+#include "CopyJob.h"
+#include "BatchJob.h"
+#include "FileTreeModel.h"
+#include "PathIndex.h"
 
 #include <QFileDialog>
 #include <QFileInfo>
-#include <QFileSystemModel>
 #include <QFileIconProvider>
 #include <QTreeView>
 #include <QMenu>
@@ -13,11 +16,14 @@
 #include <QApplication>
 #include <QHeaderView>
 #include <QMimeData>
+#include <QProgressDialog>
+#include <QLocale>
 
 Tree::Tree(QSplitter *splitter)
     : QObject(splitter),
       m_iconProvider(std::make_unique<QFileIconProvider>()),
-      m_model(std::make_unique<QFileSystemModel>()),
+      m_model(std::make_unique<FileTreeModel>()),
+      m_pathIndex(std::make_unique<PathIndex>()),
       m_tree(std::make_unique<QTreeView>(splitter))
 {
     connect(m_tree.get(), &QTreeView::clicked, this, &Tree::openFile);
@@ -33,10 +39,14 @@ void Tree::initialize(const QString &directory)
 
 void Tree::setupModel(const QString &directory)
 {
+    // Set first, so that ignored directories are never read
+    const IgnoreRules excludes = IgnoreRules::userExcludes();
+    m_model->setExcludes(excludes);
     m_model->setRootPath(directory);
     m_model->setIconProvider(m_iconProvider.get());
-    m_model->setFilter(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot);
-    m_model->setReadOnly(false);
+
+    m_pathIndex->setExcludes(excludes);
+    m_pathIndex->setRootPath(directory);
 }
 
 void Tree::setupTree()
@@ -63,11 +73,9 @@ void Tree::setupTree()
     m_tree->setDropIndicatorShown(true);
     m_tree->setDefaultDropAction(Qt::MoveAction);
     m_tree->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_tree->setSelectionMode(QAbstractItemView::ExtendedSelection);
 
-    for (int i = 1; i <= m_model->columnCount(); ++i)
-    {
-        m_tree->setColumnHidden(i, true);
-    }
+    hideDetailColumns();
 
     m_tree->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(m_tree.get(), &QTreeView::customContextMenuRequested, this, &Tree::showContextMenu);
@@ -116,31 +124,34 @@ void Tree::openFile(const QModelIndex &index)
         return;
     }
 
-    FileManager &fm = FileManager::getInstance();
-    if (fm.getCurrentFileName() != filePath)
-    {
-        if (!fm.promptUnsavedChanges())
-        {
-            return; // if user has cancelled
-        }
-
-        fm.setCurrentFileName(filePath);
-        fm.loadFileInEditor(filePath);
-    }
+    // Recently used files are swapped back in from the document cache
+    FileManager::getInstance().switchToFile(filePath);
 }
 
-QFileSystemModel *Tree::getModel() const
+FileTreeModel *Tree::getModel() const
 {
     if (!m_model)
         throw std::runtime_error("Tree model is not initialized!");
     return m_model.get();
 }
 
+PathIndex *Tree::pathIndex() const
+{
+    return m_pathIndex.get();
+}
+
 // Context menu for file operations
 // such as creating new files, folders, renaming, and deleting
 // This function is called when the user right-clicks on the tree view
 void Tree::showContextMenu(const QPoint &pos)
 {
+    const QStringList selection = selectedPaths();
+    if (selection.size() > 1)
+    {
+        showBatchContextMenu(pos, selection);
+        return;
+    }
+
     QMenu contextMenu;
 
     QAction *newFileAction   = contextMenu.addAction("New File");
@@ -148,8 +159,13 @@ void Tree::showContextMenu(const QPoint &pos)
     contextMenu.addSeparator();
     QAction *renameAction    = contextMenu.addAction("Rename");
     QAction *duplicateAction = contextMenu.addAction("Duplicate");
+    QAction *moveAction      = contextMenu.addAction("Move To...");
     contextMenu.addSeparator();
     QAction *deleteAction    = contextMenu.addAction("Delete");
+    contextMenu.addSeparator();
+    QAction *showIgnoredAction = contextMenu.addAction("Show Ignored Files");
+    showIgnoredAction->setCheckable(true);
+    showIgnoredAction->setChecked(m_model->showIgnored());
 
     QAction *selectedAction = contextMenu.exec(m_tree->viewport()->mapToGlobal(pos));
 
@@ -212,8 +228,18 @@ void Tree::showContextMenu(const QPoint &pos)
             return;
         }
 
-        OperationResult result = FileManager::getInstance().duplicatePath(pathInfo);
-        isSuccessful(result);
+        duplicatePath(pathInfo);
+    }
+    else if (selectedAction == showIgnoredAction)
+    {
+        m_model->setShowIgnored(showIgnoredAction->isChecked());
+    }
+    else if (selectedAction == moveAction)
+    {
+        if (!selection.isEmpty())
+        {
+            moveToFolder(selection);
+        }
     }
     else if (selectedAction == renameAction)
     {
@@ -274,6 +300,141 @@ QFileInfo Tree::getPathInfo()
     return QFileInfo(m_model->filePath(index));
 }
 
+QStringList Tree::selectedPaths() const
+{
+    QStringList paths;
+    const QModelIndexList rows = m_tree->selectionModel() ? m_tree->selectionModel()->selectedRows(0) : QModelIndexList();
+    for (const QModelIndex &index : rows)
+    {
+        paths << m_model->filePath(index);
+    }
+
+    if (paths.isEmpty() && m_tree->currentIndex().isValid())
+    {
+        paths << m_model->filePath(m_tree->currentIndex());
+    }
+
+    return paths;
+}
+
+void Tree::showBatchContextMenu(const QPoint &pos, const QStringList &paths)
+{
+    QMenu contextMenu;
+
+    const QString count      = QString::number(paths.size());
+    QAction *duplicateAction = contextMenu.addAction("Duplicate " + count + " Items");
+    QAction *moveAction      = contextMenu.addAction("Move " + count + " Items To...");
+    contextMenu.addSeparator();
+    QAction *deleteAction    = contextMenu.addAction("Delete " + count + " Items");
+
+    QAction *selectedAction = contextMenu.exec(m_tree->viewport()->mapToGlobal(pos));
+
+    if (selectedAction == duplicateAction)
+    {
+        runBatch(new BatchJob(BatchJob::Operation::Duplicate, paths, QString(), this));
+    }
+    else if (selectedAction == moveAction)
+    {
+        moveToFolder(paths);
+    }
+    else if (selectedAction == deleteAction)
+    {
+        QMessageBox::StandardButton reply = QMessageBox::question(nullptr, "Confirm Deletion",
+                                                                  "Are you sure you want to delete these " + count + " items?",
+                                                                  QMessageBox::Yes | QMessageBox::No);
+        if (reply == QMessageBox::No)
+        {
+            qInfo() << "Deletion cancelled.";
+        }
+        else
+        {
+            runBatch(new BatchJob(BatchJob::Operation::Delete, paths, QString(), this));
+        }
+    }
+}
+
+void Tree::moveToFolder(const QStringList &paths)
+{
+    const QString destination = QFileDialog::getExistingDirectory(nullptr, "Move To", m_model->rootPath());
+    if (!destination.isEmpty())
+    {
+        runBatch(new BatchJob(BatchJob::Operation::Move, paths, destination, this));
+    }
+}
+
+void Tree::runBatch(BatchJob *job)
+{
+    // The model would otherwise update each directory several times while the batch
+    // runs; the view stays live, and every change is applied once at the end
+    m_model->suspendChanges();
+
+    QProgressDialog *dialog = new QProgressDialog("Processing " + QString::number(job->paths().size()) + " items...", "Cancel",
+                                                  0, static_cast<int>(job->paths().size()), m_tree.get());
+    dialog->setMinimumDuration(500);
+    dialog->setAutoReset(false);
+    dialog->setAutoClose(false);
+    dialog->setValue(0);
+
+    connect(dialog, &QProgressDialog::canceled, job, &BatchJob::cancel);
+    connect(job, &BatchJob::progress, dialog, &QProgressDialog::setValue);
+    connect(job, &BatchJob::finished, this, [this, job, dialog](bool success, const QString &message)
+    {
+        dialog->deleteLater();
+        job->deleteLater();
+        m_model->resumeChanges();
+
+        isSuccessful({success, message.toStdString()});
+    });
+
+    job->start();
+}
+
+void Tree::hideDetailColumns()
+{
+    for (int i = 1; i <= m_model->columnCount(); ++i)
+    {
+        m_tree->setColumnHidden(i, true);
+    }
+}
+
+void Tree::duplicatePath(const QFileInfo &pathInfo)
+{
+    CopyJob *job = FileManager::duplicatePathAsync(pathInfo, this);
+    if (!job)
+    {
+        isSuccessful({false, "ERROR: invalid path."});
+        return;
+    }
+
+    // Only shows up when the copy lasts, and is not modal: the editor stays usable
+    QProgressDialog *dialog = new QProgressDialog("Duplicating " + pathInfo.fileName() + "...", "Cancel", 0, 1000, m_tree.get());
+    dialog->setMinimumDuration(500);
+    dialog->setAutoReset(false);
+    dialog->setAutoClose(false);
+    dialog->setValue(0);
+
+    connect(dialog, &QProgressDialog::canceled, job, &CopyJob::cancel);
+    connect(job, &CopyJob::progress, dialog, [dialog, pathInfo](qint64 copiedBytes, qint64 totalBytes)
+    {
+        dialog->setLabelText(QString("Duplicating %1... %2 copied")
+                                 .arg(pathInfo.fileName(), QLocale().formattedDataSize(copiedBytes)));
+        dialog->setValue(totalBytes > 0 ? static_cast<int>(copiedBytes * 1000 / totalBytes) : 0);
+    });
+    connect(job, &CopyJob::finished, this, [this, job, dialog](bool success, const QString &message)
+    {
+        dialog->deleteLater();
+        job->deleteLater();
+
+        // A copy that completed before the cancel went through is kept
+        if (!success && job->isCancelled())
+        {
+            qInfo() << message;
+            return;
+        }
+        isSuccessful({success, message.toStdString()});
+    });
+}
+
 void Tree::isSuccessful(OperationResult result)
 {
     if (result.success)
@@ -0,0 +1,1791 @@
+#include "TrigramIndex.h"
+#include "DirectoryWatcher.h"
+#include "ProjectSearch.h"
+#include "TextFormat.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QStringDecoder>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <limits>
+
+namespace
+{
+    constexpr quint32 Magic      = 0x49525443; // "CTRI"
+    constexpr quint32 Version    = 1;
+    constexpr quint32 NoFile     = 0xffffffff;
+    constexpr quint32 AnyTrigram = 0xffffffff; // Lists the files that are not indexed
+    constexpr int WriteChunk     = 1024 * 1024;
+
+    // A segment is a Header, a FileEntry per file, their paths back to back,
+    // the postings of each trigram, then a TrigramEntry per trigram
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        quint32 fileCount;
+        quint32 trigramCount;
+        quint64 namesOffset;
+        quint64 postingsOffset;
+        quint64 trigramsOffset;
+    };
+
+    struct FileEntry
+    {
+        quint32 nameOffset; // From namesOffset
+        quint32 nameLength;
+        quint32 flags;
+        quint32 reserved;
+        qint64 size;
+        qint64 modified;
+    };
+
+    struct TrigramEntry
+    {
+        quint32 trigram;
+        quint32 count;
+        quint64 offset; // From postingsOffset
+    };
+
+    static_assert(sizeof(Header) == 40 && sizeof(FileEntry) == 32 && sizeof(TrigramEntry) == 16);
+
+    inline uchar foldByte(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<uchar>(c - 'A' + 'a') : static_cast<uchar>(c);
+    }
+
+    int comparePaths(QByteArrayView left, QByteArrayView right)
+    {
+        const qsizetype length = std::min(left.size(), right.size());
+        const int order        = length > 0 ? std::memcmp(left.data(), right.data(), static_cast<std::size_t>(length)) : 0;
+        if (order != 0)
+        {
+            return order;
+        }
+        return left.size() < right.size() ? -1 : (left.size() > right.size() ? 1 : 0);
+    }
+
+    bool startsWith(QByteArrayView path, QByteArrayView prefix)
+    {
+        return path.size() >= prefix.size() && comparePaths(path.first(prefix.size()), prefix) == 0;
+    }
+
+    void appendVarint(QByteArray &out, quint32 value)
+    {
+        while (value >= 0x80)
+        {
+            out.append(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.append(static_cast<char>(value));
+    }
+
+    // File numbers stored as gaps from the previous one; false when data ends first
+    bool decodePostings(const uchar *data, const uchar *end, quint32 count, std::vector<quint32> &ids)
+    {
+        ids.resize(count);
+        quint32 id = 0;
+        for (quint32 i = 0; i < count; ++i)
+        {
+            quint32 gap = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                if (data == end || shift > 28)
+                {
+                    return false;
+                }
+                const uchar byte = *data++;
+                gap |= static_cast<quint32>(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                {
+                    break;
+                }
+            }
+            id += gap;
+            ids[i] = id;
+        }
+        return true;
+    }
+
+    QString joinPath(const QString &directory, const QString &name)
+    {
+        if (directory.isEmpty() || name.isEmpty())
+        {
+            return directory.isEmpty() ? name : directory;
+        }
+        return directory.endsWith('/') ? directory + name : directory + '/' + name;
+    }
+}
+
+struct TrigramIndex::Segment
+{
+    QFile file; // Mapped while open
+    const Header *header         = nullptr;
+    const FileEntry *files       = nullptr;
+    const char *names            = nullptr;
+    quint64 namesSize            = 0;
+    const uchar *postings        = nullptr;
+    quint64 postingsSize         = 0;
+    const TrigramEntry *trigrams = nullptr;
+
+    // Set by the first read that finds the segment damaged; the index is then rebuilt
+    mutable std::atomic<bool> damaged = false;
+
+    static std::shared_ptr<const Segment> open(const QString &path);
+
+    // Reads every path and posting, so that damage is found before the segment is used
+    bool verify() const;
+
+    QByteArrayView name(quint32 id) const
+    {
+        const FileEntry &entry = files[id];
+        if (quint64(entry.nameOffset) + entry.nameLength > namesSize)
+        {
+            damaged = true;
+            return {};
+        }
+        return QByteArrayView(names + entry.nameOffset, entry.nameLength);
+    }
+
+    const TrigramEntry *find(quint32 trigram) const
+    {
+        const TrigramEntry *end = trigrams + header->trigramCount;
+        const TrigramEntry *it  = std::lower_bound(trigrams, end, trigram, [](const TrigramEntry &entry, quint32 value)
+        {
+            return entry.trigram < value;
+        });
+        return it != end && it->trigram == trigram ? it : nullptr;
+    }
+
+    // Postings of a trigram, empty when the segment is damaged
+    std::vector<quint32> postingsOf(const TrigramEntry *entry) const
+    {
+        std::vector<quint32> ids;
+        const quint64 end = entry + 1 < trigrams + header->trigramCount ? entry[1].offset : postingsSize;
+        if (entry->offset > end || end > postingsSize
+            || !decodePostings(postings + entry->offset, postings + end, entry->count, ids))
+        {
+            damaged = true;
+            ids.clear();
+        }
+        return ids;
+    }
+};
+
+bool TrigramIndex::Segment::verify() const
+{
+    // Lookups bisect the paths and the trigrams, which must be in order
+    for (quint32 id = 0; id < header->fileCount && !damaged; ++id)
+    {
+        const QByteArrayView path = name(id);
+        if (id > 0 && !damaged && comparePaths(name(id - 1), path) >= 0)
+        {
+            damaged = true;
+        }
+    }
+
+    std::vector<quint32> ids;
+    for (quint32 i = 0; i < header->trigramCount && !damaged; ++i)
+    {
+        if (i > 0 && trigrams[i - 1].trigram >= trigrams[i].trigram)
+        {
+            damaged = true;
+            break;
+        }
+        ids = postingsOf(trigrams + i);
+        const quint32 fileCount = header->fileCount;
+        if (std::any_of(ids.cbegin(), ids.cend(), [fileCount](quint32 id) { return id >= fileCount; }))
+        {
+            damaged = true;
+        }
+    }
+    return !damaged;
+}
+
+std::shared_ptr<const TrigramIndex::Segment> TrigramIndex::Segment::open(const QString &path)
+{
+    auto segment = std::make_shared<Segment>();
+    segment->file.setFileName(path);
+    if (!segment->file.open(QIODevice::ReadOnly))
+    {
+        return nullptr;
+    }
+
+    const qint64 size = segment->file.size();
+    if (size < static_cast<qint64>(sizeof(Header)))
+    {
+        return nullptr;
+    }
+
+    // Unmapped when the file is closed
+    const uchar *data = segment->file.map(0, size);
+    if (!data)
+    {
+        return nullptr;
+    }
+
+    const auto *header = reinterpret_cast<const Header *>(data);
+    const quint64 end  = static_cast<quint64>(size);
+    if (header->magic != Magic || header->version != Version
+        || sizeof(Header) + quint64(header->fileCount) * sizeof(FileEntry) > header->namesOffset
+        || header->namesOffset > header->postingsOffset || header->postingsOffset > header->trigramsOffset
+        || header->trigramsOffset % alignof(TrigramEntry) != 0
+        || header->trigramsOffset + quint64(header->trigramCount) * sizeof(TrigramEntry) != end)
+    {
+        return nullptr;
+    }
+
+    segment->header       = header;
+    segment->files        = reinterpret_cast<const FileEntry *>(data + sizeof(Header));
+    segment->names        = reinterpret_cast<const char *>(data + header->namesOffset);
+    segment->namesSize    = header->postingsOffset - header->namesOffset;
+    segment->postings     = data + header->postingsOffset;
+    segment->postingsSize = header->trigramsOffset - header->postingsOffset;
+    segment->trigrams     = reinterpret_cast<const TrigramEntry *>(data + header->trigramsOffset);
+    return segment;
+}
+
+quint32 TrigramIndex::Layer::count() const
+{
+    return segment ? segment->header->fileCount : static_cast<quint32>(documents->size());
+}
+
+QByteArrayView TrigramIndex::Layer::path(quint32 id) const
+{
+    return segment ? segment->name(id) : QByteArrayView((*documents)[id].path);
+}
+
+bool TrigramIndex::Layer::isCurrent(quint32 id, qint64 size, qint64 modified) const
+{
+    if (segment)
+    {
+        return segment->files[id].size == size && segment->files[id].modified == modified;
+    }
+    const Document &document = (*documents)[id];
+    return document.size == size && document.modified == modified;
+}
+
+qint64 TrigramIndex::Layer::find(QByteArrayView path) const
+{
+    const auto [first, last] = range(path);
+    return first < last && comparePaths(this->path(first), path) == 0 ? qint64(first) : -1;
+}
+
+std::pair<quint32, quint32> TrigramIndex::Layer::range(QByteArrayView prefix) const
+{
+    // Paths are sorted, so those starting with prefix follow each other
+    quint32 low  = 0;
+    quint32 high = count();
+    while (low < high)
+    {
+        const quint32 middle = low + (high - low) / 2;
+        if (comparePaths(path(middle), prefix) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    const quint32 first = low;
+    high                = count();
+    while (low < high)
+    {
+        const quint32 middle = low + (high - low) / 2;
+        if (startsWith(path(middle), prefix))
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return {first, low};
+}
+
+std::vector<quint32> TrigramIndex::Layer::matching(const std::vector<quint32> &trigrams) const
+{
+    std::vector<quint32> ids;
+    if (segment)
+    {
+        // The rarest trigram first, so the intersection starts small
+        std::vector<const TrigramEntry *> entries;
+        for (const quint32 trigram : trigrams)
+        {
+            const TrigramEntry *entry = segment->find(trigram);
+            if (!entry)
+            {
+                entries.clear();
+                break;
+            }
+            entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end(), [](const TrigramEntry *left, const TrigramEntry *right)
+        {
+            return left->count < right->count;
+        });
+
+        if (!entries.empty())
+        {
+            ids = segment->postingsOf(entries.front());
+        }
+        std::vector<quint32> kept;
+        for (size_t i = 1; i < entries.size() && !ids.empty(); ++i)
+        {
+            const std::vector<quint32> other = segment->postingsOf(entries[i]);
+            kept.clear();
+            std::set_intersection(ids.begin(), ids.end(), other.begin(), other.end(), std::back_inserter(kept));
+            ids.swap(kept);
+        }
+
+        if (const TrigramEntry *unindexed = segment->find(AnyTrigram))
+        {
+            const std::vector<quint32> always = segment->postingsOf(unindexed);
+            ids.insert(ids.end(), always.begin(), always.end());
+        }
+    }
+    else
+    {
+        for (quint32 id = 0; id < documents->size(); ++id)
+        {
+            const Document &document = (*documents)[id];
+            if ((document.flags & Unindexed)
+                || (!(document.flags & Binary)
+                    && std::includes(document.trigrams.begin(), document.trigrams.end(), trigrams.begin(),
+                                     trigrams.end())))
+            {
+                ids.push_back(id);
+            }
+        }
+    }
+
+    const quint32 size = count();
+    std::erase_if(ids, [this, size](quint32 id) { return id >= size || removed[id]; });
+    return ids;
+}
+
+void TrigramIndex::Layer::remove(quint32 id)
+{
+    if (!removed[id])
+    {
+        removed[id] = 1;
+        ++removedCount;
+    }
+}
+
+TrigramIndex::TrigramIndex(QObject *parent)
+    : QObject(parent),
+      m_directory(defaultDirectory()),
+      m_cancelled(std::make_shared<std::atomic<bool>>(false))
+{
+    m_pool.setMaxThreadCount(std::clamp(QThread::idealThreadCount(), 2, MaxWorkers));
+
+    m_updateTimer.setSingleShot(true);
+    m_updateTimer.setInterval(UpdateInterval);
+    connect(&m_updateTimer, &QTimer::timeout, this, &TrigramIndex::flushChanges);
+
+    DirectoryWatcher &watcher = DirectoryWatcher::getInstance();
+    connect(&watcher, &DirectoryWatcher::entriesChanged, this, &TrigramIndex::onDirectoryChanged);
+    connect(&watcher, &DirectoryWatcher::fileWritten, this, &TrigramIndex::onFileWritten);
+    connect(&watcher, &DirectoryWatcher::overflowed, this, &TrigramIndex::onOverflowed);
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    // Workers call back into the index, which must outlive them
+    close();
+    m_pool.waitForDone();
+}
+
+QString TrigramIndex::defaultDirectory()
+{
+    return QDir::homePath() + "/.config/codeastra/index";
+}
+
+void TrigramIndex::setDirectory(const QString &directory)
+{
+    m_directory = directory;
+}
+
+QString TrigramIndex::directory() const
+{
+    return m_directory;
+}
+
+void TrigramIndex::setExcludes(const IgnoreRules &excludes)
+{
+    m_excludes.clear();
+    if (!excludes.isEmpty())
+    {
+        m_excludes.push_back(std::make_shared<const IgnoreRules>(excludes));
+    }
+}
+
+void TrigramIndex::setRootPath(const QString &path)
+{
+    close();
+    if (path.isEmpty())
+    {
+        return;
+    }
+
+    m_rootPath  = QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+    m_indexPath = indexPathOf(m_rootPath);
+    if (!QDir().mkpath(m_indexPath))
+    {
+        qWarning() << "[TrigramIndex] Cannot create" << m_indexPath << ", searches will read every file";
+        return;
+    }
+
+    // Two instances writing one index would remove each other's segments
+    m_lock = std::make_unique<QLockFile>(m_indexPath + "/lock");
+    if (!m_lock->tryLock())
+    {
+        qWarning() << "[TrigramIndex]" << m_indexPath << "is used by another instance, searches will read every file";
+        m_lock.reset();
+        return;
+    }
+
+    openSegments();
+
+    const int generation = m_generation;
+    m_pool.start([this, root = m_rootPath, excludes = m_excludes, layers = m_layers, generation,
+                  cancelled = m_cancelled]() mutable
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        std::vector<Listing> listings = list(root, {QString("")}, true, excludes, {}, *cancelled);
+        if (*cancelled)
+        {
+            return;
+        }
+
+        // Checked before reconcile() looks paths up in them; onScanned() rebuilds a damaged index
+        const bool isIntact = std::all_of(layers.cbegin(), layers.cend(), [](const Layer &layer)
+        {
+            return layer.segment->verify();
+        });
+        std::vector<QByteArray> changed = isIntact ? reconcile(layers, listings) : std::vector<QByteArray>();
+
+        qDebug() << "[TrigramIndex] Listed" << listings.size() << "directories of" << root << "in" << timer.elapsed()
+                 << "ms," << changed.size() << "files to read";
+
+        QMetaObject::invokeMethod(this, [this, generation, layers = std::move(layers), listings = std::move(listings),
+                                         changed = std::move(changed)]() mutable
+        {
+            if (generation == m_generation)
+            {
+                onScanned(std::move(layers), listings, changed);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+QString TrigramIndex::rootPath() const
+{
+    return m_rootPath;
+}
+
+void TrigramIndex::close()
+{
+    // Jobs of the project stop at the next file, and their results are dropped
+    *m_cancelled = true;
+    m_cancelled  = std::make_shared<std::atomic<bool>>(false);
+    ++m_generation;
+    m_pool.clear();
+
+    DirectoryWatcher::getInstance().unwatch(m_watched.values());
+    m_watched.clear();
+    m_changedDirectories.clear();
+    m_writtenFiles.clear();
+    m_updateTimer.stop();
+
+    m_layers.clear();
+    m_memory.clear();
+    m_memoryPostings = 0;
+    m_pending.clear();
+    m_reading.clear();
+    m_readJobs = 0;
+    m_directories.clear();
+    m_rules.clear();
+
+    m_ready        = false;
+    m_writing      = false;
+    m_caughtUp     = false;
+    m_nextSequence = 1;
+    m_lock.reset();
+    m_rootPath.clear();
+    m_indexPath.clear();
+}
+
+void TrigramIndex::removeIndex()
+{
+    const QString indexPath = m_indexPath;
+    close();
+
+    // Segments stay mapped until the jobs using them end
+    m_pool.waitForDone();
+    if (!indexPath.isEmpty() && !QDir(indexPath).removeRecursively())
+    {
+        qWarning() << "[TrigramIndex] Cannot remove" << indexPath;
+    }
+}
+
+bool TrigramIndex::hasIndex(const QString &path) const
+{
+    return !QDir(indexPathOf(path)).entryList({"*.seg"}, QDir::Files).isEmpty();
+}
+
+bool TrigramIndex::isReady() const
+{
+    return m_ready;
+}
+
+int TrigramIndex::fileCount() const
+{
+    qint64 count = static_cast<qint64>(m_memory.size());
+    for (const Layer &layer : m_layers)
+    {
+        count += static_cast<qint64>(layer.count()) - layer.removedCount;
+    }
+    return static_cast<int>(count);
+}
+
+int TrigramIndex::pendingCount() const
+{
+    return static_cast<int>(m_pending.size() + m_reading.size());
+}
+
+qint64 TrigramIndex::diskUsage() const
+{
+    qint64 bytes = 0;
+    for (const Layer &layer : m_layers)
+    {
+        if (layer.segment)
+        {
+            bytes += layer.segment->file.size();
+        }
+    }
+    return bytes;
+}
+
+std::optional<QStringList> TrigramIndex::candidates(const QByteArray &text) const
+{
+    if (!m_ready)
+    {
+        return std::nullopt;
+    }
+
+    const std::vector<quint32> trigrams = trigramsOf(text.constData(), text.size());
+    if (trigrams.empty())
+    {
+        return std::nullopt;
+    }
+
+    QStringList files;
+    for (const Layer &layer : m_layers)
+    {
+        for (const quint32 id : layer.matching(trigrams))
+        {
+            files << QString::fromUtf8(layer.path(id));
+        }
+    }
+
+    // Files of a damaged segment may be missing: every file is searched until the index is rebuilt
+    if (isDamaged())
+    {
+        QMetaObject::invokeMethod(const_cast<TrigramIndex *>(this),
+                                  [index = const_cast<TrigramIndex *>(this), generation = m_generation]()
+        {
+            if (generation == index->m_generation)
+            {
+                index->rebuild();
+            }
+        }, Qt::QueuedConnection);
+        return std::nullopt;
+    }
+
+    for (const auto &[path, document] : m_memory)
+    {
+        if ((document.flags & Unindexed)
+            || (!(document.flags & Binary)
+                && std::includes(document.trigrams.begin(), document.trigrams.end(), trigrams.begin(), trigrams.end())))
+        {
+            files << QString::fromUtf8(path);
+        }
+    }
+
+    // Not read yet, so any of them may hold text
+    for (const QByteArray &path : m_pending)
+    {
+        files << QString::fromUtf8(path);
+    }
+    for (const QByteArray &path : m_reading)
+    {
+        files << QString::fromUtf8(path);
+    }
+    return files;
+}
+
+std::vector<quint32> TrigramIndex::trigramsOf(const char *data, qsizetype size)
+{
+    std::vector<quint32> trigrams;
+    if (size < 3)
+    {
+        return trigrams;
+    }
+
+    // One bit per possible trigram, cleared again before returning
+    thread_local std::vector<quint64> seen(std::size_t(1) << 18);
+
+    qsizetype lineStart = 0;
+    quint32 window      = 0;
+    for (qsizetype i = 0; i < size; ++i)
+    {
+        const uchar c = foldByte(data[i]);
+        if (c == '\n' || c == '\r')
+        {
+            lineStart = i + 1;
+            continue;
+        }
+
+        window = ((window << 8) | c) & 0xffffff;
+        if (i - lineStart < 2)
+        {
+            continue;
+        }
+
+        quint64 &word     = seen[window >> 6];
+        const quint64 bit = quint64(1) << (window & 63);
+        if (!(word & bit))
+        {
+            word |= bit;
+            trigrams.push_back(window);
+        }
+    }
+
+    for (const quint32 trigram : trigrams)
+    {
+        seen[trigram >> 6] = 0;
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    return trigrams;
+}
+
+std::vector<TrigramIndex::Listing> TrigramIndex::list(const QString &root, const QStringList &directories,
+                                                      bool recursive, const RuleChain &excludes,
+                                                      const QHash<QString, std::shared_ptr<const IgnoreRules>> &rules,
+                                                      const std::atomic<bool> &cancelled)
+{
+    std::deque<std::pair<QString, RuleChain>> pending;
+    for (const QString &directory : directories)
+    {
+        pending.emplace_back(directory, IgnoreRules::rulesAbove(directory, excludes, rules));
+    }
+
+    std::vector<Listing> listings;
+    while (!pending.empty() && !cancelled)
+    {
+        auto [directory, chain] = std::move(pending.front());
+        pending.pop_front();
+
+        const QString path = joinPath(root, directory);
+        std::vector<DirectoryReader::Entry> entries = DirectoryReader::read(path);
+
+        // The ignore files of the directory apply to its own entries
+        Listing listing;
+        listing.directory = directory;
+        listing.rules     = IgnoreRules::readDirectory(path, directory, entries);
+        if (listing.rules)
+        {
+            chain.push_back(listing.rules);
+        }
+        IgnoreRules::markIgnored(entries, chain, directory, false);
+
+        for (const DirectoryReader::Entry &entry : entries)
+        {
+            if (!entry.isDirectory)
+            {
+                const QFileInfo info(joinPath(path, entry.name));
+                if (info.exists())
+                {
+                    listing.files.push_back({entry.name, info.size(), info.lastModified().toMSecsSinceEpoch()});
+                }
+            }
+            else if (!entry.isSymLink)
+            {
+                // Links to directories are not followed, which also keeps them from looping
+                listing.subdirectories << entry.name;
+                if (recursive)
+                {
+                    pending.emplace_back(joinPath(directory, entry.name), chain);
+                }
+            }
+        }
+        listings.push_back(std::move(listing));
+    }
+    return listings;
+}
+
+std::vector<QByteArray> TrigramIndex::reconcile(std::vector<Layer> &layers, const std::vector<Listing> &listings)
+{
+    std::vector<std::vector<quint8>> seen(layers.size());
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        seen[i].assign(layers[i].count(), 0);
+    }
+
+    std::vector<QByteArray> changed;
+    for (const Listing &listing : listings)
+    {
+        for (const FileState &file : listing.files)
+        {
+            const QByteArray path = joinPath(listing.directory, file.name).toUtf8();
+
+            // Only the newest copy of a file counts; older ones are left over from an interrupted merge
+            bool isCurrent = false;
+            for (size_t i = layers.size(); i-- > 0;)
+            {
+                const qint64 id = layers[i].find(path);
+                if (id >= 0 && !layers[i].removed[id])
+                {
+                    isCurrent = layers[i].isCurrent(id, file.size, file.modified);
+                    seen[i][id] = isCurrent;
+                    break;
+                }
+            }
+            if (!isCurrent)
+            {
+                changed.push_back(path);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < layers.size(); ++i)
+    {
+        for (quint32 id = 0; id < layers[i].count(); ++id)
+        {
+            if (!seen[i][id])
+            {
+                layers[i].remove(id);
+            }
+        }
+    }
+    return changed;
+}
+
+std::optional<TrigramIndex::Document> TrigramIndex::read(const QString &root, const QByteArray &path)
+{
+    QFile file(joinPath(root, QString::fromUtf8(path)));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return std::nullopt;
+    }
+
+    const QFileInfo info(file);
+    Document document;
+    document.path     = path;
+    document.size     = info.size();
+    document.modified = info.lastModified().toMSecsSinceEpoch();
+    if (document.size == 0)
+    {
+        return document;
+    }
+
+    if (document.size > MaxFileSize)
+    {
+        document.flags = Unindexed;
+        return document;
+    }
+
+    // Read in blocks rather than mapped: a file truncated by another program while mapped would raise
+    // SIGBUS. Each block starts with the last two bytes of the previous one, for the trigrams across them.
+    QByteArray block(ProjectSearch::ReadSize + 2, Qt::Uninitialized);
+    QByteArray decoded; // Of a file not in UTF-8: the carried bytes, then the block as UTF-8
+    std::optional<QStringDecoder> decoder;
+    qsizetype carried = 0;
+    int blocks        = 0;
+    for (;; ++blocks)
+    {
+        const qint64 count = file.read(block.data() + carried, ProjectSearch::ReadSize);
+        if (count < 0)
+        {
+            return std::nullopt;
+        }
+        if (count == 0)
+        {
+            break;
+        }
+
+        if (blocks == 0)
+        {
+            // NUL bytes are binary, unless the text is UTF-16: searches skip the same files
+            const TextFormat format = TextFormat::detect(
+                QByteArrayView(block.constData(), std::min<qint64>(count, TextFormat::SampleSize)));
+            const bool isWide = format.encoding == QStringConverter::Utf16LE
+                             || format.encoding == QStringConverter::Utf16BE;
+            if (!isWide
+                && std::memchr(block.constData(), 0,
+                               static_cast<std::size_t>(std::min<qint64>(count, ProjectSearch::BinaryProbeSize))))
+            {
+                document.flags = Binary;
+                return document;
+            }
+
+            // Searches decode such files, and look for the text in UTF-8
+            if (format.encoding != QStringConverter::Utf8)
+            {
+                decoder.emplace(format.encoding);
+            }
+        }
+
+        const char *text = block.constData();
+        qsizetype size   = carried + count;
+        if (decoder)
+        {
+            decoded.remove(0, std::max<qsizetype>(decoded.size() - 2, 0));
+            decoded += QString(decoder->decode(QByteArrayView(block.constData(), count))).toUtf8();
+            text = decoded.constData();
+            size = decoded.size();
+        }
+
+        const std::vector<quint32> found = trigramsOf(text, size);
+        document.trigrams.insert(document.trigrams.end(), found.begin(), found.end());
+
+        if (!decoder)
+        {
+            carried = std::min<qsizetype>(size, 2);
+            std::memmove(block.data(), block.constData() + size - carried, static_cast<std::size_t>(carried));
+        }
+    }
+
+    if (blocks > 1)
+    {
+        std::sort(document.trigrams.begin(), document.trigrams.end());
+        document.trigrams.erase(std::unique(document.trigrams.begin(), document.trigrams.end()), document.trigrams.end());
+    }
+    return document;
+}
+
+std::optional<TrigramIndex::Written> TrigramIndex::write(const QString &path, const std::vector<Layer> &inputs,
+                                                         const std::atomic<bool> &cancelled)
+{
+    // The files still current in the inputs, in path order; the newest input wins a path found twice
+    Written written;
+    std::vector<quint32> next(inputs.size(), 0);
+    const auto skipRemoved = [&](size_t input)
+    {
+        while (next[input] < inputs[input].count() && inputs[input].removed[next[input]])
+        {
+            ++next[input];
+        }
+    };
+    for (size_t input = 0; input < inputs.size(); ++input)
+    {
+        skipRemoved(input);
+    }
+    for (;;)
+    {
+        int best = -1;
+        for (size_t input = 0; input < inputs.size(); ++input)
+        {
+            if (next[input] < inputs[input].count()
+                && (best < 0 || comparePaths(inputs[input].path(next[input]), inputs[best].path(next[best])) <= 0))
+            {
+                best = static_cast<int>(input);
+            }
+        }
+        if (best < 0)
+        {
+            break;
+        }
+
+        const QByteArrayView chosen = inputs[best].path(next[best]);
+        written.sources.emplace_back(best, next[best]);
+        for (size_t input = 0; input < inputs.size(); ++input)
+        {
+            if (static_cast<int>(input) != best && next[input] < inputs[input].count()
+                && comparePaths(inputs[input].path(next[input]), chosen) == 0)
+            {
+                ++next[input];
+                skipRemoved(input);
+            }
+        }
+        ++next[best];
+        skipRemoved(best);
+    }
+
+    std::vector<std::vector<quint32>> renumbered(inputs.size());
+    for (size_t input = 0; input < inputs.size(); ++input)
+    {
+        renumbered[input].assign(inputs[input].count(), NoFile);
+    }
+    for (quint32 id = 0; id < written.sources.size(); ++id)
+    {
+        renumbered[written.sources[id].first][written.sources[id].second] = id;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        return std::nullopt;
+    }
+
+    QByteArray buffer;
+    quint64 position = 0;
+    bool ok          = true;
+    const auto put   = [&](const void *data, qsizetype size)
+    {
+        buffer.append(static_cast<const char *>(data), size);
+        position += static_cast<quint64>(size);
+        if (buffer.size() >= WriteChunk)
+        {
+            ok = ok && file.write(buffer) == buffer.size();
+            buffer.clear();
+        }
+    };
+    const auto align = [&]()
+    {
+        static const char padding[alignof(TrigramEntry)] = {};
+        put(padding, static_cast<qsizetype>((alignof(TrigramEntry) - position % alignof(TrigramEntry))
+                                            % alignof(TrigramEntry)));
+    };
+
+    Header header    = {};
+    header.magic     = Magic;
+    header.version   = Version;
+    header.fileCount = static_cast<quint32>(written.sources.size());
+    put(&header, sizeof(header));
+
+    quint64 nameOffset = 0;
+    for (const auto &[input, id] : written.sources)
+    {
+        const Layer &layer = inputs[input];
+        FileEntry entry    = {};
+        entry.nameOffset   = static_cast<quint32>(nameOffset);
+        entry.nameLength   = static_cast<quint32>(layer.path(id).size());
+        if (layer.segment)
+        {
+            entry.flags    = layer.segment->files[id].flags;
+            entry.size     = layer.segment->files[id].size;
+            entry.modified = layer.segment->files[id].modified;
+        }
+        else
+        {
+            const Document &document = (*layer.documents)[id];
+            entry.flags              = document.flags;
+            entry.size               = document.size;
+            entry.modified           = document.modified;
+        }
+        put(&entry, sizeof(entry));
+        nameOffset += entry.nameLength;
+    }
+    if (nameOffset > std::numeric_limits<quint32>::max())
+    {
+        file.cancelWriting();
+        return std::nullopt;
+    }
+
+    header.namesOffset = position;
+    for (const auto &[input, id] : written.sources)
+    {
+        const QByteArrayView name = inputs[input].path(id);
+        put(name.data(), name.size());
+    }
+    header.postingsOffset = position;
+
+    // The files in memory are turned around to be listed by trigram, like those of the segments
+    std::vector<std::vector<std::pair<quint32, quint32>>> inverted(inputs.size());
+    for (size_t input = 0; input < inputs.size(); ++input)
+    {
+        if (inputs[input].segment)
+        {
+            continue;
+        }
+        const std::vector<Document> &documents = *inputs[input].documents;
+        for (quint32 id = 0; id < documents.size(); ++id)
+        {
+            const quint32 number = renumbered[input][id];
+            if (number == NoFile || (documents[id].flags & Binary))
+            {
+                continue;
+            }
+            if (documents[id].flags & Unindexed)
+            {
+                inverted[input].emplace_back(AnyTrigram, number);
+            }
+            for (const quint32 trigram : documents[id].trigrams)
+            {
+                inverted[input].emplace_back(trigram, number);
+            }
+        }
+        std::sort(inverted[input].begin(), inverted[input].end());
+    }
+
+    // Trigrams of every input in order, each one's files merged
+    std::vector<TrigramEntry> table;
+    std::vector<size_t> cursors(inputs.size(), 0);
+    std::vector<quint32> ids;
+    QByteArray encoded;
+    for (;;)
+    {
+        if (cancelled)
+        {
+            file.cancelWriting();
+            return std::nullopt;
+        }
+
+        bool any        = false;
+        quint32 trigram = 0;
+        for (size_t input = 0; input < inputs.size(); ++input)
+        {
+            const Layer &layer = inputs[input];
+            const bool hasNext = layer.segment ? cursors[input] < layer.segment->header->trigramCount
+                                               : cursors[input] < inverted[input].size();
+            if (!hasNext)
+            {
+                continue;
+            }
+            const quint32 value = layer.segment ? layer.segment->trigrams[cursors[input]].trigram
+                                                : inverted[input][cursors[input]].first;
+            if (!any || value < trigram)
+            {
+                trigram = value;
+                any     = true;
+            }
+        }
+        if (!any)
+        {
+            break;
+        }
+
+        ids.clear();
+        for (size_t input = 0; input < inputs.size(); ++input)
+        {
+            const Layer &layer = inputs[input];
+            if (layer.segment)
+            {
+                if (cursors[input] < layer.segment->header->trigramCount
+                    && layer.segment->trigrams[cursors[input]].trigram == trigram)
+                {
+                    for (const quint32 id : layer.segment->postingsOf(layer.segment->trigrams + cursors[input]))
+                    {
+                        if (id < renumbered[input].size() && renumbered[input][id] != NoFile)
+                        {
+                            ids.push_back(renumbered[input][id]);
+                        }
+                    }
+                    ++cursors[input];
+                }
+            }
+            else
+            {
+                for (; cursors[input] < inverted[input].size() && inverted[input][cursors[input]].first == trigram;
+                     ++cursors[input])
+                {
+                    ids.push_back(inverted[input][cursors[input]].second);
+                }
+            }
+        }
+        if (ids.empty())
+        {
+            continue;
+        }
+
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        encoded.clear();
+        quint32 previous = 0;
+        for (const quint32 id : ids)
+        {
+            appendVarint(encoded, id - previous);
+            previous = id;
+        }
+        table.push_back({trigram, static_cast<quint32>(ids.size()), position - header.postingsOffset});
+        put(encoded.constData(), encoded.size());
+    }
+
+    // The files of a damaged input would be lost
+    if (std::any_of(inputs.cbegin(), inputs.cend(), [](const Layer &layer)
+    {
+        return layer.segment && layer.segment->damaged;
+    }))
+    {
+        file.cancelWriting();
+        return std::nullopt;
+    }
+
+    align();
+    header.trigramsOffset = position;
+    header.trigramCount   = static_cast<quint32>(table.size());
+    put(table.data(), static_cast<qsizetype>(table.size() * sizeof(TrigramEntry)));
+
+    ok = ok && file.write(buffer) == buffer.size() && file.seek(0)
+      && file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == static_cast<qint64>(sizeof(header));
+    if (!ok)
+    {
+        file.cancelWriting();
+        return std::nullopt;
+    }
+    if (!file.commit())
+    {
+        return std::nullopt;
+    }
+
+    written.segment = Segment::open(path);
+    if (!written.segment)
+    {
+        return std::nullopt;
+    }
+    return written;
+}
+
+QString TrigramIndex::indexPathOf(const QString &rootPath) const
+{
+    const QByteArray key = QDir::cleanPath(QFileInfo(rootPath).absoluteFilePath()).toUtf8();
+    return m_directory + "/" + QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+}
+
+QString TrigramIndex::segmentPath(quint64 sequence) const
+{
+    return QString("%1/%2.seg").arg(m_indexPath).arg(sequence, 16, 16, QChar('0'));
+}
+
+void TrigramIndex::openSegments()
+{
+    // Named by sequence, so listed oldest first
+    const QDir directory(m_indexPath);
+    for (const QFileInfo &info : directory.entryInfoList({"*.seg*"}, QDir::Files, QDir::Name))
+    {
+        bool isNumber          = false;
+        const quint64 sequence = info.completeBaseName().toULongLong(&isNumber, 16);
+
+        // Left over from a write that was interrupted, or damaged
+        std::shared_ptr<const Segment> segment = isNumber && info.suffix() == "seg" ? Segment::open(info.filePath())
+                                                                                    : nullptr;
+        if (!segment)
+        {
+            qWarning() << "[TrigramIndex] Removing" << info.filePath();
+            QFile::remove(info.filePath());
+            continue;
+        }
+
+        Layer layer;
+        layer.segment = segment;
+        layer.removed.assign(layer.count(), 0);
+        m_layers.push_back(std::move(layer));
+        m_nextSequence = std::max(m_nextSequence, sequence + 1);
+    }
+}
+
+void TrigramIndex::onScanned(std::vector<Layer> layers, const std::vector<Listing> &listings,
+                             const std::vector<QByteArray> &changed)
+{
+    m_layers = std::move(layers);
+    if (isDamaged())
+    {
+        rebuild();
+        return;
+    }
+    for (const Listing &listing : listings)
+    {
+        m_directories.insert(listing.directory);
+        if (listing.rules)
+        {
+            m_rules.insert(listing.directory, listing.rules);
+        }
+    }
+    watch(listings);
+
+    for (const QByteArray &path : changed)
+    {
+        m_pending.insert(path);
+    }
+
+    m_ready = true;
+    emit ready();
+    readNext();
+    checkIndexed();
+}
+
+void TrigramIndex::watch(const std::vector<Listing> &listings)
+{
+    QStringList paths;
+    paths.reserve(static_cast<qsizetype>(listings.size()));
+    for (const Listing &listing : listings)
+    {
+        const QString path = joinPath(m_rootPath, listing.directory);
+        if (!m_watched.contains(path))
+        {
+            paths << path;
+        }
+    }
+
+    if (!paths.isEmpty())
+    {
+        const QStringList failed = DirectoryWatcher::getInstance().watch(paths);
+        for (const QString &path : paths)
+        {
+            m_watched.insert(path);
+        }
+        for (const QString &path : failed)
+        {
+            m_watched.remove(path);
+        }
+        if (!failed.isEmpty())
+        {
+            qWarning() << "[TrigramIndex] Cannot watch" << failed.size() << "directories, changes to them will be missed";
+        }
+    }
+}
+
+QString TrigramIndex::relativeDirectory(const QString &path) const
+{
+    const QString directory = QDir(m_rootPath).relativeFilePath(path);
+    return directory == "." ? QString("") : directory;
+}
+
+void TrigramIndex::onDirectoryChanged(const QString &path)
+{
+    // The watcher reports the directories of every user
+    if (!m_watched.contains(path))
+    {
+        return;
+    }
+
+    m_changedDirectories.insert(relativeDirectory(path));
+    if (!m_updateTimer.isActive())
+    {
+        m_updateTimer.start();
+    }
+}
+
+void TrigramIndex::onFileWritten(const QString &directory, const QString &name)
+{
+    if (!m_watched.contains(directory))
+    {
+        return;
+    }
+    if (IgnoreRules::isIgnoreFile(name))
+    {
+        onDirectoryChanged(directory);
+        return;
+    }
+
+    // Read again even if its size and time did not change, as a rewrite within the same millisecond
+    m_writtenFiles.insert(joinPath(relativeDirectory(directory), name).toUtf8());
+    if (!m_updateTimer.isActive())
+    {
+        m_updateTimer.start();
+    }
+}
+
+void TrigramIndex::onOverflowed()
+{
+    // Events were lost: every directory is read again
+    for (const QString &directory : std::as_const(m_directories))
+    {
+        m_changedDirectories.insert(directory);
+    }
+    if (!m_changedDirectories.isEmpty() && !m_updateTimer.isActive())
+    {
+        m_updateTimer.start();
+    }
+}
+
+void TrigramIndex::flushChanges()
+{
+    for (const QString &directory : std::as_const(m_changedDirectories))
+    {
+        if (m_directories.contains(directory))
+        {
+            scan(directory, false);
+        }
+    }
+    m_changedDirectories.clear();
+
+    // Only files already listed: the others are ignored, or new and listed with their directory
+    for (const QByteArray &path : std::as_const(m_writtenFiles))
+    {
+        if (isListed(path))
+        {
+            markChanged(path);
+        }
+    }
+    if (!m_writtenFiles.isEmpty())
+    {
+        m_writtenFiles.clear();
+        readNext();
+        checkIndexed();
+    }
+}
+
+void TrigramIndex::scan(const QString &directory, bool recursive)
+{
+    m_pool.start([this, root = m_rootPath, directory, recursive, excludes = m_excludes, rules = m_rules,
+                  generation = m_generation, cancelled = m_cancelled]()
+    {
+        std::vector<Listing> listings = list(root, {directory}, recursive, excludes, rules, *cancelled);
+        QMetaObject::invokeMethod(this, [this, generation, directory, recursive, listings = std::move(listings)]()
+        {
+            if (generation == m_generation)
+            {
+                applyListings(directory, recursive, listings);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void TrigramIndex::applyListings(const QString &scope, bool recursive, const std::vector<Listing> &listings)
+{
+    QSet<QByteArray> listed;
+    QSet<QString> directories;
+    QStringList added;
+    QStringList rescans;
+    for (const Listing &listing : listings)
+    {
+        directories.insert(listing.directory);
+
+        // New ignore rules may hide or show anything below: the directory is read again with them
+        const std::shared_ptr<const IgnoreRules> previousRules = m_rules.value(listing.directory);
+        const bool rulesChanged = IgnoreRules::isChanged(previousRules, listing.rules);
+        if (listing.rules)
+        {
+            m_rules.insert(listing.directory, listing.rules);
+        }
+        else
+        {
+            m_rules.remove(listing.directory);
+        }
+        if (rulesChanged && !recursive)
+        {
+            rescans << listing.directory;
+        }
+
+        for (const QString &subdirectory : listing.subdirectories)
+        {
+            const QString path = joinPath(listing.directory, subdirectory);
+            directories.insert(path);
+            if (!recursive && !m_directories.contains(path))
+            {
+                added << path;
+            }
+        }
+
+        for (const FileState &file : listing.files)
+        {
+            const QByteArray path = joinPath(listing.directory, file.name).toUtf8();
+            listed.insert(path);
+            if (!m_pending.contains(path) && !m_reading.contains(path) && !isCurrent(path, file.size, file.modified))
+            {
+                markChanged(path);
+            }
+        }
+    }
+
+    // Files below scope that were not listed are gone, but those of the subdirectories a
+    // directory listed alone still has, which were not read
+    const QByteArray prefix = scope.isEmpty() ? QByteArray() : (scope + '/').toUtf8();
+    const auto keptDirectory = [&](QByteArrayView path) -> qsizetype
+    {
+        if (recursive)
+        {
+            return -1;
+        }
+        const QByteArrayView rest = path.sliced(prefix.size());
+        const char *slash         = static_cast<const char *>(std::memchr(rest.data(), '/', rest.size()));
+        if (!slash)
+        {
+            return -1;
+        }
+        const qsizetype end = prefix.size() + (slash - rest.data());
+        return directories.contains(QString::fromUtf8(path.first(end))) ? end : -1;
+    };
+    const auto isGone = [&](QByteArrayView path)
+    {
+        return !listed.contains(QByteArray::fromRawData(path.data(), path.size())) && keptDirectory(path) < 0;
+    };
+
+    for (Layer &layer : m_layers)
+    {
+        auto [id, end] = layer.range(prefix);
+        while (id < end)
+        {
+            const QByteArrayView path = layer.path(id);
+            const qsizetype kept      = keptDirectory(path);
+            if (kept >= 0)
+            {
+                id = std::max(id + 1, layer.range(path.first(kept + 1)).second);
+                continue;
+            }
+            if (!layer.removed[id] && isGone(path))
+            {
+                layer.remove(id);
+            }
+            ++id;
+        }
+    }
+    for (auto it = m_memory.lower_bound(prefix); it != m_memory.end() && it->first.startsWith(prefix);)
+    {
+        if (isGone(it->first))
+        {
+            m_memoryPostings -= static_cast<qint64>(it->second.trigrams.size());
+            it = m_memory.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for (QSet<QByteArray> *paths : {&m_pending, &m_reading})
+    {
+        for (auto it = paths->begin(); it != paths->end();)
+        {
+            it = it->startsWith(prefix) && isGone(*it) ? paths->erase(it) : std::next(it);
+        }
+    }
+
+    for (auto it = m_directories.begin(); it != m_directories.end();)
+    {
+        const QByteArray path = it->toUtf8();
+        const bool isBelow    = *it != scope && (scope.isEmpty() || path.startsWith(prefix));
+        if (isBelow && !directories.contains(*it) && keptDirectory(path) < 0)
+        {
+            m_rules.remove(*it);
+            const QString path = joinPath(m_rootPath, *it);
+            if (m_watched.remove(path))
+            {
+                DirectoryWatcher::getInstance().unwatch(path);
+            }
+            it = m_directories.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (recursive)
+    {
+        std::vector<Listing> unwatched;
+        for (const Listing &listing : listings)
+        {
+            if (!m_directories.contains(listing.directory))
+            {
+                m_directories.insert(listing.directory);
+                unwatched.push_back({listing.directory, {}, {}, nullptr});
+            }
+        }
+        watch(unwatched);
+    }
+    for (const QString &directory : std::as_const(added))
+    {
+        scan(directory, true);
+    }
+    for (const QString &directory : std::as_const(rescans))
+    {
+        scan(directory, true);
+    }
+
+    readNext();
+    checkIndexed();
+}
+
+bool TrigramIndex::isDamaged() const
+{
+    return std::any_of(m_layers.cbegin(), m_layers.cend(), [](const Layer &layer)
+    {
+        return layer.segment && layer.segment->damaged;
+    });
+}
+
+void TrigramIndex::rebuild()
+{
+    const QString root = m_rootPath;
+    qWarning() << "[TrigramIndex] The index of" << root << "is damaged, every file is read again";
+    removeIndex();
+    setRootPath(root);
+}
+
+bool TrigramIndex::isCurrent(const QByteArray &path, qint64 size, qint64 modified) const
+{
+    const auto it = m_memory.find(path);
+    if (it != m_memory.end())
+    {
+        return it->second.size == size && it->second.modified == modified;
+    }
+
+    for (auto layer = m_layers.crbegin(); layer != m_layers.crend(); ++layer)
+    {
+        const qint64 id = layer->find(path);
+        if (id >= 0 && !layer->removed[id])
+        {
+            return layer->isCurrent(id, size, modified);
+        }
+    }
+    return false;
+}
+
+bool TrigramIndex::isListed(const QByteArray &path) const
+{
+    if (m_memory.count(path) > 0 || m_pending.contains(path) || m_reading.contains(path))
+    {
+        return true;
+    }
+    return std::any_of(m_layers.cbegin(), m_layers.cend(), [&path](const Layer &layer)
+    {
+        const qint64 id = layer.find(path);
+        return id >= 0 && !layer.removed[id];
+    });
+}
+
+void TrigramIndex::markChanged(const QByteArray &path)
+{
+    removeCurrent(path);
+    m_reading.remove(path);
+    m_pending.insert(path);
+}
+
+void TrigramIndex::removeCurrent(const QByteArray &path)
+{
+    const auto it = m_memory.find(path);
+    if (it != m_memory.end())
+    {
+        m_memoryPostings -= static_cast<qint64>(it->second.trigrams.size());
+        m_memory.erase(it);
+        return;
+    }
+
+    for (Layer &layer : m_layers)
+    {
+        const qint64 id = layer.find(path);
+        if (id >= 0)
+        {
+            layer.remove(static_cast<quint32>(id));
+        }
+    }
+}
+
+void TrigramIndex::readNext()
+{
+    // Reading waits while the memory is full and being written
+    while (!m_pending.isEmpty() && m_readJobs < m_pool.maxThreadCount()
+           && !(m_writing && m_memoryPostings >= MaxMemoryPostings))
+    {
+        std::vector<QByteArray> batch;
+        for (auto it = m_pending.begin(); it != m_pending.end() && batch.size() < static_cast<size_t>(BatchSize);)
+        {
+            m_reading.insert(*it);
+            batch.push_back(*it);
+            it = m_pending.erase(it);
+        }
+
+        ++m_readJobs;
+        m_pool.start([this, root = m_rootPath, batch = std::move(batch), generation = m_generation,
+                      cancelled = m_cancelled]()
+        {
+            std::vector<std::pair<QByteArray, std::optional<Document>>> documents;
+            documents.reserve(batch.size());
+            for (const QByteArray &path : batch)
+            {
+                if (*cancelled)
+                {
+                    return;
+                }
+                documents.emplace_back(path, read(root, path));
+            }
+
+            QMetaObject::invokeMethod(this, [this, generation, documents = std::move(documents)]() mutable
+            {
+                if (generation == m_generation)
+                {
+                    applyDocuments(documents);
+                }
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void TrigramIndex::applyDocuments(std::vector<std::pair<QByteArray, std::optional<Document>>> &documents)
+{
+    --m_readJobs;
+    for (auto &[path, document] : documents)
+    {
+        // Changed or removed again while it was read
+        if (!m_reading.remove(path) || !document)
+        {
+            continue;
+        }
+
+        m_memoryPostings += static_cast<qint64>(document->trigrams.size());
+        m_memory[path] = std::move(*document);
+    }
+
+    writeNext();
+    readNext();
+    checkIndexed();
+}
+
+void TrigramIndex::writeNext()
+{
+    if (m_writing || m_memory.empty())
+    {
+        return;
+    }
+
+    // Once the memory is full, or everything was read; a few files changed since the last segment stay in memory
+    const bool isDrained  = m_pending.isEmpty() && m_reading.isEmpty();
+    const bool hasSegment = std::any_of(m_layers.cbegin(), m_layers.cend(), [](const Layer &layer)
+    {
+        return layer.segment != nullptr;
+    });
+    if (m_memoryPostings < MaxMemoryPostings
+        && !(isDrained && (!hasSegment || m_memory.size() >= static_cast<size_t>(MinSegmentFiles))))
+    {
+        return;
+    }
+
+    auto documents = std::make_shared<std::vector<Document>>();
+    documents->reserve(m_memory.size());
+    for (auto &[path, document] : m_memory)
+    {
+        documents->push_back(std::move(document));
+    }
+    m_memory.clear();
+    m_memoryPostings = 0;
+
+    Layer layer;
+    layer.documents = documents;
+    layer.removed.assign(documents->size(), 0);
+    m_layers.push_back(std::move(layer));
+
+    // Merged with the newest segments while they are not much larger, so sizes grow geometrically
+    size_t first = m_layers.size() - 1;
+    qint64 files = static_cast<qint64>(documents->size());
+    while (first > 0)
+    {
+        const Layer &previous = m_layers[first - 1];
+        const qint64 current  = static_cast<qint64>(previous.count()) - previous.removedCount;
+        if (previous.segment && current > 2 * files)
+        {
+            break;
+        }
+        files += current;
+        --first;
+    }
+
+    std::vector<Layer> inputs(m_layers.begin() + static_cast<std::ptrdiff_t>(first), m_layers.end());
+    m_writing = true;
+    m_pool.start([this, path = segmentPath(m_nextSequence++), inputs = std::move(inputs), first,
+                  generation = m_generation, cancelled = m_cancelled]() mutable
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        std::optional<Written> written = write(path, inputs, *cancelled);
+        if (*cancelled)
+        {
+            return;
+        }
+        if (written)
+        {
+            qDebug() << "[TrigramIndex] Wrote" << written->sources.size() << "files from" << inputs.size()
+                     << "layers to" << path << "in" << timer.elapsed() << "ms";
+        }
+
+        // The inputs are released here, so that their files can be removed once replaced
+        inputs.clear();
+        QMetaObject::invokeMethod(this, [this, generation, first, written = std::move(written)]() mutable
+        {
+            if (generation == m_generation)
+            {
+                onWritten(first, written);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void TrigramIndex::onWritten(size_t first, std::optional<Written> &written)
+{
+    m_writing = false;
+    if (!written && isDamaged())
+    {
+        rebuild();
+        return;
+    }
+    if (!written)
+    {
+        // The files stay in memory, and are written with the next segment
+        qWarning() << "[TrigramIndex] Cannot write a segment to" << m_indexPath;
+        readNext();
+        checkIndexed();
+        return;
+    }
+
+    // Files changed or removed while the segment was written
+    Layer layer;
+    layer.segment = written->segment;
+    layer.removed.assign(written->sources.size(), 0);
+    for (quint32 id = 0; id < written->sources.size(); ++id)
+    {
+        const auto &[input, source] = written->sources[id];
+        if (m_layers[first + input].removed[source])
+        {
+            layer.remove(id);
+        }
+    }
+
+    QStringList replaced;
+    for (size_t i = first; i < m_layers.size(); ++i)
+    {
+        if (m_layers[i].segment)
+        {
+            replaced << m_layers[i].segment->file.fileName();
+        }
+    }
+    m_layers.erase(m_layers.begin() + static_cast<std::ptrdiff_t>(first), m_layers.end());
+    m_layers.push_back(std::move(layer));
+
+    // Unmapped now that no layer holds them
+    for (const QString &path : std::as_const(replaced))
+    {
+        if (!QFile::remove(path))
+        {
+            qWarning() << "[TrigramIndex] Cannot remove" << path;
+        }
+    }
+
+    writeNext();
+    readNext();
+    checkIndexed();
+}
+
+void TrigramIndex::checkIndexed()
+{
+    const bool caughtUp = m_ready && m_pending.isEmpty() && m_reading.isEmpty() && !m_writing;
+    if (caughtUp == m_caughtUp)
+    {
+        return;
+    }
+
+    m_caughtUp = caughtUp;
+    if (caughtUp)
+    {
+        qDebug() << "[TrigramIndex] Indexed" << fileCount() << "files of" << m_rootPath << "in" << diskUsage()
+                 << "bytes of segments";
+        emit indexed();
+    }
+}
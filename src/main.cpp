@@ -1,5 +1,7 @@
 #include "MainWindow.h"
+#include "FileManager.h"
 #include "SyntaxManager.h"
+#include "SyntaxProfiler.h"
 
 #include <QApplication>
 #include <QMainWindow>
@@ -105,8 +107,19 @@ int main(int argc, char *argv[])
     app.setApplicationName(QStringLiteral("CodeAstra"));
     app.setApplicationDisplayName(QStringLiteral("CodeAstra"));
 
+#ifdef DEBUG
+    SyntaxProfiler::getInstance().setEnabled(true);
+#endif
+
     QScopedPointer<MainWindow> window(new MainWindow);
     window->show();
+    FileManager::getInstance().recoverUnsavedChanges();
+
+    int result = app.exec();
+
+#ifdef DEBUG
+    SyntaxProfiler::getInstance().dump();
+#endif
 
-    return app.exec();
+    return result;
 }
\ No newline at end of file
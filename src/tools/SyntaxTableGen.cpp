@@ -0,0 +1,240 @@
+/*
+ * Compiles the bundled syntax definitions into the static tables declared
+ * in BundledSyntax.h.
+ *
+ * Usage: SyntaxTableGen <output.cpp> <definition.yaml>...
+ */
+#include "BundledSyntax.h"
+
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // C++ string literal of arbitrary bytes
+    std::string quote(const std::string &text)
+    {
+        std::string literal = "\"";
+        for (unsigned char c : text)
+        {
+            switch (c)
+            {
+            case '\\':
+                literal += "\\\\";
+                break;
+            case '"':
+                literal += "\\\"";
+                break;
+            case '\n':
+                literal += "\\n";
+                break;
+            case '\t':
+                literal += "\\t";
+                break;
+            default:
+                if (c < 0x20 || c >= 0x7f)
+                {
+                    // Always three octal digits, so the next character cannot extend the escape
+                    char escape[5];
+                    std::snprintf(escape, sizeof(escape), "\\%03o", c);
+                    literal += escape;
+                }
+                else
+                {
+                    literal += static_cast<char>(c);
+                }
+            }
+        }
+        return literal + "\"";
+    }
+
+    std::string boolean(bool value)
+    {
+        return value ? "true" : "false";
+    }
+
+    bool readFile(const std::filesystem::path &path, std::string &content)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        content = stream.str();
+        return true;
+    }
+
+    // Mirrors Syntax::parseFormat: a rule without a color is skipped
+    bool readStyle(const YAML::Node &rule, std::string &color, bool &bold, bool &italic)
+    {
+        if (!rule["color"])
+        {
+            return false;
+        }
+
+        color  = rule["color"].as<std::string>();
+        bold   = rule["bold"] && rule["bold"].as<bool>();
+        italic = rule["italic"] && rule["italic"].as<bool>();
+        return true;
+    }
+
+    void writeArray(std::ostream &out, const std::string &type, const std::string &name,
+                    const std::vector<std::string> &entries)
+    {
+        if (entries.empty())
+        {
+            return;
+        }
+
+        out << "    const " << type << " " << name << "[] = {\n";
+        for (const std::string &entry : entries)
+        {
+            out << "        " << entry << ",\n";
+        }
+        out << "    };\n\n";
+    }
+
+    std::string arrayRef(const std::string &name, std::size_t size)
+    {
+        return size == 0 ? "nullptr, 0" : name + ", " + std::to_string(size);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: SyntaxTableGen <output.cpp> <definition.yaml>..." << std::endl;
+        return 1;
+    }
+
+    // Same order as a directory listing, which decides who owns an extension
+    std::vector<std::filesystem::path> files(argv + 2, argv + argc);
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b)
+    {
+        return a.filename() < b.filename();
+    });
+
+    std::ostringstream tables;
+    std::vector<std::string> definitions;
+
+    for (const std::filesystem::path &path : files)
+    {
+        std::string content;
+        if (!readFile(path, content))
+        {
+            std::cerr << "[SyntaxTableGen] Failed to open syntax config: " << path << std::endl;
+            return 1;
+        }
+
+        YAML::Node config;
+        try
+        {
+            config = YAML::Load(content);
+        }
+        catch (const YAML::Exception &e)
+        {
+            std::cerr << "[SyntaxTableGen] Failed to parse " << path << ": " << e.what() << std::endl;
+            return 1;
+        }
+
+        if (!config["extensions"])
+        {
+            std::cerr << "[SyntaxTableGen] No extensions key in YAML config: " << path << std::endl;
+            continue;
+        }
+
+        const std::string prefix = "syntax" + std::to_string(definitions.size());
+
+        std::vector<std::string> extensions;
+        for (const auto &ext : config["extensions"])
+        {
+            extensions.push_back(quote(ext.as<std::string>()));
+        }
+
+        const YAML::Node keywords = config["keywords"];
+        std::vector<std::string> rules;
+        for (const auto &category : keywords)
+        {
+            const std::string key = category.first.as<std::string>();
+            for (const auto &rule : category.second)
+            {
+                std::string color;
+                bool bold, italic;
+                if (!rule["regex"] || !readStyle(rule, color, bold, italic))
+                {
+                    std::cerr << "[SyntaxTableGen] Skipping incomplete rule in " << path << " (" << key << ")" << std::endl;
+                    continue;
+                }
+
+                const int priority = rule["priority"] ? rule["priority"].as<int>() : 0;
+                rules.push_back("{" + quote(key) + ", " + quote(rule["regex"].as<std::string>()) + ", " + quote(color) + ", "
+                                + boolean(bold) + ", " + boolean(italic) + ", " + std::to_string(priority) + "}");
+            }
+        }
+
+        const YAML::Node regionConfig = config["regions"];
+        std::vector<std::string> regions;
+        for (const auto &category : regionConfig)
+        {
+            const std::string key = category.first.as<std::string>();
+            for (const auto &rule : category.second)
+            {
+                std::string color;
+                bool bold, italic;
+                if (!rule["begin"] || !rule["end"] || !readStyle(rule, color, bold, italic))
+                {
+                    std::cerr << "[SyntaxTableGen] Skipping incomplete region in " << path << " (" << key << ")" << std::endl;
+                    continue;
+                }
+
+                regions.push_back("{" + quote(key) + ", " + quote(rule["begin"].as<std::string>()) + ", "
+                                  + quote(rule["end"].as<std::string>()) + ", " + quote(color) + ", "
+                                  + boolean(bold) + ", " + boolean(italic) + "}");
+            }
+        }
+
+        writeArray(tables, "char *const", prefix + "Extensions", extensions);
+        writeArray(tables, "BundledRule", prefix + "Rules", rules);
+        writeArray(tables, "BundledRegion", prefix + "Regions", regions);
+
+        definitions.push_back("{" + quote(path.filename().string()) + ", "
+                              + std::to_string(bundledSyntaxHash(content.data(), content.size())) + "ull, "
+                              + arrayRef(prefix + "Extensions", extensions.size()) + ", "
+                              + arrayRef(prefix + "Rules", rules.size()) + ", "
+                              + arrayRef(prefix + "Regions", regions.size()) + ", "
+                              + boolean(config["engine"] && config["engine"].IsScalar()
+                                      && config["engine"].as<std::string>() == "lexer") + "}");
+    }
+
+    std::ostringstream out;
+    out << "// Generated by SyntaxTableGen from resources/syntax. Do not edit.\n"
+        << "#include \"BundledSyntax.h\"\n\n"
+        << "namespace\n{\n"
+        << tables.str();
+    writeArray(out, "BundledSyntax", "definitions", definitions);
+    out << "}\n\n"
+        << "std::span<const BundledSyntax> bundledSyntaxDefinitions()\n{\n"
+        << (definitions.empty() ? "    return {};\n" : "    return definitions;\n")
+        << "}\n";
+
+    std::ofstream output(argv[1], std::ios::binary | std::ios::trunc);
+    output << out.str();
+    if (!output)
+    {
+        std::cerr << "[SyntaxTableGen] Failed to write " << argv[1] << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,13 +1,23 @@
 #include "Tree.h"
 #include "FileManager.h"
+#include "DocumentLoader.h"
+#include "DocumentSaver.h"
+#include "EditJournal.h"
+#include "CopyJob.h"
+#include "BatchJob.h"
+#include "DocumentCache.h"
+#include "FileTreeModel.h"
 
 #include <QtTest>
 #include <QCoreApplication>
 #include <QAction>
 #include <QMenu>
-#include <QFileSystemModel>
 #include <QSplitter>
 #include <QDir>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextStream>
+#include <QSignalSpy>
 #include <QDebug>
 
 class TestFileManager : public QObject
@@ -29,6 +39,16 @@ private slots:
     void testNewFolder();
     void testNewFolderFail();
     void testDuplicatePath();
+    void testCopyJob();
+    void testBatchJob();
+    void testDocumentCache();
+    void testDocumentLoader();
+    void testStreamingLoad();
+    void testDocumentSaver();
+    void testEditJournal();
+    void testTextFormatRoundTrip();
+    void testInvalidUtf8PastSample();
+    void testMixedLineEndings();
 };
 
 void TestFileManager::initTestCase()
@@ -85,7 +105,7 @@ void TestFileManager::testDeleteFile()
 
     QVERIFY2(QFile::exists(tempFilePath), "Temporary file should exist before deletion.");
 
-    QFileSystemModel *model = tree->getModel();
+    FileTreeModel *model = tree->getModel();
     QVERIFY2(model, "Tree model should not be null.");
 
     QModelIndex index = model->index(tempFilePath);
@@ -106,7 +126,7 @@ void TestFileManager::testDeleteDir()
 
     QVERIFY2(QFileInfo(dirPath).exists(), "Test directory should exist before deletion.");
 
-    QFileSystemModel *model = tree->getModel();
+    FileTreeModel *model = tree->getModel();
     QVERIFY2(model, "Tree model should not be null.");
 
     QModelIndex index = model->index(dirPath);
@@ -165,5 +185,477 @@ void TestFileManager::testDuplicatePath()
     QVERIFY2(pathDuplicated.success, "Path should be duplicated successfully.");
 }
 
+void TestFileManager::testCopyJob()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    QString sourcePath = tempDir.path() + "/source";
+    QVERIFY(QDir().mkpath(sourcePath + "/nested/deeper"));
+
+    QStringList files;
+    for (int i = 0; i < 30; ++i)
+    {
+        const QString relative = (i % 3 == 0 ? "" : i % 3 == 1 ? "nested/" : "nested/deeper/") + QString("file%1.txt").arg(i);
+        QFile file(sourcePath + "/" + relative);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray(i * 1000, static_cast<char>('a' + i % 26)));
+        files << relative;
+    }
+
+    CopyJob job(sourcePath, tempDir.path() + "/copy");
+    QSignalSpy finished(&job, &CopyJob::finished);
+    job.start();
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY2(finished.first().at(0).toBool(), qPrintable(finished.first().at(1).toString()));
+    QCOMPARE(job.copiedBytes(), job.totalBytes());
+
+    for (const QString &relative : files)
+    {
+        QFile source(sourcePath + "/" + relative);
+        QFile copy(tempDir.path() + "/copy/" + relative);
+        QVERIFY(source.open(QIODevice::ReadOnly));
+        QVERIFY2(copy.open(QIODevice::ReadOnly), qPrintable(relative));
+        QCOMPARE(copy.readAll(), source.readAll());
+    }
+
+    // A cancelled copy leaves nothing behind, unless it completed first
+    CopyJob cancelled(sourcePath, tempDir.path() + "/cancelled");
+    QSignalSpy cancelledFinished(&cancelled, &CopyJob::finished);
+    cancelled.start();
+    cancelled.cancel();
+    QTRY_COMPARE(cancelledFinished.count(), 1);
+    QVERIFY(cancelledFinished.first().at(0).toBool() || !QFileInfo::exists(tempDir.path() + "/cancelled"));
+
+    // The target is never overwritten
+    QVERIFY(!CopyJob(sourcePath, tempDir.path() + "/copy").run().success);
+}
+
+void TestFileManager::testBatchJob()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    const QString base = tempDir.path();
+    QVERIFY(QDir().mkpath(base + "/folder/nested"));
+    QVERIFY(QDir().mkpath(base + "/folder-other"));
+    QVERIFY(QDir().mkpath(base + "/destination"));
+
+    QStringList paths{base + "/folder", base + "/folder/nested", base + "/folder-other/"};
+    for (int i = 0; i < 20; ++i)
+    {
+        const QString path = base + QString("/folder/nested/file%1.txt").arg(i);
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        paths << path;
+    }
+
+    // What is inside a selected folder goes with it
+    QCOMPARE(BatchJob::topLevelPaths(paths), QStringList({base + "/folder", base + "/folder-other"}));
+
+    BatchJob move(BatchJob::Operation::Move, paths, base + "/destination");
+    QSignalSpy finished(&move, &BatchJob::finished);
+    move.start();
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY2(finished.first().at(0).toBool(), qPrintable(finished.first().at(1).toString()));
+    QVERIFY(QFile::exists(base + "/destination/folder/nested/file19.txt"));
+    QVERIFY(QFileInfo(base + "/destination/folder-other").isDir());
+    QVERIFY(!QFile::exists(base + "/folder"));
+
+    // Failures are aggregated, and do not stop the other items
+    BatchJob duplicate(BatchJob::Operation::Duplicate, {base + "/missing", base + "/destination/folder"});
+    OperationResult result = duplicate.run();
+    QVERIFY(!result.success);
+    QVERIFY2(QString::fromStdString(result.message).startsWith("1 of 2 items duplicated."), result.message.c_str());
+    QVERIFY(QFile::exists(base + "/destination/folder_copy/nested/file0.txt"));
+
+    BatchJob moveIntoItself(BatchJob::Operation::Move, {base + "/destination"}, base + "/destination/folder");
+    QVERIFY(!moveIntoItself.run().success);
+}
+
+void TestFileManager::testDocumentCache()
+{
+    auto cachedDocument = [](const QString &filePath, int lines)
+    {
+        auto entry      = std::make_unique<CachedDocument>();
+        entry->filePath = filePath;
+        entry->document = std::make_unique<QTextDocument>();
+        entry->document->setPlainText(QString("line\n").repeated(lines));
+        entry->document->setModified(false);
+        return entry;
+    };
+
+    const qint64 size = DocumentCache::estimatedSize(cachedDocument("", 100)->document.get());
+    DocumentCache cache(3 * size);
+
+    QVERIFY(cache.insert(cachedDocument("a", 100)).isEmpty());
+    QVERIFY(cache.insert(cachedDocument("b", 100)).isEmpty());
+    QVERIFY(cache.insert(cachedDocument("c", 100)).isEmpty());
+    QCOMPARE(cache.filePaths(), QStringList({"c", "b", "a"}));
+    QCOMPARE(cache.memoryUsage(), 3 * size);
+
+    // Taking a document out and putting it back makes it the most recently used
+    std::unique_ptr<CachedDocument> a = cache.take("a");
+    QVERIFY(a && !cache.contains("a"));
+    a->document->setModified(true);
+    QVERIFY(cache.insert(std::move(a)).isEmpty());
+
+    // Over budget: the least recently used goes first, never a modified one
+    QCOMPARE(cache.insert(cachedDocument("d", 100)), QStringList({"b"}));
+    QCOMPARE(cache.setMemoryBudget(0), QStringList({"c", "d"}));
+    QCOMPARE(cache.filePaths(), QStringList({"a"}));
+    QCOMPARE(cache.memoryUsage(), size);
+}
+
+void TestFileManager::testDocumentLoader()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    // A "\r\n" split across the first chunk boundary, a two-byte character across the second
+    const qsizetype chunk = DocumentLoader::ChunkSize;
+    QByteArray content    = "\xEF\xBB\xBF" + QByteArray(chunk - 4, 'x') + "\r";
+    content += "\n" + QByteArray(chunk - 2, 'y') + "\xC3";
+    content += "\xA9\r\nend";
+
+    QString filePath = tempDir.path() + "/large.txt";
+    QFile file(filePath);
+    QVERIFY2(file.open(QIODevice::WriteOnly), "File should be created successfully.");
+    file.write(content);
+    file.close();
+
+    QTextDocument document;
+    OperationResult loaded = DocumentLoader::load(filePath, &document);
+    QVERIFY2(loaded.success, loaded.message.c_str());
+
+    QFile reference(filePath);
+    QVERIFY(reference.open(QIODevice::ReadOnly | QIODevice::Text));
+    QCOMPARE_EQ(document.toPlainText(), QTextStream(&reference).readAll());
+    QVERIFY(!document.isUndoAvailable());
+
+    // The file hashes like the text loaded from it, whatever its line endings
+    const QByteArray hash = DocumentLoader::hashFile(filePath);
+    QVERIFY(!hash.isEmpty());
+    QCOMPARE_EQ(hash, DocumentLoader::hashDocument(&document));
+    QCOMPARE_EQ(hash, DocumentLoader::hashText(document.toPlainText().toUtf8()));
+
+    QTextCursor cursor(&document);
+    cursor.insertText("edit");
+    QVERIFY(DocumentLoader::hashDocument(&document) != hash);
+
+    // Not UTF-8 from the start: read as Latin-1, byte for byte
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("ok\xFF\n");
+    file.close();
+    TextFormat format;
+    loaded = DocumentLoader::load(filePath, &document, &format);
+    QVERIFY(loaded.success);
+    QCOMPARE_EQ(format.encoding, QStringConverter::Latin1);
+    QCOMPARE_EQ(document.toPlainText(), QString("ok") + QChar(0xFF) + "\n");
+
+    // Invalid bytes past the detection sample are replaced, and reported
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(QByteArray(TextFormat::SampleSize, 'a') + "\xFF\n");
+    file.close();
+    loaded = DocumentLoader::load(filePath, &document);
+    QVERIFY(loaded.success);
+    QVERIFY(QString::fromStdString(loaded.message).contains("UTF-8"));
+    QVERIFY(document.toPlainText().endsWith(QString(QChar::ReplacementCharacter) + "\n"));
+
+    QVERIFY(!DocumentLoader::load(tempDir.path() + "/missing.txt", &document).success);
+}
+
+void TestFileManager::testStreamingLoad()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    // Several batches, lines straddling them
+    QByteArray first;
+    for (int line = 0; first.size() < 3 * DocumentLoader::BatchSize; ++line)
+    {
+        first += "line " + QByteArray::number(line) + " of the first file\n";
+    }
+
+    QString firstPath  = tempDir.path() + "/first.log";
+    QString secondPath = tempDir.path() + "/second.log";
+    QFile firstFile(firstPath);
+    QVERIFY(firstFile.open(QIODevice::WriteOnly));
+    firstFile.write(first);
+    firstFile.close();
+    QFile secondFile(secondPath);
+    QVERIFY(secondFile.open(QIODevice::WriteOnly));
+    secondFile.write("second\nfile\n");
+    secondFile.close();
+
+    QTextDocument document;
+    DocumentLoader loader;
+    QSignalSpy finished(&loader, &DocumentLoader::finished);
+    QSignalSpy progress(&loader, &DocumentLoader::progress);
+
+    QVERIFY(loader.start(firstPath, &document).success);
+    QVERIFY(loader.isLoading());
+    QTRY_COMPARE_EQ(finished.count(), 1);
+    QVERIFY(finished.first().first().toBool());
+    QVERIFY(!loader.isLoading());
+    QVERIFY(progress.count() >= 3);
+    QCOMPARE_EQ(progress.last().first().toLongLong(), first.size());
+    QCOMPARE_EQ(document.toPlainText(), QString::fromUtf8(first));
+
+    // Opening another file cancels the current load: only the second one finishes
+    finished.clear();
+    QVERIFY(loader.start(firstPath, &document).success);
+    QVERIFY(loader.start(secondPath, &document).success);
+    QTRY_COMPARE_EQ(finished.count(), 1);
+    QTest::qWait(100);
+    QCOMPARE_EQ(finished.count(), 1);
+    QCOMPARE_EQ(document.toPlainText(), QString("second\nfile\n"));
+
+    // A missing file is reported before the document is touched
+    QVERIFY(!loader.start(tempDir.path() + "/missing.log", &document).success);
+    QCOMPARE_EQ(document.toPlainText(), QString("second\nfile\n"));
+}
+
+void TestFileManager::testDocumentSaver()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    QString filePath = tempDir.path() + "/saved.txt";
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("previous content\n");
+    file.close();
+
+    DocumentSaver saver;
+    QSignalSpy finished(&saver, &DocumentSaver::finished);
+
+    // Snapshots queued behind the one being written coalesce: the last one wins
+    const QString large = QString(8 * 1024 * 1024, u'a');
+    saver.save(filePath, large);
+    for (int i = 0; i < 10; ++i)
+    {
+        saver.save(filePath, "version " + QString::number(i) + "\n");
+    }
+    QTRY_VERIFY(!saver.isSaving());
+    QTRY_VERIFY(finished.count() >= 1);
+    QVERIFY(finished.count() < 11);
+
+    const QList<QVariant> last = finished.last();
+    QCOMPARE_EQ(last.at(0).toString(), filePath);
+    QVERIFY(last.at(1).toBool());
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE_EQ(file.readAll(), QByteArray("version 9\n"));
+    file.close();
+    QCOMPARE_EQ(last.at(3).toByteArray(), DocumentLoader::hashFile(filePath));
+
+    // No temporary file is left behind
+    QCOMPARE_EQ(QDir(tempDir.path()).entryList(QDir::Files), QStringList{"saved.txt"});
+
+    // A failed save leaves the original untouched
+    OperationResult failed = DocumentSaver::write(tempDir.path() + "/missing/dir/file.txt", "text");
+    QVERIFY(!failed.success);
+}
+
+void TestFileManager::testEditJournal()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    QString filePath = tempDir.path() + "/edited.txt";
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("first\nsecond\nthird\n");
+    file.close();
+
+    QTextDocument document;
+    QVERIFY(DocumentLoader::load(filePath, &document).success);
+
+    EditJournal journal(tempDir.path() + "/journal");
+    journal.attach(&document, filePath);
+
+    QTextCursor cursor(&document);
+    cursor.insertText("zeroth\n");
+    cursor.movePosition(QTextCursor::Down);
+    cursor.movePosition(QTextCursor::EndOfBlock, QTextCursor::KeepAnchor);
+    cursor.insertText("2nd\nand more");
+    cursor.movePosition(QTextCursor::End);
+    cursor.deletePreviousChar();
+    document.undo();
+    document.redo();
+    journal.flush();
+    journal.waitForDone();
+
+    // Highlighting passes are not edits
+    const qint64 journalSize = QFileInfo(journal.journalPath(filePath)).size();
+    QVERIFY(journalSize > 0);
+    document.markContentsDirty(0, document.characterCount());
+    journal.flush();
+    journal.waitForDone();
+    QCOMPARE_EQ(QFileInfo(journal.journalPath(filePath)).size(), journalSize);
+    QCOMPARE_EQ(journal.journaledFiles(), QStringList{filePath});
+
+    // Replayed onto the file as loaded, as after a crash
+    auto recover = [&]()
+    {
+        QTextDocument recovered;
+        if (!DocumentLoader::load(filePath, &recovered).success
+            || !EditJournal(journal.directory()).replay(filePath, &recovered).success)
+        {
+            return QString("replay failed");
+        }
+        return recovered.toPlainText();
+    };
+    QCOMPARE_EQ(recover(), document.toPlainText());
+
+    // Compacted into a snapshot, then edited further
+    journal.compact();
+    cursor.insertText("after compaction");
+    journal.flush();
+    journal.waitForDone();
+    QCOMPARE_EQ(recover(), document.toPlainText());
+
+    // Saved: nothing left to recover
+    journal.markSaved();
+    journal.waitForDone();
+    QVERIFY(!QFile::exists(journal.journalPath(filePath)));
+
+    // Edits recorded against a file changed since are not replayed
+    cursor.insertText("unsaved");
+    journal.detach(true);
+    journal.waitForDone();
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    file.write("changed elsewhere\n");
+    file.close();
+    QCOMPARE_EQ(recover(), QString("replay failed"));
+}
+
+void TestFileManager::testTextFormatRoundTrip()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    QCOMPARE_EQ(TextFormat::detect("a\r\nb\r\nc\n").lineEnding, TextFormat::LineEnding::CRLF);
+    QCOMPARE_EQ(TextFormat::detect("a\rb\r").lineEnding, TextFormat::LineEnding::CR);
+    QCOMPARE_EQ(TextFormat::detect("a\nb\r\nc\n").lineEnding, TextFormat::LineEnding::LF);
+    QCOMPARE_EQ(TextFormat::detect("caf\xC3\xA9").encoding, QStringConverter::Utf8);
+    QCOMPARE_EQ(TextFormat::detect("caf\xC3").encoding, QStringConverter::Utf8); // Cut by the sample
+    QCOMPARE_EQ(TextFormat::detect("caf\xE9!").encoding, QStringConverter::Latin1);
+    QCOMPARE_EQ(TextFormat::detect(QByteArrayView("a\0b\0\r\0\n\0", 8)).encoding, QStringConverter::Utf16LE);
+
+    // Each file is saved back byte for byte
+    const QString text = QString::fromUtf8("first line \xC3\xA9\nsecond line\n");
+    const QList<QByteArray> contents = {
+        "\xEF\xBB\xBF" + text.toUtf8().replace("\n", "\r\n"),
+        text.toLatin1().replace("\n", "\r"),
+        QByteArray("\xFF\xFE") + QByteArray(reinterpret_cast<const char *>(text.utf16()), text.size() * 2),
+    };
+
+    for (const QByteArray &content : contents)
+    {
+        QString filePath = tempDir.path() + "/round_trip.txt";
+        QFile file(filePath);
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(content);
+        file.close();
+
+        QTextDocument document;
+        TextFormat format;
+        QVERIFY(DocumentLoader::load(filePath, &document, &format).success);
+        QCOMPARE_EQ(document.toPlainText(), text);
+
+        QByteArray hash;
+        QVERIFY(DocumentSaver::write(filePath, document.toPlainText(), format, &hash).success);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE_EQ(file.readAll(), content);
+        file.close();
+        QCOMPARE_EQ(hash, DocumentLoader::hashFile(filePath));
+    }
+
+    // Characters Latin-1 cannot hold are saved as UTF-8 rather than lost
+    TextFormat latin1;
+    latin1.encoding = QStringConverter::Latin1;
+    QString filePath = tempDir.path() + "/euro.txt";
+    OperationResult saved = DocumentSaver::write(filePath, QString::fromUtf8("\xE2\x82\xAC 5\n"), latin1);
+    QVERIFY(saved.success);
+    QVERIFY(QString::fromStdString(saved.message).contains("UTF-8"));
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE_EQ(file.readAll(), QByteArray("\xE2\x82\xAC 5\n"));
+}
+
+void TestFileManager::testInvalidUtf8PastSample()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    // Valid UTF-8 over the whole detection sample, then a Latin-1 byte
+    const QByteArray content = QByteArray(TextFormat::SampleSize + 1000, 'a') + "\ncaf\xE9 \xC3\xA9\n";
+    const QString filePath   = tempDir.path() + "/late.txt";
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+    file.close();
+    QCOMPARE_EQ(TextFormat::detect(content.left(TextFormat::SampleSize)).encoding, QStringConverter::Utf8);
+
+    // Loaded again as Latin-1, so that every byte is saved back
+    QTextDocument document;
+    TextFormat format;
+    OperationResult loaded = DocumentLoader::load(filePath, &document, &format);
+    QVERIFY(loaded.success);
+    QVERIFY(QString::fromStdString(loaded.message).contains("Latin-1"));
+    QCOMPARE_EQ(format.encoding, QStringConverter::Latin1);
+    QCOMPARE_EQ(document.toPlainText(), QString::fromLatin1(content));
+
+    QByteArray hash;
+    QVERIFY(DocumentSaver::write(filePath, document.toPlainText(), format, &hash).success);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE_EQ(file.readAll(), content);
+    file.close();
+    QCOMPARE_EQ(hash, DocumentLoader::hashFile(filePath));
+
+    // Streaming starts over the same way
+    QTextDocument streamed;
+    DocumentLoader loader;
+    QSignalSpy finished(&loader, &DocumentLoader::finished);
+    QVERIFY(loader.start(filePath, &streamed).success);
+    QTRY_COMPARE_EQ(finished.count(), 1);
+    QVERIFY(finished.first().first().toBool());
+    QCOMPARE_EQ(loader.format().encoding, QStringConverter::Latin1);
+    QCOMPARE_EQ(streamed.toPlainText(), QString::fromLatin1(content));
+}
+
+void TestFileManager::testMixedLineEndings()
+{
+    QTemporaryDir tempDir;
+    QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+    const QString filePath = tempDir.path() + "/mixed.txt";
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("a\r\nb\nc\r\n");
+    file.close();
+
+    QTextDocument document;
+    TextFormat format;
+    QVERIFY(DocumentLoader::load(filePath, &document, &format).success);
+    QCOMPARE_EQ(format.lineEnding, TextFormat::LineEnding::CRLF);
+    QVERIFY(format.mixedLineEndings);
+    QCOMPARE_EQ(document.toPlainText(), QString("a\nb\nc\n"));
+
+    // Saving writes the dominant ending everywhere
+    QVERIFY(DocumentSaver::write(filePath, document.toPlainText(), format).success);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE_EQ(file.readAll(), QByteArray("a\r\nb\r\nc\r\n"));
+    file.close();
+
+    // Consistent endings are not flagged
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write("a\r\nb\r\n");
+    file.close();
+    QVERIFY(DocumentLoader::load(filePath, &document, &format).success);
+    QVERIFY(!format.mixedLineEndings);
+}
+
 QTEST_MAIN(TestFileManager)
 #include "test_filemanager.moc"
@@ -0,0 +1,348 @@
+#include "FileTreeModel.h"
+#include "NamePool.h"
+#include "DirectoryReader.h"
+#include "IgnoreRules.h"
+
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+
+class TestFileTreeModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testNamePool();
+    void testDirectoryReader();
+    void testLazyFetch();
+    void testIndexOfDeepPath();
+    void testFollowsChanges();
+    void testRescanAfterManyChanges();
+    void testIgnorePatterns();
+    void testIgnoredEntries();
+};
+
+namespace
+{
+    void touch(const QString &path)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+
+    QStringList rowNames(const FileTreeModel &model, const QModelIndex &parent)
+    {
+        QStringList names;
+        for (int row = 0; row < model.rowCount(parent); ++row)
+        {
+            names << model.fileName(model.index(row, 0, parent));
+        }
+        return names;
+    }
+}
+
+void TestFileTreeModel::testNamePool()
+{
+    NamePool pool;
+    const quint32 index = pool.intern(u"index.js");
+    QCOMPARE(pool.intern(u"package.json"), index + 1);
+    QCOMPARE(pool.intern(u"index.js"), index);
+    QCOMPARE(pool.name(index).toString(), QString("index.js"));
+    QCOMPARE(pool.intern(u""), index + 2);
+    QCOMPARE(pool.name(index + 2).size(), 0);
+
+    // Growing the table keeps every id
+    for (int i = 0; i < 5000; ++i)
+    {
+        QCOMPARE(pool.intern(QString("file%1.txt").arg(i)), static_cast<quint32>(i + 3));
+    }
+    QCOMPARE(pool.size(), 5003);
+    QCOMPARE(pool.intern(u"file1234.txt"), 1237u);
+    QCOMPARE(pool.name(1237).toString(), QString("file1234.txt"));
+}
+
+void TestFileTreeModel::testDirectoryReader()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QVERIFY(QDir(tempDir.path()).mkdir("folder"));
+    touch(tempDir.filePath("file.txt"));
+    QVERIFY(QFile::link(tempDir.filePath("folder"), tempDir.filePath("link")));
+
+    bool ok = false;
+    std::vector<DirectoryReader::Entry> entries = DirectoryReader::read(tempDir.path(), &ok);
+    QVERIFY(ok);
+    QCOMPARE(entries.size(), size_t(3));
+
+    std::sort(entries.begin(), entries.end(), [](const DirectoryReader::Entry &left, const DirectoryReader::Entry &right)
+    {
+        return left.name < right.name;
+    });
+    QCOMPARE(entries[0].name, QString("file.txt"));
+    QVERIFY(!entries[0].isDirectory);
+    QCOMPARE(entries[1].name, QString("folder"));
+    QVERIFY(entries[1].isDirectory);
+    QVERIFY(!entries[1].isSymLink);
+    QCOMPARE(entries[2].name, QString("link"));
+    QVERIFY(entries[2].isDirectory);
+    QVERIFY(entries[2].isSymLink);
+
+    DirectoryReader::read(tempDir.filePath("missing"), &ok);
+    QVERIFY(!ok);
+}
+
+void TestFileTreeModel::testLazyFetch()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    QVERIFY(root.mkpath("src/nested"));
+    QVERIFY(root.mkdir("Docs"));
+    touch(root.filePath("b.txt"));
+    touch(root.filePath("A.txt"));
+    touch(root.filePath("src/main.cpp"));
+
+    FileTreeModel model;
+    QSignalSpy loaded(&model, &FileTreeModel::directoryLoaded);
+    const QModelIndex rootIndex = model.setRootPath(tempDir.path());
+    QVERIFY(rootIndex.isValid());
+    QCOMPARE(model.filePath(rootIndex), QDir::cleanPath(tempDir.path()));
+
+    QTRY_VERIFY(model.isFetched(rootIndex));
+    QCOMPARE(loaded.count(), 1);
+    QCOMPARE(rowNames(model, rootIndex), QStringList({"Docs", "src", "A.txt", "b.txt"}));
+
+    // Subdirectories are only listed once asked for
+    const QModelIndex src = model.index(1, 0, rootIndex);
+    QVERIFY(model.isDir(src));
+    QVERIFY(model.hasChildren(src));
+    QVERIFY(model.canFetchMore(src));
+    QCOMPARE(model.rowCount(src), 0);
+
+    model.fetchMore(src);
+    QTRY_VERIFY(model.isFetched(src));
+    QCOMPARE(rowNames(model, src), QStringList({"nested", "main.cpp"}));
+    QCOMPARE(model.filePath(model.index(1, 0, src)), root.filePath("src/main.cpp"));
+    QCOMPARE(model.parent(model.index(1, 0, src)), src);
+
+    // An empty directory loses its expander once listed
+    const QModelIndex docs = model.index(0, 0, rootIndex);
+    model.fetchMore(docs);
+    QTRY_VERIFY(model.isFetched(docs));
+    QVERIFY(!model.hasChildren(docs));
+    QVERIFY(model.watchCount() >= 3);
+}
+
+void TestFileTreeModel::testIndexOfDeepPath()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QVERIFY(QDir(tempDir.path()).mkpath("a/b/c"));
+    touch(tempDir.filePath("a/b/c/deep.txt"));
+
+    FileTreeModel model;
+    const QModelIndex rootIndex = model.setRootPath(tempDir.path());
+    QTRY_VERIFY(model.isFetched(rootIndex));
+
+    // Reached without listing the directories on the way
+    const QString path = tempDir.filePath("a/b/c/deep.txt");
+    const QModelIndex deep = model.index(path);
+    QVERIFY(deep.isValid());
+    QCOMPARE(model.filePath(deep), path);
+    QVERIFY(!model.isDir(deep));
+    QVERIFY(!model.isFetched(model.parent(deep)));
+
+    QVERIFY(!model.index(tempDir.filePath("a/missing")).isValid());
+
+    // Listing the parent later keeps the same row
+    const QModelIndex c = model.parent(deep);
+    QPersistentModelIndex persistent(deep);
+    model.fetchMore(c);
+    QTRY_VERIFY(model.isFetched(c));
+    QCOMPARE(model.rowCount(c), 1);
+    QCOMPARE(QModelIndex(persistent), deep);
+}
+
+void TestFileTreeModel::testFollowsChanges()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    QVERIFY(root.mkdir("folder"));
+    touch(root.filePath("folder/inside.txt"));
+    touch(root.filePath("old.txt"));
+
+    FileTreeModel model;
+    const QModelIndex rootIndex = model.setRootPath(tempDir.path());
+    QTRY_VERIFY(model.isFetched(rootIndex));
+    QCOMPARE(rowNames(model, rootIndex), QStringList({"folder", "old.txt"}));
+
+    QSignalSpy inserted(&model, &FileTreeModel::rowsInserted);
+    QSignalSpy removed(&model, &FileTreeModel::rowsRemoved);
+
+    touch(root.filePath("new.txt"));
+    QTRY_COMPARE(rowNames(model, rootIndex), QStringList({"folder", "new.txt", "old.txt"}));
+    QCOMPARE(inserted.count(), 1);
+
+    QVERIFY(QFile::remove(root.filePath("old.txt")));
+    QTRY_COMPARE(rowNames(model, rootIndex), QStringList({"folder", "new.txt"}));
+    QCOMPARE(removed.count(), 1);
+
+    // A renamed directory comes back unlisted, and its children are freed
+    const QModelIndex folder = model.index(0, 0, rootIndex);
+    model.fetchMore(folder);
+    QTRY_VERIFY(model.isFetched(folder));
+    QCOMPARE(model.rowCount(folder), 1);
+    const int nodes   = model.nodeCount();
+    const int watches = model.watchCount();
+
+    QVERIFY(root.rename("folder", "renamed"));
+    QTRY_COMPARE(rowNames(model, rootIndex), QStringList({"renamed", "new.txt"}));
+    QCOMPARE(model.nodeCount(), nodes - 1);
+    QCOMPARE(model.watchCount(), watches - 1);
+    QVERIFY(!model.isFetched(model.index(0, 0, rootIndex)));
+}
+
+void TestFileTreeModel::testRescanAfterManyChanges()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+
+    FileTreeModel model;
+    const QModelIndex rootIndex = model.setRootPath(tempDir.path());
+    QTRY_VERIFY(model.isFetched(rootIndex));
+
+    const int count = FileTreeModel::RescanThreshold * 2;
+    for (int i = 0; i < count; ++i)
+    {
+        touch(tempDir.filePath(QString("file%1.txt").arg(i, 4, 10, QChar('0'))));
+    }
+
+    // Read again as a whole, or checked name by name when the events came in small bursts
+    QTRY_COMPARE(model.rowCount(rootIndex), count);
+
+    const QStringList names = rowNames(model, rootIndex);
+    QCOMPARE(names.first(), QString("file0000.txt"));
+    QCOMPARE(names.last(), QString("file%1.txt").arg(count - 1, 4, 10, QChar('0')));
+    QVERIFY(model.memoryUsage() > 0);
+
+    // Held back while suspended, as during a batch, then applied at once
+    model.suspendChanges();
+    for (const QString &name : names)
+    {
+        QVERIFY(QFile::remove(tempDir.filePath(name)));
+    }
+    QTest::qWait(FileTreeModel::CoalesceInterval * 4);
+    QCOMPARE(model.rowCount(rootIndex), count);
+
+    model.resumeChanges();
+    QTRY_COMPARE(model.rowCount(rootIndex), 0);
+}
+
+void TestFileTreeModel::testIgnorePatterns()
+{
+    QVERIFY(IgnoreRules::globMatch(u"*.o", u"main.o"));
+    QVERIFY(!IgnoreRules::globMatch(u"*.o", u"obj/main.o"));
+    QVERIFY(IgnoreRules::globMatch(u"a/**/b", u"a/b"));
+    QVERIFY(IgnoreRules::globMatch(u"a/**/b", u"a/x/y/b"));
+    QVERIFY(IgnoreRules::globMatch(u"[!a-c]x", u"dx"));
+    QVERIFY(!IgnoreRules::globMatch(u"?x", u"/x"));
+
+    IgnoreRules rules;
+    rules.addPatterns("# Build output\n\nbuild/\n*.o\n!keep.o\n/root.txt\nsrc/*.gen\n**/tmp\n");
+    QCOMPARE(rules.size(), 6);
+
+    using Match = IgnoreRules::Match;
+    QCOMPARE(rules.match(u"build", true), Match::Ignored);
+    QCOMPARE(rules.match(u"lib/build", true), Match::Ignored);
+    QCOMPARE(rules.match(u"build", false), Match::None);
+    QCOMPARE(rules.match(u"lib/main.o", false), Match::Ignored);
+    QCOMPARE(rules.match(u"lib/keep.o", false), Match::Included);
+    QCOMPARE(rules.match(u"root.txt", false), Match::Ignored);
+    QCOMPARE(rules.match(u"lib/root.txt", false), Match::None);
+    QCOMPARE(rules.match(u"src/parser.gen", false), Match::Ignored);
+    QCOMPARE(rules.match(u"lib/src/parser.gen", false), Match::None);
+    QCOMPARE(rules.match(u"a/b/tmp", true), Match::Ignored);
+
+    // Deeper rules override the ones above, relative to their own directory
+    auto top = std::make_shared<IgnoreRules>();
+    top->addPatterns("*.log\n");
+    auto lib = std::make_shared<IgnoreRules>("lib");
+    lib->addPatterns("!important.log\n/generated/\n");
+
+    const std::vector<std::shared_ptr<const IgnoreRules>> chain = {top, lib};
+    QVERIFY(IgnoreRules::isIgnored(chain, u"lib/debug.log", false));
+    QVERIFY(!IgnoreRules::isIgnored(chain, u"lib/important.log", false));
+    QVERIFY(IgnoreRules::isIgnored(chain, u"lib/generated", true));
+    QVERIFY(!IgnoreRules::isIgnored(chain, u"lib/sub/generated", true));
+}
+
+void TestFileTreeModel::testIgnoredEntries()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    QVERIFY(root.mkpath("build/objects"));
+    QVERIFY(root.mkpath("src/generated"));
+    QVERIFY(root.mkpath("vendor"));
+    touch(root.filePath("src/main.cpp"));
+    touch(root.filePath("src/main.o"));
+
+    QFile gitignore(root.filePath(".gitignore"));
+    QVERIFY(gitignore.open(QIODevice::WriteOnly));
+    gitignore.write("build/\n*.o\n");
+    gitignore.close();
+
+    QFile srcIgnore(root.filePath("src/.ignore"));
+    QVERIFY(srcIgnore.open(QIODevice::WriteOnly));
+    srcIgnore.write("generated/\n");
+    srcIgnore.close();
+
+    IgnoreRules excludes;
+    excludes.addPatterns("vendor/\n");
+
+    FileTreeModel model;
+    model.setExcludes(excludes);
+    const QModelIndex rootIndex = model.setRootPath(tempDir.path());
+    QTRY_VERIFY(model.isFetched(rootIndex));
+    QCOMPARE(rowNames(model, rootIndex), QStringList({"src", ".gitignore"}));
+
+    const QModelIndex src = model.index(0, 0, rootIndex);
+    model.fetchMore(src);
+    QTRY_VERIFY(model.isFetched(src));
+    QCOMPARE(rowNames(model, src), QStringList({".ignore", "main.cpp"}));
+    QCOMPARE(model.watchCount(), 2);
+
+    // New files are filtered as well
+    touch(root.filePath("src/util.o"));
+    touch(root.filePath("src/util.cpp"));
+    QTRY_COMPARE(rowNames(model, src), QStringList({".ignore", "main.cpp", "util.cpp"}));
+
+    // Shown on demand, greyed out, and read only once expanded
+    model.setShowIgnored(true);
+    QTRY_COMPARE(rowNames(model, rootIndex), QStringList({"build", "src", "vendor", ".gitignore"}));
+    QTRY_COMPARE(rowNames(model, model.index(1, 0, rootIndex)),
+                 QStringList({"generated", ".ignore", "main.cpp", "main.o", "util.cpp", "util.o"}));
+
+    const QModelIndex build = model.index(0, 0, rootIndex);
+    QVERIFY(model.isIgnored(build));
+    QVERIFY(!model.isIgnored(model.index(1, 0, rootIndex)));
+    QVERIFY(model.data(build, Qt::ForegroundRole).isValid());
+    QVERIFY(model.canFetchMore(build));
+    QCOMPARE(model.watchCount(), 2);
+
+    model.setShowIgnored(false);
+    QTRY_COMPARE(rowNames(model, rootIndex), QStringList({"src", ".gitignore"}));
+
+    // Editing an ignore file applies to what is listed below it
+    QVERIFY(gitignore.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    gitignore.write("build/\n");
+    gitignore.close();
+    QTRY_COMPARE(rowNames(model, model.index(0, 0, rootIndex)),
+                 QStringList({".ignore", "main.cpp", "main.o", "util.cpp", "util.o"}));
+}
+
+QTEST_MAIN(TestFileTreeModel)
+#include "test_filetreemodel.moc"
@@ -5,6 +5,12 @@
 #include "MainWindow.h"
 #include "CodeEditor.h"
 #include "FileManager.h"
+#include "DocumentCache.h"
+
+#include <QApplication>
+#include <QTabBar>
+#include <QTemporaryDir>
+#include <QTimer>
 
 class TestMainWindow : public QObject
 {
@@ -18,6 +24,8 @@ private slots:
   void testMenuBar();
   void testInitTree();
   void testCreateAction();
+  void testDocumentTabs();
+  void testFailedOpen();
 
 private:
   std::unique_ptr<MainWindow> mainWindow;
@@ -103,5 +111,102 @@ void TestMainWindow::testCreateAction()
     QCOMPARE_EQ(slotCalled, true);
 }
 
+void TestMainWindow::testDocumentTabs()
+{
+  QTemporaryDir tempDir;
+  QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+  const QString first  = tempDir.filePath("first.cpp");
+  const QString second = tempDir.filePath("second.txt");
+  for (const QString &path : {first, second})
+  {
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("int main()\n{\n    return 0;\n}\n");
+  }
+
+  FileManager &fileManager = FileManager::getInstance();
+  CodeEditor *editor       = mainWindow->findChild<CodeEditor *>();
+  QVERIFY(fileManager.switchToFile(first));
+
+  QTextDocument *firstDocument = editor->document();
+  QTextCursor cursor           = editor->textCursor();
+  cursor.setPosition(5);
+  editor->setTextCursor(cursor);
+
+  QVERIFY(fileManager.switchToFile(second));
+  QVERIFY(editor->document() != firstDocument);
+  QVERIFY(fileManager.documentCache()->contains(first));
+
+  // Switching back swaps the same document in, with its cursor
+  QVERIFY(fileManager.switchToFile(first));
+  QCOMPARE(editor->document(), firstDocument);
+  QCOMPARE(editor->textCursor().position(), 5);
+  QVERIFY(fileManager.documentCache()->contains(second));
+
+  QTabBar *tabBar = mainWindow->findChild<QTabBar *>();
+  QVERIFY2(tabBar != nullptr, "MainWindow must contain a QTabBar.");
+  QCOMPARE(tabBar->count(), 2);
+  QCOMPARE(tabBar->tabData(tabBar->currentIndex()).toString(), first);
+
+  fileManager.closeDocument(second);
+  QVERIFY(!fileManager.documentCache()->contains(second));
+  QCOMPARE(fileManager.openDocuments(), QStringList({first}));
+
+  fileManager.closeDocument(first);
+  QVERIFY(fileManager.openDocuments().isEmpty());
+  QVERIFY(fileManager.getCurrentFileName().isEmpty());
+}
+
+void TestMainWindow::testFailedOpen()
+{
+  QTemporaryDir tempDir;
+  QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+
+  const QString shown      = tempDir.filePath("shown.cpp");
+  const QString unreadable = tempDir.filePath("unreadable.cpp");
+  for (const QString &path : {shown, unreadable})
+  {
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("int " + QFileInfo(path).baseName().toUtf8() + ";\n");
+  }
+  QVERIFY(QFile::setPermissions(unreadable, QFileDevice::Permissions()));
+  QFile probe(unreadable);
+  if (probe.open(QIODevice::ReadOnly))
+  {
+    QSKIP("File permissions are not enforced for this user.");
+  }
+
+  FileManager &fileManager = FileManager::getInstance();
+  QVERIFY(fileManager.switchToFile(shown));
+
+  // The error box, then the file dialog of saving an untitled document, are dismissed
+  QTimer dismiss;
+  dismiss.setInterval(50);
+  connect(&dismiss, &QTimer::timeout, []()
+  {
+    if (QWidget *modal = QApplication::activeModalWidget())
+    {
+      modal->close();
+    }
+  });
+  dismiss.start();
+
+  // The failed file is not left current, so saving cannot write the empty editor over it
+  fileManager.switchToFile(unreadable);
+  QVERIFY(fileManager.getCurrentFileName().isEmpty());
+  QVERIFY(!fileManager.openDocuments().contains(unreadable));
+  fileManager.saveFile();
+  dismiss.stop();
+
+  QVERIFY(QFile::setPermissions(unreadable, QFileDevice::ReadOwner | QFileDevice::WriteOwner));
+  QFile file(unreadable);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  QCOMPARE(file.readAll(), QByteArray("int unreadable;\n"));
+
+  fileManager.closeDocument(shown);
+}
+
 QTEST_MAIN(TestMainWindow)
 #include "test_mainwindow.moc"
@@ -0,0 +1,280 @@
+#include "PathIndex.h"
+#include "DirectoryWatcher.h"
+#include "FileTreeModel.h"
+
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+
+class TestPathIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testScore();
+    void testMatchPositions();
+    void testIndexAndSearch();
+    void testNarrowingSearch();
+    void testParallelSearch();
+    void testFollowsChanges();
+};
+
+namespace
+{
+    void touch(const QString &path)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+
+    int score(const char *query, const char *path)
+    {
+        return PathIndex::score(query, static_cast<int>(qstrlen(query)), path, static_cast<int>(qstrlen(path)));
+    }
+
+    QStringList paths(const PathIndex &index, const std::vector<PathIndex::Match> &matches)
+    {
+        QStringList result;
+        for (const PathIndex::Match &match : matches)
+        {
+            result << index.path(match.id);
+        }
+        return result;
+    }
+
+    QStringList search(PathIndex &index, const QString &query, int limit = PathIndex::DefaultLimit)
+    {
+        return paths(index, index.search(query, limit));
+    }
+}
+
+void TestPathIndex::testScore()
+{
+    QCOMPARE(score("xyz", "src/main.cpp"), -1);
+    QCOMPARE(score("niam", "src/main.cpp"), -1);
+    QVERIFY(score("main", "src/MAIN.cpp") >= 0);
+
+    // Starts of names and words, and runs of characters, come first
+    QVERIFY(score("mw", "src/MainWindow.cpp") > score("mw", "src/somewhere.cpp"));
+    QVERIFY(score("fm", "src/file_manager.cpp") > score("fm", "src/formatting.cpp"));
+    QVERIFY(score("main", "src/main.cpp") > score("main", "src/m_a_i_n.cpp"));
+    QVERIFY(score("tree", "src/Tree.cpp") > score("tree", "docs/tree/readme.md"));
+
+    // The name is preferred to a match spread over the directories
+    QVERIFY(score("abc", "abc.txt") > score("abc", "a/b/c.txt"));
+    QVERIFY(score("main", "src/maintenance/main.cpp") >= score("main", "src/maintenance/other.cpp"));
+}
+
+void TestPathIndex::testMatchPositions()
+{
+    QCOMPARE(PathIndex::matchPositions("mw", "src/MainWindow.cpp"), QList<int>({4, 8}));
+    QCOMPARE(PathIndex::matchPositions("main", "src/maintenance/main.cpp"), QList<int>({16, 17, 18, 19}));
+    QCOMPARE(PathIndex::matchPositions("m w", "src/MainWindow.cpp"), QList<int>({4, 8}));
+    QVERIFY(PathIndex::matchPositions("xyz", "src/main.cpp").isEmpty());
+
+    // Positions in the QString, not in its UTF-8
+    QCOMPARE(PathIndex::matchPositions("ts", QString::fromUtf8("d\xc3\xa9j\xc3\xa0/tests.cpp")), QList<int>({5, 7}));
+}
+
+void TestPathIndex::testIndexAndSearch()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    QVERIFY(root.mkpath("src/widgets"));
+    QVERIFY(root.mkpath("build/objects"));
+    QVERIFY(root.mkpath(".git/objects"));
+    touch(root.filePath("src/MainWindow.cpp"));
+    touch(root.filePath("src/widgets/main.cpp"));
+    touch(root.filePath("src/widgets/main.o"));
+    touch(root.filePath("build/objects/MainWindow.o"));
+    touch(root.filePath(".git/HEAD"));
+    touch(root.filePath("README.md"));
+    QVERIFY(QFile::link(root.filePath("src"), root.filePath("link")));
+
+    QFile gitignore(root.filePath(".gitignore"));
+    QVERIFY(gitignore.open(QIODevice::WriteOnly));
+    gitignore.write("build/\n*.o\n");
+    gitignore.close();
+
+    PathIndex index;
+    index.setExcludes(IgnoreRules::userExcludes());
+    QSignalSpy indexed(&index, &PathIndex::indexed);
+    index.setRootPath(tempDir.path());
+    QVERIFY(index.isIndexing());
+    QVERIFY(indexed.wait());
+    QVERIFY(!index.isIndexing());
+
+    // Ignored files, .git and links to directories are left out
+    QCOMPARE(index.size(), 4);
+    QVERIFY(index.memoryUsage() > 0);
+    QCOMPARE(search(index, "mainwindow"), QStringList({"src/MainWindow.cpp"}));
+    QCOMPARE(search(index, "main"), QStringList({"src/MainWindow.cpp", "src/widgets/main.cpp"}));
+    QCOMPARE(index.matchCount(), 2);
+    QVERIFY(search(index, "head").isEmpty());
+    QVERIFY(search(index, "").isEmpty());
+
+    QCOMPARE(search(index, "gitignore"), QStringList({".gitignore"}));
+    QCOMPARE(search(index, "readme"), QStringList({"README.md"}));
+    QVERIFY(search(index, "link").isEmpty());
+
+    const std::vector<PathIndex::Match> matches = index.search("swm");
+    QCOMPARE(matches.size(), size_t(1));
+    QCOMPARE(index.absolutePath(matches[0].id), root.filePath("src/widgets/main.cpp"));
+
+    // Limited to the best ones
+    QCOMPARE(search(index, "main", 1), QStringList({"src/MainWindow.cpp"}));
+    QCOMPARE(index.matchCount(), 2);
+}
+
+void TestPathIndex::testNarrowingSearch()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    for (const QString &directory : {"core", "model", "view", "util"})
+    {
+        QVERIFY(root.mkdir(directory));
+        for (int i = 0; i < 50; ++i)
+        {
+            touch(root.filePath(QString("%1/%2File%3.cpp").arg(directory, directory).arg(i)));
+        }
+    }
+
+    PathIndex index;
+    QSignalSpy indexed(&index, &PathIndex::indexed);
+    index.setRootPath(tempDir.path());
+    QVERIFY(indexed.wait());
+    QCOMPARE(index.size(), 200);
+
+    // Typing one character at a time finds what a search from scratch does
+    const QString query = "modfile12";
+    for (int length = 1; length <= query.size(); ++length)
+    {
+        const QStringList typed = search(index, query.left(length));
+        const int typedCount    = index.matchCount();
+
+        search(index, "zzz");
+        QCOMPARE(search(index, query.left(length)), typed);
+        QCOMPARE(index.matchCount(), typedCount);
+    }
+    QCOMPARE(search(index, query).first(), QString("model/modelFile12.cpp"));
+
+    // Going back does not narrow
+    QCOMPARE(search(index, "file").size(), qsizetype(PathIndex::DefaultLimit));
+    QCOMPARE(index.matchCount(), 200);
+}
+
+void TestPathIndex::testParallelSearch()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    for (int directory = 0; directory < 100; ++directory)
+    {
+        const QString name = QString("dir%1").arg(directory);
+        QVERIFY(root.mkdir(name));
+        for (int i = 0; i < 400; ++i)
+        {
+            touch(root.filePath(QString("%1/file%2.txt").arg(name).arg(i)));
+        }
+    }
+
+    PathIndex index;
+    QSignalSpy indexed(&index, &PathIndex::indexed);
+    index.setRootPath(tempDir.path());
+    QVERIFY(indexed.wait(30000));
+    QCOMPARE(index.size(), 40000);
+
+    // Scored in several chunks, the results are those of scoring every path
+    const QByteArray query = "d7f39";
+    std::vector<PathIndex::Match> expected;
+    for (quint32 id = 0; id < 40000; ++id)
+    {
+        const QByteArray path = index.path(id).toUtf8();
+        const int value = PathIndex::score(query.constData(), static_cast<int>(query.size()), path.constData(),
+                                           static_cast<int>(path.size()));
+        if (value >= 0)
+        {
+            expected.push_back({id, value});
+        }
+    }
+    std::sort(expected.begin(), expected.end(), [&index](const PathIndex::Match &left, const PathIndex::Match &right)
+    {
+        if (left.score != right.score)
+        {
+            return left.score > right.score;
+        }
+        const qsizetype leftLength  = index.path(left.id).size();
+        const qsizetype rightLength = index.path(right.id).size();
+        return leftLength != rightLength ? leftLength < rightLength : left.id < right.id;
+    });
+
+    const std::vector<PathIndex::Match> matches = index.search(query, 20);
+    QCOMPARE(index.matchCount(), static_cast<int>(expected.size()));
+    QCOMPARE(matches.size(), size_t(20));
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        QCOMPARE(matches[i].id, expected[i].id);
+        QCOMPARE(matches[i].score, expected[i].score);
+    }
+}
+
+void TestPathIndex::testFollowsChanges()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    QVERIFY(root.mkdir("src"));
+    touch(root.filePath("src/old.cpp"));
+
+    PathIndex index;
+    QSignalSpy indexed(&index, &PathIndex::indexed);
+    index.setRootPath(tempDir.path());
+    QVERIFY(indexed.wait());
+    QCOMPARE(search(index, "old"), QStringList({"src/old.cpp"}));
+
+    // The tree shares the watches of the index
+    QCOMPARE(DirectoryWatcher::getInstance().watchCount(), 2);
+    FileTreeModel model;
+    const QModelIndex rootIndex = model.setRootPath(tempDir.path());
+    QTRY_VERIFY(model.isFetched(rootIndex));
+    QCOMPARE(model.watchCount(), 1);
+    QCOMPARE(DirectoryWatcher::getInstance().watchCount(), 2);
+
+    touch(root.filePath("src/new.cpp"));
+    QTRY_COMPARE(search(index, "new"), QStringList({"src/new.cpp"}));
+
+    QVERIFY(QFile::remove(root.filePath("src/old.cpp")));
+    QTRY_VERIFY(search(index, "old").isEmpty());
+    QCOMPARE(index.size(), 1);
+
+    // New directories are read with everything below them
+    QVERIFY(root.mkpath("lib/deep/er"));
+    touch(root.filePath("lib/deep/er/found.cpp"));
+    QTRY_COMPARE(search(index, "found"), QStringList({"lib/deep/er/found.cpp"}));
+
+    // Ignoring a directory drops what it holds
+    QFile gitignore(root.filePath(".gitignore"));
+    QVERIFY(gitignore.open(QIODevice::WriteOnly));
+    gitignore.write("lib/\n");
+    gitignore.close();
+    QTRY_VERIFY(search(index, "found").isEmpty());
+    QTRY_COMPARE(index.size(), 2);
+
+    // A pattern rewritten in place, with as many rules, applies as well
+    QVERIFY(gitignore.open(QIODevice::WriteOnly));
+    gitignore.write("src/\n");
+    gitignore.close();
+    QTRY_COMPARE(search(index, "found"), QStringList({"lib/deep/er/found.cpp"}));
+    QTRY_VERIFY(search(index, "new").isEmpty());
+
+    QVERIFY(QDir(root.filePath("lib")).removeRecursively());
+    QTRY_VERIFY(search(index, "found").isEmpty());
+    QCOMPARE(search(index, "gitignore"), QStringList({".gitignore"}));
+}
+
+QTEST_MAIN(TestPathIndex)
+#include "test_pathindex.moc"
@@ -0,0 +1,202 @@
+#include "PieceTable.h"
+#include "LargeFileDocument.h"
+
+#include <QtTest>
+#include <QSignalSpy>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+
+class TestPieceTable : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testEditsMatchReference();
+    void testPartialIndex();
+    void testLargeFileSave();
+    void testLargeFileFormat();
+};
+
+namespace
+{
+    void compareLines(const PieceTable &table, const QByteArray &reference)
+    {
+        const QList<QByteArray> lines = reference.split('\n');
+        QCOMPARE(table.size(), reference.size());
+        QCOMPARE(table.lineCount(), lines.size());
+
+        qint64 offset = 0;
+        for (qsizetype i = 0; i < lines.size(); ++i)
+        {
+            QCOMPARE(table.lineStart(i), offset);
+            QCOMPARE(table.line(i), lines[i]);
+            QCOMPARE(table.lineOf(offset), i);
+            offset += lines[i].size() + 1;
+        }
+    }
+}
+
+void TestPieceTable::testEditsMatchReference()
+{
+    const QByteArray original = "first line\nsecond line\n\nfourth line without end";
+    PieceTable table;
+    table.setOriginal(original.constData(), original.size());
+    table.appendOriginalIndex(PieceTable::indexLines(original.constData(), 0, original.size()), original.size());
+    QVERIFY(table.isIndexed());
+    compareLines(table, original);
+
+    // Typing at the same place extends a single piece
+    table.insert(5, "a");
+    table.insert(6, "b");
+    QCOMPARE(table.pieceCount(), 3);
+
+    QByteArray reference = original;
+    reference.insert(5, "ab");
+    compareLines(table, reference);
+
+    QRandomGenerator random(42);
+    const QByteArray alphabet = "ab\n";
+    for (int i = 0; i < 500; ++i)
+    {
+        const qint64 offset = random.bounded(static_cast<int>(reference.size()) + 1);
+        if (random.bounded(2) == 0)
+        {
+            QByteArray bytes;
+            for (int j = random.bounded(1, 6); j > 0; --j)
+            {
+                bytes += alphabet[random.bounded(static_cast<int>(alphabet.size()))];
+            }
+            table.insert(offset, bytes);
+            reference.insert(offset, bytes);
+        }
+        else
+        {
+            const qint64 length = random.bounded(6);
+            table.remove(offset, length);
+            reference.remove(offset, length);
+        }
+
+        // Queries between edits see the offsets brought up to date lazily
+        if (i % 50 == 0)
+        {
+            compareLines(table, reference);
+        }
+    }
+    compareLines(table, reference);
+
+    QByteArray spans;
+    table.forEachSpan([&spans](QByteArrayView span)
+    {
+        spans += span;
+        return true;
+    });
+    QCOMPARE(spans, reference);
+}
+
+void TestPieceTable::testPartialIndex()
+{
+    const QByteArray original = "one\ntwo\nthree";
+    PieceTable table;
+    table.setOriginal(original.constData(), original.size());
+
+    // Only the lines ended by an indexed '\n' are known
+    table.appendOriginalIndex(PieceTable::indexLines(original.constData(), 0, 5), 5);
+    QVERIFY(!table.isIndexed());
+    QCOMPARE(table.lineCount(), 1);
+    QCOMPARE(table.line(0), QByteArray("one"));
+
+    table.appendOriginalIndex(PieceTable::indexLines(original.constData(), 5, original.size()), original.size());
+    QVERIFY(table.isIndexed());
+    QCOMPARE(table.lineCount(), 3);
+    QCOMPARE(table.line(2), QByteArray("three"));
+}
+
+void TestPieceTable::testLargeFileSave()
+{
+    QTemporaryDir directory;
+    const QString path = directory.filePath("large.log");
+
+    QByteArray contents;
+    for (int i = 0; i < 1000; ++i)
+    {
+        contents += "line " + QByteArray::number(i) + "\n";
+    }
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(contents);
+    file.close();
+
+    LargeFileDocument document;
+    QVERIFY(document.open(path).success);
+    QTRY_VERIFY(document.isIndexed());
+    QCOMPARE(document.text().lineCount(), 1001);
+
+    // Saving over the mapped file keeps reading the previous version
+    document.insert(document.text().lineStart(10), "inserted\n");
+    document.remove(0, 7);
+    QVERIFY(document.isModified());
+    QSignalSpy saved(&document, &LargeFileDocument::saved);
+    QVERIFY(document.save(path).success);
+
+    // Written on a worker thread, with edits ignored until it is done
+    QVERIFY(document.isSaving());
+    QVERIFY(!document.isEditable());
+    const qint64 size = document.text().size();
+    document.insert(0, "ignored\n");
+    QCOMPARE(document.text().size(), size);
+    QVERIFY(!document.save(path).success);
+
+    QVERIFY(saved.wait());
+    QCOMPARE(saved.first().at(0).toBool(), true);
+    QVERIFY(!document.isModified());
+    QVERIFY(document.isEditable());
+
+    contents.insert(contents.indexOf("line 10\n"), "inserted\n");
+    contents.remove(0, 7);
+
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), contents);
+}
+
+void TestPieceTable::testLargeFileFormat()
+{
+    QTemporaryDir directory;
+    const QString latin1Path = directory.filePath("latin1.log");
+    const QString utf16Path  = directory.filePath("utf16.log");
+
+    QFile file(latin1Path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    for (int i = 0; i < 100; ++i)
+    {
+        file.write("caf\xE9 " + QByteArray::number(i) + "\r\n");
+    }
+    file.close();
+
+    // Lines are decoded, and edits encoded, as the file is
+    QVERIFY(LargeFileDocument::canOpen(latin1Path));
+    LargeFileDocument document;
+    QVERIFY(document.open(latin1Path).success);
+    QTRY_VERIFY(document.isIndexed());
+    QCOMPARE(document.format().encoding, QStringConverter::Latin1);
+    QCOMPARE(document.format().lineEnding, TextFormat::LineEnding::CRLF);
+    QCOMPARE(document.lineEnding(), QByteArray("\r\n"));
+    QCOMPARE(document.decode(document.text().line(0)), QString::fromUtf8("caf\u00e9 0\r"));
+
+    bool lossless = false;
+    QCOMPARE(document.encode(QString::fromUtf8("\u00e9"), &lossless), QByteArray("\xE9"));
+    QVERIFY(lossless);
+    document.encode(QString::fromUtf8("\u20ac"), &lossless);
+    QVERIFY(!lossless);
+
+    // '\n' is not a byte of its own in UTF-16
+    file.setFileName(utf16Path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("\xFF\xFE" "a\0\n\0");
+    file.close();
+    QVERIFY(!LargeFileDocument::canOpen(utf16Path));
+    QVERIFY(!document.open(utf16Path).success);
+}
+
+QTEST_MAIN(TestPieceTable)
+#include "test_piecetable.moc"
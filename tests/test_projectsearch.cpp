@@ -0,0 +1,280 @@
+#include "ProjectSearch.h"
+
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+
+class TestProjectSearch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testFindLiteral();
+    void testSearch();
+    void testSkipsIgnoredAndBinary();
+    void testRegularExpression();
+    void testEncodingsAndBlocks();
+    void testCancel();
+    void testMaxHits();
+};
+
+namespace
+{
+    void write(const QString &path, const QByteArray &content)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(content);
+    }
+
+    qsizetype find(const QByteArray &data, const QByteArray &needle, bool caseSensitive = true)
+    {
+        return ProjectSearch::findLiteral(data.constData(), data.size(), needle, caseSensitive);
+    }
+
+    // Runs a search to its end and returns its hits, sorted by file and line
+    QList<ProjectSearch::Hit> search(ProjectSearch &search, const QString &root, const QString &pattern,
+                                     ProjectSearch::Options options = {})
+    {
+        QList<ProjectSearch::Hit> hits;
+        QMetaObject::Connection connection = QObject::connect(&search, &ProjectSearch::hitsFound,
+                                                              [&hits](const QList<ProjectSearch::Hit> &found)
+        {
+            hits += found;
+        });
+
+        QSignalSpy finished(&search, &ProjectSearch::finished);
+        if (search.start(root, pattern, options).success)
+        {
+            finished.wait(10000);
+        }
+        QObject::disconnect(connection);
+
+        std::sort(hits.begin(), hits.end(), [](const ProjectSearch::Hit &left, const ProjectSearch::Hit &right)
+        {
+            return left.filePath != right.filePath ? left.filePath < right.filePath : left.line < right.line;
+        });
+        return hits;
+    }
+
+    QStringList locations(const QList<ProjectSearch::Hit> &hits, const QString &root)
+    {
+        QStringList result;
+        for (const ProjectSearch::Hit &hit : hits)
+        {
+            result << QString("%1:%2:%3").arg(QDir(root).relativeFilePath(hit.filePath)).arg(hit.line).arg(hit.column);
+        }
+        return result;
+    }
+}
+
+void TestProjectSearch::testFindLiteral()
+{
+    QCOMPARE(find("hello world", "world"), qsizetype(6));
+    QCOMPARE(find("hello world", "World"), qsizetype(-1));
+    QCOMPARE(find("hello World", "world", false), qsizetype(6));
+    QCOMPARE(find("hello", "hello!"), qsizetype(-1));
+    QCOMPARE(find("hello", ""), qsizetype(-1));
+    QCOMPARE(find("abc", "c"), qsizetype(2));
+
+    // Around the 16 byte chunks, and in the tail after the last full one
+    const QByteArray padding(37, '.');
+    for (int at = 0; at + 6 <= padding.size(); ++at)
+    {
+        QByteArray data = padding;
+        data.replace(at, 6, "NeEdLe");
+        QCOMPARE(find(data, "NeEdLe"), qsizetype(at));
+        QCOMPARE(find(data, "needle", false), qsizetype(at));
+        QCOMPARE(find(data, "needle"), qsizetype(-1));
+    }
+
+    // First of several, and only bytes above 0x7f left as they are
+    QCOMPARE(find(QByteArray(40, 'a') + "ab" + QByteArray(20, 'b') + "ab", "ab"), qsizetype(40));
+    QCOMPARE(find("caf\xc3\xa9 CAF\xc3\x89", "caf\xc3\x89", false), qsizetype(6));
+    QCOMPARE(find("[\\]^_`", "[\\]^_`", false), qsizetype(0));
+}
+
+void TestProjectSearch::testSearch()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    QVERIFY(root.mkpath("src/deep"));
+    write(root.filePath("src/main.cpp"), "int main()\n{\n    return Value + value;\n}\n");
+    write(root.filePath("src/deep/other.h"), "// value\nstatic int VALUE;");
+    write(root.filePath("notes.txt"), QString::fromUtf8("é value\r\n").toUtf8());
+    write(root.filePath("empty.txt"), "");
+
+    ProjectSearch projectSearch;
+    QList<ProjectSearch::Hit> hits = search(projectSearch, tempDir.path(), "value");
+
+    // One hit per line, at the first match; columns count characters, not bytes
+    QCOMPARE(locations(hits, tempDir.path()),
+             QStringList({"notes.txt:1:2", "src/deep/other.h:1:3", "src/deep/other.h:2:11", "src/main.cpp:3:11"}));
+    QCOMPARE(hits[0].text, QString::fromUtf8("é value\r"));
+    QCOMPARE(hits[3].text, QString("    return Value + value;"));
+    QCOMPARE(hits[3].length, 5);
+    QVERIFY(!projectSearch.isRunning());
+
+    ProjectSearch::Options options;
+    options.caseSensitive = true;
+    hits = search(projectSearch, tempDir.path(), "value", options);
+    QCOMPARE(locations(hits, tempDir.path()),
+             QStringList({"notes.txt:1:2", "src/deep/other.h:1:3", "src/main.cpp:3:19"}));
+
+    // Non ASCII text without case is searched as a regular expression
+    hits = search(projectSearch, tempDir.path(), QString::fromUtf8("É"));
+    QCOMPARE(locations(hits, tempDir.path()), QStringList({"notes.txt:1:0"}));
+
+    QVERIFY(!projectSearch.start(tempDir.path(), "", {}).success);
+    QVERIFY(!projectSearch.start(root.filePath("missing"), "value", {}).success);
+}
+
+void TestProjectSearch::testSkipsIgnoredAndBinary()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    QVERIFY(root.mkpath("src"));
+    QVERIFY(root.mkpath("build"));
+    QVERIFY(root.mkpath(".git"));
+    write(root.filePath("src/found.cpp"), "marker\n");
+    write(root.filePath("src/found.log"), "marker\n");
+    write(root.filePath("build/output.cpp"), "marker\n");
+    write(root.filePath(".git/config"), "marker\n");
+    write(root.filePath("image.bin"), QByteArray("marker\0\1\2", 9));
+    write(root.filePath(".gitignore"), "build/\n*.log\n");
+    QVERIFY(QFile::link(root.filePath("src"), root.filePath("link")));
+
+    ProjectSearch projectSearch;
+    projectSearch.setExcludes(IgnoreRules::userExcludes());
+
+    QList<ProjectSearch::Hit> hits;
+    connect(&projectSearch, &ProjectSearch::hitsFound, this, [&hits](const QList<ProjectSearch::Hit> &found)
+    {
+        hits += found;
+    });
+    QSignalSpy finished(&projectSearch, &ProjectSearch::finished);
+    QVERIFY(projectSearch.start(tempDir.path(), "marker", {}).success);
+    QVERIFY(finished.wait());
+
+    QCOMPARE(locations(hits, tempDir.path()), QStringList({"src/found.cpp:1:0"}));
+    QCOMPARE(finished.first().at(1).toInt(), 1);
+}
+
+void TestProjectSearch::testRegularExpression()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    write(root.filePath("code.cpp"), "int first = 1;\nint second;\nfloat third = 3.5;\n");
+
+    ProjectSearch projectSearch;
+    ProjectSearch::Options options;
+    options.regularExpression = true;
+
+    QList<ProjectSearch::Hit> hits = search(projectSearch, tempDir.path(), "\\w+ = \\d", options);
+    QCOMPARE(locations(hits, tempDir.path()), QStringList({"code.cpp:1:4", "code.cpp:3:6"}));
+    QCOMPARE(hits[1].length, 9);
+
+    // Anchors apply to each line
+    hits = search(projectSearch, tempDir.path(), "^int", options);
+    QCOMPARE(locations(hits, tempDir.path()), QStringList({"code.cpp:1:0", "code.cpp:2:0"}));
+
+    // Literal text in regular expression mode takes the fast path, with the same results
+    hits = search(projectSearch, tempDir.path(), "SECOND", options);
+    QCOMPARE(locations(hits, tempDir.path()), QStringList({"code.cpp:2:4"}));
+
+    const OperationResult result = projectSearch.start(tempDir.path(), "(unclosed", options);
+    QVERIFY(!result.success);
+    QVERIFY(QString::fromStdString(result.message).startsWith("Invalid regular expression"));
+    QVERIFY(!projectSearch.isRunning());
+}
+
+void TestProjectSearch::testEncodingsAndBlocks()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    write(root.filePath("latin1.txt"), "caf\xE9 value\n");
+    write(root.filePath("utf16.txt"), QByteArray("\xFF\xFE" "a\0\n\0v\0a\0l\0u\0e\0\n\0", 18));
+
+    // Lines ending past a block, and one longer than a block
+    const QByteArray lines = QByteArray("a\n").repeated(ProjectSearch::ReadSize);
+    write(root.filePath("large.txt"), lines + QByteArray(ProjectSearch::ReadSize + 10, 'b') + "value\nvalue\n");
+
+    ProjectSearch projectSearch;
+    QList<ProjectSearch::Hit> hits = search(projectSearch, tempDir.path(), "value");
+    const QString last = QString::number(ProjectSearch::ReadSize + 1) + ":" + QString::number(ProjectSearch::ReadSize + 10);
+    QCOMPARE(locations(hits, tempDir.path()),
+             QStringList({"large.txt:" + last, "large.txt:" + QString::number(ProjectSearch::ReadSize + 2) + ":0",
+                          "latin1.txt:1:5", "utf16.txt:2:0"}));
+    QCOMPARE(hits[2].text, QString::fromUtf8("café value"));
+
+    // Text that is not ASCII is found in the decoded Latin-1 file
+    ProjectSearch::Options options;
+    options.caseSensitive = true;
+    hits = search(projectSearch, tempDir.path(), QString::fromUtf8("café"), options);
+    QCOMPARE(locations(hits, tempDir.path()), QStringList({"latin1.txt:1:0"}));
+
+    options.regularExpression = true;
+    hits = search(projectSearch, tempDir.path(), "v\\w+e$", options);
+    QCOMPARE(locations(hits, tempDir.path()).mid(2), QStringList({"latin1.txt:1:5", "utf16.txt:2:0"}));
+}
+
+void TestProjectSearch::testCancel()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+    for (int directory = 0; directory < 20; ++directory)
+    {
+        const QString name = QString("dir%1").arg(directory);
+        QVERIFY(root.mkdir(name));
+        for (int i = 0; i < 50; ++i)
+        {
+            write(root.filePath(QString("%1/file%2.txt").arg(name).arg(i)), "first\nsecond\n");
+        }
+    }
+
+    ProjectSearch projectSearch;
+    QSignalSpy finished(&projectSearch, &ProjectSearch::finished);
+    QVERIFY(projectSearch.start(tempDir.path(), "first", {}).success);
+    projectSearch.cancel();
+    QVERIFY(!projectSearch.isRunning());
+
+    // A cancelled search reports nothing; the one replacing it runs to its end
+    QList<ProjectSearch::Hit> hits = search(projectSearch, tempDir.path(), "second");
+    QCOMPARE(hits.size(), qsizetype(1000));
+    for (const ProjectSearch::Hit &hit : hits)
+    {
+        QCOMPARE(hit.line, 2);
+    }
+    QCOMPARE(finished.size(), 1);
+    QCOMPARE(finished.first().at(0).toInt(), 1000);
+}
+
+void TestProjectSearch::testMaxHits()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    QDir root(tempDir.path());
+
+    const QByteArray lines = QByteArray("hit\n").repeated(ProjectSearch::MaxHits / 4);
+    for (int i = 0; i < 6; ++i)
+    {
+        write(root.filePath(QString("file%1.txt").arg(i)), lines);
+    }
+
+    ProjectSearch projectSearch;
+    QSignalSpy finished(&projectSearch, &ProjectSearch::finished);
+    const QList<ProjectSearch::Hit> hits = search(projectSearch, tempDir.path(), "hit");
+    QCOMPARE(hits.size(), qsizetype(ProjectSearch::MaxHits));
+    QCOMPARE(finished.size(), 1);
+    QCOMPARE(finished.first().at(1).toInt(), ProjectSearch::MaxHits);
+}
+
+QTEST_MAIN(TestProjectSearch)
+#include "test_projectsearch.moc"
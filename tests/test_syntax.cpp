@@ -1,9 +1,18 @@
 #include <QtTest>
 #include "Syntax.h"
+#include "SyntaxProfiler.h"
+#include "SyntaxPrefilter.h"
+#include "SyntaxLexer.h"
 
 #include <QTextDocument>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QTextCursor>
 #include <QColor>
+#include <QSignalSpy>
+#include <QElapsedTimer>
 #include <yaml-cpp/yaml.h>
+#include <algorithm>
 
 // Helper function to create a YAML node for testing
 YAML::Node createTestConfig()
@@ -45,6 +54,14 @@ private slots:
   void testLoadValidSyntaxRules();
   void testLoadEmptySyntaxRules();
   void testLoadMissingKeywords();
+  void testBackgroundHighlighting();
+  void testBackgroundKeepsFormats();
+  void testRegionRules();
+  void testOverlappingMatches();
+  void testProfiler();
+  void testMatchBudget();
+  void testPrefilter();
+  void testLexer();
 };
 
 void TestSyntax::initTestCase()
@@ -101,5 +118,367 @@ void TestSyntax::testLoadMissingKeywords()
   QVERIFY(syntax->m_syntaxRules.isEmpty());
 }
 
+void TestSyntax::testBackgroundHighlighting()
+{
+  QStringList lines(Syntax::BackgroundThreshold + 1000, "int x;");
+  QTextDocument largeDocument;
+  largeDocument.setPlainText(lines.join('\n'));
+
+  Syntax background(&largeDocument, createTestConfig());
+  background.setBackgroundHighlighting(true);
+  background.setVisibleBlocks(0, 10);
+
+  // Off-screen blocks are formatted once the worker publishes them
+  QTextBlock lastBlock = largeDocument.lastBlock();
+  QTRY_VERIFY_WITH_TIMEOUT(!lastBlock.layout()->formats().isEmpty(), 10000);
+
+  const QTextLayout::FormatRange range = lastBlock.layout()->formats().first();
+  QCOMPARE_EQ(range.start, 0);
+  QCOMPARE_EQ(range.length, 3);
+  QCOMPARE_EQ(range.format.foreground().color(), QColor("#ff0000"));
+}
+
+void TestSyntax::testBackgroundKeepsFormats()
+{
+  YAML::Node config = createTestConfig();
+  YAML::Node region;
+  region["begin"] = "/\\*";
+  region["end"]   = "\\*/";
+  region["color"] = "#0000ff";
+  config["regions"]["comment"].push_back(region);
+
+  QStringList lines(Syntax::BackgroundThreshold + 1000, "int x;");
+  QTextDocument largeDocument;
+  largeDocument.setPlainText(lines.join('\n'));
+
+  Syntax background(&largeDocument, config);
+  background.setBackgroundHighlighting(true);
+  background.setVisibleBlocks(0, 10);
+  QTextBlock lastBlock = largeDocument.lastBlock();
+  QTRY_VERIFY_WITH_TIMEOUT(!lastBlock.layout()->formats().isEmpty(), 10000);
+
+  // Opening a comment on screen: off-screen blocks keep their formats until
+  // the worker publishes the new ones, then all turn into the comment
+  QTextCursor cursor(largeDocument.findBlockByNumber(2));
+  cursor.insertText("/*\n");
+  QTextBlock offScreen = largeDocument.findBlockByNumber(11); // Re-highlighted, as the state before it changed
+  QCOMPARE_EQ(offScreen.layout()->formats().size(), 1);
+  QCOMPARE_EQ(offScreen.layout()->formats().first().format.foreground().color(), QColor("#ff0000"));
+
+  QTRY_COMPARE_WITH_TIMEOUT(lastBlock.layout()->formats().first().format.foreground().color(), QColor("#0000ff"),
+                            10000);
+  QCOMPARE_EQ(offScreen.layout()->formats().first().format.foreground().color(), QColor("#0000ff"));
+  QCOMPARE_EQ(offScreen.layout()->formats().first().length, 6);
+
+  // Closing it turns them back, from the edit on
+  cursor.insertText("*/");
+  QTRY_COMPARE_WITH_TIMEOUT(lastBlock.layout()->formats().first().format.foreground().color(), QColor("#ff0000"),
+                            10000);
+  QCOMPARE_EQ(offScreen.layout()->formats().first().length, 3);
+}
+
+void TestSyntax::testRegionRules()
+{
+  YAML::Node config = createTestConfig();
+  YAML::Node region;
+  region["begin"] = "/\\*";
+  region["end"]   = "\\*/";
+  region["color"] = "#0000ff";
+  config["regions"]["comment"].push_back(region);
+
+  QTextDocument regionDocument;
+  regionDocument.setPlainText("int a; /* start\nint b;\nend */ int c;");
+  Syntax regions(&regionDocument, config);
+
+  QTextBlock inside = regionDocument.findBlockByNumber(1);
+  QCOMPARE_EQ(regionDocument.firstBlock().userState(), 1);
+  QCOMPARE_EQ(inside.userState(), 1);
+  QCOMPARE_EQ(inside.layout()->formats().size(), 1);
+  QCOMPARE_EQ(inside.layout()->formats().first().format.foreground().color(), QColor("#0000ff"));
+
+  // The region ends on the last block, the keyword after it is highlighted again
+  QTextBlock last = regionDocument.lastBlock();
+  QCOMPARE_EQ(last.userState(), 0);
+  QCOMPARE_EQ(last.layout()->formats().last().start, 7);
+  QCOMPARE_EQ(last.layout()->formats().last().format.foreground().color(), QColor("#ff0000"));
+
+  // Line rules apply after a region that closes on the block, not across it
+  Syntax::RuleSet ruleSet = regions.ruleSet();
+  ruleSet.rules.append(Syntax::compileRule("//[^\n]*", QTextCharFormat(), 0));
+  const int commentRegion = static_cast<int>(ruleSet.rules.size());
+
+  QVector<SyntaxToken> tokens;
+  QCOMPARE_EQ(Syntax::tokenize(ruleSet, "/* a // b */ int x; // c", 0, tokens), 0);
+  QCOMPARE_EQ(tokens.size(), 3);
+  QCOMPARE_EQ(tokens[0].start, 0);
+  QCOMPARE_EQ(tokens[0].length, 12);
+  QCOMPARE_EQ(tokens[0].rule, commentRegion);
+  QCOMPARE_EQ(tokens[1].start, 13);
+  QCOMPARE_EQ(tokens[1].rule, 0);
+  QCOMPARE_EQ(tokens[2].start, 20);
+  QCOMPARE_EQ(tokens[2].length, 4);
+  QCOMPARE_EQ(tokens[2].rule, 2);
+
+  // Same for a region carried over from the previous block
+  QCOMPARE_EQ(Syntax::tokenize(ruleSet, "a // b */ int y; /* c", 1, tokens), 1);
+  QCOMPARE_EQ(tokens.size(), 3);
+  QCOMPARE_EQ(tokens[0].length, 9);
+  QCOMPARE_EQ(tokens[1].start, 10);
+  QCOMPARE_EQ(tokens[1].rule, 0);
+  QCOMPARE_EQ(tokens[2].start, 17);
+  QCOMPARE_EQ(tokens[2].rule, commentRegion);
+
+  // Removing the begin marker re-highlights the following blocks
+  QTextCursor cursor(regionDocument.firstBlock());
+  cursor.setPosition(7);
+  cursor.setPosition(9, QTextCursor::KeepAnchor);
+  cursor.removeSelectedText();
+
+  QCOMPARE_EQ(inside.userState(), 0);
+  QCOMPARE_EQ(inside.layout()->formats().first().format.foreground().color(), QColor("#ff0000"));
+}
+
+void TestSyntax::testOverlappingMatches()
+{
+  QTextCharFormat red;
+  red.setForeground(QColor("#ff0000"));
+  QTextCharFormat green;
+  green.setForeground(QColor("#00ff00"));
+
+  QTextDocument overlapDocument;
+  Syntax overlap(&overlapDocument, YAML::Node());
+  overlap.addPattern("\\bint\\b", red);
+  overlap.addPattern("//[^\n]*", green);
+  overlap.addPattern("\\bx\\b", red);
+  overlapDocument.setPlainText("int x; // int y");
+
+  // The keyword inside the comment is not formatted on its own
+  const QList<QTextLayout::FormatRange> formats = overlapDocument.firstBlock().layout()->formats();
+  QCOMPARE_EQ(formats.size(), 3);
+  QCOMPARE_EQ(formats[2].start, 7);
+  QCOMPARE_EQ(formats[2].length, 8);
+  QCOMPARE_EQ(formats[2].format.foreground().color(), QColor("#00ff00"));
+
+  QVector<SyntaxToken> tokens;
+  Syntax::tokenize(overlap.ruleSet(), "int x; // int y", 0, tokens);
+  QCOMPARE_EQ(tokens.size(), 3);
+  QCOMPARE_EQ(tokens[1].rule, 2);
+  QCOMPARE_EQ(tokens[2].rule, 1);
+
+  // Adjacent tokens with the same format are applied as one span
+  QTextDocument mergeDocument;
+  Syntax merge(&mergeDocument, YAML::Node());
+  merge.addPattern("ab", red);
+  merge.addPattern("cd", red);
+  mergeDocument.setPlainText("abcd");
+  QCOMPARE_EQ(mergeDocument.firstBlock().layout()->formats().size(), 1);
+  QCOMPARE_EQ(mergeDocument.firstBlock().layout()->formats().first().length, 4);
+}
+
+void TestSyntax::testProfiler()
+{
+  SyntaxProfiler &profiler = SyntaxProfiler::getInstance();
+  profiler.reset();
+  profiler.setEnabled(true);
+
+  Syntax::RuleSet ruleSet;
+  ruleSet.rules    = Syntax::parseSyntaxRules(createTestConfig());
+  ruleSet.language = "test.syntax.yaml";
+
+  QVector<SyntaxToken> tokens;
+  Syntax::tokenize(ruleSet, "int a; int b; float c;", 0, tokens);
+  profiler.setEnabled(false);
+
+  // Every rule is accounted for, with its matches and the bytes it scanned
+  QCOMPARE_EQ(profiler.languages(), QStringList{"test.syntax.yaml"});
+  const QVector<SyntaxProfiler::RuleStats> ranking = profiler.ranking("test.syntax.yaml");
+  QVERIFY(ranking.size() >= 2);
+  for (qsizetype i = 1; i < ranking.size(); ++i)
+  {
+    QVERIFY(ranking[i - 1].nanoseconds >= ranking[i].nanoseconds);
+  }
+
+  auto rule = std::find_if(ranking.cbegin(), ranking.cend(), [](const SyntaxProfiler::RuleStats &stats)
+  {
+    return stats.label == "\\bint\\b";
+  });
+  QVERIFY(rule != ranking.cend());
+  QCOMPARE_EQ(rule->matches, 2);
+  QCOMPARE_EQ(rule->bytes, 22 * 2);
+  QVERIFY(profiler.report().contains("test.syntax.yaml"));
+
+  // Rules sharing a pattern keep an entry each; a block split by a region counts once, for the bytes scanned
+  YAML::Node config = createTestConfig();
+  YAML::Node region;
+  region["begin"] = "/\\*";
+  region["end"]   = "\\*/";
+  region["color"] = "#0000ff";
+  config["regions"]["comment"].push_back(region);
+  QTextDocument regionDocument;
+  Syntax regions(&regionDocument, config);
+  Syntax::RuleSet split = regions.ruleSet();
+  split.rules.append(Syntax::compileRule("\\bint\\b", QTextCharFormat(), 0));
+  split.language = "split.syntax.yaml";
+
+  profiler.setEnabled(true);
+  Syntax::tokenize(split, "int a; /* x */ int b;", 0, tokens);
+  profiler.setEnabled(false);
+
+  const QVector<SyntaxProfiler::RuleStats> splitRanking = profiler.ranking("split.syntax.yaml");
+  QCOMPARE_EQ(std::count_if(splitRanking.cbegin(), splitRanking.cend(), [](const SyntaxProfiler::RuleStats &stats)
+  {
+    return stats.label == "\\bint\\b";
+  }), 2);
+  for (const SyntaxProfiler::RuleStats &stats : splitRanking)
+  {
+    QCOMPARE_EQ(stats.blocks, 1);
+    if (stats.rule == 0)
+    {
+      QCOMPARE_EQ(stats.bytes, (21 + 7) * 2);
+    }
+  }
+  QVERIFY(std::any_of(splitRanking.cbegin(), splitRanking.cend(), [](const SyntaxProfiler::RuleStats &stats)
+  {
+    return stats.rule == SyntaxProfiler::Regions;
+  }));
+
+  // Nothing is recorded while disabled
+  profiler.reset();
+  Syntax::tokenize(ruleSet, "int a;", 0, tokens);
+  QVERIFY(profiler.languages().isEmpty());
+}
+
+void TestSyntax::testMatchBudget()
+{
+  QTextCharFormat red;
+  red.setForeground(QColor("#ff0000"));
+
+  QTextDocument budgetDocument;
+  Syntax budget(&budgetDocument, YAML::Node());
+  budget.addPattern("(a+)+$", red); // Backtracks exponentially on "aaa...!"
+  budget.addPattern("\\bint\\b", red);
+  QSignalSpy spy(&budget, &Syntax::matchBudgetExceeded);
+
+  QElapsedTimer timer;
+  timer.start();
+  budgetDocument.setPlainText(QStringList(Syntax::StrikeLimit + 1, "int " + QString(64, 'a') + "!").join('\n'));
+  QVERIFY(timer.elapsed() < 5000);
+
+  // Reported on the first block, then once more when disabled for the document
+  QTRY_COMPARE_EQ(spy.count(), 2);
+  QVERIFY(spy.last().first().toString().contains("disabled"));
+  QVERIFY(budget.ruleSet().guard->isDisabled(0));
+  QVERIFY(!budget.ruleSet().guard->isDisabled(1));
+
+  // The other rules still apply
+  const QTextBlock last = budgetDocument.lastBlock();
+  QCOMPARE_EQ(last.layout()->formats().size(), 1);
+  QCOMPARE_EQ(last.layout()->formats().first().length, 3);
+}
+
+void TestSyntax::testPrefilter()
+{
+  auto comment = SyntaxPrefilter::requiredCharacters(QRegularExpression("//[^\\n]*"));
+  QVERIFY(comment.has_value());
+  QCOMPARE_EQ(comment->count(), 1);
+  QVERIFY(comment->test('/'));
+
+  // Any word character may start a match
+  QVERIFY(!SyntaxPrefilter::requiredCharacters(QRegularExpression("\\b\\w+")).has_value());
+
+  QVector<Syntax::SyntaxRule> rules;
+  rules.append({QRegularExpression("\"[^\"]*\""), QTextCharFormat()});
+  rules.append({QRegularExpression("\\b(int|float)\\b"), QTextCharFormat()});
+  rules.append({QRegularExpression("\\b\\w+(?=\\()"), QTextCharFormat()});
+  rules.append({QRegularExpression("\\b\\w+\\b"), QTextCharFormat()});
+  auto prefilter = std::make_shared<SyntaxPrefilter>(rules);
+  QCOMPARE_EQ(prefilter->filteredRules(), 3);
+
+  const quint32 present = prefilter->scan("int value = 42;");
+  QVERIFY(!prefilter->canMatch(0, present));
+  QVERIFY(prefilter->canMatch(1, present));
+  QVERIFY(!prefilter->canMatch(2, present));
+  QVERIFY(prefilter->canMatch(3, present));
+
+  // Skipping rules never changes the tokens
+  Syntax::RuleSet filtered{rules, {}, QString(), nullptr, prefilter};
+  Syntax::RuleSet unfiltered{rules, {}, QString(), nullptr, nullptr};
+  const QStringList lines{"int value = 42;", "print(\"float\")", "", QString(100, ' ') + "call(x);",
+                          QString::fromUtf8("\u00e9t\u00e9 \"caf\u00e9\" float")};
+  for (const QString &line : lines)
+  {
+    QVector<SyntaxToken> expected, actual;
+    Syntax::tokenize(unfiltered, line, 0, expected);
+    Syntax::tokenize(filtered, line, 0, actual);
+    QCOMPARE_EQ(actual.size(), expected.size());
+    for (qsizetype i = 0; i < actual.size(); ++i)
+    {
+      QCOMPARE_EQ(actual[i].start, expected[i].start);
+      QCOMPARE_EQ(actual[i].length, expected[i].length);
+      QCOMPARE_EQ(actual[i].rule, expected[i].rule);
+    }
+  }
+}
+
+void TestSyntax::testLexer()
+{
+  QVector<Syntax::SyntaxRule> rules;
+  rules.append({QRegularExpression("\\b(int|return|if|else)\\b"), QTextCharFormat()});
+  rules.append({QRegularExpression("\"(\\\\.|[^\"\\\\])*\""), QTextCharFormat()});
+  rules.append({QRegularExpression("\\\\[nt\"\\\\]"), QTextCharFormat(), 1});
+  rules.append({QRegularExpression("\\b(0x[0-9a-fA-F]+|\\d+(\\.\\d+)?)\\b"), QTextCharFormat()});
+  rules.append({QRegularExpression("//[^\\n]*"), QTextCharFormat()});
+  rules.append({QRegularExpression("\\b\\w+(?=\\()"), QTextCharFormat()});
+  rules.append({QRegularExpression("(?<!\\w)#include(?!\\w)"), QTextCharFormat()});
+  rules.append({QRegularExpression("(\\w)\\1"), QTextCharFormat()});
+
+  // The rules the automaton cannot match fall back, each with its reason
+  auto lexer = std::make_shared<SyntaxLexer>(rules);
+  QCOMPARE_EQ(lexer->compiledRules(), 5);
+  QCOMPARE_EQ(lexer->fallbackRules().size(), 3);
+  QCOMPARE_EQ(lexer->fallbackRules()[0].rule, 5);
+  QCOMPARE(lexer->fallbackRules()[0].reason, QString("lookahead"));
+  QCOMPARE(lexer->fallbackRules()[1].reason, QString("lookbehind"));
+  QCOMPARE(lexer->fallbackRules()[2].reason, QString("backreference"));
+  QVERIFY(lexer->compiles(2));
+  QVERIFY(!lexer->compiles(6));
+  QCOMPARE(SyntaxLexer::unsupportedReason(QRegularExpression("a+?")), QString("lazy quantifier"));
+  QVERIFY(SyntaxLexer::unsupportedReason(QRegularExpression("^[A-Z_]{2,8}$")).isEmpty());
+
+  // The tokens are those of the regex path
+  Syntax::RuleSet lexed{rules, {}, QString(), nullptr, nullptr, lexer};
+  Syntax::RuleSet unlexed{rules, {}, QString(), nullptr, nullptr, nullptr};
+  const QStringList lines{"int main() { return 0x1F + 2.5; }", "printf(\"a\\tb \\\"c\\\" %d\\n\", 42); // done",
+                          "#include \"x.h\"", "if (x) return \"\\\\\"; else return 100;", "", "   ",
+                          "aa bb_ int1 1int \"unterminated", QString::fromUtf8("café \"été\\n\" 7")};
+  for (const QString &line : lines)
+  {
+    QVector<SyntaxToken> expected, actual;
+    Syntax::tokenize(unlexed, line, 0, expected);
+    Syntax::tokenize(lexed, line, 0, actual);
+    QCOMPARE_EQ(actual.size(), expected.size());
+    for (qsizetype i = 0; i < actual.size(); ++i)
+    {
+      QCOMPARE_EQ(actual[i].start, expected[i].start);
+      QCOMPARE_EQ(actual[i].length, expected[i].length);
+      QCOMPARE_EQ(actual[i].rule, expected[i].rule);
+    }
+  }
+
+  // Opt-in per language
+  YAML::Node config = createTestConfig();
+  QTextDocument regexDocument;
+  Syntax regex(&regexDocument, config);
+  QVERIFY(!regex.ruleSet().lexer);
+
+  config["engine"] = "lexer";
+  QTextDocument lexerDocument;
+  Syntax lexerSyntax(&lexerDocument, config);
+  QVERIFY(lexerSyntax.ruleSet().lexer);
+  QCOMPARE_EQ(lexerSyntax.ruleSet().lexer->compiledRules(), 2);
+  lexerDocument.setPlainText("int a; float b;");
+  QCOMPARE_EQ(lexerDocument.firstBlock().layout()->formats().size(), 2);
+}
+
 QTEST_MAIN(TestSyntax)
 #include "test_syntax.moc"
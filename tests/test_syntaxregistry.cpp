@@ -0,0 +1,169 @@
+#include <QtTest>
+#include "SyntaxRegistry.h"
+
+#include <QTemporaryDir>
+#include <QSignalSpy>
+#include <QFile>
+
+// Helper function to write a minimal language config
+static bool writeSyntaxFile(const QString &path, const QByteArray &extraRule = QByteArray())
+{
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+  {
+    return false;
+  }
+
+  file.write("extensions: [foo, bar]\n"
+             "keywords:\n"
+             "  keyword:\n"
+             "    - regex: \"\\\\bfoo\\\\b\"\n"
+             "      color: \"#ff0000\"\n");
+  file.write(extraRule);
+  return true;
+}
+
+class TestSyntaxRegistry : public QObject
+{
+  Q_OBJECT
+
+private:
+  QTemporaryDir tempDir;
+
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+  void testLookupByExtension();
+  void testSharedDefinition();
+  void testUnknownExtension();
+  void testBundledDefinition();
+  void testInvalidateOnChange();
+  void testMalformedFile();
+  void testPreviousBundledCopy();
+};
+
+void TestSyntaxRegistry::initTestCase()
+{
+  qDebug() << "Initializing TestSyntaxRegistry tests...";
+  QVERIFY2(tempDir.isValid(), "Temporary directory should be valid.");
+  QVERIFY2(writeSyntaxFile(tempDir.filePath("foo.syntax.yaml")), "Syntax file should be written.");
+  qputenv("CONFIG_DIR", tempDir.path().toUtf8());
+}
+
+void TestSyntaxRegistry::cleanupTestCase()
+{
+  qDebug() << "Cleaning up TestSyntaxRegistry tests...";
+  qunsetenv("CONFIG_DIR");
+}
+
+void TestSyntaxRegistry::testLookupByExtension()
+{
+  auto definition = SyntaxRegistry::getInstance().definitionForExtension("foo");
+
+  QVERIFY2(definition != nullptr, "Definition should be found for a registered extension.");
+  QCOMPARE_EQ(definition->name, "foo.syntax.yaml");
+  QCOMPARE_EQ(definition->rules.size(), 1);
+  QCOMPARE_EQ(definition->rules[0].m_pattern.pattern(), "\\bfoo\\b");
+}
+
+void TestSyntaxRegistry::testSharedDefinition()
+{
+  auto first  = SyntaxRegistry::getInstance().definitionForExtension("foo");
+  auto second = SyntaxRegistry::getInstance().definitionForExtension("bar");
+
+  QVERIFY2(first == second, "Extensions of the same file should share one definition.");
+  QVERIFY2(first == SyntaxRegistry::getInstance().definitionForExtension("FOO"),
+           "Lookups should be case insensitive and not reload the directory.");
+}
+
+void TestSyntaxRegistry::testUnknownExtension()
+{
+  QVERIFY(SyntaxRegistry::getInstance().definitionForExtension("unknown") == nullptr);
+}
+
+void TestSyntaxRegistry::testBundledDefinition()
+{
+  // Not in the config directory: served from the tables compiled at build time
+  auto definition = SyntaxRegistry::getInstance().definitionForExtension("py");
+
+  QVERIFY2(definition != nullptr, "Bundled languages should be available without a config file.");
+  QCOMPARE_EQ(definition->name, "python.syntax.yaml");
+  QVERIFY(!definition->rules.isEmpty());
+  QCOMPARE_EQ(definition->regions.size(), 2);
+  QVERIFY(definition == SyntaxRegistry::getInstance().definitionForExtension("py"));
+}
+
+void TestSyntaxRegistry::testInvalidateOnChange()
+{
+  auto before = SyntaxRegistry::getInstance().definitionForExtension("foo");
+  QSignalSpy spy(&SyntaxRegistry::getInstance(), &SyntaxRegistry::definitionsChanged);
+
+  QVERIFY(writeSyntaxFile(tempDir.filePath("foo.syntax.yaml"),
+                          "    - regex: \"\\\\bbar\\\\b\"\n"
+                          "      color: \"#00ff00\"\n"));
+  QTRY_VERIFY_WITH_TIMEOUT(spy.count() > 0, 5000);
+
+  auto after = SyntaxRegistry::getInstance().definitionForExtension("foo");
+  QVERIFY2(after != before, "A changed config file should produce a new definition.");
+  QCOMPARE_EQ(after->rules.size(), 2);
+  QCOMPARE_EQ(before->rules.size(), 1);
+}
+
+void TestSyntaxRegistry::testMalformedFile()
+{
+  SyntaxRegistry::getInstance().definitionForExtension("foo");
+  QSignalSpy spy(&SyntaxRegistry::getInstance(), &SyntaxRegistry::definitionsChanged);
+
+  // Valid YAML, but maps where strings and numbers are expected
+  QFile file(tempDir.filePath("broken.yaml"));
+  QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+  file.write("extensions: [brk, {half: typed}]\n"
+             "keywords:\n"
+             "  keyword:\n"
+             "    - regex: \"x\"\n"
+             "      color: \"#ff0000\"\n"
+             "      priority: high\n");
+  file.close();
+  QTRY_VERIFY_WITH_TIMEOUT(spy.count() > 0, 5000);
+
+  // The broken file is skipped; the others still load
+  QVERIFY(!SyntaxRegistry::getInstance().definitionForExtension("brk"));
+  auto definition = SyntaxRegistry::getInstance().definitionForExtension("foo");
+  QVERIFY(definition);
+  QCOMPARE_EQ(definition->rules.size(), 2);
+}
+
+void TestSyntaxRegistry::testPreviousBundledCopy()
+{
+  SyntaxRegistry::getInstance().definitionForExtension("foo");
+  QSignalSpy spy(&SyntaxRegistry::getInstance(), &SyntaxRegistry::definitionsChanged);
+
+  // go.syntax.yaml as the first release copied it, before regions existed
+  QFile file(tempDir.filePath("go.syntax.yaml"));
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write(R"yaml(extensions: [go]
+
+keywords:
+  comment:
+    - regex: "\"(\\\\.|[^\"\\\\])*\""
+      color: "#808080" # Gray
+
+  string:
+    - regex: "\"(\\\\.|[^\"\\\\])*\""
+      color: "#E37100" # Orange
+
+  number:
+    - regex: "\\b(0b[01]+|0o[0-7]+|0x[0-9a-fA-F]+|\\d+(\\.\\d+)?)\\b"
+      color: "#0000FF" # Blue
+)yaml");
+  file.close();
+  QTRY_VERIFY_WITH_TIMEOUT(spy.count() > 0, 5000);
+
+  // Not taken for a user edit: the bundled definition is served, with its regions
+  auto definition = SyntaxRegistry::getInstance().definitionForExtension("go");
+  QVERIFY(definition);
+  QCOMPARE_EQ(definition->regions.size(), 2);
+}
+
+QTEST_MAIN(TestSyntaxRegistry)
+#include "test_syntaxregistry.moc"
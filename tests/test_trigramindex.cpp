@@ -0,0 +1,385 @@
+#include "TrigramIndex.h"
+#include "ProjectSearch.h"
+
+#include <QtTest>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QSaveFile>
+#include <QSignalSpy>
+#include <QStringEncoder>
+#include <QTemporaryDir>
+#include <QtEndian>
+
+class TestTrigramIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testTrigramsOf();
+    void testIndexAndCandidates();
+    void testReopen();
+    void testFollowsChanges();
+    void testMergesSegments();
+    void testRebuildsDamagedIndex();
+    void testNarrowsSearch();
+};
+
+namespace
+{
+    void write(const QString &path, const QByteArray &content)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(content);
+    }
+
+    // Written to a new file then renamed over path, as editors do
+    void replace(const QString &path, const QByteArray &content)
+    {
+        QSaveFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(content);
+        QVERIFY(file.commit());
+    }
+
+    quint32 trigram(const char *text)
+    {
+        return (quint32(uchar(text[0])) << 16) | (quint32(uchar(text[1])) << 8) | uchar(text[2]);
+    }
+
+    std::vector<quint32> trigramsOf(const QByteArray &text)
+    {
+        return TrigramIndex::trigramsOf(text.constData(), text.size());
+    }
+
+    QStringList candidates(const TrigramIndex &index, const QByteArray &text)
+    {
+        QStringList files = index.candidates(text).value_or(QStringList({"<none>"}));
+        files.sort();
+        return files;
+    }
+
+    int segmentCount(const QString &directory)
+    {
+        int count = 0;
+        for (QDirIterator it(directory, {"*.seg"}, QDir::Files, QDirIterator::Subdirectories); it.hasNext(); it.next())
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    // Fills the postings of every segment with bytes that never end a number
+    void damageSegments(const QString &directory)
+    {
+        for (QDirIterator it(directory, {"*.seg"}, QDir::Files, QDirIterator::Subdirectories); it.hasNext();)
+        {
+            QFile file(it.next());
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            const QByteArray header = file.read(32);
+            QCOMPARE(header.size(), qsizetype(32));
+            const quint64 postingsOffset = qFromLittleEndian<quint64>(header.constData() + 16);
+            const quint64 trigramsOffset = qFromLittleEndian<quint64>(header.constData() + 24);
+            QVERIFY(postingsOffset < trigramsOffset);
+            QVERIFY(file.seek(static_cast<qint64>(postingsOffset)));
+            file.write(QByteArray(static_cast<qsizetype>(trigramsOffset - postingsOffset), '\xff'));
+        }
+    }
+
+    void createProject(const QDir &root)
+    {
+        QVERIFY(root.mkpath("src"));
+        QVERIFY(root.mkpath("build"));
+        write(root.filePath("src/a.cpp"), "Hello world\n");
+        write(root.filePath("src/b.cpp"), "goodbye\n");
+        write(root.filePath("notes.txt"), "say hello there\n");
+        write(root.filePath("build/out.cpp"), "hello\n");
+        write(root.filePath("image.bin"), QByteArray("hello\0\1", 7));
+        write(root.filePath("empty.txt"), "");
+        write(root.filePath(".gitignore"), "build/\n");
+    }
+
+    void index(TrigramIndex &index, const QTemporaryDir &project, const QTemporaryDir &indexes)
+    {
+        index.setDirectory(indexes.path());
+        index.setExcludes(IgnoreRules::userExcludes());
+        QSignalSpy indexed(&index, &TrigramIndex::indexed);
+        index.setRootPath(project.path());
+        QVERIFY(indexed.wait(10000));
+        QVERIFY(index.isReady());
+    }
+}
+
+void TestTrigramIndex::testTrigramsOf()
+{
+    QCOMPARE(trigramsOf("abcd"), std::vector<quint32>({trigram("abc"), trigram("bcd")}));
+    QCOMPARE(trigramsOf("ABcD"), trigramsOf("abcd"));
+    QCOMPARE(trigramsOf("aaaaaa"), std::vector<quint32>({trigram("aaa")}));
+    QCOMPARE(trigramsOf("bcdabc"), std::vector<quint32>({trigram("abc"), trigram("bcd"), trigram("cda"), trigram("dab")}));
+
+    // Texts shorter than a trigram, and line breaks, give none
+    QVERIFY(trigramsOf("ab").empty());
+    QVERIFY(trigramsOf("ab\ncd\r\nef").empty());
+    QCOMPARE(trigramsOf("ab\ncde"), std::vector<quint32>({trigram("cde")}));
+
+    // Bytes above 0x7f are kept as they are
+    QCOMPARE(trigramsOf("\xc3\xa9t"), std::vector<quint32>({trigram("\xc3\xa9t")}));
+}
+
+void TestTrigramIndex::testIndexAndCandidates()
+{
+    QTemporaryDir project;
+    QTemporaryDir indexes;
+    QVERIFY(project.isValid() && indexes.isValid());
+    createProject(QDir(project.path()));
+
+    TrigramIndex trigramIndex;
+    QVERIFY(!trigramIndex.hasIndex(project.path()));
+    index(trigramIndex, project, indexes);
+
+    // Ignored files are left out; binary and empty files never match
+    QCOMPARE(trigramIndex.fileCount(), 6);
+    QCOMPARE(trigramIndex.pendingCount(), 0);
+    QCOMPARE(candidates(trigramIndex, "hello"), QStringList({"notes.txt", "src/a.cpp"}));
+    QCOMPARE(candidates(trigramIndex, "HELLO"), QStringList({"notes.txt", "src/a.cpp"}));
+    QCOMPARE(candidates(trigramIndex, "hello world"), QStringList({"src/a.cpp"}));
+    QCOMPARE(candidates(trigramIndex, "build"), QStringList({".gitignore"}));
+    QVERIFY(candidates(trigramIndex, "xyz").isEmpty());
+
+    // Too short to narrow
+    QVERIFY(!trigramIndex.candidates("he").has_value());
+
+    QVERIFY(trigramIndex.hasIndex(project.path()));
+    QVERIFY(trigramIndex.diskUsage() > 0);
+    QCOMPARE(segmentCount(indexes.path()), 1);
+
+    trigramIndex.removeIndex();
+    QVERIFY(!trigramIndex.isReady());
+    QVERIFY(!trigramIndex.hasIndex(project.path()));
+    QCOMPARE(segmentCount(indexes.path()), 0);
+}
+
+void TestTrigramIndex::testReopen()
+{
+    QTemporaryDir project;
+    QTemporaryDir indexes;
+    QVERIFY(project.isValid() && indexes.isValid());
+    QDir root(project.path());
+    createProject(root);
+
+    {
+        TrigramIndex trigramIndex;
+        index(trigramIndex, project, indexes);
+    }
+
+    write(root.filePath("src/b.cpp"), "goodbye, hello\n");
+    write(root.filePath("new.txt"), "hello again\n");
+    QVERIFY(QFile::remove(root.filePath("notes.txt")));
+
+    // Only the files changed meanwhile are read again
+    TrigramIndex trigramIndex;
+    int pendingWhenReady = -1;
+    connect(&trigramIndex, &TrigramIndex::ready, this, [&]() { pendingWhenReady = trigramIndex.pendingCount(); });
+    index(trigramIndex, project, indexes);
+    QCOMPARE(pendingWhenReady, 2);
+    QCOMPARE(candidates(trigramIndex, "hello"), QStringList({"new.txt", "src/a.cpp", "src/b.cpp"}));
+    QCOMPARE(trigramIndex.fileCount(), 6);
+
+    // Another instance cannot open it meanwhile
+    TrigramIndex other;
+    other.setDirectory(indexes.path());
+    other.setRootPath(project.path());
+    QTest::qWait(200);
+    QVERIFY(!other.isReady());
+    QVERIFY(!other.candidates("hello").has_value());
+}
+
+void TestTrigramIndex::testFollowsChanges()
+{
+    QTemporaryDir project;
+    QTemporaryDir indexes;
+    QTemporaryDir staging;
+    QVERIFY(project.isValid() && indexes.isValid() && staging.isValid());
+    QDir root(project.path());
+    createProject(root);
+
+    TrigramIndex trigramIndex;
+    index(trigramIndex, project, indexes);
+
+    // New files are candidates at once, then once read if they match
+    write(root.filePath("src/c.cpp"), "hello from c\n");
+    QTRY_VERIFY(candidates(trigramIndex, "hello").contains("src/c.cpp"));
+    QTRY_COMPARE(trigramIndex.pendingCount(), 0);
+    QCOMPARE(candidates(trigramIndex, "hello"), QStringList({"notes.txt", "src/a.cpp", "src/c.cpp"}));
+    QVERIFY(!candidates(trigramIndex, "xyz").contains("src/c.cpp"));
+
+    replace(root.filePath("src/a.cpp"), "nothing here\n");
+    QTRY_VERIFY(!candidates(trigramIndex, "hello").contains("src/a.cpp"));
+    QTRY_COMPARE(candidates(trigramIndex, "nothing"), QStringList({"src/a.cpp"}));
+
+    QVERIFY(QFile::remove(root.filePath("notes.txt")));
+    QTRY_VERIFY(!candidates(trigramIndex, "hello").contains("notes.txt"));
+
+    // Rewritten in place, its size kept and no entry of the directory changed
+    QFile rewritten(root.filePath("src/b.cpp"));
+    QVERIFY(rewritten.open(QIODevice::ReadWrite));
+    QCOMPARE(rewritten.write("rewrote"), qint64(7));
+    rewritten.close();
+    QTRY_COMPARE(candidates(trigramIndex, "rewrote"), QStringList({"src/b.cpp"}));
+    QVERIFY(candidates(trigramIndex, "goodbye").isEmpty());
+
+    // Directories moved in are read with everything below them
+    QVERIFY(QDir(staging.path()).mkpath("lib/deep"));
+    write(staging.path() + "/lib/deep/d.cpp", "hello deep\n");
+    QVERIFY(QDir().rename(staging.path() + "/lib", root.filePath("lib")));
+    QTRY_COMPARE(candidates(trigramIndex, "deep"), QStringList({"lib/deep/d.cpp"}));
+
+    // Ignoring a directory drops what it holds
+    replace(root.filePath(".gitignore"), "build/\nlib/\n");
+    QTRY_VERIFY(candidates(trigramIndex, "deep").isEmpty());
+
+    QVERIFY(QDir(root.filePath("src")).removeRecursively());
+    QTRY_VERIFY(!candidates(trigramIndex, "hello").contains("src/c.cpp"));
+    QTRY_COMPARE(trigramIndex.fileCount(), 3);
+}
+
+void TestTrigramIndex::testMergesSegments()
+{
+    QTemporaryDir project;
+    QTemporaryDir indexes;
+    QTemporaryDir staging;
+    QVERIFY(project.isValid() && indexes.isValid() && staging.isValid());
+    QDir root(project.path());
+    createProject(root);
+
+    TrigramIndex trigramIndex;
+    index(trigramIndex, project, indexes);
+    QCOMPARE(segmentCount(indexes.path()), 1);
+
+    // Enough new files for a segment, merged with the smaller one there was
+    const int count = TrigramIndex::MinSegmentFiles + 100;
+    QVERIFY(QDir(staging.path()).mkdir("many"));
+    for (int i = 0; i < count; ++i)
+    {
+        write(QString("%1/many/file%2.txt").arg(staging.path()).arg(i), QString("needle %1\n").arg(i).toUtf8());
+    }
+    QSignalSpy indexed(&trigramIndex, &TrigramIndex::indexed);
+    QVERIFY(QDir().rename(staging.path() + "/many", root.filePath("many")));
+    QTRY_VERIFY_WITH_TIMEOUT(trigramIndex.fileCount() == 6 + count && !indexed.isEmpty(), 20000);
+
+    QCOMPARE(segmentCount(indexes.path()), 1);
+    QCOMPARE(candidates(trigramIndex, "needle").size(), qsizetype(count));
+    QCOMPARE(candidates(trigramIndex, "needle 1099"), QStringList({"many/file1099.txt"}));
+    QCOMPARE(candidates(trigramIndex, "hello"), QStringList({"notes.txt", "src/a.cpp"}));
+
+    // Written files are not read again
+    TrigramIndex reopened;
+    int pendingWhenReady = -1;
+    connect(&reopened, &TrigramIndex::ready, this, [&]() { pendingWhenReady = reopened.pendingCount(); });
+    trigramIndex.close();
+    index(reopened, project, indexes);
+    QCOMPARE(pendingWhenReady, 0);
+    QCOMPARE(reopened.fileCount(), 6 + count);
+    QCOMPARE(candidates(reopened, "needle 1099"), QStringList({"many/file1099.txt"}));
+}
+
+void TestTrigramIndex::testRebuildsDamagedIndex()
+{
+    QTemporaryDir project;
+    QTemporaryDir indexes;
+    QVERIFY(project.isValid() && indexes.isValid());
+    createProject(QDir(project.path()));
+
+    {
+        TrigramIndex trigramIndex;
+        index(trigramIndex, project, indexes);
+    }
+    damageSegments(indexes.path());
+
+    // Found when opened: every file is read again
+    TrigramIndex trigramIndex;
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("is damaged"));
+    index(trigramIndex, project, indexes);
+    QCOMPARE(segmentCount(indexes.path()), 1);
+    QCOMPARE(trigramIndex.fileCount(), 6);
+    QCOMPARE(candidates(trigramIndex, "hello"), QStringList({"notes.txt", "src/a.cpp"}));
+
+    // Found by a search: it reads every file until the index is built again
+    damageSegments(indexes.path());
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("is damaged"));
+    QSignalSpy indexed(&trigramIndex, &TrigramIndex::indexed);
+    QVERIFY(!trigramIndex.candidates("hello").has_value());
+    QVERIFY(indexed.wait(10000));
+    QCOMPARE(candidates(trigramIndex, "hello"), QStringList({"notes.txt", "src/a.cpp"}));
+}
+
+void TestTrigramIndex::testNarrowsSearch()
+{
+    QTemporaryDir project;
+    QTemporaryDir indexes;
+    QVERIFY(project.isValid() && indexes.isValid());
+    QDir root(project.path());
+    createProject(root);
+
+    TrigramIndex trigramIndex;
+    index(trigramIndex, project, indexes);
+
+    ProjectSearch search;
+    search.setExcludes(IgnoreRules::userExcludes());
+    QList<ProjectSearch::Hit> hits;
+    connect(&search, &ProjectSearch::hitsFound, this, [&hits](const QList<ProjectSearch::Hit> &found)
+    {
+        hits += found;
+    });
+    QSignalSpy finished(&search, &ProjectSearch::finished);
+
+    // Every text file is read without the index
+    QVERIFY(search.start(project.path(), "hello", {}).success);
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.takeFirst().at(0).toInt(), 4);
+    QCOMPARE(hits.size(), qsizetype(2));
+
+    // Only the candidates with it, for the same hits
+    search.setIndex(&trigramIndex);
+    hits.clear();
+    QVERIFY(search.start(project.path(), "hello", {}).success);
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.takeFirst().at(0).toInt(), 2);
+    QCOMPARE(hits.size(), qsizetype(2));
+
+    // Regular expressions still read every file
+    ProjectSearch::Options options;
+    options.regularExpression = true;
+    hits.clear();
+    QVERIFY(search.start(project.path(), "h.llo", options).success);
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.takeFirst().at(0).toInt(), 4);
+    QCOMPARE(hits.size(), qsizetype(2));
+
+    // Files in UTF-16 or Latin-1 are indexed by their decoded text, so the index keeps their hits
+    QStringEncoder toUtf16(QStringEncoder::Utf16LE, QStringEncoder::Flag::WriteBom);
+    write(root.filePath("wide.txt"), toUtf16.encode(QString("needle in UTF-16\n")));
+    write(root.filePath("latin1.txt"), "caf\xe9 needle\n");
+    QTRY_VERIFY(candidates(trigramIndex, "needle").size() == 2);
+    QTRY_COMPARE(trigramIndex.pendingCount(), 0);
+    QCOMPARE(candidates(trigramIndex, "needle"), QStringList({"latin1.txt", "wide.txt"}));
+
+    hits.clear();
+    QVERIFY(search.start(project.path(), "needle", {}).success);
+    QVERIFY(finished.wait());
+    QCOMPARE(finished.takeFirst().at(0).toInt(), 2);
+    QCOMPARE(hits.size(), qsizetype(2));
+
+    // A non-ASCII literal is looked for in UTF-8, which the Latin-1 file was indexed as
+    options.regularExpression = false;
+    options.caseSensitive     = true;
+    hits.clear();
+    QVERIFY(search.start(project.path(), QString::fromUtf8("caf\u00e9"), options).success);
+    QVERIFY(finished.wait());
+    QCOMPARE(hits.size(), qsizetype(1));
+    QCOMPARE(QFileInfo(hits.first().filePath).fileName(), QString("latin1.txt"));
+}
+
+QTEST_MAIN(TestTrigramIndex)
+#include "test_trigramindex.moc"